@@ -5,6 +5,7 @@
 
 #include "alu.h"
 #include "memory.h"
+#include "trap.h"
 
 #include <iostream>
 
@@ -15,59 +16,64 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
 #include <bitset>
 
 void
-ALU::execute(DecodedInstruction data,RegisterFile & reg, MemAddress & PC)
+ALU::execute(DecodedInstruction data,RegisterFile & reg, MemAddress & PC, CSRFile & csr, MMU & mmu)
 {
   ////////////
   // R-TYPE //
   ////////////
-  if(data.opcode == 0x33 || data.opcode == 0x3b)
+  /* funct5 and funct2 make up funct7: 0x01 selects the M extension,
+   * 0x20 (funct5 0x08) sub and sra.
+   */
+  if(data.opcode == 0x33)
   {
-    if(data.funct5 == 0x00)
-      add(reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]));
-    if(data.funct5 == 0x08)
-      sub(reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]));
+    if(data.funct2 == 0x01)
+      multiply(data.funct3,reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]));
+    else
+      arithmetic(data.funct3,data.funct5 == 0x08,reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]));
+  }
+
+  if(data.opcode == 0x3b)
+  {
+    if(data.funct2 == 0x01)
+      multiplyWord(data.funct3,reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]));
+    else
+      arithmeticWord(data.funct3,data.funct5 == 0x08,reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]));
   }
 
   ////////////
   // I-TYPE //
   ////////////
+  /* The shift amount is in the lower bits of the immediate, bit 10
+   * selects srai. The immediate of the other operations is
+   * sign-extended.
+   */
   if(data.opcode == 0x13 || data.opcode == 0x1b)
   {
-    if(data.funct3 == 0x00)
-    {
-      if(!data.reg[1])
-        li(data.immediate);
-      else if(!data.reg[2])
-        addi(reg.readRegister(data.reg[1]),data.immediate);
-      else
-        mv(reg.readRegister(data.reg[1]));
-    }
-
-    if(data.funct3 == 0x01)
-    {
-      sll(reg.readRegister(data.reg[1]),data.immediate);
-    }
-
-    if(data.funct3 == 0x05)
-    {
-      srl(reg.readRegister(data.reg[1]),data.immediate);
-    }
-
-    if(data.funct3 == 0x07)
-    {
-      andi(reg.readRegister(data.reg[1]),data.immediate);
-    }
+    bool alternate = data.funct3 == 0x05 && (data.immediate & 0x400);
+    RegValue R = (RegValue)(int64_t)data.immediate;
+    if(data.funct3 == 0x01 || data.funct3 == 0x05)
+      R = data.immediate & 0x3f;
+
+    if(data.opcode == 0x13)
+      arithmetic(data.funct3,alternate,reg.readRegister(data.reg[1]),R);
+    else
+      arithmeticWord(data.funct3,alternate,reg.readRegister(data.reg[1]),R);
   }
 
+  /* jalr: the target is computed before rd is written, so rd may be
+   * the same register as rs1.
+   */
   if(data.opcode == 0x67)
   {
-    jump(reg.readRegister(data.reg[1]),PC);
+    result = PC;
+    jump((reg.readRegister(data.reg[1]) + data.immediate) & ~(RegValue)1,PC);
   }
 
   /////////////
@@ -75,33 +81,21 @@ ALU::execute(DecodedInstruction data,RegisterFile & reg, MemAddress & PC)
   /////////////
   if(data.opcode == 0x63)
   {
-    if(data.funct3 == 0x00)
-    {
-      beq(reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]),data.immediate,PC);
-    }
-
-    if(data.funct3 == 0x01)
-    {
-      bne(reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]),data.immediate,PC);
-    }
-
-    if(data.funct3 == 0x04)
-    {
-      blt(reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]),data.immediate,PC);
-    }
-
-    if(data.funct3 == 0x05 || data.funct3 == 0x07)
-    {
-      ble(reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]),data.immediate,PC);
-    }
+    branch(data.funct3,reg.readRegister(data.reg[1]),reg.readRegister(data.reg[2]),data.immediate,PC);
   }
 
   ////////////
   // U-TYPE //
   ////////////
-  if(data.opcode == 0x37)
+  /* lui and auipc: the 20-bit immediate forms bits 31-12 of a value
+   * that is sign-extended to 64 bits. PC has already been advanced
+   * past the auipc.
+   */
+  if(data.opcode == 0x37 || data.opcode == 0x17)
   {
-    result = data.immediate * 0x1000;
+    result = (RegValue)(int64_t)(int32_t)((uint32_t)data.immediate << 12);
+    if(data.opcode == 0x17)
+      result += PC - 4;
   }
 
   /////////////
@@ -112,10 +106,43 @@ ALU::execute(DecodedInstruction data,RegisterFile & reg, MemAddress & PC)
     result = PC;
     call(data.immediate,PC);
   }
+
+  /* fence and fence.i (opcode 0x0f) need no action: memory accesses
+   * complete in order, and the decode cache compares each fetched
+   * instruction with the one it decoded.
+   */
+
+  /////////////
+  // SYSTEM  //
+  /////////////
+  /* Zicsr: funct3 bit 2 selects the immediate (zimm) variants, in
+   * which the rs1 field holds the operand itself.
+   */
+  if(data.opcode == 0x73 && data.funct3 == 0x00)
+  {
+    system(data,reg,csr,mmu,PC);
+  }
+
+  if(data.opcode == 0x73 && (data.funct3 & 0x03) != 0)
+  {
+    RegValue operand = data.reg[1];
+    if(!(data.funct3 & 0x04))
+      operand = reg.readRegister(data.reg[1]);
+
+    if((data.funct3 & 0x03) == 0x01)
+      csrrw(csr,data.immediate,operand,data.reg[0] != 0);
+    if((data.funct3 & 0x03) == 0x02)
+      csrrs(csr,data.immediate,operand,data.reg[1] != 0);
+    if((data.funct3 & 0x03) == 0x03)
+      csrrc(csr,data.immediate,operand,data.reg[1] != 0);
+  }
 }
 
+/* Loads and stores compute a virtual address, which is translated by
+ * the MMU. Access faults report the virtual address.
+ */
 void
-ALU::memorycontroller(DecodedInstruction data,RegisterFile & reg,MemoryBus & mem)
+ALU::memorycontroller(DecodedInstruction data,RegisterFile & reg,MemoryBus & mem,MMU & mmu)
 {
 
   ////////////
@@ -124,7 +151,18 @@ ALU::memorycontroller(DecodedInstruction data,RegisterFile & reg,MemoryBus & mem
   if(data.opcode == 0x23)
   {
     addi(reg.readRegister(data.reg[1]),data.immediate);
-    store(getResult(),reg.readRegister(data.reg[2]),data.funct3,mem);
+    MemAddress vaddr = getResult();
+    try
+    {
+      MemAddress paddr = mmu.translate(vaddr,AccessType::Store);
+      RegValue value = reg.readRegister(data.reg[2]);
+      store(paddr,value,data.funct3,mem);
+      access = { vaddr, paddr, value, (uint8_t)(1 << (data.funct3 & 3)), true, true };
+    }
+    catch(IllegalAccess &e)
+    {
+      throw GuestException(ExceptionCause::StoreAccessFault,vaddr,e.what());
+    }
   }
 
   ////////////
@@ -133,7 +171,44 @@ ALU::memorycontroller(DecodedInstruction data,RegisterFile & reg,MemoryBus & mem
   if(data.opcode == 0x03)
   {
     addi(reg.readRegister(data.reg[1]),data.immediate);
-    load(getResult(),data.funct3,mem);
+    MemAddress vaddr = getResult();
+    try
+    {
+      MemAddress paddr = mmu.translate(vaddr,AccessType::Load);
+      load(paddr,data.funct3,mem);
+      access = { vaddr, paddr, result, (uint8_t)(1 << (data.funct3 & 3)), false, true };
+    }
+    catch(IllegalAccess &e)
+    {
+      throw GuestException(ExceptionCause::LoadAccessFault,vaddr,e.what());
+    }
+  }
+
+  /////////////
+  // ATOMICS //
+  /////////////
+  /* lr only reads, sc and the AMOs are translated as stores so that a
+   * read-only page faults before anything is read.
+   */
+  if(data.opcode == 0x2f)
+  {
+    MemAddress vaddr = reg.readRegister(data.reg[1]);
+    bool loadOnly = data.funct5 == 0x02;
+    try
+    {
+      MemAddress paddr = mmu.translate(vaddr,loadOnly ? AccessType::Load
+                                                      : AccessType::Store);
+      RegValue value = reg.readRegister(data.reg[2]);
+      atomic(data,paddr,value,mem);
+      access = { vaddr, paddr, loadOnly ? result : value,
+                 (uint8_t)(1 << (data.funct3 & 3)), !loadOnly, true };
+    }
+    catch(IllegalAccess &e)
+    {
+      throw GuestException(loadOnly ? ExceptionCause::LoadAccessFault
+                                    : ExceptionCause::StoreAccessFault,
+                           vaddr,e.what());
+    }
   }
 }
 
@@ -145,6 +220,7 @@ ALU::clear()
 {
   result = 0;
   flag = false;
+  access.valid = false;
 }
 
 ////////////////
@@ -152,104 +228,281 @@ ALU::clear()
 //   &LOGIC   //
 ////////////////
 void
-ALU::add(RegValue L, RegValue R)
+ALU::arithmetic(int funct3, bool alternate, RegValue L, RegValue R)
 {
-  result = L + R;
-}
-
-void
-ALU::sub(RegValue L, RegValue R)
-{
-  result = L - R;
+  switch(funct3)
+  {
+    case 0x00:
+      result = alternate ? L - R : L + R;
+      break;
+    case 0x01:
+      result = L << (R & 0x3f);
+      break;
+    case 0x02:
+      result = (int64_t)L < (int64_t)R;
+      break;
+    case 0x03:
+      result = L < R;
+      break;
+    case 0x04:
+      result = L ^ R;
+      break;
+    case 0x05:
+      if(alternate)
+        result = (int64_t)L >> (R & 0x3f);
+      else
+        result = L >> (R & 0x3f);
+      break;
+    case 0x06:
+      result = L | R;
+      break;
+    case 0x07:
+      result = L & R;
+      break;
+  }
 }
 
 void
-ALU::li(int I)
+ALU::arithmeticWord(int funct3, bool alternate, RegValue L, RegValue R)
 {
-  result = I;
-}
+  uint32_t word = L;
 
-void
-ALU::addi(RegValue L, int I)
-{
-  result = L + I;
+  if(funct3 == 0x00)
+    word = alternate ? word - (uint32_t)R : word + (uint32_t)R;
+  else if(funct3 == 0x01)
+    word <<= (R & 0x1f);
+  else if(funct3 == 0x05 && alternate)
+    word = (int32_t)word >> (R & 0x1f);
+  else if(funct3 == 0x05)
+    word >>= (R & 0x1f);
+  else
+    throw IllegalInstruction("Unsupported word instruction");
+
+  result = (RegValue)(int64_t)(int32_t)word;
 }
 
+/* Division by zero and the overflow of the most negative value divided
+ * by -1 do not trap, but give the results defined by the ISA.
+ */
 void
-ALU::sll(RegValue L, int I)
+ALU::multiply(int funct3, RegValue L, RegValue R)
 {
-  std::bitset<64> R1 = std::bitset<64>(L);
-  R1 = (R1<<I);
+  int64_t SL = L, SR = R;
 
-  result = R1.to_ulong();
+  switch(funct3)
+  {
+    case 0x00:
+      result = L * R;
+      break;
+    case 0x01:
+      result = (unsigned __int128)((__int128)SL * SR) >> 64;
+      break;
+    case 0x02:
+      result = (unsigned __int128)((__int128)SL * (unsigned __int128)R) >> 64;
+      break;
+    case 0x03:
+      result = ((unsigned __int128)L * R) >> 64;
+      break;
+    case 0x04:
+      if(R == 0)
+        result = ~(RegValue)0;
+      else if(SL == INT64_MIN && SR == -1)
+        result = L;
+      else
+        result = SL / SR;
+      break;
+    case 0x05:
+      result = R == 0 ? ~(RegValue)0 : L / R;
+      break;
+    case 0x06:
+      if(R == 0)
+        result = L;
+      else if(SL == INT64_MIN && SR == -1)
+        result = 0;
+      else
+        result = SL % SR;
+      break;
+    case 0x07:
+      result = R == 0 ? L : L % R;
+      break;
+  }
 }
 
 void
-ALU::srl(RegValue L, int I)
+ALU::multiplyWord(int funct3, RegValue L, RegValue R)
 {
-  std::bitset<64> R1 = std::bitset<64>(L);
-  R1 = (R1>>I);
+  int32_t SL = L, SR = R;
+  uint32_t UL = L, UR = R;
+  uint32_t word;
 
-  result = R1.to_ulong();
-}
+  switch(funct3)
+  {
+    case 0x00:
+      word = UL * UR;
+      break;
+    case 0x04:
+      if(SR == 0)
+        word = ~0U;
+      else if(SL == INT32_MIN && SR == -1)
+        word = UL;
+      else
+        word = SL / SR;
+      break;
+    case 0x05:
+      word = UR == 0 ? ~0U : UL / UR;
+      break;
+    case 0x06:
+      if(SR == 0)
+        word = UL;
+      else if(SL == INT32_MIN && SR == -1)
+        word = 0;
+      else
+        word = SL % SR;
+      break;
+    case 0x07:
+      word = UR == 0 ? UL : UL % UR;
+      break;
+    default:
+      throw IllegalInstruction("Unsupported word instruction");
+  }
 
-void
-ALU::mv(RegValue L)
-{
-  result = L;
+  result = (RegValue)(int64_t)(int32_t)word;
 }
 
 void
-ALU::andi(RegValue L, int I)
+ALU::addi(RegValue L, int I)
 {
-    std::bitset<64> R1 = std::bitset<64>(L);
-    std::bitset<64> R2 = std::bitset<64>(I);
-    std::bitset<64> R3 = (R1&=R2);
-
-    result = R3.to_ulong();
+  result = L + I;
 }
 
 /////////////
 // CONTROL //
 /////////////
 void
-ALU::beq(RegValue L, RegValue R, MemAddress addr, MemAddress & PC)
+ALU::branch(int funct3, RegValue L, RegValue R, MemAddress addr, MemAddress & PC)
 {
-  if(L == R)
+  bool taken = false;
+
+  switch(funct3)
+  {
+    case 0x00:
+      taken = L == R;
+      break;
+    case 0x01:
+      taken = L != R;
+      break;
+    case 0x04:
+      taken = (int64_t)L < (int64_t)R;
+      break;
+    case 0x05:
+      taken = (int64_t)L >= (int64_t)R;
+      break;
+    case 0x06:
+      taken = L < R;
+      break;
+    case 0x07:
+      taken = L >= R;
+      break;
+    default:
+      throw IllegalInstruction("Unsupported branch instruction");
+  }
+
+  if(taken)
     call(addr,PC);
 }
 
 void
-ALU::bne(RegValue L, RegValue R, MemAddress addr, MemAddress & PC)
+ALU::call(MemAddress addr, MemAddress & PC)
 {
-  if(L != R)
-    call(addr,PC);
+  PC += ((addr * 4) - 4);
 }
 
 void
-ALU::blt(RegValue L, RegValue R, MemAddress addr, MemAddress & PC)
+ALU::jump(MemAddress addr, MemAddress & PC)
 {
-  if(L < R)
-    call(addr,PC);
+  PC = addr;
 }
 
+////////////
+// SYSTEM //
+////////////
 void
-ALU::ble(RegValue L, RegValue R, MemAddress addr, MemAddress & PC)
+ALU::system(DecodedInstruction data, RegisterFile & reg, CSRFile & csr, MMU & mmu, MemAddress & PC)
 {
-  if(L >= R)
-    call(addr,PC);
+  int funct12 = data.immediate;
+
+  /* ecall, the cause depends on the current privilege level */
+  if(funct12 == 0x000)
+  {
+    if(csr.getPrivilege() == Privilege::User)
+      throw GuestException(ExceptionCause::UserEnvironmentCall, 0,
+                           "Environment call from U-mode");
+    if(csr.getPrivilege() == Privilege::Supervisor)
+      throw GuestException(ExceptionCause::SupervisorEnvironmentCall, 0,
+                           "Environment call from S-mode");
+    throw GuestException(ExceptionCause::MachineEnvironmentCall, 0,
+                         "Environment call from M-mode");
+  }
+  /* ebreak */
+  else if(funct12 == 0x001)
+    throw GuestException(ExceptionCause::Breakpoint, PC - 4,
+                         "Breakpoint");
+  /* sret */
+  else if(funct12 == 0x102)
+    PC = csr.returnFromTrap(Privilege::Supervisor);
+  /* mret */
+  else if(funct12 == 0x302)
+    PC = csr.returnFromTrap(Privilege::Machine);
+  /* wfi: interrupts are checked at the end of every block, so
+   * this may simply continue.
+   */
+  else if(funct12 == 0x105)
+  {
+    if(csr.getPrivilege() != Privilege::Machine &&
+       (csr.getStatus() & MSTATUS_TW))
+      throw IllegalInstruction("wfi not permitted");
+  }
+  /* sfence.vma rs1, rs2: x0 selects all addresses or ASIDs */
+  else if((funct12 >> 5) == 0x09)
+  {
+    if(csr.getPrivilege() == Privilege::User ||
+       (csr.getPrivilege() == Privilege::Supervisor &&
+        (csr.getStatus() & MSTATUS_TVM)))
+      throw IllegalInstruction("sfence.vma not permitted");
+
+    mmu.flush(reg.readRegister(data.reg[1]),data.reg[1] == 0,
+              reg.readRegister(data.reg[2]),data.reg[2] == 0);
+  }
+  else
+    throw IllegalInstruction("Unsupported SYSTEM instruction");
 }
 
+/////////
+// CSR //
+/////////
 void
-ALU::call(MemAddress addr, MemAddress & PC)
+ALU::csrrw(CSRFile & csr, int number, RegValue value, bool read)
 {
-  PC += ((addr * 4) - 4);
+  /* The CSR is not read when the destination register is x0 */
+  if(read)
+    result = csr.read(number);
+  csr.write(number,value);
 }
 
 void
-ALU::jump(MemAddress addr, MemAddress & PC)
+ALU::csrrs(CSRFile & csr, int number, RegValue mask, bool write)
 {
-  PC = addr;
+  result = csr.read(number);
+  if(write)
+    csr.write(number,result | mask);
+}
+
+void
+ALU::csrrc(CSRFile & csr, int number, RegValue mask, bool write)
+{
+  result = csr.read(number);
+  if(write)
+    csr.write(number,result & ~mask);
 }
 
 ////////////
@@ -269,17 +522,23 @@ ALU::store(RegValue addr, RegValue value, int funct3, MemoryBus & mem)
   if(funct3 == 0x03)
     size = 8;
 
-  uint8_t *segment = NULL;
-  uint8_t align = 16;
-  posix_memalign((void **)&segment, align, size);
-  memset(segment, 0, size);
+  /* Only allocate when the address is not backed yet, the bus returns
+   * the first matching client so a new memory would never be used.
+   */
+  if(allocateOnStore && !mem.isMapped(addr))
+  {
+    uint8_t *segment = NULL;
+    uint8_t align = 16;
+    posix_memalign((void **)&segment, align, size);
+    memset(segment, 0, size);
 
-  std::shared_ptr<Memory> memory(new Memory("data", segment,
-                                            addr,
-                                            size));
-  memory->setMayWrite(true);
+    std::shared_ptr<Memory> memory(new Memory("data", segment,
+                                              addr,
+                                              size));
+    memory->setMayWrite(true);
 
-  mem.addClient(std::shared_ptr<MemoryInterface>(memory));
+    mem.addClient(std::shared_ptr<MemoryInterface>(memory));
+  }
 
   if(funct3 == 0x00)
     mem.writeByte(addr,value);
@@ -291,15 +550,100 @@ ALU::store(RegValue addr, RegValue value, int funct3, MemoryBus & mem)
     mem.writeDoubleWord(addr,value);
 }
 
+/* lb, lh and lw sign-extend, funct3 4 to 6 are the unsigned loads. */
 void
 ALU::load(RegValue addr, int funct3, MemoryBus & mem)
 {
-  if(funct3 == 0x00 || funct3 == 0x04)
+  if(funct3 == 0x00)
+    result = (RegValue)(int64_t)(int8_t)mem.readByte(addr);
+  if(funct3 == 0x01)
+    result = (RegValue)(int64_t)(int16_t)mem.readHalfWord(addr);
+  if(funct3 == 0x02)
+    result = (RegValue)(int64_t)(int32_t)mem.readWord(addr);
+  if(funct3 == 0x04)
     result = mem.readByte(addr);
-  if(funct3 == 0x01 || funct3 == 0x05)
+  if(funct3 == 0x05)
     result = mem.readHalfWord(addr);
-  if(funct3 == 0x02 || funct3 == 0x06)
+  if(funct3 == 0x06)
     result = mem.readWord(addr);
-  if(funct3 == 0x03 || funct3 == 0x07)
+  if(funct3 == 0x03)
     result = mem.readDoubleWord(addr);
 }
+
+/* lr, sc and the AMOs on a word (funct3 2) or double word (funct3 3),
+ * which must be naturally aligned. The AMOs return the old value and
+ * store the result of funct5 applied to it and value. sc returns 0
+ * when it stored value, 1 when the reservation of the last lr does not
+ * cover the address any more.
+ */
+void
+ALU::atomic(DecodedInstruction data, RegValue addr, RegValue value, MemoryBus & mem)
+{
+  if(data.funct3 != 0x02 && data.funct3 != 0x03)
+    throw IllegalInstruction("Unsupported atomic instruction");
+
+  bool word = data.funct3 == 0x02;
+  if(addr & (word ? 0x03 : 0x07))
+    throw IllegalAccess("Misaligned atomic memory operation");
+
+  /* sc */
+  if(data.funct5 == 0x03)
+  {
+    bool reserved = reservationValid && reservation == addr;
+    reservationValid = false;
+    if(reserved)
+      store(addr,value,data.funct3,mem);
+    result = !reserved;
+    return;
+  }
+
+  load(addr,data.funct3,mem);
+  RegValue old = result;
+
+  /* lr */
+  if(data.funct5 == 0x02)
+  {
+    reservation = addr;
+    reservationValid = true;
+    return;
+  }
+
+  /* Compare the sign-extended words for the word variants */
+  if(word)
+    value = (RegValue)(int64_t)(int32_t)value;
+
+  switch(data.funct5)
+  {
+    case 0x00:
+      value = old + value;
+      break;
+    case 0x01:
+      break;
+    case 0x04:
+      value = old ^ value;
+      break;
+    case 0x08:
+      value = old | value;
+      break;
+    case 0x0c:
+      value = old & value;
+      break;
+    case 0x10:
+      value = (int64_t)old < (int64_t)value ? old : value;
+      break;
+    case 0x14:
+      value = (int64_t)old > (int64_t)value ? old : value;
+      break;
+    case 0x18:
+      value = old < value ? old : value;
+      break;
+    case 0x1c:
+      value = old > value ? old : value;
+      break;
+    default:
+      throw IllegalInstruction("Unsupported atomic instruction");
+  }
+
+  store(addr,value,data.funct3,mem);
+  result = old;
+}
@@ -11,10 +11,24 @@
 #include "inst-decoder.h"
 #include "reg-file.h"
 #include "memory-bus.h"
+#include "csr-file.h"
+#include "mmu.h"
 #include "arch.h"
 
 #include <map>
 
+/* Data memory access performed by the last memory instruction. 
+*/
+struct MemoryAccess
+{
+  MemAddress vaddr;
+  MemAddress paddr;
+  RegValue value;
+  uint8_t size;
+  bool write;
+  bool valid;
+};
+
 /* The ALU component performs the specified operation on operands A and B,
  * placing the result in result. The operation is specified through
  * opcode and/or function code.
@@ -29,34 +43,52 @@ class ALU
 
     RegValue getResult() const { return result; }
     RegValue getFlag() const { return flag; }
+    const MemoryAccess &getMemoryAccess() const { return access; }
+
+    void execute(DecodedInstruction data,RegisterFile & reg, MemAddress & PC, CSRFile & csr, MMU & mmu);
+    void memorycontroller(DecodedInstruction data,RegisterFile & reg,MemoryBus & mem,MMU & mmu);
 
-    void execute(DecodedInstruction data,RegisterFile & reg, MemAddress & PC);
-    void memorycontroller(DecodedInstruction data,RegisterFile & reg,MemoryBus & mem);
+    /* Stores to addresses without memory allocate a small memory for
+     * the stored value. Platforms with a full memory map disable this,
+     * so that such stores fault instead.
+     */
+    void setAllocateOnStore(bool setting) { allocateOnStore = setting; }
 
   private:
-    void add(RegValue L, RegValue R);
-    void sub(RegValue L, RegValue R);
-    void li(int I);
+    /* Integer operations selected by funct3, on 64 bits or, for the
+     * word variants, on the lower 32 bits with the result sign-extended.
+     * alternate selects sub and sra (bit 30 of the instruction).
+     */
+    void arithmetic(int funct3, bool alternate, RegValue L, RegValue R);
+    void arithmeticWord(int funct3, bool alternate, RegValue L, RegValue R);
+    void multiply(int funct3, RegValue L, RegValue R);
+    void multiplyWord(int funct3, RegValue L, RegValue R);
     void addi(RegValue L, int I);
-    void sll(RegValue L, int I);
-    void srl(RegValue L, int I);
-    void mv(RegValue L);
-    void andi(RegValue L, int I);
-
-    void beq(RegValue L, RegValue R, MemAddress addr, MemAddress & PC);
-    void bne(RegValue L, RegValue R, MemAddress addr, MemAddress & PC);
-    void blt(RegValue L, RegValue R, MemAddress addr, MemAddress & PC);
-    void ble(RegValue L, RegValue R, MemAddress addr, MemAddress & PC);
+
+    void branch(int funct3, RegValue L, RegValue R, MemAddress addr, MemAddress & PC);
     void call(MemAddress addr, MemAddress & PC);
     void jump(MemAddress addr, MemAddress & PC);
 
+    void system(DecodedInstruction data, RegisterFile & reg, CSRFile & csr, MMU & mmu, MemAddress & PC);
+    void csrrw(CSRFile & csr, int number, RegValue value, bool read);
+    void csrrs(CSRFile & csr, int number, RegValue mask, bool write);
+    void csrrc(CSRFile & csr, int number, RegValue mask, bool write);
+
     void store(RegValue addr, RegValue value, int funct3, MemoryBus & mem);
     void load(RegValue addr, int funct3, MemoryBus & mem);
+    void atomic(DecodedInstruction data, RegValue addr, RegValue value, MemoryBus & mem);
 
     RegValue A;
     RegValue B;
     RegValue result;
     RegValue flag;
+    MemoryAccess access = {};
+
+    /* Address reserved by the last lr, sc only stores there */
+    MemAddress reservation = 0;
+    bool reservationValid = false;
+
+    bool allocateOnStore = true;
 };
 
 #endif /* __ALU_H__ */
@@ -0,0 +1,400 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * bench.cc - Benchmark harness measuring emulator throughput.
+ */
+
+#include "elf-file.h"
+#include "processor.h"
+
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/resource.h>
+
+/* Mean, sample standard deviation and range of repeated measurements.
+ */
+struct Summary
+{
+  double mean;
+  double stddev;
+  double min;
+  double max;
+
+  Summary(const std::vector<double> &samples)
+    : mean(0.0), stddev(0.0), min(0.0), max(0.0)
+  {
+    if (samples.empty())
+      return;
+
+    min = max = samples[0];
+    for (double sample : samples)
+      {
+        mean += sample;
+        min = std::min(min, sample);
+        max = std::max(max, sample);
+      }
+    mean /= samples.size();
+
+    if (samples.size() > 1)
+      {
+        for (double sample : samples)
+          stddev += (sample - mean) * (sample - mean);
+        stddev = std::sqrt(stddev / (samples.size() - 1));
+      }
+  }
+};
+
+struct BenchmarkResult
+{
+  std::string name;
+  std::string filename;
+  uint64_t instructions;
+  uint64_t cycles;
+  uint64_t exitCode;
+  std::vector<double> seconds;
+  std::vector<double> mips;
+  long maxRSS;
+};
+
+/* The exit code and instruction count a benchmark must reproduce */
+struct Expectation
+{
+  uint64_t exitCode;
+  uint64_t instructions;
+};
+
+typedef std::map<std::string, Expectation> ExpectationMap;
+
+/* Reads lines of "name exit-code instructions", '#' starts a comment.
+ */
+static ExpectationMap
+readExpectations(const char *filename)
+{
+  std::ifstream file(filename);
+  if (!file)
+    throw std::runtime_error(std::string("Could not open ") + filename + ".");
+
+  ExpectationMap expectations;
+  std::string line;
+  int lineNumber = 0;
+
+  while (std::getline(file, line))
+    {
+      ++lineNumber;
+      line = line.substr(0, line.find('#'));
+
+      std::istringstream fields(line);
+      std::string name;
+      Expectation expectation;
+
+      if (!(fields >> name))
+        continue;
+      if (!(fields >> expectation.exitCode >> expectation.instructions))
+        throw std::runtime_error(std::string(filename) + ":" +
+                                 std::to_string(lineNumber) +
+                                 ": expected a name, exit code and "
+                                 "instruction count.");
+      expectations[name] = expectation;
+    }
+
+  return expectations;
+}
+
+/* The program name without directory, extension and "bench-" prefix */
+static std::string
+benchmarkName(const std::string &filename)
+{
+  std::string name = filename.substr(filename.find_last_of('/') + 1);
+
+  if (name.compare(0, 6, "bench-") == 0)
+    name = name.substr(6);
+  return name.substr(0, name.find('.'));
+}
+
+/* Peak resident set size of this process so far, in KiB. */
+static long
+getMaxRSS(void)
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/* Runs the program warmup + runs times, each time in a freshly
+ * constructed processor. Only the execution itself is timed.
+ */
+static BenchmarkResult
+runBenchmark(const std::string &filename, int runs, int warmup)
+{
+  BenchmarkResult result{ benchmarkName(filename), filename, 0, 0, 0,
+                          {}, {}, 0 };
+
+  for (int i = 0; i < warmup + runs; ++i)
+    {
+      ELFFile program(filename);
+      Processor p(program);
+
+      auto start = std::chrono::steady_clock::now();
+      bool completed = p.run();
+      auto end = std::chrono::steady_clock::now();
+
+      if (!completed)
+        throw std::runtime_error(filename + " terminated abnormally.");
+
+      if (i > 0 && (p.getInstructionCount() != result.instructions ||
+                         p.getExitCode() != result.exitCode))
+        throw std::runtime_error(filename + " does not run deterministically.");
+
+      result.instructions = p.getInstructionCount();
+      result.cycles = p.getCycleCount();
+      result.exitCode = p.getExitCode();
+
+      if (i < warmup)
+        continue;
+
+      double seconds = std::chrono::duration<double>(end - start).count();
+      result.seconds.push_back(seconds);
+      result.mips.push_back(result.instructions / seconds / 1e6);
+    }
+
+  result.maxRSS = getMaxRSS();
+  return result;
+}
+
+static std::string
+jsonString(const std::string &s)
+{
+  std::string out("\"");
+
+  for (char c : s)
+    {
+      if (c == '"' || c == '\\')
+        out += '\\';
+      if ((unsigned char)c < 0x20)
+        continue;
+      out += c;
+    }
+
+  return out + "\"";
+}
+
+static void
+writeSummary(std::ostream &os, const char *name,
+             const std::vector<double> &samples)
+{
+  Summary summary(samples);
+
+  os << "      " << jsonString(name) << ": { \"mean\": " << summary.mean
+     << ", \"stddev\": " << summary.stddev
+     << ", \"min\": " << summary.min << ", \"max\": " << summary.max
+     << ", \"samples\": [";
+  for (size_t i = 0; i < samples.size(); ++i)
+    os << (i ? ", " : " ") << samples[i];
+  os << " ] }";
+}
+
+static void
+writeJSON(std::ostream &os, const std::string &label, int runs,
+          const std::vector<BenchmarkResult> &results)
+{
+  char timestamp[32];
+  time_t now = time(nullptr);
+  strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+  os << std::setprecision(9);
+  os << "{" << std::endl
+     << "  \"label\": " << jsonString(label) << "," << std::endl
+     << "  \"timestamp\": " << jsonString(timestamp) << "," << std::endl
+     << "  \"runs\": " << runs << "," << std::endl
+     << "  \"benchmarks\": [" << std::endl;
+
+  for (size_t i = 0; i < results.size(); ++i)
+    {
+      const BenchmarkResult &result = results[i];
+
+      os << "    {" << std::endl
+         << "      \"name\": " << jsonString(result.name) << "," << std::endl
+         << "      \"program\": " << jsonString(result.filename) << ","
+         << std::endl
+         << "      \"instructions\": " << result.instructions << ","
+         << std::endl
+         << "      \"cycles\": " << result.cycles << "," << std::endl
+         << "      \"exit_code\": " << result.exitCode << "," << std::endl;
+      writeSummary(os, "seconds", result.seconds);
+      os << "," << std::endl;
+      writeSummary(os, "mips", result.mips);
+      os << "," << std::endl
+         << "      \"max_rss_kib\": " << result.maxRSS << std::endl
+         << "    }" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+
+  os << "  ]" << std::endl << "}" << std::endl;
+}
+
+static void
+printTable(std::ostream &os, const std::vector<BenchmarkResult> &results)
+{
+  os << std::left << std::setw(12) << "benchmark" << std::right
+     << std::setw(14) << "instructions"
+     << std::setw(22) << "time (ms)"
+     << std::setw(20) << "MIPS"
+     << std::setw(14) << "max RSS" << std::endl;
+
+  os << std::fixed;
+  for (auto &result : results)
+    {
+      Summary seconds(result.seconds);
+      Summary mips(result.mips);
+
+      os << std::left << std::setw(12) << result.name << std::right
+         << std::setw(14) << result.instructions
+         << std::setprecision(2)
+         << std::setw(12) << seconds.mean * 1000 << " +- "
+         << std::setw(6) << seconds.stddev * 1000
+         << std::setw(10) << mips.mean << " +- "
+         << std::setw(6) << mips.stddev
+         << std::setw(10) << result.maxRSS << " KiB" << std::endl;
+    }
+}
+
+/* Throws when the benchmark did not compute what it should, so that
+ * a broken kernel or emulator does not go unnoticed as a fast run.
+ */
+static void
+checkResult(const BenchmarkResult &result,
+            const ExpectationMap &expectations)
+{
+  auto expectation = expectations.find(result.name);
+
+  if (expectation == expectations.end())
+    throw std::runtime_error("No expected result for " + result.name + ".");
+
+  const Expectation &expected = expectation->second;
+
+  if (result.exitCode != expected.exitCode ||
+      result.instructions != expected.instructions)
+    {
+      std::ostringstream message;
+
+      message << result.filename << " exited with " << result.exitCode
+              << " after " << result.instructions << " instructions, "
+              << "expected " << expected.exitCode << " after "
+              << expected.instructions << ".";
+      throw std::runtime_error(message.str());
+    }
+}
+
+static void
+showHelp(const char *progName)
+{
+  std::cerr << progName << " [-n runs] [-w warmup] [-o results.json] "
+            << "[-l label] [-c expected] <program> ..." << std::endl;
+  std::cerr <<
+R"HERE(
+    Runs every program runs times (default 5) after warmup runs (default
+    1), each time in a new processor in this process, and reports the
+    host time, guest MIPS and peak RSS with their variation. -o writes
+    the results as JSON, labeled with -l (such as a commit hash) to
+    compare runs across commits. -c fails unless every program ends
+    with the exit code and instruction count listed in the given file,
+    in lines of "name exit-code instructions".
+
+    Max RSS is the peak of this process up to and including the
+    benchmark, programs are therefore best listed from small to large.
+)HERE";
+}
+
+int
+main(int argc, char **argv)
+{
+  int c;
+  int runs = 5, warmup = 1;
+  const char *jsonFilename = nullptr;
+  const char *expectedFilename = nullptr;
+  std::string label;
+  const char *progName = argv[0];
+
+  while ((c = getopt(argc, argv, "n:w:o:l:c:h")) != -1)
+    {
+      switch (c)
+        {
+          case 'n':
+            runs = atoi(optarg);
+            break;
+
+          case 'w':
+            warmup = atoi(optarg);
+            break;
+
+          case 'o':
+            jsonFilename = optarg;
+            break;
+
+          case 'l':
+            label = optarg;
+            break;
+
+          case 'c':
+            expectedFilename = optarg;
+            break;
+
+          case 'h':
+          default:
+            showHelp(progName);
+            return 2;
+        }
+    }
+
+  if (optind >= argc || runs < 1 || warmup < 0)
+    {
+      showHelp(progName);
+      return 2;
+    }
+
+  std::vector<BenchmarkResult> results;
+
+  try
+    {
+      ExpectationMap expectations;
+
+      if (expectedFilename)
+        expectations = readExpectations(expectedFilename);
+
+      for (int i = optind; i < argc; ++i)
+        {
+          results.push_back(runBenchmark(argv[i], runs, warmup));
+          if (expectedFilename)
+            checkResult(results.back(), expectations);
+        }
+    }
+  catch (std::exception &e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
+    }
+
+  printTable(std::cout, results);
+
+  if (jsonFilename)
+    {
+      std::ofstream jsonFile(jsonFilename);
+      if (!jsonFile)
+        {
+          std::cerr << "Error: Could not write " << jsonFilename << std::endl;
+          return 1;
+        }
+      writeJSON(jsonFile, label, runs, results);
+    }
+
+  return 0;
+}
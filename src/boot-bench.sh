@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# rv64-emu -- Simple 64-bit RISC-V simulator
+# boot-bench.sh - Time a boot of the virt platform to a shell prompt.
+#
+# Usage: boot-bench.sh <budget-seconds> <rv64-emu arguments>
+#
+# Runs ./rv64-emu --platform=virt with the given arguments (images and
+# options) and exits with status 0 when the prompt appeared on the
+# console within the budget, 1 otherwise. The prompt can be changed
+# through BOOT_PROMPT.
+#
+
+if [ $# -lt 2 ]; then
+  echo "usage: $0 <budget-seconds> <rv64-emu arguments>" >&2
+  exit 2
+fi
+
+budget=$1
+shift
+prompt=${BOOT_PROMPT:-"/ # "}
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+now() {
+  date +%s.%N
+}
+
+elapsed() {
+  awk "BEGIN { printf \"%.2f\", $(now) - $start }"
+}
+
+start=$(now)
+./rv64-emu --platform=virt "$@" < /dev/null > "$tmp/console" 2> "$tmp/stderr" &
+pid=$!
+
+# Poll the console for the prompt. A kernel may power off right after
+# printing it, or wait for input forever; the emulator is stopped in
+# either case.
+found=1
+while :; do
+  if grep -q -F -- "$prompt" "$tmp/console"; then
+    found=0
+    break
+  fi
+  if ! kill -0 $pid 2> /dev/null; then
+    break
+  fi
+  if awk "BEGIN { exit !($(elapsed) > $budget) }"; then
+    break
+  fi
+  sleep 0.01
+done
+time=$(elapsed)
+
+kill $pid 2> /dev/null
+wait $pid 2> /dev/null
+
+# Only printed when the emulator exited by itself
+instructions=$(sed -n 's/.* \([0-9]*\) instructions executed.*/\1/p' "$tmp/stderr")
+
+if [ $found -eq 0 ]; then
+  echo "boot-to-shell: $time s (budget $budget s)${instructions:+, $instructions instructions}"
+  exit 0
+fi
+
+echo "boot-to-shell: no prompt within budget of $budget s, console ends with:"
+tail -n 5 "$tmp/console"
+echo
+exit 1
@@ -0,0 +1,204 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * checkpoint.cc - Checkpoint file reader and writer.
+ */
+
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char CheckpointMagic[8] = { 'R', 'V', '6', '4',
+                                         'C', 'K', 'P', 'T' };
+static const uint32_t CheckpointByteOrder = 0x01020304;
+
+/*
+ * CheckpointWriter
+ */
+CheckpointWriter::CheckpointWriter(const std::string &filename,
+                                   const std::string &parent)
+  : filename(filename), temporary(filename + "." + std::to_string(getpid())),
+    finished(false), file(temporary, std::ios::binary), offset(0)
+{
+  if (!file)
+    throw std::runtime_error("Could not create checkpoint " + filename);
+
+  std::string parentPath;
+  if (!parent.empty())
+    {
+      char *path = realpath(parent.c_str(), nullptr);
+      if (!path)
+        throw std::runtime_error("Could not find checkpoint " + parent);
+
+      parentPath = path;
+      free(path);
+    }
+
+  write(CheckpointMagic, sizeof(CheckpointMagic));
+  put(CheckpointVersion);
+  put(CheckpointByteOrder);
+  put(CheckpointPageSize);
+  putString(parentPath);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+  if (!finished)
+    {
+      file.close();
+      unlink(temporary.c_str());
+    }
+}
+
+void
+CheckpointWriter::putString(const std::string &value)
+{
+  put<uint32_t>(value.size());
+  write(value.data(), value.size());
+}
+
+void
+CheckpointWriter::write(const void *data, size_t size)
+{
+  file.write((const char *)data, size);
+  offset += size;
+}
+
+void
+CheckpointWriter::alignToPage(void)
+{
+  static const char zeroes[CheckpointPageSize] = { 0 };
+
+  size_t padding = -offset & (CheckpointPageSize - 1);
+  write(zeroes, padding);
+}
+
+void
+CheckpointWriter::finish(void)
+{
+  file.close();
+  finished = true;
+
+  if (!file || rename(temporary.c_str(), filename.c_str()) < 0)
+    {
+      unlink(temporary.c_str());
+      throw std::runtime_error("Could not write checkpoint " + filename);
+    }
+}
+
+/*
+ * CheckpointReader
+ */
+CheckpointReader::CheckpointReader(const std::string &filename)
+  : filename(filename), fd(-1), data(nullptr), size(0), offset(0)
+{
+  fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Could not open checkpoint " + filename);
+
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) < 0 || statbuf.st_size < 20)
+    {
+      close(fd);
+      throw std::runtime_error("Not a checkpoint: " + filename);
+    }
+
+  size = statbuf.st_size;
+  void *addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED)
+    {
+      close(fd);
+      throw std::runtime_error("Could not map checkpoint " + filename);
+    }
+  data = (const uint8_t *)addr;
+
+  if (memcmp(data, CheckpointMagic, sizeof(CheckpointMagic)) != 0)
+    {
+      munmap((void *)data, size);
+      close(fd);
+      throw std::runtime_error("Not a checkpoint: " + filename);
+    }
+  offset = sizeof(CheckpointMagic);
+
+  if (get<uint32_t>() != CheckpointVersion ||
+      get<uint32_t>() != CheckpointByteOrder ||
+      get<uint32_t>() != CheckpointPageSize)
+    {
+      munmap((void *)data, size);
+      close(fd);
+      throw std::runtime_error("Unsupported checkpoint version, byte order "
+                               "or page size: " + filename);
+    }
+
+  parent = getString();
+  if (!parent.empty() && access(parent.c_str(), R_OK) != 0)
+    {
+      size_t slash = filename.rfind('/');
+      std::string directory = slash == std::string::npos ?
+          std::string() : filename.substr(0, slash + 1);
+
+      parent = directory + parent.substr(parent.rfind('/') + 1);
+    }
+}
+
+CheckpointReader::~CheckpointReader()
+{
+  munmap((void *)data, size);
+  close(fd);
+}
+
+std::string
+CheckpointReader::getString(void)
+{
+  uint32_t length = get<uint32_t>();
+  const uint8_t *chars = getData(length);
+
+  return std::string((const char *)chars, length);
+}
+
+void
+CheckpointReader::read(void *dest, size_t bytes)
+{
+  memcpy(dest, getData(bytes), bytes);
+}
+
+void
+CheckpointReader::alignToPage(void)
+{
+  size_t padding = -offset & (CheckpointPageSize - 1);
+  getData(padding);
+}
+
+const uint8_t *
+CheckpointReader::getData(size_t bytes)
+{
+  check(bytes);
+
+  const uint8_t *result = data + offset;
+  offset += bytes;
+  return result;
+}
+
+void
+CheckpointReader::mapData(void *dest, size_t bytes)
+{
+  check(bytes);
+
+  if (mmap(dest, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           fd, offset) == MAP_FAILED)
+    throw std::runtime_error("Could not map checkpoint " + filename);
+
+  offset += bytes;
+}
+
+void
+CheckpointReader::check(size_t bytes) const
+{
+  if (bytes > size - offset)
+    throw std::runtime_error("Truncated checkpoint " + filename);
+}
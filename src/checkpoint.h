@@ -0,0 +1,126 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * checkpoint.h - Checkpoint file reader and writer.
+ */
+
+/* A checkpoint file starts with a header:
+ *
+ *   magic      8 bytes  "RV64CKPT"
+ *   version    uint32
+ *   byte order uint32   0x01020304 in host order
+ *   page size  uint32   CheckpointPageSize
+ *   parent     uint32 length, characters
+ *
+ * followed by the state of the components, in the order the processor
+ * saves them. An incremental checkpoint names the checkpoint it builds
+ * on as parent and only contains the memory pages written since then,
+ * the parent is empty for a full checkpoint. The parent is stored as an
+ * absolute path; when it no longer exists, a file of the same name next
+ * to the incremental checkpoint is used. Values are stored in host byte
+ * order, so checkpoints can only be restored on a host with the same
+ * byte order. Page contents start at file offsets that are a multiple
+ * of the page size, so they can be mapped into guest memory instead of
+ * being copied.
+ */
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static const uint32_t CheckpointVersion = 2;
+static const uint32_t CheckpointPageSize = 4096;
+
+/* The checkpoint is written to a temporary file that finish() renames
+ * to the final name. Restored guest memory may still be mapped from a
+ * file of that name, which must not be truncated underneath it.
+ */
+class CheckpointWriter
+{
+  public:
+    CheckpointWriter(const std::string &filename,
+                     const std::string &parent = std::string());
+    ~CheckpointWriter();
+
+    template <typename T>
+    void put(const T &value)
+    {
+      write(&value, sizeof(T));
+    }
+
+    void putString(const std::string &value);
+    void write(const void *data, size_t size);
+
+    /* Pad with zeroes up to the next page boundary. 
+		*/
+    void alignToPage(void);
+
+    /* Close the file and rename it into place, throws when any write
+     * failed.
+     */
+    void finish(void);
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+  private:
+    std::string filename;
+    std::string temporary;
+    bool finished;
+    std::ofstream file;
+    uint64_t offset;
+};
+
+class CheckpointReader
+{
+  public:
+    CheckpointReader(const std::string &filename);
+    ~CheckpointReader();
+
+    bool isIncremental(void) const { return !parent.empty(); }
+    const std::string &getParent(void) const { return parent; }
+
+    CheckpointReader(const CheckpointReader &) = delete;
+    CheckpointReader &operator=(const CheckpointReader &) = delete;
+
+    template <typename T>
+    T get(void)
+    {
+      T value;
+      read(&value, sizeof(T));
+      return value;
+    }
+
+    std::string getString(void);
+    void read(void *data, size_t size);
+
+    void alignToPage(void);
+
+    /* Returns the contents of size bytes at the current position and
+     * skips them. The pointer is valid while the reader exists.
+     */
+    const uint8_t *getData(size_t size);
+
+    /* Map size bytes at the current position copy-on-write over dest,
+     * which must be page aligned and part of a private host mapping,
+     * and skip them. The mapping stays valid after the reader is gone.
+     */
+    void mapData(void *dest, size_t size);
+
+  private:
+    std::string filename;
+    std::string parent;
+    int fd;
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+
+    void check(size_t bytes) const;
+};
+
+#endif /* __CHECKPOINT_H__ */
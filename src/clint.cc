@@ -0,0 +1,191 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * clint.cc - Core-local interruptor (timer and software interrupts).
+ */
+
+#include "clint.h"
+#include "checkpoint.h"
+#include "trap.h"
+
+#include <limits>
+
+CLINT::CLINT(const MemAddress base, CSRFile &csrs,
+             const uint64_t *instructions)
+  : base(base), csrs(csrs), instructions(instructions),
+    msip(0), mtimecmp(std::numeric_limits<uint64_t>::max()), timeOffset(0)
+{
+  csrs.attachTimer(this);
+}
+
+CLINT::~CLINT()
+{
+}
+
+void
+CLINT::update(void)
+{
+  uint64_t now = getTime();
+
+  if (now >= mtimecmp)
+    csrs.setInterruptPending(Interrupt::MachineTimer, true);
+  else
+    {
+      /* Schedule the next check for when mtime reaches mtimecmp,
+       * taking care not to overflow.
+       */
+      uint64_t delta = mtimecmp - now;
+      uint64_t limit = std::numeric_limits<uint64_t>::max() - *instructions;
+
+      csrs.setInterruptPending(Interrupt::MachineTimer, false);
+      csrs.requestInterruptCheck(delta > limit ?
+                                 std::numeric_limits<uint64_t>::max() :
+                                 *instructions + delta);
+    }
+}
+
+void
+CLINT::saveState(CheckpointWriter &writer) const
+{
+  writer.put(msip);
+  writer.put(mtimecmp);
+  writer.put(timeOffset);
+}
+
+void
+CLINT::restoreState(CheckpointReader &reader)
+{
+  msip = reader.get<uint32_t>();
+  mtimecmp = reader.get<uint64_t>();
+  timeOffset = reader.get<uint64_t>();
+}
+
+/*
+ * MemoryInterface
+ */
+
+uint8_t
+CLINT::readByte(MemAddress addr)
+{
+  return readRegister(addr, sizeof(uint8_t));
+}
+
+uint16_t
+CLINT::readHalfWord(MemAddress addr)
+{
+  return readRegister(addr, sizeof(uint16_t));
+}
+
+uint32_t
+CLINT::readWord(MemAddress addr)
+{
+  return readRegister(addr, sizeof(uint32_t));
+}
+
+uint64_t
+CLINT::readDoubleWord(MemAddress addr)
+{
+  return readRegister(addr, sizeof(uint64_t));
+}
+
+
+void
+CLINT::writeByte(MemAddress addr, uint8_t value)
+{
+  writeRegister(addr, sizeof(value), value);
+}
+
+void
+CLINT::writeHalfWord(MemAddress addr, uint16_t value)
+{
+  writeRegister(addr, sizeof(value), value);
+}
+
+void
+CLINT::writeWord(MemAddress addr, uint32_t value)
+{
+  writeRegister(addr, sizeof(value), value);
+}
+
+void
+CLINT::writeDoubleWord(MemAddress addr, uint64_t value)
+{
+  writeRegister(addr, sizeof(value), value);
+}
+
+bool
+CLINT::contains(MemAddress addr) const
+{
+  return base <= addr && addr < base + Register::End;
+}
+
+
+/*
+ * Private methods
+ */
+
+/* Registers may be accessed in parts (e.g. two 32-bit halves) with
+ * naturally aligned accesses, as done by 32-bit software.
+ */
+uint64_t
+CLINT::readRegister(MemAddress addr, size_t size)
+{
+  MemAddress offset = addr - base;
+  unsigned int shift = (offset & 0x7) * 8;
+
+  if ((addr & (size - 1)) != 0)
+    throw IllegalAccess(addr, size);
+
+  switch (offset & ~(MemAddress)0x7)
+    {
+      case Register::MSip:
+        return (offset & 0x7) < 4 ? msip >> shift : 0;
+
+      case Register::MTimeCmp:
+        return mtimecmp >> shift;
+
+      case Register::MTime:
+        return getTime() >> shift;
+
+      default:
+        throw IllegalAccess(addr, size);
+    }
+}
+
+void
+CLINT::writeRegister(MemAddress addr, size_t size, uint64_t value)
+{
+  MemAddress offset = addr - base;
+  unsigned int shift = (offset & 0x7) * 8;
+  uint64_t mask = size == 8 ? ~(uint64_t)0 : (((uint64_t)1 << (size * 8)) - 1);
+
+  if ((addr & (size - 1)) != 0)
+    throw IllegalAccess(addr, size);
+
+  switch (offset & ~(MemAddress)0x7)
+    {
+      case Register::MSip:
+        if ((offset & 0x7) == 0)
+          {
+            msip = value & 0x1;
+            csrs.setInterruptPending(Interrupt::MachineSoftware, msip != 0);
+          }
+        break;
+
+      case Register::MTimeCmp:
+        mtimecmp = (mtimecmp & ~(mask << shift)) | ((value & mask) << shift);
+        update();
+        break;
+
+      case Register::MTime:
+        {
+          uint64_t mtime = getTime();
+          mtime = (mtime & ~(mask << shift)) | ((value & mask) << shift);
+          timeOffset = mtime - *instructions;
+          update();
+        }
+        break;
+
+      default:
+        throw IllegalAccess(addr, size);
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * clint.h - Core-local interruptor (timer and software interrupts).
+ */
+
+/* Register layout is compatible with the SiFive CLINT as found on
+ * the QEMU "virt" platform:
+ *
+ *   0x0000  msip      (rw, 32-bit) bit 0 raises a software interrupt
+ *   0x4000  mtimecmp  (rw, 64-bit) timer interrupt when mtime >= mtimecmp
+ *   0xbff8  mtime     (rw, 64-bit) timer
+ *
+ * To keep runs deterministic and timer checks cheap, mtime advances
+ * by one tick per executed instruction.
+ */
+
+#ifndef __CLINT_H__
+#define __CLINT_H__
+
+#include "memory-interface.h"
+#include "csr-file.h"
+
+class CheckpointWriter;
+class CheckpointReader;
+
+class CLINT : public MemoryInterface
+{
+  public:
+    static const MemAddress DefaultBase = 0x2000000;
+
+    CLINT(const MemAddress base, CSRFile &csrs,
+          const uint64_t *instructions);
+    virtual ~CLINT();
+
+    void saveState(CheckpointWriter &writer) const;
+    void restoreState(CheckpointReader &reader);
+
+    uint64_t getTime(void) const { return *instructions + timeOffset; }
+
+    /* Update the timer interrupt line. Called by the processor when
+     * the interrupt check point requested earlier has been reached.
+     */
+    void update(void);
+
+    /* MemoryInterface 
+		*/
+    virtual uint8_t readByte(MemAddress addr) override;
+    virtual uint16_t readHalfWord(MemAddress addr) override;
+    virtual uint32_t readWord(MemAddress addr) override;
+    virtual uint64_t readDoubleWord(MemAddress addr) override;
+
+    virtual void writeByte(MemAddress addr, uint8_t value) override;
+    virtual void writeHalfWord(MemAddress addr, uint16_t value) override;
+    virtual void writeWord(MemAddress addr, uint32_t value) override;
+    virtual void writeDoubleWord(MemAddress addr, uint64_t value) override;
+
+    virtual bool contains(MemAddress addr) const override;
+
+  private:
+    enum Register : MemAddress
+    {
+      MSip = 0x0000,
+      MTimeCmp = 0x4000,
+      MTime = 0xbff8,
+      End = 0x10000
+    };
+
+    const MemAddress base;
+    CSRFile &csrs;
+    const uint64_t *instructions;
+
+    uint32_t msip;
+    uint64_t mtimecmp;
+    uint64_t timeOffset;
+
+    /* Private helper methods 
+		*/
+    uint64_t readRegister(MemAddress addr, size_t size);
+    void writeRegister(MemAddress addr, size_t size, uint64_t value);
+};
+
+#endif /* __CLINT_H__ */
@@ -0,0 +1,240 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * coverage.cc - Basic block and branch edge coverage.
+ */
+
+#include "coverage.h"
+#include "elf-file.h"
+#include "inst-decoder.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+
+/* Used when the program has no usable line information */
+static const LineTable noLines;
+
+Coverage::Coverage(const ELFFile &program)
+  : base(0), nSlots(0), lines(&noLines), functions(program.getSymbolTable())
+{
+  std::vector<ELFSection> sections = program.getCodeSections();
+
+  if (!sections.empty())
+    {
+      MemAddress end = 0;
+
+      base = ~(MemAddress)0;
+      for (auto &section : sections)
+        {
+          base = std::min(base, section.addr & ~(MemAddress)3);
+          end = std::max(end, section.addr + section.size);
+        }
+      nSlots = (end - base + 3) / 4;
+    }
+
+  code.resize(nSlots, 0);
+  for (auto &section : sections)
+    {
+      uint64_t firstSlot = (section.addr - base) / 4;
+
+      ranges.push_back(CodeRange{ firstSlot, section.size / 4 });
+      for (uint64_t i = 0; i + 4 <= section.size; i += 4)
+        code[firstSlot + i / 4] = section.data[i] |
+                                  (section.data[i + 1] << 8) |
+                                  (section.data[i + 2] << 16) |
+                                  ((uint32_t)section.data[i + 3] << 24);
+    }
+
+  blocks.resize((nSlots + 63) / 64, 0);
+  edges.resize((2 * nSlots + 63) / 64, 0);
+
+  try
+    {
+      lines = &program.getLineTable();
+    }
+  catch (std::runtime_error &e)
+    {
+      std::cerr << "Warning: no source lines for coverage: " << e.what()
+                << std::endl;
+    }
+}
+
+void
+Coverage::dumpSummary(std::ostream &os) const
+{
+  std::vector<bool> executed = getExecutedSlots();
+  uint64_t total = 0, covered = 0, branchEdges = 0, coveredEdges = 0;
+
+  for (auto &range : ranges)
+    for (uint64_t slot = range.firstSlot;
+         slot < range.firstSlot + range.nSlots; ++slot)
+      {
+        ++total;
+        covered += executed[slot];
+
+        if (isBranch(slot))
+          {
+            branchEdges += 2;
+            coveredEdges += testBit(edges, 2 * slot) +
+                            testBit(edges, 2 * slot + 1);
+          }
+      }
+
+  auto storeFlags(os.flags());
+
+  os << std::dec << std::fixed << std::setprecision(2)
+     << "Coverage: " << covered << " of " << total << " instructions ("
+     << (total ? 100.0 * covered / total : 0.0) << "%), "
+     << coveredEdges << " of " << branchEdges << " branch edges ("
+     << (branchEdges ? 100.0 * coveredEdges / branchEdges : 0.0) << "%)"
+     << std::endl;
+
+  os.flags(storeFlags);
+}
+
+void
+Coverage::writeLcov(std::ostream &os) const
+{
+  struct BranchCoverage
+  {
+    bool executed;
+    bool taken;
+    bool notTaken;
+  };
+
+  struct FileCoverage
+  {
+    std::map<uint32_t, bool> lines;
+    std::map<uint32_t, std::vector<BranchCoverage>> branches;
+    std::vector<std::pair<uint32_t, const Symbol *>> functions;
+  };
+
+  std::vector<bool> executed = getExecutedSlots();
+  std::map<std::string, FileCoverage> files;
+
+  for (auto &range : ranges)
+    for (uint64_t slot = range.firstSlot;
+         slot < range.firstSlot + range.nSlots; ++slot)
+      {
+        const LineRow *row = lines->lookup(base + 4 * slot);
+        if (!row)
+          continue;
+
+        FileCoverage &file = files[lines->getFileName(row->file)];
+        file.lines[row->line] |= executed[slot];
+
+        if (isBranch(slot))
+          file.branches[row->line].push_back(BranchCoverage{
+              executed[slot], testBit(edges, 2 * slot + 1),
+              testBit(edges, 2 * slot) });
+      }
+
+  for (auto &function : functions)
+    {
+      const LineRow *row = lines->lookup(function.addr);
+      if (row)
+        files[lines->getFileName(row->file)].functions.emplace_back(
+            row->line, &function);
+    }
+
+  auto storeFlags(os.flags());
+  os << std::dec;
+
+  os << "TN:" << std::endl;
+  for (auto &entry : files)
+    {
+      const FileCoverage &file = entry.second;
+      int hit;
+
+      os << "SF:" << entry.first << std::endl;
+
+      hit = 0;
+      for (auto &function : file.functions)
+        os << "FN:" << function.first << "," << function.second->name
+           << std::endl;
+      for (auto &function : file.functions)
+        {
+          uint64_t slot = (function.second->addr - base) / 4;
+          bool covered = slot < nSlots && executed[slot];
+
+          os << "FNDA:" << covered << "," << function.second->name
+             << std::endl;
+          hit += covered;
+        }
+      os << "FNF:" << file.functions.size() << std::endl
+         << "FNH:" << hit << std::endl;
+
+      /* Every conditional branch has two edges: taken (0) and not
+       * taken (1). Edges of branches that never executed are "-".
+       */
+      int found = 0;
+      hit = 0;
+      for (auto &line : file.branches)
+        for (size_t block = 0; block < line.second.size(); ++block)
+          {
+            const BranchCoverage &branch = line.second[block];
+            bool outcomes[2] = { branch.taken, branch.notTaken };
+
+            for (int edge = 0; edge < 2; ++edge)
+              {
+                os << "BRDA:" << line.first << "," << block << "," << edge
+                   << ",";
+                if (branch.executed)
+                  os << outcomes[edge];
+                else
+                  os << "-";
+                os << std::endl;
+
+                ++found;
+                hit += outcomes[edge];
+              }
+          }
+      os << "BRF:" << found << std::endl
+         << "BRH:" << hit << std::endl;
+
+      hit = 0;
+      for (auto &line : file.lines)
+        {
+          os << "DA:" << line.first << "," << line.second << std::endl;
+          hit += line.second;
+        }
+      os << "LF:" << file.lines.size() << std::endl
+         << "LH:" << hit << std::endl
+         << "end_of_record" << std::endl;
+    }
+
+  os.flags(storeFlags);
+}
+
+
+/*
+ * Private methods
+ */
+std::vector<bool>
+Coverage::getExecutedSlots(void) const
+{
+  std::vector<bool> executed(nSlots, false);
+
+  for (uint64_t slot = 0; slot < nSlots; ++slot)
+    {
+      if (!testBit(blocks, slot))
+        continue;
+
+      for (uint64_t i = slot; i < nSlots; ++i)
+        {
+          executed[i] = true;
+          if (isBlockEnd(code[i] & 0x7f))
+            break;
+        }
+    }
+
+  for (auto &block : partialBlocks)
+    {
+      uint64_t slot = (block.first - base) / 4;
+
+      for (uint64_t i = 0; i < block.second && slot + i < nSlots; ++i)
+        executed[slot + i] = true;
+    }
+
+  return executed;
+}
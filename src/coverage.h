@@ -0,0 +1,95 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * coverage.h - Basic block and branch edge coverage.
+ */
+
+#ifndef __COVERAGE_H__
+#define __COVERAGE_H__
+
+#include "arch.h"
+#include "dwarf-line.h"
+#include "symbol-table.h"
+
+#include <iostream>
+#include <set>
+#include <vector>
+
+class ELFFile;
+
+/* Coverage of the code sections of the program, kept in two bitmaps
+ * with a bit per instruction slot: one marking the slots at which an
+ * executed basic block starts, one marking the taken and not taken
+ * edges of each conditional branch. The processor sets a bit per block
+ * (and one more for a branch ending it), never per instruction.
+ *
+ * The executed instructions are derived when reporting, by walking
+ * from each block start up to the instruction that ends the block.
+ * Blocks that were cut short by a trap are kept separately.
+ */
+class Coverage
+{
+  public:
+    Coverage(const ELFFile &program);
+
+    void countBlock(MemAddress start)
+    {
+      uint64_t slot = (start - base) >> 2;
+
+      if (slot < nSlots)
+        blocks[slot >> 6] |= (uint64_t)1 << (slot & 63);
+    }
+
+    void countBranch(MemAddress pc, bool taken)
+    {
+      uint64_t edge = ((pc - base) >> 2) * 2 + taken;
+
+      if (edge < 2 * nSlots)
+        edges[edge >> 6] |= (uint64_t)1 << (edge & 63);
+    }
+
+    void countPartialBlock(MemAddress start, uint64_t instructions)
+    {
+      if (instructions != 0)
+        partialBlocks.emplace(start, instructions);
+    }
+
+    void dumpSummary(std::ostream &os) const;
+
+    /* Write the coverage per source line in lcov tracefile format,
+     * as read by genhtml.
+     */
+    void writeLcov(std::ostream &os) const;
+
+  private:
+    struct CodeRange
+    {
+      uint64_t firstSlot;
+      uint64_t nSlots;
+    };
+
+    MemAddress base;
+    uint64_t nSlots;
+    std::vector<uint32_t> code;
+    std::vector<CodeRange> ranges;
+
+    std::vector<uint64_t> blocks;
+    std::vector<uint64_t> edges;
+    std::set<std::pair<MemAddress, uint64_t>> partialBlocks;
+
+    const LineTable *lines;
+    const SymbolTable &functions;
+
+    bool testBit(const std::vector<uint64_t> &bitmap, uint64_t bit) const
+    {
+      return (bitmap[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    bool isBranch(uint64_t slot) const
+    {
+      return (code[slot] & 0x7f) == 0x63;
+    }
+
+    std::vector<bool> getExecutedSlots(void) const;
+};
+
+#endif /* __COVERAGE_H__ */
@@ -0,0 +1,656 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * csr-file.cc - Control and status register file.
+ */
+
+#include "csr-file.h"
+#include "clint.h"
+#include "inst-decoder.h"
+#include "checkpoint.h"
+
+#include <limits>
+#include <sstream>
+
+/* misa: RV64 base integer ISA with supervisor and user mode. */
+static const RegValue MISAValue = ((RegValue)2 << 62) |
+    (1 << ('I' - 'A')) | (1 << ('S' - 'A')) | (1 << ('U' - 'A'));
+
+/* mstatus.UXL and mstatus.SXL are hardwired to 64-bit. */
+static const RegValue MStatusXLen = ((RegValue)2 << 32) | ((RegValue)2 << 34);
+
+static const RegValue MStatusWriteMask =
+    MSTATUS_SIE | MSTATUS_MIE | MSTATUS_SPIE | MSTATUS_MPIE |
+    MSTATUS_SPP | MSTATUS_MPP | MSTATUS_MPRV | MSTATUS_SUM |
+    MSTATUS_MXR | MSTATUS_TVM | MSTATUS_TW | MSTATUS_TSR;
+static const RegValue SStatusMask =
+    MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP | MSTATUS_SUM | MSTATUS_MXR;
+
+static const RegValue SupervisorInterrupts =
+    interruptMask(Interrupt::SupervisorSoftware) |
+    interruptMask(Interrupt::SupervisorTimer) |
+    interruptMask(Interrupt::SupervisorExternal);
+static const RegValue MIEWriteMask = SupervisorInterrupts |
+    interruptMask(Interrupt::MachineSoftware) |
+    interruptMask(Interrupt::MachineTimer) |
+    interruptMask(Interrupt::MachineExternal);
+
+/* All exceptions except environment calls from M-mode. */
+static const RegValue MEDELEGWriteMask =
+    0xffff & ~((RegValue)1 << static_cast<RegValue>(
+                   ExceptionCause::MachineEnvironmentCall));
+
+/* Interrupts in decreasing priority order. */
+static const Interrupt InterruptPriority[] =
+{
+  Interrupt::MachineExternal,
+  Interrupt::MachineSoftware,
+  Interrupt::MachineTimer,
+  Interrupt::SupervisorExternal,
+  Interrupt::SupervisorSoftware,
+  Interrupt::SupervisorTimer
+};
+
+/* Counter index 1 is the time CSR, which is not a counter. */
+static const int CycleIndex = 0;
+static const int InstRetIndex = 2;
+static const int FirstHPMIndex = 3;
+
+static const uint64_t zeroCount = 0;
+
+CSRFile::CSRFile()
+  : countInhibit(0), timer(nullptr), privilege(Privilege::Machine),
+    mstatus(0), medeleg(0), mideleg(0), mie(0), mip(0), mtvec(0),
+    mcounteren(0), mscratch(0), mepc(0), mcause(0), mtval(0),
+    stvec(0), scounteren(0), sscratch(0), sepc(0), scause(0), stval(0),
+    satp(0),
+    interruptCheckAt(0)
+{
+  eventCounts.fill(0);
+  for (int i = 0; i < NumEvents; ++i)
+    eventSources[i] = &eventCounts[i];
+
+  for (auto &counter : counters)
+    counter = Counter{ &zeroCount, 0, 0, 0 };
+}
+
+void
+CSRFile::attachCounters(const uint64_t *instructions,
+                        const uint64_t *cycles)
+{
+  counters[CycleIndex].source = cycles;
+  counters[InstRetIndex].source = instructions;
+}
+
+void
+CSRFile::attachEvent(HPMEvent event, const uint64_t *counter)
+{
+  eventSources[static_cast<int>(event)] = counter;
+
+  /* Re-select for counters already programmed to this event. */
+  for (int i = FirstHPMIndex; i < NumCounters; ++i)
+    if (counters[i].event == (RegValue)event)
+      selectEvent(i, counters[i].event);
+}
+
+void
+CSRFile::attachTimer(const CLINT *timer)
+{
+  this->timer = timer;
+}
+
+RegValue
+CSRFile::read(uint16_t csr) const
+{
+  RegValue value;
+
+  checkAccess(csr, false);
+  if (readCSR(csr, value))
+    return value;
+
+  std::stringstream msg;
+  msg << "Illegal CSR read from " << std::hex << std::showbase << csr;
+  throw IllegalInstruction(msg.str());
+}
+
+void
+CSRFile::write(uint16_t csr, RegValue value)
+{
+  checkAccess(csr, true);
+  if (writeCSR(csr, value))
+    return;
+
+  std::stringstream msg;
+  msg << "Illegal CSR write to " << std::hex << std::showbase << csr;
+  throw IllegalInstruction(msg.str());
+}
+
+MemAddress
+CSRFile::enterTrap(MemAddress epc, RegValue cause, RegValue tval)
+{
+  bool interrupt = (cause & InterruptCauseFlag) != 0;
+  RegValue code = cause & ~InterruptCauseFlag;
+  RegValue delegated = interrupt ? mideleg : medeleg;
+  RegValue tvec;
+
+  if (privilege != Privilege::Machine && ((delegated >> code) & 1))
+    {
+      sepc = epc;
+      scause = cause;
+      stval = tval;
+
+      mstatus &= ~(MSTATUS_SPIE | MSTATUS_SPP);
+      if (mstatus & MSTATUS_SIE)
+        mstatus |= MSTATUS_SPIE;
+      if (privilege == Privilege::Supervisor)
+        mstatus |= MSTATUS_SPP;
+      mstatus &= ~MSTATUS_SIE;
+
+      privilege = Privilege::Supervisor;
+      tvec = stvec;
+    }
+  else
+    {
+      mepc = epc;
+      mcause = cause;
+      mtval = tval;
+
+      mstatus &= ~(MSTATUS_MPIE | MSTATUS_MPP);
+      if (mstatus & MSTATUS_MIE)
+        mstatus |= MSTATUS_MPIE;
+      mstatus |= static_cast<RegValue>(privilege) << MSTATUS_MPP_SHIFT;
+      mstatus &= ~MSTATUS_MIE;
+
+      privilege = Privilege::Machine;
+      tvec = mtvec;
+    }
+
+  /* Interrupt enables depend on the privilege level. */
+  interruptCheckAt = 0;
+
+  MemAddress base = tvec & ~(RegValue)0x3;
+  if ((tvec & 0x1) && interrupt)
+    return base + 4 * code;
+
+  return base;
+}
+
+MemAddress
+CSRFile::returnFromTrap(Privilege level)
+{
+  MemAddress epc;
+
+  if (level == Privilege::Machine)
+    {
+      if (privilege != Privilege::Machine)
+        throw IllegalInstruction("mret outside of machine mode");
+
+      privilege = static_cast<Privilege>((mstatus & MSTATUS_MPP)
+                                         >> MSTATUS_MPP_SHIFT);
+
+      mstatus &= ~(MSTATUS_MIE | MSTATUS_MPP);
+      if (mstatus & MSTATUS_MPIE)
+        mstatus |= MSTATUS_MIE;
+      mstatus |= MSTATUS_MPIE;
+      epc = mepc;
+    }
+  else
+    {
+      if (privilege == Privilege::User ||
+          (privilege == Privilege::Supervisor && (mstatus & MSTATUS_TSR)))
+        throw IllegalInstruction("sret not permitted");
+
+      privilege = (mstatus & MSTATUS_SPP) ? Privilege::Supervisor
+                                          : Privilege::User;
+
+      mstatus &= ~(MSTATUS_SIE | MSTATUS_SPP);
+      if (mstatus & MSTATUS_SPIE)
+        mstatus |= MSTATUS_SIE;
+      mstatus |= MSTATUS_SPIE;
+      epc = sepc;
+    }
+
+  if (privilege != Privilege::Machine)
+    mstatus &= ~MSTATUS_MPRV;
+
+  interruptCheckAt = 0;
+
+  return epc;
+}
+
+void
+CSRFile::setInterruptPending(Interrupt interrupt, bool pending)
+{
+  if (pending)
+    {
+      mip |= interruptMask(interrupt);
+      interruptCheckAt = 0;
+    }
+  else
+    mip &= ~interruptMask(interrupt);
+}
+
+void
+CSRFile::clearInterruptCheck(void)
+{
+  interruptCheckAt = std::numeric_limits<uint64_t>::max();
+}
+
+/* Interrupts for a higher privilege level are always enabled, those
+ * for the current level only when enabled in mstatus. Delegated
+ * interrupts target S-mode and are never taken in M-mode.
+ */
+bool
+CSRFile::getPendingInterrupt(RegValue &cause) const
+{
+  RegValue pending = mip & mie;
+  if (!pending)
+    return false;
+
+  bool machineEnabled = privilege != Privilege::Machine ||
+      (mstatus & MSTATUS_MIE);
+  bool supervisorEnabled = privilege == Privilege::User ||
+      (privilege == Privilege::Supervisor && (mstatus & MSTATUS_SIE));
+
+  RegValue enabled = 0;
+  if (machineEnabled)
+    enabled |= pending & ~mideleg;
+  if (supervisorEnabled)
+    enabled |= pending & mideleg;
+
+  if (!enabled)
+    return false;
+
+  for (auto interrupt : InterruptPriority)
+    if (enabled & interruptMask(interrupt))
+      {
+        cause = InterruptCauseFlag | static_cast<RegValue>(interrupt);
+        return true;
+      }
+
+  return false;
+}
+
+
+void
+CSRFile::saveState(CheckpointWriter &writer) const
+{
+  writer.put(privilege);
+  for (RegValue value : { mstatus, medeleg, mideleg, mie, mip, mtvec,
+                          mcounteren, mscratch, mepc, mcause, mtval,
+                          stvec, scounteren, sscratch, sepc, scause, stval,
+                          satp })
+    writer.put(value);
+
+  writer.put(eventCounts);
+  writer.put(countInhibit);
+  for (int i = 0; i < NumCounters; ++i)
+    {
+      writer.put(counters[i].event);
+      writer.put(readCounter(i));
+    }
+
+  writer.put(interruptCheckAt);
+}
+
+void
+CSRFile::restoreState(CheckpointReader &reader)
+{
+  privilege = reader.get<Privilege>();
+  for (RegValue *value : { &mstatus, &medeleg, &mideleg, &mie, &mip, &mtvec,
+                           &mcounteren, &mscratch, &mepc, &mcause, &mtval,
+                           &stvec, &scounteren, &sscratch, &sepc, &scause,
+                           &stval, &satp })
+    *value = reader.get<RegValue>();
+
+  eventCounts = reader.get<decltype(eventCounts)>();
+  countInhibit = reader.get<uint32_t>();
+  for (int i = 0; i < NumCounters; ++i)
+    {
+      Counter &counter = counters[i];
+
+      counter.event = reader.get<RegValue>();
+      if (i >= FirstHPMIndex)
+        counter.source = counter.event > 0 && counter.event < NumEvents ?
+            eventSources[counter.event] : &zeroCount;
+
+      uint64_t value = reader.get<uint64_t>();
+      counter.frozen = value;
+      counter.offset = *counter.source - value;
+    }
+
+  interruptCheckAt = reader.get<uint64_t>();
+}
+
+/*
+ * Private methods
+ */
+
+/* Bits 9:8 of the CSR number encode the lowest privilege level that
+ * may access it, bits 11:10 equal to 3 mark it read-only.
+ */
+void
+CSRFile::checkAccess(uint16_t csr, bool write) const
+{
+  RegValue required = (csr >> 8) & 0x3;
+  bool allowed = static_cast<RegValue>(privilege) >= required;
+
+  if (write && (csr >> 10) == 0x3)
+    allowed = false;
+
+  if (csr == CSR_SATP && privilege == Privilege::Supervisor &&
+      (mstatus & MSTATUS_TVM))
+    allowed = false;
+
+  /* Counter access from lower privilege levels is controlled through
+   * mcounteren and scounteren.
+   */
+  if (csr >= CSR_CYCLE && csr <= CSR_HPMCOUNTER31)
+    {
+      RegValue bit = (RegValue)1 << (csr - CSR_CYCLE);
+
+      if (privilege != Privilege::Machine && !(mcounteren & bit))
+        allowed = false;
+      if (privilege == Privilege::User && !(scounteren & bit))
+        allowed = false;
+    }
+
+  if (!allowed)
+    {
+      std::stringstream msg;
+      msg << "Illegal CSR " << (write ? "write to " : "read from ")
+          << std::hex << std::showbase << csr;
+      throw IllegalInstruction(msg.str());
+    }
+}
+
+bool
+CSRFile::readCSR(uint16_t csr, RegValue &value) const
+{
+  switch (csr)
+    {
+      case CSR_MVENDORID:
+      case CSR_MARCHID:
+      case CSR_MIMPID:
+      case CSR_MHARTID:
+        value = 0;
+        return true;
+
+      case CSR_MSTATUS:
+        value = mstatus | MStatusXLen;
+        return true;
+      case CSR_MISA:
+        value = MISAValue;
+        return true;
+      case CSR_MEDELEG:
+        value = medeleg;
+        return true;
+      case CSR_MIDELEG:
+        value = mideleg;
+        return true;
+      case CSR_MIE:
+        value = mie;
+        return true;
+      case CSR_MTVEC:
+        value = mtvec;
+        return true;
+      case CSR_MCOUNTEREN:
+        value = mcounteren;
+        return true;
+      case CSR_MSCRATCH:
+        value = mscratch;
+        return true;
+      case CSR_MEPC:
+        value = mepc;
+        return true;
+      case CSR_MCAUSE:
+        value = mcause;
+        return true;
+      case CSR_MTVAL:
+        value = mtval;
+        return true;
+      case CSR_MIP:
+        value = mip;
+        return true;
+
+      case CSR_SSTATUS:
+        value = (mstatus & SStatusMask) | ((RegValue)2 << 32);
+        return true;
+      case CSR_SIE:
+        value = mie & mideleg;
+        return true;
+      case CSR_STVEC:
+        value = stvec;
+        return true;
+      case CSR_SCOUNTEREN:
+        value = scounteren;
+        return true;
+      case CSR_SSCRATCH:
+        value = sscratch;
+        return true;
+      case CSR_SEPC:
+        value = sepc;
+        return true;
+      case CSR_SCAUSE:
+        value = scause;
+        return true;
+      case CSR_STVAL:
+        value = stval;
+        return true;
+      case CSR_SIP:
+        value = mip & mideleg;
+        return true;
+      case CSR_SATP:
+        value = satp;
+        return true;
+
+      case CSR_TIME:
+        value = timer ? timer->getTime() : 0;
+        return true;
+    }
+
+  if (csr == CSR_CYCLE || csr == CSR_INSTRET ||
+      (csr >= CSR_HPMCOUNTER3 && csr <= CSR_HPMCOUNTER31))
+    value = readCounter(csr - CSR_CYCLE);
+  else if (csr == CSR_MCYCLE || csr == CSR_MINSTRET ||
+           (csr >= CSR_MHPMCOUNTER3 && csr <= CSR_MHPMCOUNTER31))
+    value = readCounter(csr - CSR_MCYCLE);
+  else if (csr >= CSR_MHPMEVENT3 && csr <= CSR_MHPMEVENT31)
+    value = counters[csr - CSR_MCOUNTINHIBIT].event;
+  else if (csr == CSR_MCOUNTINHIBIT)
+    value = countInhibit;
+  else
+    return false;
+
+  return true;
+}
+
+bool
+CSRFile::writeCSR(uint16_t csr, RegValue value)
+{
+  switch (csr)
+    {
+      case CSR_MSTATUS:
+        {
+          /* MPP is WARL, the reserved encoding 2 is ignored. */
+          RegValue mpp = value & MSTATUS_MPP;
+          if (mpp == ((RegValue)2 << MSTATUS_MPP_SHIFT))
+            mpp = mstatus & MSTATUS_MPP;
+
+          mstatus = (value & MStatusWriteMask & ~MSTATUS_MPP) | mpp;
+          interruptCheckAt = 0;
+        }
+        return true;
+      case CSR_MISA:
+        /* Writes are ignored, the ISA cannot be changed. */
+        return true;
+      case CSR_MEDELEG:
+        medeleg = value & MEDELEGWriteMask;
+        return true;
+      case CSR_MIDELEG:
+        mideleg = value & SupervisorInterrupts;
+        interruptCheckAt = 0;
+        return true;
+      case CSR_MIE:
+        mie = value & MIEWriteMask;
+        interruptCheckAt = 0;
+        return true;
+      case CSR_MTVEC:
+        /* Direct (0) and vectored (1) modes are supported. */
+        mtvec = value & ~(RegValue)0x2;
+        return true;
+      case CSR_MCOUNTEREN:
+        mcounteren = value & 0xffffffff;
+        return true;
+      case CSR_MSCRATCH:
+        mscratch = value;
+        return true;
+      case CSR_MEPC:
+        mepc = value & ~(RegValue)0x3;
+        return true;
+      case CSR_MCAUSE:
+        mcause = value;
+        return true;
+      case CSR_MTVAL:
+        mtval = value;
+        return true;
+      case CSR_MIP:
+        /* Machine-level pending bits are driven by devices, M-mode
+         * software may raise supervisor interrupts.
+         */
+        mip = (mip & ~SupervisorInterrupts) | (value & SupervisorInterrupts);
+        interruptCheckAt = 0;
+        return true;
+
+      case CSR_SSTATUS:
+        mstatus = (mstatus & ~SStatusMask) | (value & SStatusMask);
+        interruptCheckAt = 0;
+        return true;
+      case CSR_SIE:
+        mie = (mie & ~mideleg) | (value & mideleg);
+        interruptCheckAt = 0;
+        return true;
+      case CSR_STVEC:
+        stvec = value & ~(RegValue)0x2;
+        return true;
+      case CSR_SCOUNTEREN:
+        scounteren = value & 0xffffffff;
+        return true;
+      case CSR_SSCRATCH:
+        sscratch = value;
+        return true;
+      case CSR_SEPC:
+        sepc = value & ~(RegValue)0x3;
+        return true;
+      case CSR_SCAUSE:
+        scause = value;
+        return true;
+      case CSR_STVAL:
+        stval = value;
+        return true;
+      case CSR_SIP:
+        {
+          /* Only the software interrupt may be raised from S-mode. */
+          RegValue mask = mideleg &
+              interruptMask(Interrupt::SupervisorSoftware);
+          mip = (mip & ~mask) | (value & mask);
+          interruptCheckAt = 0;
+        }
+        return true;
+      case CSR_SATP:
+        {
+          /* Writes selecting an unsupported mode have no effect. */
+          RegValue mode = value >> SATP_MODE_SHIFT;
+          if (mode == SATP_MODE_BARE || mode == SATP_MODE_SV39)
+            satp = value & ((mode << SATP_MODE_SHIFT) |
+                            (SATP_ASID_MASK << SATP_ASID_SHIFT) |
+                            SATP_PPN_MASK);
+        }
+        return true;
+    }
+
+  if (csr == CSR_MCYCLE || csr == CSR_MINSTRET ||
+      (csr >= CSR_MHPMCOUNTER3 && csr <= CSR_MHPMCOUNTER31))
+    writeCounter(csr - CSR_MCYCLE, value);
+  else if (csr >= CSR_MHPMEVENT3 && csr <= CSR_MHPMEVENT31)
+    selectEvent(csr - CSR_MCOUNTINHIBIT, value);
+  else if (csr == CSR_MCOUNTINHIBIT)
+    setCountInhibit(value);
+  else
+    return false;
+
+  return true;
+}
+
+uint64_t
+CSRFile::readCounter(int index) const
+{
+  const Counter &counter = counters[index];
+
+  if (countInhibit & (1u << index))
+    return counter.frozen;
+
+  return *counter.source - counter.offset;
+}
+
+/* The source count from which a counter written or resumed now counts
+ * on. CSR writes take effect after the writing instruction, which only
+ * retires once the write is done; it must not be counted by instret,
+ * so that "csrw minstret,x0; nop; nop; csrr" reads 2.
+ */
+uint64_t
+CSRFile::getCounterBase(int index) const
+{
+  const Counter &counter = counters[index];
+
+  if (index == InstRetIndex)
+    return *counter.source + 1;
+
+  return *counter.source;
+}
+
+void
+CSRFile::writeCounter(int index, uint64_t value)
+{
+  Counter &counter = counters[index];
+
+  counter.frozen = value;
+  counter.offset = getCounterBase(index) - value;
+}
+
+/* Select the event counted by a hardware performance counter. The
+ * current counter value is retained. Unknown events count nothing.
+ */
+void
+CSRFile::selectEvent(int index, RegValue event)
+{
+  uint64_t value = readCounter(index);
+
+  counters[index].event = event;
+  if (event > 0 && event < (RegValue)NumEvents)
+    counters[index].source = eventSources[event];
+  else
+    counters[index].source = &zeroCount;
+
+  writeCounter(index, value);
+}
+
+void
+CSRFile::setCountInhibit(uint32_t value)
+{
+  /* Bit 1 corresponds to time, which cannot be inhibited. */
+  value &= ~(uint32_t)0x2;
+
+  for (int i = 0; i < NumCounters; ++i)
+    {
+      uint32_t mask = 1u << i;
+      if ((value & mask) == (countInhibit & mask))
+        continue;
+
+      if (value & mask)
+        counters[i].frozen = readCounter(i);
+      else
+        counters[i].offset = getCounterBase(i) - counters[i].frozen;
+    }
+
+  countInhibit = value;
+}
@@ -0,0 +1,254 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * csr-file.h - Control and status register file.
+ */
+
+#ifndef __CSR_FILE_H__
+#define __CSR_FILE_H__
+
+#include "arch.h"
+#include "trap.h"
+
+#include <array>
+
+class CLINT;
+class CheckpointWriter;
+class CheckpointReader;
+
+/* CSR numbers as defined by the privileged specification.
+ */
+enum CSRNumber : uint16_t
+{
+  /* Supervisor trap setup */
+  CSR_SSTATUS = 0x100,
+  CSR_SIE = 0x104,
+  CSR_STVEC = 0x105,
+  CSR_SCOUNTEREN = 0x106,
+
+  /* Supervisor trap handling */
+  CSR_SSCRATCH = 0x140,
+  CSR_SEPC = 0x141,
+  CSR_SCAUSE = 0x142,
+  CSR_STVAL = 0x143,
+  CSR_SIP = 0x144,
+
+  /* Supervisor protection and translation */
+  CSR_SATP = 0x180,
+
+  /* Machine information registers, read-only */
+  CSR_MVENDORID = 0xF11,
+  CSR_MARCHID = 0xF12,
+  CSR_MIMPID = 0xF13,
+  CSR_MHARTID = 0xF14,
+
+  /* Machine trap setup */
+  CSR_MSTATUS = 0x300,
+  CSR_MISA = 0x301,
+  CSR_MEDELEG = 0x302,
+  CSR_MIDELEG = 0x303,
+  CSR_MIE = 0x304,
+  CSR_MTVEC = 0x305,
+  CSR_MCOUNTEREN = 0x306,
+
+  /* Machine trap handling */
+  CSR_MSCRATCH = 0x340,
+  CSR_MEPC = 0x341,
+  CSR_MCAUSE = 0x342,
+  CSR_MTVAL = 0x343,
+  CSR_MIP = 0x344,
+
+  /* Unprivileged counters/timers (Zicntr), read-only */
+  CSR_CYCLE = 0xC00,
+  CSR_TIME = 0xC01,
+  CSR_INSTRET = 0xC02,
+  CSR_HPMCOUNTER3 = 0xC03,
+  CSR_HPMCOUNTER31 = 0xC1F,
+
+  /* Machine counter setup */
+  CSR_MCOUNTINHIBIT = 0x320,
+  CSR_MHPMEVENT3 = 0x323,
+  CSR_MHPMEVENT31 = 0x33F,
+
+  /* Machine counters/timers */
+  CSR_MCYCLE = 0xB00,
+  CSR_MINSTRET = 0xB02,
+  CSR_MHPMCOUNTER3 = 0xB03,
+  CSR_MHPMCOUNTER31 = 0xB1F,
+};
+
+/* Events that can be selected through the mhpmevent registers.
+ */
+enum class HPMEvent : int
+{
+  None = 0,
+  Load = 1,
+  Store = 2,
+  BranchTaken = 3,
+  BranchNotTaken = 4,
+  Jump = 5,
+  /* Instructions not found in the decode cache, see decode-cache.h */
+  DecodeCacheMiss = 6,
+  DeviceAccess = 7,
+  NumEvents
+};
+
+/* Fields of mstatus. 
+*/
+static const RegValue MSTATUS_SIE = (RegValue)1 << 1;
+static const RegValue MSTATUS_MIE = (RegValue)1 << 3;
+static const RegValue MSTATUS_SPIE = (RegValue)1 << 5;
+static const RegValue MSTATUS_MPIE = (RegValue)1 << 7;
+static const RegValue MSTATUS_SPP = (RegValue)1 << 8;
+static const RegValue MSTATUS_MPP = (RegValue)3 << 11;
+static const RegValue MSTATUS_MPRV = (RegValue)1 << 17;
+static const RegValue MSTATUS_SUM = (RegValue)1 << 18;
+static const RegValue MSTATUS_MXR = (RegValue)1 << 19;
+static const RegValue MSTATUS_TVM = (RegValue)1 << 20;
+static const RegValue MSTATUS_TW = (RegValue)1 << 21;
+static const RegValue MSTATUS_TSR = (RegValue)1 << 22;
+
+static const unsigned int MSTATUS_MPP_SHIFT = 11;
+
+/* Fields of satp. 
+*/
+static const unsigned int SATP_MODE_SHIFT = 60;
+static const unsigned int SATP_ASID_SHIFT = 44;
+static const RegValue SATP_ASID_MASK = 0xffff;
+static const RegValue SATP_PPN_MASK = ((RegValue)1 << 44) - 1;
+static const RegValue SATP_MODE_BARE = 0;
+static const RegValue SATP_MODE_SV39 = 8;
+
+class CSRFile
+{
+  public:
+    CSRFile();
+
+    /* The cycle and instruction counters are owned by the processor,
+     * events counted elsewhere (e.g. by the memory bus) can be attached
+     * as well. Events that are not attached are counted through
+     * countEvent().
+     */
+    void attachCounters(const uint64_t *instructions,
+                        const uint64_t *cycles);
+    void attachEvent(HPMEvent event, const uint64_t *counter);
+
+    /* The time CSR reads mtime from the CLINT. 
+		*/
+    void attachTimer(const CLINT *timer);
+
+    void countEvent(HPMEvent event)
+    {
+      ++eventCounts[static_cast<int>(event)];
+    }
+
+    uint64_t getEventCount(HPMEvent event) const
+    {
+      return *eventSources[static_cast<int>(event)];
+    }
+
+    /* Access from csr* instructions. Accesses to non-existent CSRs,
+     * accesses from insufficient privilege and writes to read-only
+     * CSRs throw IllegalInstruction.
+     */
+    RegValue read(uint16_t csr) const;
+    void write(uint16_t csr, RegValue value);
+
+    /* State used by address translation. 
+		*/
+    Privilege getPrivilege(void) const { return privilege; }
+    RegValue getStatus(void) const { return mstatus; }
+    RegValue getSatp(void) const { return satp; }
+
+    /* Trap entry and return. enterTrap() returns the address of the
+     * trap handler, which is in S-mode when the trap is delegated.
+     * returnFromTrap() implements mret and sret and returns the address
+     * to resume at.
+     */
+    bool hasTrapHandler(void) const { return mtvec != 0; }
+    MemAddress enterTrap(MemAddress epc, RegValue cause, RegValue tval);
+    MemAddress returnFromTrap(Privilege level);
+
+    /* Interrupts are only checked once the instruction count reaches
+     * the check point, which is lowered whenever the interrupt state
+     * changes or a device schedules a future event.
+     */
+    void setInterruptPending(Interrupt interrupt, bool pending);
+    uint64_t getInterruptCheckPoint(void) const { return interruptCheckAt; }
+    void requestInterruptCheck(uint64_t instructions)
+    {
+      if (instructions < interruptCheckAt)
+        interruptCheckAt = instructions;
+    }
+    void clearInterruptCheck(void);
+
+    /* Returns true and sets cause when an enabled interrupt is pending.
+     */
+    bool getPendingInterrupt(RegValue &cause) const;
+
+    /* Counters are saved by value, so the attached sources must be
+     * restored before restoreState() is called.
+     */
+    void saveState(CheckpointWriter &writer) const;
+    void restoreState(CheckpointReader &reader);
+
+  private:
+    static const int NumCounters = 32;
+
+    /* A counter reports its source minus offset. While inhibited, it
+     * keeps reporting the value it had when it was inhibited.
+     */
+    struct Counter
+    {
+      const uint64_t *source;
+      uint64_t offset;
+      uint64_t frozen;
+      RegValue event;
+    };
+
+    std::array<Counter, NumCounters> counters;
+    static const int NumEvents = static_cast<int>(HPMEvent::NumEvents);
+
+    std::array<uint64_t, NumEvents> eventCounts;
+    std::array<const uint64_t *, NumEvents> eventSources;
+    uint32_t countInhibit;
+
+    const CLINT *timer;
+
+    Privilege privilege;
+
+    RegValue mstatus;
+    RegValue medeleg;
+    RegValue mideleg;
+    RegValue mie;
+    RegValue mip;
+    RegValue mtvec;
+    RegValue mcounteren;
+    RegValue mscratch;
+    RegValue mepc;
+    RegValue mcause;
+    RegValue mtval;
+
+    RegValue stvec;
+    RegValue scounteren;
+    RegValue sscratch;
+    RegValue sepc;
+    RegValue scause;
+    RegValue stval;
+    RegValue satp;
+
+    uint64_t interruptCheckAt;
+
+    /* Private helper methods 
+		*/
+    void checkAccess(uint16_t csr, bool write) const;
+    bool readCSR(uint16_t csr, RegValue &value) const;
+    bool writeCSR(uint16_t csr, RegValue value);
+
+    uint64_t readCounter(int index) const;
+    uint64_t getCounterBase(int index) const;
+    void writeCounter(int index, uint64_t value);
+    void selectEvent(int index, RegValue event);
+    void setCountInhibit(uint32_t value);
+};
+
+#endif /* __CSR_FILE_H__ */
@@ -0,0 +1,268 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * decode-cache.cc - Predecoded instruction cache.
+ */
+
+#include "decode-cache.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char DecodeCacheMagic[8] = { 'R', 'V', '6', '4',
+                                          'D', 'C', 'C', 'H' };
+static const size_t DecodeCachePageSize = 4096;
+
+struct DecodeCacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t entrySize;
+  uint64_t key;
+  uint64_t nRanges;
+  uint64_t checksum;
+};
+
+/* 64-bit FNV-1a */
+static const uint64_t HashBasis = 0xcbf29ce484222325ULL;
+static const uint64_t HashPrime = 0x100000001b3ULL;
+
+static uint64_t
+hashBytes(uint64_t hash, const void *data, size_t size)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+
+  for (size_t i = 0; i < size; ++i)
+    hash = (hash ^ bytes[i]) * HashPrime;
+
+  return hash;
+}
+
+DecodeCache::DecodeCache(const std::vector<ELFSection> &sections)
+  : key(HashBasis), entries(nullptr), nEntries(0),
+    mapAddr(nullptr), mapLength(0), nValid(0), modified(false),
+    nHits(0), nMisses(0)
+{
+  /* The version and entry size are part of the key, a cache written
+   * by another build is not even looked at.
+   */
+  uint32_t format[2] = { DecodeCacheVersion, sizeof(DecodeCacheEntry) };
+  key = hashBytes(key, format, sizeof(format));
+
+  for (const ELFSection &section : sections)
+    {
+      uint64_t bounds[2] = { section.addr, section.size };
+
+      key = hashBytes(key, bounds, sizeof(bounds));
+      key = hashBytes(key, section.data, section.size);
+
+      ranges.push_back(Range{ section.addr, section.size / 4, nEntries });
+      nEntries += section.size / 4;
+    }
+
+  storage.resize(nEntries, DecodeCacheEntry());
+  entries = storage.data();
+}
+
+DecodeCache::~DecodeCache()
+{
+  if (mapAddr)
+    munmap(mapAddr, mapLength);
+}
+
+void
+DecodeCache::insert(MemAddress addr, uint32_t instruction,
+                    const DecodedInstruction &decoded)
+{
+  DecodeCacheEntry *entry = find(addr);
+  if (!entry)
+    return;
+
+  if (!entry->valid)
+    ++nValid;
+
+  entry->instruction = instruction;
+  entry->valid = 1;
+  entry->decoded = decoded;
+  modified = true;
+}
+
+bool
+DecodeCache::load(const std::string &directory)
+{
+  std::string filename = getFilename(directory);
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat statbuf;
+  size_t dataOffset = sizeof(DecodeCacheHeader) + ranges.size() * 16;
+  dataOffset = (dataOffset + DecodeCachePageSize - 1) /
+      DecodeCachePageSize * DecodeCachePageSize;
+  size_t length = dataOffset + nEntries * sizeof(DecodeCacheEntry);
+
+  void *addr = MAP_FAILED;
+  if (fstat(fd, &statbuf) == 0 && (size_t)statbuf.st_size == length)
+    addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  const DecodeCacheHeader *header = (const DecodeCacheHeader *)addr;
+  const uint64_t *bounds = (const uint64_t *)(header + 1);
+  DecodeCacheEntry *data = (DecodeCacheEntry *)((uint8_t *)addr + dataOffset);
+
+  bool valid = addr != MAP_FAILED &&
+      !memcmp(header->magic, DecodeCacheMagic, sizeof(DecodeCacheMagic)) &&
+      header->version == DecodeCacheVersion &&
+      header->entrySize == sizeof(DecodeCacheEntry) &&
+      header->key == key && header->nRanges == ranges.size();
+
+  for (size_t i = 0; valid && i < ranges.size(); ++i)
+    valid = bounds[2 * i] == ranges[i].base &&
+        bounds[2 * i + 1] == ranges[i].count;
+
+  if (valid)
+    valid = header->checksum == getChecksum(data);
+
+  if (!valid)
+    {
+      if (addr != MAP_FAILED)
+        munmap(addr, length);
+
+      std::cerr << "Warning: ignoring invalid decode cache "
+                << filename << std::endl;
+      return false;
+    }
+
+  mapAddr = addr;
+  mapLength = length;
+  entries = data;
+  storage.clear();
+  storage.shrink_to_fit();
+
+  nValid = 0;
+  for (size_t i = 0; i < nEntries; ++i)
+    if (entries[i].valid)
+      ++nValid;
+
+  modified = false;
+  loadedFrom = filename;
+  return true;
+}
+
+void
+DecodeCache::save(const std::string &directory)
+{
+  if (!modified)
+    return;
+
+  if (mkdir(directory.c_str(), 0777) < 0 && errno != EEXIST)
+    throw std::runtime_error("Could not create decode cache directory " +
+                             directory);
+
+  /* Write a temporary file and rename it, so that concurrent runs of
+   * the same program never see a partial cache.
+   */
+  std::string filename = getFilename(directory);
+  std::string temporary = filename + "." + std::to_string(getpid());
+
+  DecodeCacheHeader header;
+  memcpy(header.magic, DecodeCacheMagic, sizeof(DecodeCacheMagic));
+  header.version = DecodeCacheVersion;
+  header.entrySize = sizeof(DecodeCacheEntry);
+  header.key = key;
+  header.nRanges = ranges.size();
+  header.checksum = getChecksum(entries);
+
+  std::ofstream file(temporary, std::ios::binary);
+  file.write((const char *)&header, sizeof(header));
+  for (const Range &range : ranges)
+    {
+      uint64_t bounds[2] = { range.base, range.count };
+      file.write((const char *)bounds, sizeof(bounds));
+    }
+
+  size_t offset = sizeof(header) + ranges.size() * sizeof(uint64_t) * 2;
+  while (offset % DecodeCachePageSize)
+    {
+      file.put(0);
+      ++offset;
+    }
+
+  file.write((const char *)entries, nEntries * sizeof(DecodeCacheEntry));
+  file.close();
+
+  if (!file || rename(temporary.c_str(), filename.c_str()) < 0)
+    {
+      unlink(temporary.c_str());
+      throw std::runtime_error("Could not write decode cache " + filename);
+    }
+
+  modified = false;
+}
+
+void
+DecodeCache::merge(const DecodeCache &other)
+{
+  if (other.key != key)
+    return;
+
+  for (size_t i = 0; i < nEntries; ++i)
+    if (other.entries[i].valid && !entries[i].valid)
+      {
+        entries[i] = other.entries[i];
+        ++nValid;
+        modified = true;
+      }
+}
+
+void
+DecodeCache::dumpStatistics(void) const
+{
+  std::cerr << "Decode cache: " << nHits << " hits, " << nMisses
+            << " misses, " << nValid << " of " << nEntries
+            << " instructions decoded";
+  if (!loadedFrom.empty())
+    std::cerr << " (loaded from " << loadedFrom << ")";
+  std::cerr << std::endl;
+}
+
+
+/*
+ * Private methods
+ */
+
+std::string
+DecodeCache::getFilename(const std::string &directory) const
+{
+  std::ostringstream filename;
+
+  filename << directory << "/" << std::hex << std::setw(16)
+           << std::setfill('0') << key << ".rvdc";
+  return filename.str();
+}
+
+/* Entries are hashed a word at a time, which is fast enough to check
+ * a cache on every load.
+ */
+uint64_t
+DecodeCache::getChecksum(const DecodeCacheEntry *data) const
+{
+  const uint32_t *words = (const uint32_t *)data;
+  size_t nWords = nEntries * sizeof(DecodeCacheEntry) / sizeof(uint32_t);
+  uint64_t hash = HashBasis;
+
+  for (size_t i = 0; i < nWords; ++i)
+    hash = (hash ^ words[i]) * HashPrime;
+
+  return hash;
+}
@@ -0,0 +1,144 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * decode-cache.h - Predecoded instruction cache.
+ */
+
+/* The decode cache holds the decoded form of every instruction in the
+ * code sections of the program that has been executed, indexed by
+ * physical address. An entry also holds the instruction word it was
+ * decoded from and is only used when the fetched word still matches,
+ * so code that is modified or paged in is simply decoded again.
+ *
+ * The cache can be saved to and loaded from a directory, for programs
+ * that are run many times. The file is named after a hash of the
+ * addresses and contents of the code sections:
+ *
+ *   magic       8 bytes  "RV64DCCH"
+ *   version     uint32
+ *   entry size  uint32   sizeof(DecodeCacheEntry)
+ *   key         uint64   hash of the code sections
+ *   ranges      uint64   number of code sections
+ *   checksum    uint64   hash of the entries
+ *   base, count uint64 each, per code section
+ *
+ * followed by the entries of all sections, starting at a page boundary
+ * so they can be mapped copy-on-write instead of being read. Values
+ * are stored in host byte order.
+ */
+
+#ifndef __DECODE_CACHE_H__
+#define __DECODE_CACHE_H__
+
+#include "arch.h"
+#include "elf-file.h"
+#include "inst-decoder.h"
+
+#include <string>
+#include <vector>
+
+static const uint32_t DecodeCacheVersion = 1;
+
+struct DecodeCacheEntry
+{
+  uint32_t instruction;
+  uint32_t valid;
+  DecodedInstruction decoded;
+};
+
+class DecodeCache
+{
+  public:
+    DecodeCache(const std::vector<ELFSection> &sections);
+    ~DecodeCache();
+
+    DecodeCache(const DecodeCache &) = delete;
+    DecodeCache &operator=(const DecodeCache &) = delete;
+
+    /* Returns the decoded instruction at physical address addr when it
+     * was decoded from instruction, nullptr otherwise.
+     */
+    const DecodedInstruction *lookup(MemAddress addr, uint32_t instruction)
+    {
+      DecodeCacheEntry *entry = find(addr);
+
+      if (entry && entry->valid && entry->instruction == instruction)
+        {
+          ++nHits;
+          return &entry->decoded;
+        }
+
+      ++nMisses;
+      return nullptr;
+    }
+
+    /* Addresses outside the code sections are not cached.
+		*/
+    void insert(MemAddress addr, uint32_t instruction,
+                const DecodedInstruction &decoded);
+
+    /* Map the cache saved in directory for the same code, if any.
+     * Returns false when there is none; an invalid file is reported
+     * and ignored.
+     */
+    bool load(const std::string &directory);
+
+    /* Save the cache to directory, which is created if needed. Nothing
+     * is written when nothing was decoded since the cache was loaded or
+     * saved. Throws std::runtime_error when the file cannot be written.
+     */
+    void save(const std::string &directory);
+
+    /* Add the entries of other, a cache of the same code, that are
+     * missing in this one.
+     */
+    void merge(const DecodeCache &other);
+
+    size_t getSize(void) const { return nValid; }
+    const uint64_t *getMissCounter(void) const { return &nMisses; }
+
+    void dumpStatistics(void) const;
+
+  private:
+    struct Range
+    {
+      MemAddress base;
+      uint64_t count;
+      uint64_t first;
+    };
+
+    std::vector<Range> ranges;
+    uint64_t key;
+
+    /* The entries are either owned or mapped from a cache file */
+    std::vector<DecodeCacheEntry> storage;
+    DecodeCacheEntry *entries;
+    size_t nEntries;
+
+    void *mapAddr;
+    size_t mapLength;
+    std::string loadedFrom;
+
+    size_t nValid;
+    bool modified;
+
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    DecodeCacheEntry *find(MemAddress addr)
+    {
+      for (const Range &range : ranges)
+        {
+          MemAddress offset = addr - range.base;
+
+          if (offset < range.count * 4 && offset % 4 == 0)
+            return entries + range.first + offset / 4;
+        }
+
+      return nullptr;
+    }
+
+    std::string getFilename(const std::string &directory) const;
+    uint64_t getChecksum(const DecodeCacheEntry *data) const;
+};
+
+#endif /* __DECODE_CACHE_H__ */
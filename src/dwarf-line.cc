@@ -0,0 +1,475 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * dwarf-line.cc - Address to source line mapping from DWARF .debug_line.
+ */
+
+#include "dwarf-line.h"
+#include "elf-file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+/* Standard and extended opcodes, DWARF 5 section 6.2.5 
+*/
+enum LineOpcode : uint8_t
+{
+  DW_LNS_copy = 1,
+  DW_LNS_advance_pc = 2,
+  DW_LNS_advance_line = 3,
+  DW_LNS_set_file = 4,
+  DW_LNS_const_add_pc = 8,
+  DW_LNS_fixed_advance_pc = 9,
+
+  DW_LNE_end_sequence = 1,
+  DW_LNE_set_address = 2
+};
+
+/* Entry formats of the DWARF 5 directory and file tables 
+*/
+enum LineContent : uint64_t
+{
+  DW_LNCT_path = 1,
+  DW_LNCT_directory_index = 2
+};
+
+enum Form : uint64_t
+{
+  DW_FORM_block2 = 0x03,
+  DW_FORM_block4 = 0x04,
+  DW_FORM_data2 = 0x05,
+  DW_FORM_data4 = 0x06,
+  DW_FORM_data8 = 0x07,
+  DW_FORM_string = 0x08,
+  DW_FORM_block = 0x09,
+  DW_FORM_block1 = 0x0a,
+  DW_FORM_data1 = 0x0b,
+  DW_FORM_sdata = 0x0d,
+  DW_FORM_strp = 0x0e,
+  DW_FORM_udata = 0x0f,
+  DW_FORM_strx = 0x1a,
+  DW_FORM_data16 = 0x1e,
+  DW_FORM_line_strp = 0x1f
+};
+
+/* Bounds-checked little-endian reader. 
+*/
+class DwarfReader
+{
+  public:
+    DwarfReader(const uint8_t *data, uint64_t size)
+      : pos(data), end(data + size)
+    { }
+
+    bool atEnd(void) const { return pos >= end; }
+    const uint8_t *position(void) const { return pos; }
+
+    void skip(uint64_t n)
+    {
+      check(n);
+      pos += n;
+    }
+
+    uint64_t fixed(int n)
+    {
+      uint64_t value = 0;
+
+      check(n);
+      for (int i = 0; i < n; ++i)
+        value |= (uint64_t)*pos++ << (8 * i);
+      return value;
+    }
+
+    uint64_t uleb(void)
+    {
+      uint64_t value = 0;
+
+      for (unsigned int shift = 0; ; shift += 7)
+        {
+          check(1);
+          uint8_t byte = *pos++;
+          if (shift < 64)
+            value |= (uint64_t)(byte & 0x7f) << shift;
+          if ((byte & 0x80) == 0)
+            return value;
+        }
+    }
+
+    int64_t sleb(void)
+    {
+      int64_t value = 0;
+      unsigned int shift = 0;
+      uint8_t byte;
+
+      do
+        {
+          check(1);
+          byte = *pos++;
+          if (shift < 64)
+            value |= (int64_t)(byte & 0x7f) << shift;
+          shift += 7;
+        }
+      while (byte & 0x80);
+
+      if (shift < 64 && (byte & 0x40))
+        value |= -((int64_t)1 << shift);
+      return value;
+    }
+
+    std::string string(void)
+    {
+      const uint8_t *start = pos;
+
+      while (pos < end && *pos)
+        ++pos;
+      check(1);
+      return std::string((const char *)start, pos++ - start);
+    }
+
+    /* A sub-reader for the next n bytes. 
+		*/
+    DwarfReader split(uint64_t n)
+    {
+      check(n);
+      DwarfReader reader(pos, n);
+      pos += n;
+      return reader;
+    }
+
+  private:
+    const uint8_t *pos;
+    const uint8_t *end;
+
+    void check(uint64_t n) const
+    {
+      if (n > (uint64_t)(end - pos))
+        throw std::runtime_error("Malformed .debug_line section.");
+    }
+};
+
+static std::string
+sectionString(const ELFSection &section, uint64_t offset)
+{
+  if (!section.data || offset >= section.size)
+    return std::string();
+
+  const char *start = (const char *)section.data + offset;
+  return std::string(start, strnlen(start, section.size - offset));
+}
+
+static std::string
+joinPath(const std::string &dir, const std::string &name)
+{
+  if (dir.empty() || name.empty() || name[0] == '/')
+    return name;
+  return dir + "/" + name;
+}
+
+/* Context needed to read attribute values in the DWARF 5 tables. 
+*/
+struct FormContext
+{
+  int offsetSize;
+  ELFSection str;
+  ELFSection lineStr;
+};
+
+static void
+readForm(DwarfReader &reader, uint64_t form, const FormContext &context,
+         std::string *string, uint64_t *number)
+{
+  switch (form)
+    {
+      case DW_FORM_string:
+        *string = reader.string();
+        break;
+      case DW_FORM_strp:
+        *string = sectionString(context.str, reader.fixed(context.offsetSize));
+        break;
+      case DW_FORM_line_strp:
+        *string = sectionString(context.lineStr,
+                                reader.fixed(context.offsetSize));
+        break;
+      case DW_FORM_strx:
+        /* Needs .debug_str_offsets and the unit's base, not used by
+         * line tables in practice.
+         */
+        reader.uleb();
+        break;
+      case DW_FORM_data1:
+        *number = reader.fixed(1);
+        break;
+      case DW_FORM_data2:
+        *number = reader.fixed(2);
+        break;
+      case DW_FORM_data4:
+        *number = reader.fixed(4);
+        break;
+      case DW_FORM_data8:
+        *number = reader.fixed(8);
+        break;
+      case DW_FORM_udata:
+        *number = reader.uleb();
+        break;
+      case DW_FORM_sdata:
+        *number = reader.sleb();
+        break;
+      case DW_FORM_data16:
+        reader.skip(16);
+        break;
+      case DW_FORM_block1:
+        reader.skip(reader.fixed(1));
+        break;
+      case DW_FORM_block2:
+        reader.skip(reader.fixed(2));
+        break;
+      case DW_FORM_block4:
+        reader.skip(reader.fixed(4));
+        break;
+      case DW_FORM_block:
+        reader.skip(reader.uleb());
+        break;
+      default:
+        throw std::runtime_error("Unsupported form in .debug_line.");
+    }
+}
+
+/* Reads a DWARF 5 directory or file name table: a list of entry
+ * formats followed by the entries. Returns path and directory index
+ * of each entry.
+ */
+static std::vector<std::pair<std::string, uint64_t>>
+readEntryTable(DwarfReader &reader, const FormContext &context)
+{
+  std::vector<std::pair<uint64_t, uint64_t>> formats(reader.fixed(1));
+  for (auto &format : formats)
+    {
+      format.first = reader.uleb();
+      format.second = reader.uleb();
+    }
+
+  std::vector<std::pair<std::string, uint64_t>> entries(reader.uleb());
+  for (auto &entry : entries)
+    {
+      entry.second = 0;
+      for (auto &format : formats)
+        {
+          std::string string;
+          uint64_t number = 0;
+
+          readForm(reader, format.second, context, &string, &number);
+          if (format.first == DW_LNCT_path)
+            entry.first = string;
+          else if (format.first == DW_LNCT_directory_index)
+            entry.second = number;
+        }
+    }
+
+  return entries;
+}
+
+LineTable::LineTable()
+{
+}
+
+void
+LineTable::load(const ELFFile &program)
+{
+  ELFSection debugLine;
+  FormContext context{ 4, { 0, nullptr, 0 }, { 0, nullptr, 0 } };
+
+  addrs.clear();
+  rows.clear();
+  files.clear();
+
+  if (!program.getSection(".debug_line", debugLine))
+    return;
+  program.getSection(".debug_str", context.str);
+  program.getSection(".debug_line_str", context.lineStr);
+
+  DwarfReader section(debugLine.data, debugLine.size);
+  while (!section.atEnd())
+    {
+      uint64_t unitLength = section.fixed(4);
+      context.offsetSize = 4;
+      if (unitLength == 0xffffffff)
+        {
+          unitLength = section.fixed(8);
+          context.offsetSize = 8;
+        }
+
+      DwarfReader unit = section.split(unitLength);
+      int version = unit.fixed(2);
+      if (version < 2 || version > 5)
+        throw std::runtime_error("Unsupported .debug_line version " +
+                                 std::to_string(version) + ".");
+
+      if (version >= 5)
+        unit.skip(2);           /* address and segment selector size */
+
+      uint64_t headerLength = unit.fixed(context.offsetSize);
+      const uint8_t *program = unit.position() + headerLength;
+
+      unsigned int minInstLength = unit.fixed(1);
+      if (version >= 4)
+        unit.skip(1);           /* maximum operations per instruction */
+      unit.skip(1);             /* default_is_stmt */
+      int8_t lineBase = unit.fixed(1);
+      uint8_t lineRange = unit.fixed(1);
+      uint8_t opcodeBase = unit.fixed(1);
+
+      if (lineRange == 0)
+        throw std::runtime_error("Malformed .debug_line section.");
+
+      std::vector<uint8_t> opcodeLengths(opcodeBase);
+      for (int i = 1; i < opcodeBase; ++i)
+        opcodeLengths[i] = unit.fixed(1);
+
+      /* Translate the file numbers of this unit to indices in files.
+       * File numbers start at 1 before DWARF 5 and at 0 since.
+       */
+      std::vector<uint32_t> unitFiles;
+      if (version >= 5)
+        {
+          auto dirs = readEntryTable(unit, context);
+          for (auto &file : readEntryTable(unit, context))
+            {
+              unitFiles.push_back(files.size());
+              files.push_back(joinPath(file.second < dirs.size() ?
+                                       dirs[file.second].first : "",
+                                       file.first));
+            }
+        }
+      else
+        {
+          std::vector<std::string> dirs(1);
+          for (std::string dir; !(dir = unit.string()).empty(); )
+            dirs.push_back(dir);
+
+          unitFiles.push_back(files.size());
+          files.push_back("");
+          for (std::string name; !(name = unit.string()).empty(); )
+            {
+              uint64_t dir = unit.uleb();
+              unit.uleb();      /* modification time */
+              unit.uleb();      /* length */
+
+              unitFiles.push_back(files.size());
+              files.push_back(joinPath(dir < dirs.size() ? dirs[dir] : "",
+                                       name));
+            }
+        }
+
+      unit.skip(program - unit.position());
+
+      /* The state machine, only the registers that are needed */
+      MemAddress addr = 0;
+      uint64_t file = 1;
+      int64_t line = 1;
+
+      auto emit = [&](bool endSequence)
+      {
+        if (file < unitFiles.size())
+          rows.push_back(LineRow{ addr, unitFiles[file], (uint32_t)line,
+                                  endSequence });
+      };
+
+      auto reset = [&]()
+      {
+        addr = 0;
+        file = 1;
+        line = 1;
+      };
+
+      while (!unit.atEnd())
+        {
+          uint8_t opcode = unit.fixed(1);
+
+          if (opcode >= opcodeBase)
+            {
+              uint8_t adjusted = opcode - opcodeBase;
+
+              addr += (adjusted / lineRange) * minInstLength;
+              line += lineBase + adjusted % lineRange;
+              emit(false);
+              continue;
+            }
+
+          switch (opcode)
+            {
+              case 0:
+                {
+                  uint64_t length = unit.uleb();
+                  DwarfReader extended = unit.split(length);
+                  uint8_t subOpcode = length ? extended.fixed(1) : 0;
+
+                  if (subOpcode == DW_LNE_end_sequence)
+                    {
+                      emit(true);
+                      reset();
+                    }
+                  else if (subOpcode == DW_LNE_set_address)
+                    addr = extended.fixed(std::min<uint64_t>(length - 1, 8));
+                }
+                break;
+
+              case DW_LNS_copy:
+                emit(false);
+                break;
+
+              case DW_LNS_advance_pc:
+                addr += unit.uleb() * minInstLength;
+                break;
+
+              case DW_LNS_advance_line:
+                line += unit.sleb();
+                break;
+
+              case DW_LNS_set_file:
+                file = unit.uleb();
+                break;
+
+              case DW_LNS_const_add_pc:
+                addr += ((255 - opcodeBase) / lineRange) * minInstLength;
+                break;
+
+              case DW_LNS_fixed_advance_pc:
+                addr += unit.fixed(2);
+                break;
+
+              default:
+                /* Skip the operands of opcodes that do not affect the
+                 * address or line.
+                 */
+                for (int i = 0; i < opcodeLengths[opcode]; ++i)
+                  unit.uleb();
+                break;
+            }
+        }
+    }
+
+  /* Rows ending a sequence go first, so that a sequence starting at
+   * the same address takes effect.
+   */
+  std::stable_sort(rows.begin(), rows.end(),
+                   [](const LineRow &a, const LineRow &b)
+                   {
+                     return a.addr < b.addr ||
+                         (a.addr == b.addr && a.endSequence && !b.endSequence);
+                   });
+
+  addrs.reserve(rows.size());
+  for (const LineRow &row : rows)
+    addrs.push_back(row.addr);
+}
+
+const LineRow *
+LineTable::lookup(MemAddress addr) const
+{
+  auto it = std::upper_bound(addrs.begin(), addrs.end(), addr);
+  if (it == addrs.begin())
+    return nullptr;
+
+  const LineRow &row = rows[it - addrs.begin() - 1];
+  return row.endSequence ? nullptr : &row;
+}
@@ -0,0 +1,60 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * dwarf-line.h - Address to source line mapping from DWARF .debug_line.
+ */
+
+#ifndef __DWARF_LINE_H__
+#define __DWARF_LINE_H__
+
+#include "arch.h"
+
+#include <string>
+#include <vector>
+
+class ELFFile;
+
+/* A row of the line number matrix. A row maps all addresses from its
+ * address up to the address of the next row to file and line. Rows
+ * that end a sequence do not map any addresses.
+ */
+struct LineRow
+{
+  MemAddress addr;
+  uint32_t file;
+  uint32_t line;
+  bool endSequence;
+};
+
+/* Runs the line number programs of all compilation units in
+ * .debug_line (DWARF versions 2 to 5) and keeps the resulting rows
+ * sorted by address, with the addresses in a separate array that is
+ * searched by lookup().
+ */
+class LineTable
+{
+  public:
+    LineTable();
+
+    /* Throws std::runtime_error when .debug_line is malformed. A
+     * program without .debug_line results in an empty table.
+     */
+    void load(const ELFFile &program);
+
+    bool empty(void) const { return rows.empty(); }
+
+    /* Returns the row covering addr, or nullptr. 
+		*/
+    const LineRow *lookup(MemAddress addr) const;
+
+    const std::string &getFileName(uint32_t file) const
+    {
+      return files[file];
+    }
+
+  private:
+    std::vector<MemAddress> addrs;
+    std::vector<LineRow> rows;
+    std::vector<std::string> files;
+};
+
+#endif /* __DWARF_LINE_H__ */
@@ -10,6 +10,7 @@
 
 #include "elf-file.h"
 #include "memory.h"
+#include "host-profile.h"
 
 #include "elf.h"
 
@@ -25,6 +26,59 @@
 
 #include <iostream>
 
+/* The file contents of a segment must lie within the file */
+static void
+checkSegment(const Elf64_Phdr &segment, size_t programSize)
+{
+  if (segment.p_filesz > segment.p_memsz ||
+      segment.p_offset > programSize ||
+      segment.p_filesz > programSize - segment.p_offset)
+    throw std::runtime_error("Invalid program header.");
+}
+
+static bool
+isInFile(uint64_t offset, uint64_t size, size_t programSize)
+{
+  return offset <= programSize && size <= programSize - offset;
+}
+
+/* The section headers, or NULL when the table does not lie within the
+ * file. The sections themselves are checked by isSectionInFile.
+ */
+static const Elf64_Shdr *
+getSectionHeaders(const Elf64_Ehdr *elf, size_t programSize)
+{
+  if (elf->e_shoff == 0 || elf->e_shentsize != sizeof(Elf64_Shdr) ||
+      !isInFile(elf->e_shoff, (uint64_t)elf->e_shnum * sizeof(Elf64_Shdr),
+                programSize))
+    return NULL;
+
+  return (const Elf64_Shdr *)((uintptr_t)elf + (uintptr_t)elf->e_shoff);
+}
+
+static bool
+isSectionInFile(const Elf64_Shdr &section, size_t programSize)
+{
+  return section.sh_type != SHT_NOBITS &&
+      isInFile(section.sh_offset, section.sh_size, programSize);
+}
+
+/* The string at offset in string table section strtab, or NULL when it
+ * is not terminated within the section.
+ */
+static const char *
+getString(const Elf64_Ehdr *elf, const Elf64_Shdr &strtab, uint64_t offset)
+{
+  if (offset >= strtab.sh_size)
+    return NULL;
+
+  const char *str = (const char *)elf + strtab.sh_offset + offset;
+  if (!memchr(str, '\0', strtab.sh_size - offset))
+    return NULL;
+
+  return str;
+}
+
 ELFFile::ELFFile(const std::string &filename)
   : isBad(true)
 {
@@ -40,6 +94,8 @@ ELFFile::~ELFFile()
 void
 ELFFile::load(const std::string &filename)
 {
+  HOST_PROFILE_SCOPE(HostPhase::ElfLoad);
+
   fd = open(filename.c_str(), O_RDONLY);
   if (fd < 0)
     throw std::runtime_error("Could not open file.");
@@ -58,6 +114,12 @@ ELFFile::load(const std::string &filename)
     }
 
   programSize = statbuf.st_size;
+  if (programSize < sizeof(Elf64_Ehdr))
+    {
+      close(fd);
+      throw std::runtime_error("File is not a RISC-V ELF file.");
+    }
+
   mapAddr = mmap(NULL, programSize, PROT_READ, MAP_PRIVATE, fd, 0);
   if (mapAddr == MAP_FAILED)
     {
@@ -72,6 +134,15 @@ ELFFile::load(const std::string &filename)
       throw std::runtime_error("File is not a RISC-V ELF file.");
     }
 
+  const Elf64_Ehdr *elf = (Elf64_Ehdr *)mapAddr;
+  if (elf->e_phentsize != sizeof(Elf64_Phdr) ||
+      !isInFile(elf->e_phoff, (uint64_t)elf->e_phnum * sizeof(Elf64_Phdr),
+                programSize))
+    {
+      unload();
+      throw std::runtime_error("Invalid program header table.");
+    }
+
   isBad = false;
 }
 
@@ -81,6 +152,9 @@ ELFFile::unload(void)
   munmap(mapAddr, programSize);
   close(fd);
 
+  symbolTable.reset();
+  lineTable.reset();
+
   mapAddr = NULL;
   fd = 0;
 }
@@ -130,58 +204,193 @@ ELFFile::isTarget(const uint8_t elf_class,
 std::vector<std::shared_ptr<MemoryInterface>>
 ELFFile::createMemories(void)
 {
+  HOST_PROFILE_SCOPE(HostPhase::ElfLoad);
+
   std::vector<std::shared_ptr<MemoryInterface>> memories;
 
   const Elf64_Ehdr *elf = (Elf64_Ehdr *)mapAddr;
-  const Elf64_Shdr *sheader =
-      (Elf64_Shdr *)((uintptr_t)elf + (uintptr_t)elf->e_shoff);
+  const Elf64_Phdr *pheader =
+      (Elf64_Phdr *)((uintptr_t)elf + (uintptr_t)elf->e_phoff);
 
-  for (int i = 0; i < elf->e_shnum; ++i)
+  for (int i = 0; i < elf->e_phnum; ++i)
     {
-      if ((sheader[i].sh_flags & SHF_ALLOC) == SHF_ALLOC)
-        {
-          /* Create the memory area using some low-level C calls, because
-           * we must get the alignment right. Note that posix_memalign
-           * demands the alignment to at least be of sizeof(void *).
-           */
-          uint8_t *segment = NULL;
-
-          uint8_t align = sheader[i].sh_addralign;
-          if (align < sizeof(void *))
-            align = sizeof(void *);
-
-          posix_memalign((void **)&segment, align, sheader[i].sh_size);
-
-          /* Transfer section data or clear the section. */
-          if (sheader[i].sh_type == SHT_PROGBITS)
-            {
-              void *segdata = (void *)(((uintptr_t )elf) + sheader[i].sh_offset);
-              memcpy(segment, segdata, sheader[i].sh_size);
-            }
-          else
-            memset(segment, 0, sheader[i].sh_size);
-
-          /* FIXME: determine correct name for segment. */
-          std::string name("data");
-          if ((sheader[i].sh_flags & SHF_EXECINSTR) == SHF_EXECINSTR)
-            name = "text";
-
-          std::shared_ptr<Memory> memory(new Memory(name, segment,
-                                                    sheader[i].sh_addr,
-                                                    sheader[i].sh_size));
-          if ((sheader[i].sh_flags & SHF_WRITE) == SHF_WRITE)
-            memory->setMayWrite(true);
-
-          memories.push_back(std::move(memory));
-        }
+      if (pheader[i].p_type != PT_LOAD || pheader[i].p_memsz == 0)
+        continue;
+
+      checkSegment(pheader[i], programSize);
+
+      /* Map the segment from the file copy-on-write, the part beyond
+       * the file contents (.bss) is zero-filled on first touch.
+       */
+      std::string name("data");
+      if ((pheader[i].p_flags & PF_X) == PF_X)
+        name = "text";
+
+      std::shared_ptr<Memory> memory =
+          Memory::createFromFile(name, pheader[i].p_vaddr,
+                                 pheader[i].p_memsz, fd,
+                                 pheader[i].p_offset, pheader[i].p_filesz);
+      memory->setMayWrite((pheader[i].p_flags & PF_W) == PF_W);
+
+      memories.push_back(std::move(memory));
     }
 
   return memories;
 }
 
+void
+ELFFile::loadInto(Memory &ram) const
+{
+  HOST_PROFILE_SCOPE(HostPhase::ElfLoad);
+
+  const Elf64_Ehdr *elf = (Elf64_Ehdr *)mapAddr;
+  const Elf64_Phdr *pheader =
+      (Elf64_Phdr *)((uintptr_t)elf + (uintptr_t)elf->e_phoff);
+
+  /* RAM starts out cleared, so only the file contents have to be
+   * copied.
+   */
+  for (int i = 0; i < elf->e_phnum; ++i)
+    {
+      if (pheader[i].p_type != PT_LOAD)
+        continue;
+
+      checkSegment(pheader[i], programSize);
+
+      void *segdata = (void *)(((uintptr_t )elf) + pheader[i].p_offset);
+      ram.load(pheader[i].p_vaddr, segdata, pheader[i].p_filesz);
+    }
+}
+
 uint64_t
 ELFFile::getEntrypoint(void) const
 {
   const Elf64_Ehdr *elf = (Elf64_Ehdr *)mapAddr;
   return elf->e_entry;
 }
+
+std::vector<Symbol>
+ELFFile::getSymbols(void) const
+{
+  HOST_PROFILE_SCOPE(HostPhase::ElfLoad);
+
+  std::vector<Symbol> symbols;
+
+  const Elf64_Ehdr *elf = (Elf64_Ehdr *)mapAddr;
+  const Elf64_Shdr *sheader = getSectionHeaders(elf, programSize);
+  if (!sheader)
+    return symbols;
+
+  /* Symbol tables and names outside the file are skipped */
+  for (int i = 0; i < elf->e_shnum; ++i)
+    {
+      if (sheader[i].sh_type != SHT_SYMTAB || sheader[i].sh_link >= elf->e_shnum ||
+          !isSectionInFile(sheader[i], programSize) ||
+          !isSectionInFile(sheader[sheader[i].sh_link], programSize))
+        continue;
+
+      const Elf64_Sym *sym =
+          (Elf64_Sym *)((uintptr_t)elf + sheader[i].sh_offset);
+      const Elf64_Shdr &strtab = sheader[sheader[i].sh_link];
+      size_t count = sheader[i].sh_size / sizeof(Elf64_Sym);
+
+      for (size_t j = 0; j < count; ++j)
+        {
+          int type = sym[j].st_info & 0xf;
+          uint16_t shndx = sym[j].st_shndx;
+          const char *name = getString(elf, strtab, sym[j].st_name);
+
+          if (type != STT_FUNC && type != STT_NOTYPE)
+            continue;
+
+          /* Only symbols in code, skip local compiler labels. */
+          if (shndx == SHN_UNDEF || shndx >= elf->e_shnum ||
+              (sheader[shndx].sh_flags & SHF_EXECINSTR) == 0 ||
+              !name || name[0] == '\0' || !strncmp(name, ".L", 2))
+            continue;
+
+          symbols.push_back(Symbol{ name, sym[j].st_value, sym[j].st_size });
+        }
+    }
+
+  return symbols;
+}
+
+const SymbolTable &
+ELFFile::getSymbolTable(void) const
+{
+  std::lock_guard<std::mutex> guard(tablesLock);
+
+  if (!symbolTable)
+    symbolTable.reset(new SymbolTable(getSymbols()));
+
+  return *symbolTable;
+}
+
+const LineTable &
+ELFFile::getLineTable(void) const
+{
+  std::lock_guard<std::mutex> guard(tablesLock);
+
+  if (!lineTable)
+    {
+      std::unique_ptr<LineTable> table(new LineTable());
+
+      table->load(*this);
+      lineTable = std::move(table);
+    }
+
+  return *lineTable;
+}
+
+std::vector<ELFSection>
+ELFFile::getCodeSections(void) const
+{
+  std::vector<ELFSection> sections;
+
+  const Elf64_Ehdr *elf = (Elf64_Ehdr *)mapAddr;
+  const Elf64_Shdr *sheader = getSectionHeaders(elf, programSize);
+  if (!sheader)
+    return sections;
+
+  for (int i = 0; i < elf->e_shnum; ++i)
+    if ((sheader[i].sh_flags & (SHF_ALLOC | SHF_EXECINSTR)) ==
+        (SHF_ALLOC | SHF_EXECINSTR) && sheader[i].sh_type == SHT_PROGBITS &&
+        isSectionInFile(sheader[i], programSize))
+      sections.push_back(ELFSection{
+          sheader[i].sh_addr,
+          (const uint8_t *)elf + sheader[i].sh_offset,
+          sheader[i].sh_size });
+
+  return sections;
+}
+
+bool
+ELFFile::getSection(const std::string &name, ELFSection &section) const
+{
+  const Elf64_Ehdr *elf = (Elf64_Ehdr *)mapAddr;
+  const Elf64_Shdr *sheader = getSectionHeaders(elf, programSize);
+
+  if (!sheader || elf->e_shstrndx == SHN_UNDEF ||
+      elf->e_shstrndx >= elf->e_shnum ||
+      !isSectionInFile(sheader[elf->e_shstrndx], programSize))
+    return false;
+
+  const Elf64_Shdr &names = sheader[elf->e_shstrndx];
+
+  for (int i = 0; i < elf->e_shnum; ++i)
+    {
+      const char *sectionName = getString(elf, names, sheader[i].sh_name);
+
+      if (!sectionName || name != sectionName ||
+          !isSectionInFile(sheader[i], programSize))
+        continue;
+
+      section = ELFSection{ sheader[i].sh_addr,
+                            (const uint8_t *)elf + sheader[i].sh_offset,
+                            sheader[i].sh_size };
+      return true;
+    }
+
+  return false;
+}
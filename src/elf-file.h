@@ -11,16 +11,30 @@
 #ifndef __ELF_FILE_H__
 #define __ELF_FILE_H__
 
+#include "dwarf-line.h"
 #include "memory-interface.h"
+#include "symbol-table.h"
+
+class Memory;
+
+/* Contents of a section, valid as long as the ELFFile exists. 
+*/
+struct ELFSection
+{
+  MemAddress addr;
+  const uint8_t *data;
+  uint64_t size;
+};
 
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <string>
 
 /* The ELFFile class loads a program from an ELF file by creating memories
- * for every section that needs to be loaded. During construction of
- * the Processor class, these memories are added to the memory bus
- * of the system.
+ * for every loadable segment (PT_LOAD program header). During
+ * construction of the Processor class, these memories are added to the
+ * memory bus of the system.
  */
 class ELFFile
 {
@@ -32,8 +46,36 @@ class ELFFile
     void unload(void);
 
     std::vector<std::shared_ptr<MemoryInterface>> createMemories(void);
+
+    /* Copy all segments into an existing RAM instead of creating
+     * separate memories, as needed by firmware that uses the memory
+     * around its image freely.
+     */
+    void loadInto(Memory &ram) const;
     uint64_t getEntrypoint(void) const;
 
+    /* Function symbols and code labels from .symtab, empty when the
+     * program has been stripped.
+     */
+    std::vector<Symbol> getSymbols(void) const;
+
+    /* Symbol and line tables for address lookups. Each is built from
+     * the file on first use and shared by all later users, so that
+     * runs that never look up an address do not pay for parsing.
+     * getLineTable() throws std::runtime_error when .debug_line is
+     * malformed.
+     */
+    const SymbolTable &getSymbolTable(void) const;
+    const LineTable &getLineTable(void) const;
+
+    /* Sections containing code, and the section named name (such as
+     * ".debug_line"). getSection() returns false when there is no such
+     * section. Sections, symbols and names that do not lie within the
+     * file are skipped by these and by getSymbols().
+     */
+    std::vector<ELFSection> getCodeSections(void) const;
+    bool getSection(const std::string &name, ELFSection &section) const;
+
   private:
     int fd;
     size_t programSize;
@@ -41,6 +83,10 @@ class ELFFile
 
     bool isBad;
 
+    mutable std::mutex tablesLock;
+    mutable std::unique_ptr<SymbolTable> symbolTable;
+    mutable std::unique_ptr<LineTable> lineTable;
+
     bool isELF(void) const;
     bool isTarget(const uint8_t elf_class,
                   const uint8_t endianness,
@@ -0,0 +1,176 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * fdt.cc - Flattened device tree (DTB) builder.
+ */
+
+#include "fdt.h"
+
+#include <stdexcept>
+
+static const uint32_t FDTMagic = 0xd00dfeed;
+static const uint32_t FDTVersion = 17;
+static const uint32_t FDTLastCompatibleVersion = 16;
+
+static const uint32_t FDTBeginNode = 0x1;
+static const uint32_t FDTEndNode = 0x2;
+static const uint32_t FDTProp = 0x3;
+static const uint32_t FDTEnd = 0x9;
+
+static const size_t FDTHeaderSize = 40;
+static const size_t FDTReserveMapSize = 16;
+
+FDTBuilder::FDTBuilder()
+  : depth(0)
+{
+}
+
+void
+FDTBuilder::beginNode(const std::string &name)
+{
+  appendU32(structure, FDTBeginNode);
+  appendPadded(name.c_str(), name.size() + 1);
+  ++depth;
+}
+
+void
+FDTBuilder::endNode(void)
+{
+  if (depth == 0)
+    throw std::logic_error("Device tree node closed more than once.");
+
+  appendU32(structure, FDTEndNode);
+  --depth;
+}
+
+void
+FDTBuilder::property(const std::string &name)
+{
+  appendProperty(name, nullptr, 0);
+}
+
+void
+FDTBuilder::property(const std::string &name, const std::string &value)
+{
+  appendProperty(name, value.c_str(), value.size() + 1);
+}
+
+void
+FDTBuilder::property(const std::string &name,
+                     const std::vector<std::string> &values)
+{
+  std::string list;
+
+  for (auto &value : values)
+    list.append(value.c_str(), value.size() + 1);
+
+  appendProperty(name, list.data(), list.size());
+}
+
+void
+FDTBuilder::propertyU32(const std::string &name, uint32_t value)
+{
+  propertyCells(name, { value });
+}
+
+void
+FDTBuilder::propertyU64(const std::string &name, uint64_t value)
+{
+  propertyCells(name, { (uint32_t)(value >> 32), (uint32_t)value });
+}
+
+void
+FDTBuilder::propertyCells(const std::string &name,
+                          const std::vector<uint32_t> &cells)
+{
+  std::vector<uint8_t> data;
+
+  for (auto cell : cells)
+    appendU32(data, cell);
+
+  appendProperty(name, data.data(), data.size());
+}
+
+std::vector<uint8_t>
+FDTBuilder::finish(void)
+{
+  if (depth != 0)
+    throw std::logic_error("Device tree has unclosed nodes.");
+
+  appendU32(structure, FDTEnd);
+
+  uint32_t structOffset = FDTHeaderSize + FDTReserveMapSize;
+  uint32_t stringsOffset = structOffset + structure.size();
+  uint32_t totalSize = stringsOffset + strings.size();
+
+  std::vector<uint8_t> blob;
+  appendU32(blob, FDTMagic);
+  appendU32(blob, totalSize);
+  appendU32(blob, structOffset);
+  appendU32(blob, stringsOffset);
+  appendU32(blob, FDTHeaderSize);
+  appendU32(blob, FDTVersion);
+  appendU32(blob, FDTLastCompatibleVersion);
+  appendU32(blob, 0);                   /* boot_cpuid_phys */
+  appendU32(blob, strings.size());
+  appendU32(blob, structure.size());
+
+  /* Empty memory reservation map */
+  blob.resize(blob.size() + FDTReserveMapSize, 0);
+
+  blob.insert(blob.end(), structure.begin(), structure.end());
+  blob.insert(blob.end(), strings.begin(), strings.end());
+
+  return blob;
+}
+
+
+/*
+ * Private methods
+ */
+void
+FDTBuilder::appendU32(std::vector<uint8_t> &buffer, uint32_t value)
+{
+  buffer.push_back(value >> 24);
+  buffer.push_back(value >> 16);
+  buffer.push_back(value >> 8);
+  buffer.push_back(value);
+}
+
+void
+FDTBuilder::appendPadded(const void *data, size_t size)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+  structure.insert(structure.end(), bytes, bytes + size);
+  while (structure.size() % 4)
+    structure.push_back(0);
+}
+
+void
+FDTBuilder::appendProperty(const std::string &name,
+                           const void *data, size_t size)
+{
+  if (depth == 0)
+    throw std::logic_error("Device tree property outside of node.");
+
+  appendU32(structure, FDTProp);
+  appendU32(structure, size);
+  appendU32(structure, getStringOffset(name));
+  if (size > 0)
+    appendPadded(data, size);
+}
+
+uint32_t
+FDTBuilder::getStringOffset(const std::string &name)
+{
+  auto it = stringOffsets.find(name);
+  if (it != stringOffsets.end())
+    return it->second;
+
+  uint32_t offset = strings.size();
+  strings.insert(strings.end(), name.begin(), name.end());
+  strings.push_back(0);
+  stringOffsets[name] = offset;
+
+  return offset;
+}
@@ -0,0 +1,51 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * fdt.h - Flattened device tree (DTB) builder.
+ */
+
+#ifndef __FDT_H__
+#define __FDT_H__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Builds a flattened device tree blob (version 17). Nodes are opened
+ * and closed in order, properties are added to the most recently
+ * opened node. All values are stored big-endian as required.
+ */
+class FDTBuilder
+{
+  public:
+    FDTBuilder();
+
+    void beginNode(const std::string &name);
+    void endNode(void);
+
+    void property(const std::string &name);
+    void property(const std::string &name, const std::string &value);
+    void property(const std::string &name,
+                  const std::vector<std::string> &values);
+    void propertyU32(const std::string &name, uint32_t value);
+    void propertyU64(const std::string &name, uint64_t value);
+    void propertyCells(const std::string &name,
+                       const std::vector<uint32_t> &cells);
+
+    /* Finish the tree and return the blob. */
+    std::vector<uint8_t> finish(void);
+
+  private:
+    std::vector<uint8_t> structure;
+    std::vector<uint8_t> strings;
+    std::map<std::string, uint32_t> stringOffsets;
+    int depth;
+
+    void appendU32(std::vector<uint8_t> &buffer, uint32_t value);
+    void appendPadded(const void *data, size_t size);
+    void appendProperty(const std::string &name,
+                        const void *data, size_t size);
+    uint32_t getStringOffset(const std::string &name);
+};
+
+#endif /* __FDT_H__ */
@@ -0,0 +1,116 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * flame-graph.cc - Shadow call stack and sampled folded stacks.
+ */
+
+#include "flame-graph.h"
+
+#include <algorithm>
+#include <string>
+
+FlameGraph::FlameGraph(MemAddress entry, uint64_t interval)
+  : interval(interval), nextSample(interval), lastCounter(0)
+{
+  nodes.push_back(Node{ entry, 0, 0, {} });
+  stack.push_back(Frame{ 0, 0, false });
+}
+
+void
+FlameGraph::call(MemAddress target, MemAddress returnAddress)
+{
+  push(target, returnAddress, false);
+}
+
+void
+FlameGraph::trap(MemAddress handler, MemAddress epc)
+{
+  push(handler, epc, true);
+}
+
+void
+FlameGraph::ret(MemAddress target)
+{
+  /* Trap handlers return to the trapping instruction, or to the one
+   * after it for ecall and ebreak. The root frame is never popped.
+   */
+  for (size_t i = stack.size() - 1; i > 0; --i)
+    {
+      const Frame &frame = stack[i];
+
+      if (target == frame.returnAddress ||
+          (frame.trap && target == frame.returnAddress + 4))
+        {
+          stack.resize(i);
+          return;
+        }
+    }
+}
+
+void
+FlameGraph::sample(uint64_t instructions, uint64_t counter)
+{
+  nodes[stack.back().node].weight += counter - lastCounter;
+  lastCounter = counter;
+  nextSample = instructions + interval;
+}
+
+void
+FlameGraph::write(std::ostream &os, const SymbolTable &symbols) const
+{
+  std::vector<std::string> names;
+
+  names.reserve(nodes.size());
+  for (auto &node : nodes)
+    names.push_back(symbols.format(node.function));
+
+  for (size_t i = 0; i < nodes.size(); ++i)
+    {
+      if (nodes[i].weight == 0)
+        continue;
+
+      std::vector<size_t> path;
+      for (size_t n = i; n != 0; n = nodes[n].parent)
+        path.push_back(n);
+      path.push_back(0);
+
+      std::string folded;
+      for (auto it = path.rbegin(); it != path.rend(); ++it)
+        {
+          if (!folded.empty())
+            folded += ';';
+          folded += names[*it];
+        }
+
+      os << folded << " " << nodes[i].weight << std::endl;
+    }
+}
+
+
+/*
+ * Private methods
+ */
+void
+FlameGraph::push(MemAddress function, MemAddress returnAddress, bool trap)
+{
+  size_t parent = stack.back().node;
+
+  if (stack.size() >= MaxDepth)
+    {
+      stack.push_back(Frame{ parent, returnAddress, trap });
+      return;
+    }
+
+  auto it = nodes[parent].children.find(function);
+  size_t node;
+
+  if (it != nodes[parent].children.end())
+    node = it->second;
+  else
+    {
+      node = nodes.size();
+      nodes[parent].children[function] = node;
+      nodes.push_back(Node{ function, parent, 0, {} });
+    }
+
+  stack.push_back(Frame{ node, returnAddress, trap });
+}
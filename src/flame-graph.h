@@ -0,0 +1,82 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * flame-graph.h - Shadow call stack and sampled folded stacks.
+ */
+
+#ifndef __FLAME_GRAPH_H__
+#define __FLAME_GRAPH_H__
+
+#include "arch.h"
+#include "symbol-table.h"
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+/* Unit of the weight assigned to a sampled stack */
+enum class SampleWeight
+{
+  Instructions,
+  Cycles
+};
+
+/* Maintains a shadow call stack from the calls, returns and traps
+ * observed by the processor and samples it at regular intervals.
+ * Stacks are stored as a call tree, so that a call, return or sample
+ * costs a constant amount of work. The samples are written in the
+ * folded format ("main;f;g 1234") read by flamegraph.pl and speedscope.
+ */
+class FlameGraph
+{
+  public:
+    FlameGraph(MemAddress entry, uint64_t interval);
+
+    /* Control transfers. A return pops the frames up to the one
+     * returning to target, returns that do not match a frame (such
+     * as longjmp) leave the stack as is.
+     */
+    void call(MemAddress target, MemAddress returnAddress);
+    void trap(MemAddress handler, MemAddress epc);
+    void ret(MemAddress target);
+
+    /* Sample when the instruction count reaches getNextSample(). The
+     * weight of the sample is the increase of counter since the
+     * previous sample.
+     */
+    uint64_t getNextSample(void) const { return nextSample; }
+    void sample(uint64_t instructions, uint64_t counter);
+
+    void write(std::ostream &os, const SymbolTable &symbols) const;
+
+  private:
+    /* Deeper calls are accounted to the deepest node, which keeps the
+     * tree bounded for runaway recursion.
+     */
+    static const size_t MaxDepth = 1024;
+
+    struct Node
+    {
+      MemAddress function;
+      size_t parent;
+      uint64_t weight;
+      std::map<MemAddress, size_t> children;
+    };
+
+    struct Frame
+    {
+      size_t node;
+      MemAddress returnAddress;
+      bool trap;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Frame> stack;
+
+    const uint64_t interval;
+    uint64_t nextSample;
+    uint64_t lastCounter;
+
+    void push(MemAddress function, MemAddress returnAddress, bool trap);
+};
+
+#endif /* __FLAME_GRAPH_H__ */
@@ -0,0 +1,108 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * fork-snapshot.cc - Run program variants from a forked snapshot.
+ */
+
+#include "fork-snapshot.h"
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Sent from the child to the parent through a pipe */
+struct ChildResult
+{
+  bool completed;
+  uint64_t exitCode;
+  uint64_t instructions;
+  std::chrono::steady_clock::time_point started;
+};
+
+ForkSnapshot::ForkSnapshot(Processor &processor)
+  : processor(processor)
+{
+}
+
+VariantResult
+ForkSnapshot::run(const std::function<void(Processor &)> &setup)
+{
+  int fds[2];
+  if (pipe(fds) < 0)
+    throw std::runtime_error("Could not create pipe for variant.");
+
+  /* Buffered output would otherwise be written by the child as well */
+  std::cout.flush();
+  std::cerr.flush();
+
+  auto forked = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0)
+    {
+      close(fds[0]);
+      close(fds[1]);
+      throw std::runtime_error("Could not fork variant.");
+    }
+
+  if (pid == 0)
+    {
+      ChildResult result;
+
+      close(fds[0]);
+      result.started = std::chrono::steady_clock::now();
+
+      uint64_t start = processor.getInstructionCount();
+      try
+        {
+          setup(processor);
+          result.completed = processor.run();
+        }
+      catch (std::exception &e)
+        {
+          std::cerr << "Variant failed: " << e.what() << std::endl;
+          result.completed = false;
+        }
+      result.exitCode = processor.getExitCode();
+      result.instructions = processor.getInstructionCount() - start;
+
+      std::cout.flush();
+      std::cerr.flush();
+      ssize_t written = write(fds[1], &result, sizeof(result));
+
+      /* Skip destructors and atexit handlers, they belong to the
+       * parent's snapshot.
+       */
+      _exit(written == sizeof(result) ? 0 : 1);
+    }
+
+  close(fds[1]);
+
+  ChildResult result;
+  ssize_t received;
+  do
+    received = read(fds[0], &result, sizeof(result));
+  while (received < 0 && errno == EINTR);
+  close(fds[0]);
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    ;
+
+  auto finished = std::chrono::steady_clock::now();
+
+  if (received != sizeof(result))
+    return VariantResult{ false, 0, 0, 0.0,
+                          std::chrono::duration<double>(finished - forked)
+                          .count() };
+
+  return VariantResult{ result.completed, result.exitCode,
+                        result.instructions,
+                        std::chrono::duration<double>(result.started - forked)
+                        .count(),
+                        std::chrono::duration<double>(finished - forked)
+                        .count() };
+}
@@ -0,0 +1,47 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * fork-snapshot.h - Run program variants from a forked snapshot.
+ */
+
+#ifndef __FORK_SNAPSHOT_H__
+#define __FORK_SNAPSHOT_H__
+
+#include "processor.h"
+
+#include <functional>
+
+struct VariantResult
+{
+  bool completed;
+  uint64_t exitCode;
+  uint64_t instructions;
+
+  /* Host time from the fork until the variant started executing, and
+   * until it finished.
+   */
+  double startSeconds;
+  double totalSeconds;
+};
+
+/* The snapshot is the state of the processor in this process. Every
+ * variant runs in a child forked from it, so it starts from a
+ * copy-on-write copy of guest memory and all other emulator state, and
+ * the snapshot itself is never modified. Only the pages a variant
+ * writes to are copied.
+ */
+class ForkSnapshot
+{
+  public:
+    ForkSnapshot(Processor &processor);
+
+    /* Run a variant to completion. setup is called in the child before
+     * the processor continues, e.g. to initialize registers. The child
+     * writes no reports or statistics, only the guest output appears.
+     */
+    VariantResult run(const std::function<void(Processor &)> &setup);
+
+  private:
+    Processor &processor;
+};
+
+#endif /* __FORK_SNAPSHOT_H__ */
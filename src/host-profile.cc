@@ -0,0 +1,80 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * host-profile.cc - Host time spent per emulator phase.
+ */
+
+#include "host-profile.h"
+
+#ifdef ENABLE_HOST_PROFILE
+
+#include <iomanip>
+
+std::atomic<uint64_t> HostProfile::totals[HostProfile::NumPhases];
+std::atomic<uint64_t> HostProfile::counts[HostProfile::NumPhases];
+
+thread_local HostProfileTimer *HostProfileTimer::current = nullptr;
+
+static const char *phaseNames[] =
+{
+  "ELF loading",
+  "fetch",
+  "decode",
+  "execute",
+  "memory access",
+  "MMIO devices",
+  "trace output",
+  "other"
+};
+
+static_assert(sizeof(phaseNames) / sizeof(phaseNames[0]) ==
+              static_cast<int>(HostPhase::NumPhases),
+              "phaseNames must name every HostPhase");
+
+void
+HostProfile::dumpReport(std::ostream &os)
+{
+  uint64_t phaseTotals[NumPhases], phaseCounts[NumPhases];
+  uint64_t total = 0;
+
+  for (int i = 0; i < NumPhases; ++i)
+    {
+      phaseTotals[i] = totals[i].load(std::memory_order_relaxed);
+      phaseCounts[i] = counts[i].load(std::memory_order_relaxed);
+      total += phaseTotals[i];
+    }
+
+  if (total == 0)
+    return;
+
+  auto storeFlags(os.flags());
+  auto storeFill(os.fill(' '));
+
+  os << std::endl << "Host time per emulator phase:" << std::endl;
+  os << std::left << std::setw(16) << "phase" << std::right
+     << std::setw(12) << "seconds" << std::setw(9) << "%"
+     << std::setw(14) << "scopes" << std::setw(14) << "ns/scope"
+     << std::endl;
+
+  for (int i = 0; i < NumPhases; ++i)
+    {
+      if (phaseCounts[i] == 0)
+        continue;
+
+      os << std::left << std::setw(16) << phaseNames[i] << std::right
+         << std::fixed
+         << std::setw(12) << std::setprecision(4) << phaseTotals[i] / 1e9
+         << std::setw(8) << std::setprecision(1)
+         << 100.0 * phaseTotals[i] / total << "%"
+         << std::setw(14) << phaseCounts[i]
+         << std::setw(14) << std::setprecision(1)
+         << (double)phaseTotals[i] / phaseCounts[i] << std::endl;
+    }
+
+  os << std::left << std::setw(16) << "total" << std::right << std::fixed
+     << std::setw(12) << std::setprecision(4) << total / 1e9 << std::endl;
+
+  os.flags(storeFlags);
+  os.fill(storeFill);
+}
+
+#endif /* ENABLE_HOST_PROFILE */
@@ -0,0 +1,117 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * host-profile.h - Host time spent per emulator phase.
+ */
+
+#ifndef __HOST_PROFILE_H__
+#define __HOST_PROFILE_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+/* Phases of the emulator that host time is attributed to. Other covers
+ * the rest of the run loop: block accounting, interrupts and traps.
+ */
+enum class HostPhase : int
+{
+  ElfLoad = 0,
+  Fetch,
+  Decode,
+  Execute,
+  Memory,
+  Device,
+  Trace,
+  Other,
+  NumPhases
+};
+
+/* Scoped timers only exist when built with ENABLE_HOST_PROFILE
+ * ("make HOST_PROFILE=1"), otherwise HOST_PROFILE_SCOPE expands to
+ * nothing and the run loop is not affected at all.
+ *
+ * Timers nest: time spent in an inner scope is subtracted from the
+ * scope around it, so every phase reports its exclusive time. E.g. a
+ * store to a device counts as Device time, not as Memory time.
+ *
+ * Every thread has its own nesting of timers; the totals are shared
+ * and cover the processors of all threads, such as the job server's
+ * workers.
+ */
+#ifdef ENABLE_HOST_PROFILE
+
+class HostProfile
+{
+  public:
+    static void add(HostPhase phase, uint64_t nanoseconds)
+    {
+      int index = static_cast<int>(phase);
+
+      totals[index].fetch_add(nanoseconds, std::memory_order_relaxed);
+      counts[index].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void dumpReport(std::ostream &os);
+
+  private:
+    static const int NumPhases = static_cast<int>(HostPhase::NumPhases);
+
+    static std::atomic<uint64_t> totals[NumPhases];
+    static std::atomic<uint64_t> counts[NumPhases];
+};
+
+class HostProfileTimer
+{
+  public:
+    HostProfileTimer(HostPhase phase, bool enabled = true)
+      : phase(phase), enabled(enabled), childNanoseconds(0), parent(current)
+    {
+      if (enabled)
+        {
+          current = this;
+          start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~HostProfileTimer()
+    {
+      if (! enabled)
+        return;
+
+      uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>
+          (std::chrono::steady_clock::now() - start).count();
+
+      HostProfile::add(phase, elapsed - childNanoseconds);
+      if (parent)
+        parent->childNanoseconds += elapsed;
+      current = parent;
+    }
+
+    HostProfileTimer(const HostProfileTimer &) = delete;
+    HostProfileTimer &operator=(const HostProfileTimer &) = delete;
+
+  private:
+    HostPhase phase;
+    bool enabled;
+    uint64_t childNanoseconds;
+    HostProfileTimer *parent;
+    std::chrono::steady_clock::time_point start;
+
+    /* Innermost timer of the calling thread */
+    static thread_local HostProfileTimer *current;
+};
+
+#define HOST_PROFILE_SCOPE(phase) \
+  HostProfileTimer hostProfileTimer_(phase)
+#define HOST_PROFILE_SCOPE_IF(condition, phase) \
+  HostProfileTimer hostProfileTimer_(phase, condition)
+
+#else
+
+#define HOST_PROFILE_SCOPE(phase) do { } while (0)
+#define HOST_PROFILE_SCOPE_IF(condition, phase) do { } while (0)
+
+#endif /* ENABLE_HOST_PROFILE */
+
+#endif /* __HOST_PROFILE_H__ */
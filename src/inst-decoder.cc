@@ -63,6 +63,26 @@ InstructionDecoder::decodeInstruction(const uint32_t instruction)
     }
   }
 
+  /////////////
+  // SYSTEM  //
+  /////////////
+  /* The immediate holds the CSR number (or funct12 for the
+   * privileged instructions) and is never sign-extended.
+   */
+  if(decoded.opcode == 0x73)
+  {
+    for(int i = 7; i <= 11; i++)
+      map[0].set(i-7,bin[i]);
+    for(int i = 12; i <= 14; i++)
+      f3.set(i-12,bin[i]);
+    for(int i = 15; i <= 19; i++)
+      map[1].set(i-15,bin[i]);
+    for(int i = 20; i <= 24; i++)
+      map[2].set(i-20,bin[i]);
+    for(int i = 20; i <= 31; i++)
+      imm.set(i-20,bin[i]);
+  }
+
   ////////////
   // S-TYPE //
   ////////////
@@ -94,7 +114,10 @@ InstructionDecoder::decodeInstruction(const uint32_t instruction)
   ////////////
   // R-TYPE //
   ////////////
-  if(decoded.opcode == 0x33 || decoded.opcode == 0x3b)
+  /* The atomics use this format as well: funct5 selects the operation,
+   * funct2 holds the aq and rl bits.
+   */
+  if(decoded.opcode == 0x33 || decoded.opcode == 0x3b || decoded.opcode == 0x2f)
   {
     for(int i = 7; i <= 11; i++)
       map[0].set(i-7,bin[i]);
@@ -141,12 +164,14 @@ InstructionDecoder::decodeInstruction(const uint32_t instruction)
       temp >>= 1;
       imm = std::bitset<20>(temp.to_ulong()+1);
     }
+    else
+      imm >>= 1;
   }
 
   ////////////
   // U-TYPE //
   ////////////
-  if(decoded.opcode == 0x37)
+  if(decoded.opcode == 0x37 || decoded.opcode == 0x17)
   {
     for(int i = 7; i <= 11; i++)
       map[0].set(i-7,bin[i]);
@@ -26,6 +26,14 @@ class IllegalInstruction : public std::runtime_error
     { }
 };
 
+/* Control transfer and system instructions end a basic block.
+ */
+static inline bool
+isBlockEnd(int opcode)
+{
+  return opcode == 0x63 || opcode == 0x67 || opcode == 0x6f || opcode == 0x73;
+}
+
 /* Structure to keep together all data for a single decoded instruction.
  */
 struct DecodedInstruction
@@ -0,0 +1,341 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * inst-mix.cc - Instruction mix statistics.
+ */
+
+#include "inst-mix.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct InstructionMix::Summary
+{
+  uint64_t total;
+  std::map<std::string, uint64_t> mnemonics;
+  std::vector<std::pair<std::string, uint64_t>> formats;
+  std::vector<std::pair<std::string, uint64_t>> classes;
+};
+
+static int
+getOpcode(int key)
+{
+  return key & 0x7f;
+}
+
+static int
+getFunct3(int key)
+{
+  return (key >> 7) & 0x7;
+}
+
+static bool
+getAlternate(int key)
+{
+  return (key >> 10) & 0x1;
+}
+
+static bool
+getMulDiv(int key)
+{
+  return (key >> 11) & 0x1;
+}
+
+static std::string
+getMnemonic(int key)
+{
+  static const char *op[] =
+    { "add", "sll", "slt", "sltu", "xor", "srl", "or", "and" };
+  static const char *muldiv[] =
+    { "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu" };
+  static const char *muldivw[] =
+    { "mulw", nullptr, nullptr, nullptr, "divw", "divuw", "remw", "remuw" };
+  static const char *opimm[] =
+    { "addi", "slli", "slti", "sltiu", "xori", "srli", "ori", "andi" };
+  static const char *load[] =
+    { "lb", "lh", "lw", "ld", "lbu", "lhu", "lwu", nullptr };
+  static const char *store[] =
+    { "sb", "sh", "sw", "sd", nullptr, nullptr, nullptr, nullptr };
+  static const char *branch[] =
+    { "beq", "bne", nullptr, nullptr, "blt", "bge", "bltu", "bgeu" };
+  static const char *system[] =
+    { "priv", "csrrw", "csrrs", "csrrc",
+      nullptr, "csrrwi", "csrrsi", "csrrci" };
+
+  int funct3 = getFunct3(key);
+  bool alternate = getAlternate(key);
+  const char *name = nullptr;
+
+  switch (getOpcode(key))
+    {
+      case 0x33:
+        name = op[funct3];
+        if (getMulDiv(key))
+          name = muldiv[funct3];
+        else if (alternate && funct3 == 0)
+          name = "sub";
+        else if (alternate && funct3 == 5)
+          name = "sra";
+        break;
+
+      case 0x3b:
+        if (getMulDiv(key))
+          name = muldivw[funct3];
+        else if (funct3 == 0)
+          name = alternate ? "subw" : "addw";
+        else if (funct3 == 1)
+          name = "sllw";
+        else if (funct3 == 5)
+          name = alternate ? "sraw" : "srlw";
+        break;
+
+      case 0x13:
+        name = (alternate && funct3 == 5) ? "srai" : opimm[funct3];
+        break;
+
+      case 0x1b:
+        if (funct3 == 0)
+          name = "addiw";
+        else if (funct3 == 1)
+          name = "slliw";
+        else if (funct3 == 5)
+          name = alternate ? "sraiw" : "srliw";
+        break;
+
+      case 0x03:
+        name = load[funct3];
+        break;
+
+      case 0x23:
+        name = store[funct3];
+        break;
+
+      case 0x63:
+        name = branch[funct3];
+        break;
+
+      case 0x37:
+        name = "lui";
+        break;
+
+      case 0x17:
+        name = "auipc";
+        break;
+
+      case 0x6f:
+        name = "jal";
+        break;
+
+      case 0x67:
+        name = "jalr";
+        break;
+
+      case 0x73:
+        name = system[funct3];
+        break;
+
+      /* The key does not hold funct5, so the atomics are only split
+       * by size.
+       */
+      case 0x2f:
+        if (funct3 == 2)
+          name = "amo.w";
+        else if (funct3 == 3)
+          name = "amo.d";
+        break;
+
+      case 0x0f:
+        if (funct3 == 0)
+          name = "fence";
+        else if (funct3 == 1)
+          name = "fence.i";
+        break;
+    }
+
+  if (name)
+    return name;
+
+  std::stringstream ss;
+  ss << "opcode 0x" << std::hex << getOpcode(key)
+     << " funct3 " << std::dec << funct3;
+  return ss.str();
+}
+
+/* Instruction format as classified by the decoder. 
+*/
+static const char *
+getFormat(int key)
+{
+  switch (getOpcode(key))
+    {
+      case 0x33:
+      case 0x3b:
+      case 0x2f:
+        return "R";
+      case 0x13:
+      case 0x1b:
+      case 0x03:
+      case 0x67:
+      case 0x73:
+      case 0x0f:
+        return "I";
+      case 0x23:
+        return "S";
+      case 0x63:
+        return "SB";
+      case 0x37:
+      case 0x17:
+        return "U";
+      case 0x6f:
+        return "UJ";
+      default:
+        return "other";
+    }
+}
+
+InstructionMix::InstructionMix()
+{
+  counts.fill(0);
+}
+
+InstructionMix::Summary
+InstructionMix::summarize(const ExecutionEvents &events) const
+{
+  Summary summary;
+  std::map<std::string, uint64_t> formats;
+  uint64_t alu = 0, load = 0, store = 0, atomic = 0, jump = 0, system = 0;
+  uint64_t other = 0;
+
+  summary.total = 0;
+  for (int key = 0; key < NumKeys; ++key)
+    {
+      if (counts[key] == 0)
+        continue;
+
+      summary.total += counts[key];
+      summary.mnemonics[getMnemonic(key)] += counts[key];
+      formats[getFormat(key)] += counts[key];
+
+      switch (getOpcode(key))
+        {
+          case 0x33: case 0x3b: case 0x13: case 0x1b: case 0x37: case 0x17:
+            alu += counts[key];
+            break;
+          case 0x03:
+            load += counts[key];
+            break;
+          case 0x23:
+            store += counts[key];
+            break;
+          case 0x2f:
+            atomic += counts[key];
+            break;
+          case 0x63:
+            /* Split using the taken/not-taken events */
+            break;
+          case 0x6f: case 0x67:
+            jump += counts[key];
+            break;
+          case 0x73:
+            system += counts[key];
+            break;
+          default:
+            other += counts[key];
+            break;
+        }
+    }
+
+  for (const char *format : { "R", "I", "S", "SB", "U", "UJ", "other" })
+    if (formats.count(format))
+      summary.formats.push_back({ format, formats[format] });
+
+  summary.classes = {
+    { "alu", alu },
+    { "load", load },
+    { "store", store },
+    { "branch_taken", events.branchesTaken },
+    { "branch_not_taken", events.branchesNotTaken },
+    { "jump", jump },
+    { "system", system },
+    { "mmio", events.deviceAccesses },
+  };
+  if (atomic)
+    summary.classes.push_back({ "atomic", atomic });
+  if (other)
+    summary.classes.push_back({ "other", other });
+
+  return summary;
+}
+
+static void
+printRows(std::ostream &os, const std::string &title,
+          std::vector<std::pair<std::string, uint64_t>> rows, uint64_t total)
+{
+  os << std::endl << title << ":" << std::endl;
+  for (auto &row : rows)
+    os << "  " << std::left << std::setw(18) << row.first << std::right
+       << std::setw(14) << row.second << "  " << std::setw(6)
+       << std::fixed << std::setprecision(2)
+       << (total ? 100.0 * row.second / total : 0.0) << "%" << std::endl;
+}
+
+void
+InstructionMix::dumpTable(std::ostream &os,
+                          const ExecutionEvents &events) const
+{
+  Summary summary = summarize(events);
+  auto storeFlags(os.flags());
+  auto storeFill(os.fill());
+
+  os << std::dec << std::noshowbase << std::setfill(' ');
+
+  /* Mnemonics are listed from most to least frequent */
+  std::vector<std::pair<std::string, uint64_t>>
+      mnemonics(summary.mnemonics.begin(), summary.mnemonics.end());
+  std::stable_sort(mnemonics.begin(), mnemonics.end(),
+                   [](const std::pair<std::string, uint64_t> &a,
+                      const std::pair<std::string, uint64_t> &b)
+                   { return a.second > b.second; });
+
+  printRows(os, "Instruction mix by mnemonic", mnemonics, summary.total);
+  printRows(os, "Instruction mix by format", summary.formats, summary.total);
+  printRows(os, "Instruction mix by class (mmio is part of load/store)",
+            summary.classes, summary.total);
+
+  os.flags(storeFlags);
+  os.fill(storeFill);
+}
+
+static void
+writeObject(std::ostream &os, const std::string &name,
+            const std::vector<std::pair<std::string, uint64_t>> &rows)
+{
+  os << "  \"" << name << "\": {";
+  for (size_t i = 0; i < rows.size(); ++i)
+    os << (i ? ", " : "") << "\"" << rows[i].first << "\": " << rows[i].second;
+  os << "}";
+}
+
+void
+InstructionMix::writeJSON(std::ostream &os,
+                          const ExecutionEvents &events) const
+{
+  Summary summary = summarize(events);
+  auto storeFlags(os.flags());
+
+  os << std::dec << "{" << std::endl
+     << "  \"instructions\": " << summary.total << "," << std::endl;
+  writeObject(os, "mnemonics",
+              std::vector<std::pair<std::string, uint64_t>>(
+                  summary.mnemonics.begin(), summary.mnemonics.end()));
+  os << "," << std::endl;
+  writeObject(os, "formats", summary.formats);
+  os << "," << std::endl;
+  writeObject(os, "classes", summary.classes);
+  os << std::endl << "}" << std::endl;
+
+  os.flags(storeFlags);
+}
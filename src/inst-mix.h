@@ -0,0 +1,55 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * inst-mix.h - Instruction mix statistics.
+ */
+
+#ifndef __INST_MIX_H__
+#define __INST_MIX_H__
+
+#include "arch.h"
+
+#include <array>
+#include <iostream>
+
+/* Counts that are only known at execution time, gathered by the
+ * processor when the report is generated.
+ */
+struct ExecutionEvents
+{
+  uint64_t branchesTaken;
+  uint64_t branchesNotTaken;
+  uint64_t deviceAccesses;
+};
+
+/* Counts retired instructions by opcode, funct3, bit 30 (which
+ * distinguishes e.g. add from sub and srl from sra) and bit 25 (which
+ * selects the M extension). That is a single array increment per
+ * instruction; mnemonics, formats and classes are derived from these
+ * counts when the report is generated.
+ */
+class InstructionMix
+{
+  public:
+    InstructionMix();
+
+    void count(uint32_t instruction)
+    {
+      ++counts[(instruction & 0x7f) | ((instruction >> 5) & 0x380) |
+               ((instruction >> 20) & 0x400) | ((instruction >> 14) & 0x800)];
+    }
+
+    /* Print as table, or write as JSON. 
+		*/
+    void dumpTable(std::ostream &os, const ExecutionEvents &events) const;
+    void writeJSON(std::ostream &os, const ExecutionEvents &events) const;
+
+  private:
+    static const int NumKeys = 1 << 12;
+
+    std::array<uint64_t, NumKeys> counts;
+
+    struct Summary;
+    Summary summarize(const ExecutionEvents &events) const;
+};
+
+#endif /* __INST_MIX_H__ */
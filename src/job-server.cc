@@ -0,0 +1,527 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * job-server.cc - Resident emulator running jobs from a UNIX socket.
+ */
+
+#include "job-server.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Written to by the signal handler to stop JobServer::run() */
+static int stopFds[2] = { -1, -1 };
+
+static void
+stopHandler(int)
+{
+  if (write(stopFds[1], "", 1) < 0)
+    { }
+}
+
+static bool
+sendAll(int fd, const char *data, size_t size)
+{
+  while (size > 0)
+    {
+      ssize_t count = send(fd, data, size, MSG_NOSIGNAL);
+
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        return false;
+
+      data += count;
+      size -= count;
+    }
+
+  return true;
+}
+
+/* Sends what is written to it to the client as output chunks, a chunk
+ * per line or when the buffer fills up. There is no put area, so that
+ * every character passes through overflow() and complete lines are
+ * sent right away.
+ */
+class JobOutput : public std::streambuf
+{
+  public:
+    JobOutput(int fd)
+      : fd(fd), connected(true)
+    { }
+
+    ~JobOutput()
+    {
+      sync();
+    }
+
+  protected:
+    virtual int_type overflow(int_type c) override
+    {
+      if (c == traits_type::eof())
+        return traits_type::not_eof(c);
+
+      char value = traits_type::to_char_type(c);
+      return xsputn(&value, 1) == 1 ? c : traits_type::eof();
+    }
+
+    virtual std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+      pending.append(s, n);
+
+      if (pending.size() >= MaxChunk ||
+          std::char_traits<char>::find(s, n, '\n'))
+        sync();
+
+      return connected ? n : 0;
+    }
+
+    virtual int sync() override
+    {
+      if (pending.empty() || !connected)
+        return connected ? 0 : -1;
+
+      std::string header = "output " + std::to_string(pending.size()) + "\n";
+      connected = sendAll(fd, header.data(), header.size()) &&
+          sendAll(fd, pending.data(), pending.size());
+      pending.clear();
+
+      return connected ? 0 : -1;
+    }
+
+  private:
+    static const size_t MaxChunk = 4096;
+
+    int fd;
+    bool connected;
+    std::string pending;
+};
+
+/*
+ * JobControl
+ */
+
+void
+JobControl::requestStop(void)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  stopRequested = true;
+  if (stop)
+    stop();
+}
+
+bool
+JobControl::isStopRequested(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  return stopRequested;
+}
+
+/* A stop requested before the job registered is passed on right away */
+JobStopper::JobStopper(JobControl &control, std::function<void(void)> stop)
+  : control(control)
+{
+  std::lock_guard<std::mutex> guard(control.lock);
+
+  control.stop = stop;
+  if (control.stopRequested)
+    stop();
+}
+
+JobStopper::~JobStopper()
+{
+  std::lock_guard<std::mutex> guard(control.lock);
+
+  control.stop = nullptr;
+}
+
+/*
+ * JobServer
+ */
+
+JobServer::JobServer(const std::string &path, unsigned int nWorkers,
+                     JobHandler handler)
+  : path(path), listenFd(-1), handler(handler), stopping(false)
+{
+  struct sockaddr_un addr;
+
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path " + path + " is too long.");
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd < 0)
+    throw std::runtime_error("Could not create job socket.");
+
+  /* A socket left behind by an earlier run would make bind fail */
+  unlink(path.c_str());
+
+  if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listenFd, 64) < 0)
+    {
+      std::string error(strerror(errno));
+
+      close(listenFd);
+      throw std::runtime_error("Could not listen on " + path + ": " + error);
+    }
+
+  if (pipe2(finishedFds, O_CLOEXEC | O_NONBLOCK) < 0)
+    {
+      close(listenFd);
+      unlink(path.c_str());
+      throw std::runtime_error("Could not create job socket.");
+    }
+
+  for (unsigned int i = 0; i < nWorkers; ++i)
+    workers.push_back(std::thread(&JobServer::workerThread, this));
+}
+
+JobServer::~JobServer()
+{
+  /* Running jobs stop at the end of their current basic block */
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+
+    for (JobControl *control : running)
+      control->requestStop();
+  }
+  wakeup.notify_all();
+
+  for (auto &worker : workers)
+    worker.join();
+
+  for (auto &connection : connections)
+    close(connection.first);
+
+  close(finishedFds[0]);
+  close(finishedFds[1]);
+  close(listenFd);
+  unlink(path.c_str());
+}
+
+void
+JobServer::run(void)
+{
+  if (pipe(stopFds) < 0)
+    throw std::runtime_error("Could not create job socket.");
+
+  struct sigaction action, oldInt, oldTerm;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stopHandler;
+  sigaction(SIGINT, &action, &oldInt);
+  sigaction(SIGTERM, &action, &oldTerm);
+
+  while (true)
+    {
+      /* Busy connections are not read until their job is finished */
+      std::vector<struct pollfd> fds =
+      {
+        { listenFd, POLLIN, 0 },
+        { stopFds[0], POLLIN, 0 },
+        { finishedFds[0], POLLIN, 0 }
+      };
+      for (auto &connection : connections)
+        if (!connection.second.busy && !connection.second.closed)
+          fds.push_back({ connection.first, POLLIN, 0 });
+
+      if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          break;
+        }
+
+      if (fds[1].revents)
+        break;
+
+      if (fds[2].revents)
+        collectFinished();
+
+      for (size_t i = 3; i < fds.size(); ++i)
+        if (fds[i].revents)
+          readConnection(fds[i].fd);
+
+      if (!(fds[0].revents & POLLIN))
+        continue;
+
+      int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd >= 0)
+        connections[fd] = Connection{ std::string(), false, false };
+    }
+
+  sigaction(SIGINT, &oldInt, nullptr);
+  sigaction(SIGTERM, &oldTerm, nullptr);
+  close(stopFds[0]);
+  close(stopFds[1]);
+}
+
+
+/*
+ * Private methods
+ */
+void
+JobServer::workerThread(void)
+{
+  while (true)
+    {
+      Job job;
+      JobControl control;
+
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        wakeup.wait(guard, [this] { return stopping || !jobs.empty(); });
+
+        if (stopping)
+          return;
+
+        job = jobs.front();
+        jobs.pop_front();
+        running.insert(&control);
+      }
+
+      bool connected = serveJob(job, control);
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        running.erase(&control);
+        finished.push_back({ job.fd, connected });
+      }
+
+      if (write(finishedFds[1], "", 1) < 0)
+        { }
+    }
+}
+
+/* Runs job and sends the result, returns false when the client can no
+ * longer be reached.
+ */
+bool
+JobServer::serveJob(const Job &job, JobControl &control)
+{
+  std::ostringstream reply;
+  auto start = std::chrono::steady_clock::now();
+
+  try
+    {
+      JobOutput outputBuffer(job.fd);
+      std::ostream output(&outputBuffer);
+
+      JobResult result = handler(job.request, output, control);
+      output.flush();
+
+      std::chrono::duration<double> seconds =
+          std::chrono::steady_clock::now() - start;
+      reply << "result " << result.status
+            << " exit=" << result.exitCode
+            << " instructions=" << result.instructions
+            << " seconds=" << seconds.count() << "\n";
+    }
+  catch (std::exception &e)
+    {
+      reply << "error " << e.what() << "\n";
+    }
+
+  std::string line = reply.str();
+  return sendAll(job.fd, line.data(), line.size());
+}
+
+void
+JobServer::readConnection(int fd)
+{
+  Connection &connection = connections[fd];
+  char buffer[1024];
+
+  ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+  if (count < 0 && errno == EINTR)
+    return;
+
+  /* The requests received before the end of input are still run */
+  if (count <= 0)
+    connection.closed = true;
+  else
+    connection.pending.append(buffer, count);
+
+  dispatch(fd);
+}
+
+void
+JobServer::collectFinished(void)
+{
+  char buffer[64];
+  while (read(finishedFds[0], buffer, sizeof(buffer)) > 0)
+    { }
+
+  std::deque<std::pair<int, bool>> done;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    done.swap(finished);
+  }
+
+  for (auto &job : done)
+    {
+      connections[job.first].busy = false;
+
+      /* The remaining requests of a client that went away are dropped */
+      if (!job.second)
+        {
+          close(job.first);
+          connections.erase(job.first);
+        }
+      else
+        dispatch(job.first);
+    }
+}
+
+/* Queues the next request of connection fd, unless one of its jobs is
+ * still queued or running. A closed connection without requests left
+ * is closed.
+ */
+void
+JobServer::dispatch(int fd)
+{
+  Connection &connection = connections[fd];
+
+  while (!connection.busy)
+    {
+      size_t newline = connection.pending.find('\n');
+
+      if (newline == std::string::npos)
+        {
+          if (connection.closed)
+            {
+              close(fd);
+              connections.erase(fd);
+            }
+          return;
+        }
+
+      std::string request = connection.pending.substr(0, newline);
+      connection.pending.erase(0, newline + 1);
+
+      if (!request.empty() && request.back() == '\r')
+        request.pop_back();
+      if (request.find_first_not_of(" \t") == std::string::npos)
+        continue;
+
+      connection.busy = true;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(Job{ fd, request });
+      }
+      wakeup.notify_one();
+    }
+}
+
+/*
+ * CachedProgram
+ */
+
+CachedProgram::CachedProgram(const std::string &filename,
+                             const std::string &decodeCacheDirectory)
+  : elf(filename), decodeCache(elf.getCodeSections()),
+    decodeCacheDirectory(decodeCacheDirectory)
+{
+  if (!decodeCacheDirectory.empty())
+    decodeCache.load(decodeCacheDirectory);
+}
+
+/* The decode cache is saved once, when the server is done with the
+ * program, rather than after every job.
+ */
+CachedProgram::~CachedProgram()
+{
+  if (decodeCacheDirectory.empty())
+    return;
+
+  try
+    {
+      decodeCache.save(decodeCacheDirectory);
+    }
+  catch (std::runtime_error &e)
+    {
+      std::cerr << "Warning: " << e.what() << std::endl;
+    }
+}
+
+void
+CachedProgram::prepareDecodeCache(DecodeCache &cache)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  cache.merge(decodeCache);
+}
+
+void
+CachedProgram::collectDecodeCache(const DecodeCache &cache)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  decodeCache.merge(cache);
+}
+
+/*
+ * ProgramCache
+ */
+
+ProgramCache::ProgramCache(const std::string &decodeCacheDirectory)
+  : decodeCacheDirectory(decodeCacheDirectory)
+{
+}
+
+std::shared_ptr<CachedProgram>
+ProgramCache::get(const std::string &filename)
+{
+  struct stat statbuf;
+
+  if (stat(filename.c_str(), &statbuf) < 0)
+    throw std::runtime_error("Could not open " + filename + ".");
+
+  /* A replaced program saves its decode cache once the lock is released,
+   * unless jobs still running it hold on to it.
+   */
+  std::shared_ptr<CachedProgram> replaced;
+  std::lock_guard<std::mutex> guard(lock);
+
+  auto it = programs.find(filename);
+  if (it != programs.end())
+    {
+      const CachedProgram &program = *it->second;
+
+      if (program.device == statbuf.st_dev &&
+          program.inode == statbuf.st_ino &&
+          program.size == statbuf.st_size &&
+          program.modified.tv_sec == statbuf.st_mtim.tv_sec &&
+          program.modified.tv_nsec == statbuf.st_mtim.tv_nsec)
+        return it->second;
+
+      replaced = it->second;
+    }
+
+  /* Jobs still running the old version keep their reference to it */
+  std::shared_ptr<CachedProgram> program(
+      new CachedProgram(filename, decodeCacheDirectory));
+  program->device = statbuf.st_dev;
+  program->inode = statbuf.st_ino;
+  program->size = statbuf.st_size;
+  program->modified = statbuf.st_mtim;
+
+  programs[filename] = program;
+  return program;
+}
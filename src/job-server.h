@@ -0,0 +1,209 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * job-server.h - Resident emulator running jobs from a UNIX socket.
+ */
+
+/* In server mode the emulator stays resident and runs jobs sent to a
+ * UNIX-domain stream socket. Every line sent on a connection is a job.
+ * The server thread reads the connections and queues their jobs for
+ * the worker threads, so a connection only occupies a worker while one
+ * of its jobs runs. The jobs of a connection run one after the other,
+ * separate connections run in parallel. For every job the server sends
+ * back the console output of the program as it is written, in chunks of
+ *
+ *   output <length>\n<length bytes>
+ *
+ * followed by a single result line:
+ *
+ *   result <status> exit=<code> instructions=<count> seconds=<time>\n
+ *
+ * or "error <message>\n" when the job could not be run. What a line
+ * contains and what the status means is up to the JobHandler.
+ */
+
+#ifndef __JOB_SERVER_H__
+#define __JOB_SERVER_H__
+
+#include "decode-cache.h"
+#include "elf-file.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+struct JobResult
+{
+  std::string status;
+  uint64_t exitCode;
+  uint64_t instructions;
+};
+
+/* Lets the server stop a running job when it shuts down. The job
+ * registers the function that stops it through a JobStopper; it is
+ * called from another thread.
+ */
+class JobControl
+{
+  public:
+    JobControl()
+      : stopRequested(false)
+    { }
+
+    void requestStop(void);
+    bool isStopRequested(void) const;
+
+  private:
+    friend class JobStopper;
+
+    mutable std::mutex lock;
+    std::function<void(void)> stop;
+    bool stopRequested;
+};
+
+/* Registers stop with control for as long as it exists. Declare it
+ * after the object that stop refers to, so that it is destroyed first.
+ */
+class JobStopper
+{
+  public:
+    JobStopper(JobControl &control, std::function<void(void)> stop);
+    ~JobStopper();
+
+    JobStopper(const JobStopper &) = delete;
+    JobStopper &operator=(const JobStopper &) = delete;
+
+  private:
+    JobControl &control;
+};
+
+/* Runs the job described by request, writing console output to
+ * output. Throws std::exception when the job cannot be run.
+ */
+using JobHandler =
+    std::function<JobResult(const std::string &request, std::ostream &output,
+                            JobControl &control)>;
+
+class JobServer
+{
+  public:
+    JobServer(const std::string &path, unsigned int nWorkers,
+              JobHandler handler);
+    ~JobServer();
+
+    /* Accept connections and read their jobs until SIGINT or SIGTERM
+     * is received. Destroying the server then stops the running jobs
+     * and drops the queued ones.
+     */
+    void run(void);
+
+  private:
+    struct Job
+    {
+      int fd;
+      std::string request;
+    };
+
+    /* Connections are only read by run(). While one of its jobs is
+     * queued or running, the connection is busy and further requests
+     * wait in pending.
+     */
+    struct Connection
+    {
+      std::string pending;
+      bool busy;
+      bool closed;
+    };
+
+    const std::string path;
+    int listenFd;
+
+    /* Written to by the workers when a job is finished */
+    int finishedFds[2];
+
+    JobHandler handler;
+
+    std::vector<std::thread> workers;
+    std::map<int, Connection> connections;
+
+    std::deque<Job> jobs;
+
+    /* Connections whose job is done, and whether the reply was sent */
+    std::deque<std::pair<int, bool>> finished;
+    std::set<JobControl *> running;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    bool stopping;
+
+    void workerThread(void);
+    bool serveJob(const Job &job, JobControl &control);
+
+    void readConnection(int fd);
+    void collectFinished(void);
+    void dispatch(int fd);
+};
+
+/* A program loaded once and shared by the jobs that run it, together
+ * with the decode cache that those jobs build up. With a directory, the
+ * decode cache is saved there when the program is destroyed: when the
+ * server stops or the file has changed and no job runs it anymore.
+ */
+class CachedProgram
+{
+  public:
+    CachedProgram(const std::string &filename,
+                  const std::string &decodeCacheDirectory);
+    ~CachedProgram();
+
+    ELFFile &getELF(void) { return elf; }
+
+    /* Give a job's decode cache the instructions decoded by earlier
+     * jobs, and collect the ones it decoded once it is done.
+     */
+    void prepareDecodeCache(DecodeCache &cache);
+    void collectDecodeCache(const DecodeCache &cache);
+
+  private:
+    friend class ProgramCache;
+
+    ELFFile elf;
+    std::mutex lock;
+    DecodeCache decodeCache;
+    const std::string decodeCacheDirectory;
+
+    /* Identity of the file when it was loaded */
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+};
+
+/* Programs by filename, loaded again when the file has changed.
+ */
+class ProgramCache
+{
+  public:
+    /* With a directory, decode caches are also loaded from and saved to
+     * it, see decode-cache.h.
+     */
+    ProgramCache(const std::string &decodeCacheDirectory = std::string());
+
+    std::shared_ptr<CachedProgram> get(const std::string &filename);
+
+  private:
+    const std::string decodeCacheDirectory;
+
+    std::mutex lock;
+    std::map<std::string, std::shared_ptr<CachedProgram>> programs;
+};
+
+#endif /* __JOB_SERVER_H__ */
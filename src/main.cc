@@ -5,16 +5,26 @@
 
 #include "arch.h"
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <regex>
 
 #include <getopt.h>
+#include <climits>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 
 #include "elf-file.h"
 #include "config-file.h"
 #include "processor.h"
+#include "fork-snapshot.h"
+#include "job-server.h"
+#include "platform.h"
+#include "watchdog.h"
 
 
 enum ExitCodes : int
@@ -22,9 +32,38 @@ enum ExitCodes : int
   Success = 0,
   AbnormalTermination = 1,
   HelpDisplayed = 2,
-  InitializationError = 3
+  InitializationError = 3,
+  TestFailure = 4,
+  LimitExceeded = 5,
+
+  /* Nonzero exit codes of the program, see getExitStatus() */
+  GuestExitBase = 16,
+  GuestExitOverflow = 255
 };
 
+/* The exit status for exit code code written by the program. Nonzero
+ * codes are moved above the statuses of the emulator itself, and those
+ * that do not fit in the 8 bits kept by the shell are all reported as
+ * GuestExitOverflow, so that a failure never looks like success or
+ * like a failing unit test. The full code is printed.
+ */
+static int
+getExitStatus(RegValue code)
+{
+  if (code == 0)
+    return ExitCodes::Success;
+
+  int status = ExitCodes::GuestExitOverflow;
+  if (code < ExitCodes::GuestExitOverflow - ExitCodes::GuestExitBase)
+    status = ExitCodes::GuestExitBase + code;
+
+  std::cerr << "Program exit code " << code;
+  if ((int64_t)code < 0)
+    std::cerr << " (" << (int64_t)code << ")";
+  std::cerr << ", exit status " << status << "." << std::endl;
+  return status;
+}
+
 /* Class to parse and store a register initializer pair consisting of
  * a register number and the value to initialize that register with.
  */
@@ -58,6 +97,9 @@ class RegisterInit
           number = regnum;
           value = atoi(match[2].str().c_str());
         }
+      else
+        throw std::invalid_argument("Malformed register initializer " +
+                                    initstr);
     }
 
     RegNumber number;
@@ -146,17 +188,22 @@ class TestFile : public ConfigFile
     }
 };
 
-static void
+/* Returns true when all registers hold their expected value.
+ */
+static bool
 validateRegisters(const Processor &p,
-                  const std::vector<RegisterInit> &expectedValues)
+                  const std::vector<RegisterInit> &expectedValues,
+                  std::ostream &os = std::cerr)
 {
+  bool valid = true;
+
   if (!expectedValues.empty())
     {
       for (auto &reginit : expectedValues)
         {
           if (reginit.value != p.getRegister(reginit.number))
             {
-              std::cerr << "Register R" << (int)reginit.number
+              os << "Register R" << (int)reginit.number
                   << " expected " << reginit.value
                   << " (" << std::hex << std::showbase
                   << reginit.value
@@ -166,31 +213,420 @@ validateRegisters(const Processor &p,
                   << p.getRegister(reginit.number)
                   << std::dec << std::noshowbase << ")"
                   << std::endl;
+              valid = false;
             }
         }
     }
+
+  return valid;
 }
 
 
+/* Flame graph output requested on the command line 
+*/
+struct FlameGraphConfig
+{
+  const char *filename = nullptr;
+  uint64_t interval = 1000;
+  SampleWeight weight = SampleWeight::Instructions;
+};
+
+/* Memory access trace requested on the command line 
+*/
+struct MemoryTraceConfig
+{
+  const char *filename = nullptr;
+  uint64_t sampleRate = 1;
+  uint64_t window = 100000;
+};
+
+/* Checkpoint to save during the run and/or to restore before it 
+*/
+struct CheckpointConfig
+{
+  const char *saveFilename = nullptr;
+  uint64_t saveAt = 0;
+  uint64_t interval = 0;
+  const char *restoreFilename = nullptr;
+};
+
+/* Sampled simulation requested on the command line 
+*/
+struct SimPointConfig
+{
+  uint64_t interval = 0;
+  int maxK = 0;                 /* 0: up to 10, as intervals allow */
+  uint64_t warmup = 0;
+  const char *bbvFilename = nullptr;
+};
+
+/* Log to record the nondeterministic inputs to, or to replay them from 
+*/
+struct ReplayConfig
+{
+  const char *recordFilename = nullptr;
+  const char *replayFilename = nullptr;
+};
+
+/* Limits on a run, to stop programs that do not terminate 
+*/
+struct LimitConfig
+{
+  uint64_t maxInstructions = 0;
+  double timeout = 0;
+};
+
+/* Variants to run from a snapshot 
+*/
+struct VariantsConfig
+{
+  const char *filename = nullptr;
+  uint64_t snapshotAt = 0;
+};
+
+/* All command-line options, as filled in by option processing 
+*/
+struct EmulatorOptions
+{
+  bool debugMode = false;
+  std::vector<RegisterInit> initializers;
+  const char *testFilename = nullptr;
+  const char *execFilename = nullptr;
+  PlatformConfig platform;
+  size_t profileTopN = 0;
+  FlameGraphConfig flameGraph;
+  bool instructionMix = false;
+  const char *mixFilename = nullptr;
+  const char *traceFilename = nullptr;
+  MemoryTraceConfig memoryTrace;
+  const char *coverageFilename = nullptr;
+  const char *statsSocket = nullptr;
+  const char *decodeCacheDirectory = nullptr;
+  const char *serveSocket = nullptr;
+  unsigned int nWorkers = std::max(1u, std::thread::hardware_concurrency());
+  CheckpointConfig checkpoint;
+  ReplayConfig replay;
+  VariantsConfig variants;
+  SimPointConfig simpoint;
+  LimitConfig limits;
+};
+
+/* Every line of a variants file lists the register initializers of one
+ * variant in the syntax of -r, separated by whitespace. Empty lines and
+ * lines starting with # are skipped.
+ */
+static std::vector<std::vector<RegisterInit>>
+readVariants(const char *filename)
+{
+  std::ifstream file(filename);
+  if (!file)
+    throw std::runtime_error(std::string("Could not open ") + filename);
+
+  std::vector<std::vector<RegisterInit>> variants;
+  std::string line;
+  while (std::getline(file, line))
+    {
+      std::istringstream fields(line);
+      std::string field;
+      std::vector<RegisterInit> variant;
+
+      while (fields >> field && field[0] != '#')
+        variant.push_back(RegisterInit(field));
+
+      if (!variant.empty())
+        variants.push_back(variant);
+    }
+
+  return variants;
+}
+
+/* Run the program up to the snapshot point once, then run every variant
+ * from there in a forked child, see fork-snapshot.h.
+ */
+static int
+runVariants(Processor &p, const VariantsConfig &config)
+{
+  std::vector<std::vector<RegisterInit>> variants;
+  try
+    {
+      variants = readVariants(config.filename);
+    }
+  catch (std::exception &e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return ExitCodes::InitializationError;
+    }
+
+  if (config.snapshotAt > 0)
+    {
+      p.setStopPoint(config.snapshotAt);
+      if (!p.run() || !p.isStopped())
+        {
+          std::cerr << "Error: the program ended before the snapshot."
+                    << std::endl;
+          return ExitCodes::AbnormalTermination;
+        }
+    }
+
+  std::cout << "Snapshot after " << p.getInstructionCount()
+            << " instructions, " << variants.size() << " variants."
+            << std::endl;
+
+  ForkSnapshot snapshot(p);
+  for (size_t i = 0; i < variants.size(); ++i)
+    {
+      VariantResult result = snapshot.run([&](Processor &child)
+        {
+          for (auto &initializer : variants[i])
+            child.initRegister(initializer.number, initializer.value);
+        });
+
+      std::cout << "variant " << i + 1 << ": ";
+      if (result.completed)
+        std::cout << "exit code " << result.exitCode;
+      else
+        std::cout << "abnormal termination";
+      std::cout << ", " << result.instructions << " instructions, started in "
+                << result.startSeconds * 1e6 << " us, "
+                << result.totalSeconds * 1e3 << " ms total" << std::endl;
+    }
+
+  return ExitCodes::Success;
+}
+
+/* After the profiled run, run only the chosen intervals on a second
+ * processor that starts from the same state, see simpoint.h. Its
+ * console output, a repeat of the profiled run's, is discarded.
+ * Returns false when the options do not fit the profile.
+ */
+static bool
+runSampled(ELFFile &program, const PlatformConfig &platform,
+           const CheckpointConfig &checkpoint,
+           const std::vector<RegisterInit> &initializers,
+           const BBVProfile &profile, const SimPointConfig &config)
+{
+  if (config.bbvFilename)
+    {
+      std::ofstream bbvFile(config.bbvFilename);
+      if (!bbvFile)
+        std::cerr << "Error: Could not write " << config.bbvFilename
+                  << std::endl;
+      else
+        profile.writeBBV(bbvFile);
+    }
+
+  uint64_t intervals = profile.getIntervalCount();
+  if (intervals == 0)
+    return true;
+
+  int maxK = config.maxK;
+  if (maxK == 0)
+    maxK = std::min<uint64_t>(10, intervals);
+  else if (static_cast<uint64_t>(maxK) > intervals)
+    {
+      std::cerr << "Error: --simpoint-max-k=" << maxK << " exceeds the "
+                << intervals << " intervals of the program." << std::endl;
+      return false;
+    }
+
+  std::ostream nullConsole(nullptr);
+  PlatformConfig detailedPlatform(platform);
+  detailedPlatform.console = &nullConsole;
+
+  Processor detailed(program, detailedPlatform);
+  if (checkpoint.restoreFilename)
+    detailed.restoreCheckpoint(checkpoint.restoreFilename);
+  for (auto &initializer : initializers)
+    detailed.initRegister(initializer.number, initializer.value);
+
+  runSimPoints(detailed, profile, profile.selectSimPoints(maxK),
+               config.warmup ? config.warmup : config.interval, std::cerr);
+  return true;
+}
+
+/* Start a watchdog for the time limit, if any, that stops p at the
+ * end of its current basic block.
+ */
+static std::unique_ptr<Watchdog>
+startLimits(Processor &p, const LimitConfig &limits)
+{
+  if (limits.maxInstructions)
+    p.setStopPoint(limits.maxInstructions);
+
+  if (limits.timeout <= 0)
+    return nullptr;
+
+  return std::unique_ptr<Watchdog>(
+      new Watchdog(limits.timeout, [&p] { p.requestStop(); }));
+}
+
+/* Report which limit stopped p and where the program was looping.
+ * Returns true when it was the time limit.
+ */
+static bool
+reportLimit(const Processor &p, const LimitConfig &limits,
+            const Watchdog *watchdog, std::ostream &os)
+{
+  bool timedOut = watchdog && watchdog->hasExpired() &&
+      (!limits.maxInstructions ||
+       p.getInstructionCount() < limits.maxInstructions);
+
+  if (timedOut)
+    os << "TIME LIMIT EXCEEDED after " << limits.timeout << " seconds";
+  else
+    os << "INSTRUCTION LIMIT EXCEEDED";
+  os << "; " << p.getInstructionCount() << " instructions executed"
+     << std::endl;
+
+  p.dumpHotLoop(os);
+  return timedOut;
+}
+
+/* A job sent to the server names a program or a unit test file,
+ * followed by register initializers (r10=5) and optional limits on
+ * the number of instructions (max-insns=N) and the run time in seconds
+ * (timeout=S), which override those given on the command line.
+ */
+static JobResult
+runJob(ProgramCache &programs, const EmulatorOptions &options,
+       const std::string &request, std::ostream &output, JobControl &control)
+{
+  PlatformConfig platform(options.platform);
+  LimitConfig limits(options.limits);
+  std::istringstream words(request);
+  std::string programFilename, word;
+  std::vector<RegisterInit> initializers, postRegisters;
+  bool testMode = false;
+
+  words >> programFilename;
+  while (words >> word)
+    {
+      if (word.compare(0, 10, "max-insns=") == 0)
+        {
+          char *end;
+          limits.maxInstructions = strtoull(word.c_str() + 10, &end, 10);
+
+          if (*end != '\0' || limits.maxInstructions == 0)
+            throw std::invalid_argument("Invalid instruction count " +
+                                        word.substr(10));
+        }
+      else if (word.compare(0, 8, "timeout=") == 0)
+        {
+          char *end;
+          limits.timeout = strtod(word.c_str() + 8, &end);
+
+          if (*end != '\0' || !(limits.timeout > 0))
+            throw std::invalid_argument("Invalid timeout " + word.substr(8));
+        }
+      else
+        initializers.push_back(RegisterInit(word));
+    }
+
+  if (programFilename.length() > 5 &&
+      programFilename.substr(programFilename.length() - 5) == ".conf")
+    {
+      TestFile testfile(programFilename);
+      std::vector<RegisterInit> preRegisters = testfile.getPreRegisters();
+
+      initializers.insert(initializers.begin(),
+                          preRegisters.begin(), preRegisters.end());
+      postRegisters = testfile.getPostRegisters();
+      programFilename = testfile.getExecutable();
+      testMode = true;
+    }
+
+  std::shared_ptr<CachedProgram> program = programs.get(programFilename);
+
+  platform.console = &output;
+  Processor p(program->getELF(), platform);
+  JobStopper stopper(control, [&p] { p.requestStop(); });
+  program->prepareDecodeCache(p.getDecodeCache());
+
+  for (auto &initializer : initializers)
+    p.initRegister(initializer.number, initializer.value);
+
+  std::unique_ptr<Watchdog> watchdog = startLimits(p, limits);
+  bool completed = p.run(testMode);
+  program->collectDecodeCache(p.getDecodeCache());
+
+  JobResult result{ "completed", p.getExitCode(), p.getInstructionCount() };
+  if (!completed)
+    {
+      result.status = "abnormal";
+      result.exitCode = ExitCodes::AbnormalTermination;
+    }
+  else if (p.isStopped() && control.isStopRequested())
+    {
+      result.status = "cancelled";
+      result.exitCode = ExitCodes::LimitExceeded;
+    }
+  else if (p.isStopped())
+    {
+      bool timedOut = reportLimit(p, limits, watchdog.get(), output);
+
+      result.status = timedOut ? "timeout" : "limit";
+      result.exitCode = ExitCodes::LimitExceeded;
+    }
+  else if (testMode)
+    {
+      bool valid = validateRegisters(p, postRegisters, output);
+
+      result.status = valid ? "passed" : "failed";
+      result.exitCode = valid ? ExitCodes::Success : ExitCodes::TestFailure;
+    }
+
+  return result;
+}
+
+/* Serve jobs until interrupted, see job-server.h.
+ */
+static int
+runServer(const EmulatorOptions &options)
+{
+  try
+    {
+      ProgramCache programs(options.decodeCacheDirectory ?
+                            options.decodeCacheDirectory : "");
+      JobServer server(options.serveSocket, options.nWorkers,
+                       [&](const std::string &request, std::ostream &output,
+                           JobControl &control)
+                       {
+                         return runJob(programs, options, request, output,
+                                       control);
+                       });
+
+      std::cerr << "Serving jobs on " << options.serveSocket << " with "
+                << options.nWorkers << " workers." << std::endl;
+      server.run();
+    }
+  catch (std::runtime_error &e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return ExitCodes::InitializationError;
+    }
+
+  return ExitCodes::Success;
+}
+
 /* Start the emulator by either executing a test or running a regular
- * program.
+ * program. When a regular program halts through the system controller,
+ * the exit code it stored there is returned.
  */
 static int
-launcher(const char *testFilename,
-         const char *execFilename,
-         bool debugMode,
-         std::vector<RegisterInit> initializers)
+launcher(const EmulatorOptions &options)
 {
+  std::vector<RegisterInit> initializers(options.initializers);
+
   try
     {
       std::string programFilename;
       std::vector<RegisterInit> postRegisters;
 
-      if (testFilename)
+      if (options.testFilename)
         {
-          std::string testConfig(testFilename);
+          std::string testConfig(options.testFilename);
 
-          if (testConfig.length() < 6 or
+          if (testConfig.length() < 6 ||
               testConfig.substr(testConfig.length() - 5) != std::string(".conf"))
             {
               std::cerr << "Error: test filename must end with .conf"
@@ -212,25 +648,186 @@ launcher(const char *testFilename,
             }
         }
       else
-        programFilename = std::string(execFilename);
+        programFilename = std::string(options.execFilename);
 
       /* Read the ELF file and start the emulator */
       ELFFile program(programFilename);
-      Processor p(program, debugMode);
+      Processor p(program, options.platform, options.debugMode);
+
+      if (options.decodeCacheDirectory)
+        p.enableDecodeCache(options.decodeCacheDirectory);
+
+      if (options.checkpoint.restoreFilename)
+        p.restoreCheckpoint(options.checkpoint.restoreFilename);
+
+      if (options.checkpoint.saveFilename)
+        {
+          try
+            {
+              p.scheduleCheckpoint(options.checkpoint.saveFilename,
+                                   options.checkpoint.saveAt,
+                                   options.checkpoint.interval);
+            }
+          catch (std::invalid_argument &e)
+            {
+              std::cerr << "Error: " << e.what() << std::endl;
+              return ExitCodes::InitializationError;
+            }
+        }
+
+      if (options.profileTopN > 0)
+        p.enableProfiling(options.profileTopN);
+
+      if (options.instructionMix || options.mixFilename)
+        p.enableInstructionMix();
+
+      if (options.traceFilename)
+        p.enableTrace(options.traceFilename);
+
+      std::ofstream memoryTraceFile;
+      if (options.memoryTrace.filename)
+        {
+          memoryTraceFile.open(options.memoryTrace.filename);
+          if (!memoryTraceFile)
+            {
+              std::cerr << "Error: Could not open "
+                        << options.memoryTrace.filename
+                        << std::endl;
+              return ExitCodes::InitializationError;
+            }
+
+          p.enableMemoryTrace(options.memoryTrace.sampleRate,
+                              options.memoryTrace.window);
+        }
+
+      std::ofstream coverageFile;
+      if (options.coverageFilename)
+        {
+          coverageFile.open(options.coverageFilename);
+          if (!coverageFile)
+            {
+              std::cerr << "Error: Could not open " << options.coverageFilename
+                        << std::endl;
+              return ExitCodes::InitializationError;
+            }
+
+          p.enableCoverage(program);
+        }
+
+      if (options.statsSocket)
+        p.enableStatsServer(options.statsSocket);
+
+      if (options.replay.recordFilename)
+        p.enableReplayLog(options.replay.recordFilename,
+                          ReplayLog::Mode::Record);
+      else if (options.replay.replayFilename)
+        p.enableReplayLog(options.replay.replayFilename,
+                          ReplayLog::Mode::Replay);
+
+      std::ofstream flameGraphFile;
+      if (options.flameGraph.filename)
+        {
+          flameGraphFile.open(options.flameGraph.filename);
+          if (!flameGraphFile)
+            {
+              std::cerr << "Error: Could not open "
+                        << options.flameGraph.filename
+                        << std::endl;
+              return ExitCodes::InitializationError;
+            }
+
+          p.enableFlameGraph(options.flameGraph.interval,
+                             options.flameGraph.weight);
+        }
 
       for (auto &initializer : initializers)
         p.initRegister(initializer.number, initializer.value);
 
-      p.run(testFilename != nullptr);
+      if (options.variants.filename)
+        return runVariants(p, options.variants);
+
+      if (options.simpoint.interval)
+        p.enableBBVProfile(options.simpoint.interval);
+
+      std::unique_ptr<Watchdog> watchdog = startLimits(p, options.limits);
+      bool completed = p.run(options.testFilename != nullptr);
+      bool limitExceeded = completed && p.isStopped();
+
+      if (limitExceeded)
+        reportLimit(p, options.limits, watchdog.get(), std::cerr);
+      watchdog.reset();
+
+      try
+        {
+          p.finishTrace();
+        }
+      catch (std::runtime_error &e)
+        {
+          std::cerr << "Error: " << e.what() << std::endl;
+        }
+      p.finishReplayLog();
+
+      try
+        {
+          p.saveDecodeCache();
+        }
+      catch (std::runtime_error &e)
+        {
+          std::cerr << "Warning: " << e.what() << std::endl;
+        }
+
+      if (completed && !limitExceeded && options.replay.replayFilename &&
+          !p.getReplayLog()->atEnd())
+        std::cerr << "Warning: the program ended before the end of the "
+                  << "replay log." << std::endl;
+
+      if (p.isCheckpointPending())
+        std::cerr << "Warning: the program ended before a checkpoint "
+                  << "could be saved." << std::endl;
+
+      if (options.flameGraph.filename)
+        p.writeFlameGraph(flameGraphFile);
+
+      if (options.memoryTrace.filename)
+        p.writeMemoryTrace(memoryTraceFile);
+
+      if (options.coverageFilename)
+        p.writeCoverage(coverageFile);
+
+      if (options.mixFilename)
+        {
+          std::ofstream mixFile(options.mixFilename);
+          if (!mixFile)
+            std::cerr << "Error: Could not write " << options.mixFilename
+                      << std::endl;
+          else
+            p.writeInstructionMix(mixFile);
+        }
 
       /* Dump registers and statistics when not running a unit test. */
-      if (!testFilename)
+      if (!options.testFilename)
         {
           p.dumpRegisters();
           p.dumpStatistics();
+
+          if (options.simpoint.interval && completed && !limitExceeded &&
+              !runSampled(program, options.platform, options.checkpoint,
+                          initializers, *p.getBBVProfile(),
+                          options.simpoint))
+            return ExitCodes::InitializationError;
         }
 
-      validateRegisters(p, postRegisters);
+      if (!completed)
+        return ExitCodes::AbnormalTermination;
+
+      if (limitExceeded)
+        return ExitCodes::LimitExceeded;
+
+      if (options.testFilename)
+        return validateRegisters(p, postRegisters) ?
+            ExitCodes::Success : ExitCodes::TestFailure;
+
+      return getExitStatus(p.getExitCode());
     }
   catch (std::runtime_error &e)
     {
@@ -251,7 +848,7 @@ launcher(const char *testFilename,
 static void
 showHelp(const char *progName)
 {
-  std::cerr << progName << " [-d] [-r reginit] <programFilename>" << std::endl;
+  std::cerr << progName << " [-d] [-r reginit] [platform options] <programFilename>" << std::endl;
   std::cerr << std::endl << "    or" << std::endl << std::endl;
   std::cerr << progName << " [-d] -t testfile" << std::endl;
   std::cerr <<
@@ -262,31 +859,210 @@ R"HERE(
 
     -d enables debug mode in which every decoded instruction is printed
     to the terminal.
+
+    Platform options:
+      --platform=NAME   'simple' (default) or 'virt', a QEMU virt-like
+                        platform with RAM at 0x80000000, UART 16550,
+                        CLINT, PLIC and a generated device tree.
+      --ram=MIB         RAM size of the virt platform in MiB (default 128).
+      --kernel=FILE     raw kernel image, loaded at 0x80200000.
+      --initrd=FILE     initial ramdisk, placed at the end of RAM.
+      --append=ARGS     kernel command line (bootargs).
+
+    --profile[=N] counts executions per basic block and prints the N
+    (default 20) hottest functions and instructions at exit.
+
+    --flamegraph=FILE tracks guest calls in a shadow call stack and
+    writes sampled stacks to FILE in the folded format used by
+    flamegraph.pl and speedscope.
+      --sample-interval=N   sample every N instructions (default 1000).
+      --sample-weight=UNIT  'instructions' (default) or 'cycles'.
+
+    --mix prints the instruction mix by mnemonic, format and class at
+    exit, --mix-json=FILE writes it to FILE as JSON.
+
+    --trace=FILE writes every retired instruction (PC, instruction,
+    register write, memory access) to FILE as a compressed binary
+    trace. Use trace-dump to decode it.
+
+    --memtrace=FILE records the data accesses of loads and stores and
+    writes a report of reuse distances, working set and strides to FILE.
+      --memtrace-sample=N     only record accesses to 1 in N pages.
+      --memtrace-window=N     working set window in instructions
+                              (default 100000).
+
+    --coverage=FILE records basic block and branch edge coverage and
+    writes it per source line (from DWARF .debug_line) to FILE in lcov
+    format, for genhtml. A summary is printed with the statistics.
+
+    --stats-socket=PATH serves live statistics (instruction count, PC,
+    MIPS, TLB hit rates) as JSON to every connection on the UNIX-domain
+    socket PATH, e.g. "socat - UNIX-CONNECT:PATH".
+
+    --decode-cache=DIR keeps the decoded instructions of the program in
+    DIR across runs, in a file named after a hash of its code, so a
+    rerun of the same binary does not decode them again.
+
+    --checkpoint=FILE --checkpoint-at=N saves the complete machine
+    state to FILE at the end of the basic block in which instruction N
+    executes. --restore=FILE resumes from such a checkpoint, taken with
+    the same program and platform options. Register initializers are
+    applied after restoring.
+      --checkpoint-every=N    save a checkpoint every N instructions to
+                              FILE.1, FILE.2, ..., each incremental on
+                              top of the previous one.
+
+    --record=FILE logs the nondeterministic inputs of the run: reads of
+    the system controller's TIME and TIMER_STATUS registers, UART input
+    and the points at which interrupts are taken. --replay=FILE feeds
+    them back from the log instead of the host, so a run with the same
+    program and options repeats the recorded run exactly. A replay that
+    diverges from the log terminates the program.
+
+    --serve=PATH keeps the emulator resident and runs jobs sent to the
+    UNIX-domain socket PATH on a pool of worker threads. Every line is a
+    job: a program or unit test .conf file, followed by register
+    initializers (r10=5) and optionally max-insns=N and timeout=S, which
+    override --max-insns and --timeout. Console output and a result line
+    with the status, exit code and instruction count are sent back.
+    Programs and their decoded instructions are cached.
+      --workers=N             number of worker threads (default: the
+                              number of host CPUs).
+
+    --variants=FILE runs the program once up to instruction N given by
+    --snapshot-at=N (default 0), then runs each line of FILE as a variant
+    from there. A line lists register initializers like -r. Variants
+    start from a forked copy-on-write snapshot; only their exit codes
+    and instruction counts are reported.
+
+    --simpoint=N collects basic block vectors per interval of N
+    instructions, picks representative intervals with k-means and then
+    reruns only those, after a warm-up, to extrapolate CPI and TLB
+    misses with error bounds.
+      --simpoint-max-k=K      consider up to K clusters, at most the
+                              number of intervals (default 10).
+      --simpoint-warmup=W     warm up for W instructions (default N).
+      --simpoint-bbv=FILE     write the vectors in SimPoint .bb format.
+
+    --max-insns=N stops the program at the end of the basic block in
+    which instruction N executes, --timeout=S once it has run for S
+    seconds of host time. The address range of the last basic blocks
+    executed is reported, to locate the loop the program is stuck in.
+
+    The exit status is 0 when the program wrote exit code 0 to the
+    system controller, or 1 on abnormal termination. Unit tests exit
+    with status 4 when a register does not hold its expected value.
+    Status 5 means that --max-insns or --timeout stopped the program.
+    Other exit codes are printed in full and give status 16 + code,
+    or 255 for codes of 239 and up.
 )HERE";
 }
 
 
+/* Long options without a short equivalent */
+enum LongOption : int
+{
+  OptPlatform = 256,
+  OptRAM,
+  OptKernel,
+  OptInitrd,
+  OptAppend,
+  OptProfile,
+  OptFlameGraph,
+  OptSampleInterval,
+  OptSampleWeight,
+  OptMix,
+  OptMixJSON,
+  OptTrace,
+  OptMemoryTrace,
+  OptMemoryTraceSample,
+  OptMemoryTraceWindow,
+  OptCoverage,
+  OptStatsSocket,
+  OptDecodeCache,
+  OptServe,
+  OptWorkers,
+  OptCheckpoint,
+  OptCheckpointAt,
+  OptCheckpointEvery,
+  OptRestore,
+  OptRecord,
+  OptReplay,
+  OptVariants,
+  OptSnapshotAt,
+  OptSimPoint,
+  OptSimPointMaxK,
+  OptSimPointWarmup,
+  OptSimPointBBV,
+  OptMaxInstructions,
+  OptTimeout
+};
+
+static const size_t DefaultProfileTopN = 20;
+
+static const struct option longOptions[] =
+{
+  { "debug", no_argument, nullptr, 'd' },
+  { "reg", required_argument, nullptr, 'r' },
+  { "test", required_argument, nullptr, 't' },
+  { "help", no_argument, nullptr, 'h' },
+  { "platform", required_argument, nullptr, OptPlatform },
+  { "ram", required_argument, nullptr, OptRAM },
+  { "kernel", required_argument, nullptr, OptKernel },
+  { "initrd", required_argument, nullptr, OptInitrd },
+  { "append", required_argument, nullptr, OptAppend },
+  { "profile", optional_argument, nullptr, OptProfile },
+  { "flamegraph", required_argument, nullptr, OptFlameGraph },
+  { "sample-interval", required_argument, nullptr, OptSampleInterval },
+  { "sample-weight", required_argument, nullptr, OptSampleWeight },
+  { "mix", no_argument, nullptr, OptMix },
+  { "mix-json", required_argument, nullptr, OptMixJSON },
+  { "trace", required_argument, nullptr, OptTrace },
+  { "memtrace", required_argument, nullptr, OptMemoryTrace },
+  { "memtrace-sample", required_argument, nullptr, OptMemoryTraceSample },
+  { "memtrace-window", required_argument, nullptr, OptMemoryTraceWindow },
+  { "coverage", required_argument, nullptr, OptCoverage },
+  { "stats-socket", required_argument, nullptr, OptStatsSocket },
+  { "decode-cache", required_argument, nullptr, OptDecodeCache },
+  { "serve", required_argument, nullptr, OptServe },
+  { "workers", required_argument, nullptr, OptWorkers },
+  { "checkpoint", required_argument, nullptr, OptCheckpoint },
+  { "checkpoint-at", required_argument, nullptr, OptCheckpointAt },
+  { "checkpoint-every", required_argument, nullptr, OptCheckpointEvery },
+  { "restore", required_argument, nullptr, OptRestore },
+  { "record", required_argument, nullptr, OptRecord },
+  { "replay", required_argument, nullptr, OptReplay },
+  { "variants", required_argument, nullptr, OptVariants },
+  { "snapshot-at", required_argument, nullptr, OptSnapshotAt },
+  { "simpoint", required_argument, nullptr, OptSimPoint },
+  { "simpoint-max-k", required_argument, nullptr, OptSimPointMaxK },
+  { "simpoint-warmup", required_argument, nullptr, OptSimPointWarmup },
+  { "simpoint-bbv", required_argument, nullptr, OptSimPointBBV },
+  { "max-insns", required_argument, nullptr, OptMaxInstructions },
+  { "timeout", required_argument, nullptr, OptTimeout },
+  { nullptr, 0, nullptr, 0 }
+};
+
+
 int
 main(int argc, char **argv)
 {
-  char c;
-  bool debugMode = false;
-  std::vector<RegisterInit> initializers;
-  const char *testFilename = nullptr;
+  int c;
+  EmulatorOptions options;
 
   /* Command line option processing */
   const char *progName = argv[0];
 
-  while ((c = getopt(argc, argv, "dr:t:h")) != -1)
+  while ((c = getopt_long(argc, argv, "dr:t:h", longOptions, nullptr)) != -1)
     {
       switch (c)
         {
           case 'd':
-            debugMode = true;
+            options.debugMode = true;
             break;
 
           case 'r':
-            if (testFilename != nullptr)
+            if (options.testFilename != nullptr)
               {
                 std::cerr << "Error: Cannot set unit test and individual "
                           << "registers at the same time." << std::endl;
@@ -296,7 +1072,7 @@ main(int argc, char **argv)
             try
               {
                 RegisterInit init((std::string(optarg)));
-                initializers.push_back(init);
+                options.initializers.push_back(init);
               }
             catch (std::exception &e)
               {
@@ -307,14 +1083,277 @@ main(int argc, char **argv)
             break;
 
           case 't':
-            if (testFilename != nullptr)
+            if (options.testFilename != nullptr)
               {
                 std::cerr << "Error: Cannot specify testfile more than once."
                           << std::endl;
                 return ExitCodes::InitializationError;
               }
 
-            testFilename = optarg;
+            options.testFilename = optarg;
+            break;
+
+          case OptPlatform:
+            if (!strcmp(optarg, "simple"))
+              options.platform.type = PlatformType::Simple;
+            else if (!strcmp(optarg, "virt"))
+              options.platform.type = PlatformType::Virt;
+            else
+              {
+                std::cerr << "Error: Unknown platform " << optarg << std::endl;
+                return ExitCodes::InitializationError;
+              }
+            break;
+
+          case OptRAM:
+            {
+              char *end;
+              unsigned long long mib = strtoull(optarg, &end, 10);
+
+              if (*end != '\0' || mib == 0 || mib > 64 * 1024)
+                {
+                  std::cerr << "Error: Invalid RAM size " << optarg << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+              options.platform.ramSize = mib * 1024 * 1024;
+            }
+            break;
+
+          case OptKernel:
+            options.platform.kernel = optarg;
+            break;
+
+          case OptInitrd:
+            options.platform.initrd = optarg;
+            break;
+
+          case OptAppend:
+            options.platform.bootargs = optarg;
+            break;
+
+          case OptProfile:
+            options.profileTopN = DefaultProfileTopN;
+            if (optarg)
+              {
+                char *end;
+                options.profileTopN = strtoul(optarg, &end, 10);
+
+                if (*end != '\0' || options.profileTopN == 0)
+                  {
+                    std::cerr << "Error: Invalid profile size " << optarg
+                              << std::endl;
+                    return ExitCodes::InitializationError;
+                  }
+              }
+            break;
+
+          case OptFlameGraph:
+            options.flameGraph.filename = optarg;
+            break;
+
+          case OptSampleInterval:
+            {
+              char *end;
+              options.flameGraph.interval = strtoull(optarg, &end, 10);
+
+              if (*end != '\0' || options.flameGraph.interval == 0)
+                {
+                  std::cerr << "Error: Invalid sample interval " << optarg
+                            << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+            }
+            break;
+
+          case OptSampleWeight:
+            if (!strcmp(optarg, "instructions"))
+              options.flameGraph.weight = SampleWeight::Instructions;
+            else if (!strcmp(optarg, "cycles"))
+              options.flameGraph.weight = SampleWeight::Cycles;
+            else
+              {
+                std::cerr << "Error: Unknown sample weight " << optarg
+                          << std::endl;
+                return ExitCodes::InitializationError;
+              }
+            break;
+
+          case OptMix:
+            options.instructionMix = true;
+            break;
+
+          case OptMixJSON:
+            options.mixFilename = optarg;
+            break;
+
+          case OptTrace:
+            options.traceFilename = optarg;
+            break;
+
+          case OptMemoryTrace:
+            options.memoryTrace.filename = optarg;
+            break;
+
+          case OptCoverage:
+            options.coverageFilename = optarg;
+            break;
+
+          case OptStatsSocket:
+            options.statsSocket = optarg;
+            break;
+
+          case OptDecodeCache:
+            options.decodeCacheDirectory = optarg;
+            break;
+
+          case OptServe:
+            options.serveSocket = optarg;
+            break;
+
+          case OptWorkers:
+            {
+              char *end;
+              options.nWorkers = strtoul(optarg, &end, 10);
+
+              if (*end != '\0' || options.nWorkers == 0)
+                {
+                  std::cerr << "Error: Invalid number of workers "
+                            << optarg << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+            }
+            break;
+
+          case OptCheckpoint:
+            options.checkpoint.saveFilename = optarg;
+            break;
+
+          case OptCheckpointAt:
+          case OptCheckpointEvery:
+            {
+              char *end;
+              uint64_t value = strtoull(optarg, &end, 10);
+
+              if (c == OptCheckpointAt)
+                options.checkpoint.saveAt = value;
+              else
+                options.checkpoint.interval = value;
+
+              if (*end != '\0' || value == 0)
+                {
+                  std::cerr << "Error: Invalid instruction count "
+                            << optarg << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+            }
+            break;
+
+          case OptRestore:
+            options.checkpoint.restoreFilename = optarg;
+            break;
+
+          case OptRecord:
+            options.replay.recordFilename = optarg;
+            break;
+
+          case OptReplay:
+            options.replay.replayFilename = optarg;
+            break;
+
+          case OptVariants:
+            options.variants.filename = optarg;
+            break;
+
+          case OptSimPoint:
+          case OptSimPointMaxK:
+          case OptSimPointWarmup:
+            {
+              char *end;
+              uint64_t value = strtoull(optarg, &end, 10);
+
+              if (*end != '\0' || (value == 0 && c != OptSimPointWarmup) ||
+                  (value > INT_MAX && c == OptSimPointMaxK))
+                {
+                  std::cerr << "Error: Invalid value " << optarg
+                            << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+
+              if (c == OptSimPoint)
+                options.simpoint.interval = value;
+              else if (c == OptSimPointMaxK)
+                options.simpoint.maxK = value;
+              else
+                options.simpoint.warmup = value;
+            }
+            break;
+
+          case OptSimPointBBV:
+            options.simpoint.bbvFilename = optarg;
+            break;
+
+          case OptSnapshotAt:
+            {
+              char *end;
+              options.variants.snapshotAt = strtoull(optarg, &end, 10);
+
+              if (*end != '\0')
+                {
+                  std::cerr << "Error: Invalid instruction count "
+                            << optarg << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+            }
+            break;
+
+          case OptMaxInstructions:
+            {
+              char *end;
+              options.limits.maxInstructions = strtoull(optarg, &end, 10);
+
+              if (*end != '\0' || options.limits.maxInstructions == 0)
+                {
+                  std::cerr << "Error: Invalid instruction count "
+                            << optarg << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+            }
+            break;
+
+          case OptTimeout:
+            {
+              char *end;
+              options.limits.timeout = strtod(optarg, &end);
+
+              if (*end != '\0' || !(options.limits.timeout > 0))
+                {
+                  std::cerr << "Error: Invalid timeout " << optarg
+                            << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+            }
+            break;
+
+          case OptMemoryTraceSample:
+          case OptMemoryTraceWindow:
+            {
+              char *end;
+              uint64_t value = strtoull(optarg, &end, 10);
+
+              if (*end != '\0' || value == 0)
+                {
+                  std::cerr << "Error: Invalid "
+                            << (c == OptMemoryTraceSample ?
+                                "sample rate " : "window ")
+                            << optarg << std::endl;
+                  return ExitCodes::InitializationError;
+                }
+
+              if (c == OptMemoryTraceSample)
+                options.memoryTrace.sampleRate = value;
+              else
+                options.memoryTrace.window = value;
+            }
             break;
 
           case 'h':
@@ -328,12 +1367,72 @@ main(int argc, char **argv)
   argc -= optind;
   argv += optind;
 
-  if (!testFilename and argc < 1)
+  if (options.variants.filename && options.traceFilename)
+    {
+      std::cerr << "Error: --variants cannot be combined with --trace."
+                << std::endl;
+      return ExitCodes::InitializationError;
+    }
+
+  if (options.replay.recordFilename && options.replay.replayFilename)
+    {
+      std::cerr << "Error: --record cannot be combined with --replay."
+                << std::endl;
+      return ExitCodes::InitializationError;
+    }
+
+  if (options.variants.filename &&
+      (options.replay.recordFilename || options.replay.replayFilename))
+    {
+      std::cerr << "Error: --variants cannot be combined with --record or "
+                << "--replay." << std::endl;
+      return ExitCodes::InitializationError;
+    }
+
+  if (options.variants.filename &&
+      (options.limits.maxInstructions || options.limits.timeout > 0))
+    {
+      std::cerr << "Error: --variants cannot be combined with --max-insns "
+                << "or --timeout." << std::endl;
+      return ExitCodes::InitializationError;
+    }
+
+  if (options.checkpoint.saveAt == 0)
+    options.checkpoint.saveAt = options.checkpoint.interval;
+
+  if (options.checkpoint.saveFilename && options.checkpoint.saveAt == 0)
+    {
+      std::cerr << "Error: --checkpoint requires --checkpoint-at or "
+                << "--checkpoint-every." << std::endl;
+      return ExitCodes::InitializationError;
+    }
+
+  if (options.serveSocket)
+    {
+      if (options.platform.type != PlatformType::Simple)
+        {
+          std::cerr << "Error: The server runs jobs on the simple platform "
+                    << "only." << std::endl;
+          return ExitCodes::InitializationError;
+        }
+
+      return runServer(options);
+    }
+
+  if (!options.testFilename && argc < 1)
     {
       std::cerr << "Error: No executable specified." << std::endl << std::endl;
       showHelp(progName);
       return ExitCodes::InitializationError;
     }
 
-  return launcher(testFilename, argv[0], debugMode, initializers);
+  if (options.testFilename && options.platform.type != PlatformType::Simple)
+    {
+      std::cerr << "Error: Unit tests run on the simple platform only."
+                << std::endl;
+      return ExitCodes::InitializationError;
+    }
+
+  options.execFilename = argv[0];
+  return launcher(options);
 }
@@ -4,10 +4,14 @@
  */
 
 #include "memory-bus.h"
+#include "memory.h"
+#include "host-profile.h"
 
 MemoryBus::MemoryBus(std::vector<std::shared_ptr<MemoryInterface> > &&clients)
-  : clients(std::move(clients))
+  : nDeviceAccesses(0)
 {
+  for (auto &client : clients)
+    addClient(std::move(client));
 }
 
 MemoryBus::~MemoryBus()
@@ -15,57 +19,96 @@ MemoryBus::~MemoryBus()
 }
 
 void
-MemoryBus::addClient(std::shared_ptr<MemoryInterface> client)
+MemoryBus::addClient(std::shared_ptr<MemoryInterface> client, bool device)
+{
+  clients.push_back(Client{ client, device });
+}
+
+std::vector<std::shared_ptr<Memory>>
+MemoryBus::getMemories(void) const
 {
-  clients.push_back(client);
+  std::vector<std::shared_ptr<Memory>> memories;
+
+  for (auto &client : clients)
+    {
+      auto memory = std::dynamic_pointer_cast<Memory>(client.client);
+      if (memory)
+        memories.push_back(memory);
+    }
+
+  return memories;
 }
 
 uint8_t
 MemoryBus::readByte(MemAddress addr)
 {
-  return getClient(addr)->readByte(addr);
+  const Client *client = getClient(addr);
+  HOST_PROFILE_SCOPE_IF(client->device, HostPhase::Device);
+
+  return client->client->readByte(addr);
 }
 
 uint16_t
 MemoryBus::readHalfWord(MemAddress addr)
 {
-  return getClient(addr)->readHalfWord(addr);
+  const Client *client = getClient(addr);
+  HOST_PROFILE_SCOPE_IF(client->device, HostPhase::Device);
+
+  return client->client->readHalfWord(addr);
 }
 
 uint32_t
 MemoryBus::readWord(MemAddress addr)
 {
-  return getClient(addr)->readWord(addr);
+  const Client *client = getClient(addr);
+  HOST_PROFILE_SCOPE_IF(client->device, HostPhase::Device);
+
+  return client->client->readWord(addr);
 }
 
 uint64_t
 MemoryBus::readDoubleWord(MemAddress addr)
 {
-  return getClient(addr)->readDoubleWord(addr);
+  const Client *client = getClient(addr);
+  HOST_PROFILE_SCOPE_IF(client->device, HostPhase::Device);
+
+  return client->client->readDoubleWord(addr);
 }
 
 void
 MemoryBus::writeByte(MemAddress addr, uint8_t value)
 {
-  return getClient(addr)->writeByte(addr, value);
+  const Client *client = getClient(addr);
+  HOST_PROFILE_SCOPE_IF(client->device, HostPhase::Device);
+
+  return client->client->writeByte(addr, value);
 }
 
 void
 MemoryBus::writeHalfWord(MemAddress addr, uint16_t value)
 {
-  return getClient(addr)->writeHalfWord(addr, value);
+  const Client *client = getClient(addr);
+  HOST_PROFILE_SCOPE_IF(client->device, HostPhase::Device);
+
+  return client->client->writeHalfWord(addr, value);
 }
 
 void
 MemoryBus::writeWord(MemAddress addr, uint32_t value)
 {
-  return getClient(addr)->writeWord(addr, value);
+  const Client *client = getClient(addr);
+  HOST_PROFILE_SCOPE_IF(client->device, HostPhase::Device);
+
+  return client->client->writeWord(addr, value);
 }
 
 void
 MemoryBus::writeDoubleWord(MemAddress addr, uint64_t value)
 {
-  return getClient(addr)->writeDoubleWord(addr, value);
+  const Client *client = getClient(addr);
+  HOST_PROFILE_SCOPE_IF(client->device, HostPhase::Device);
+
+  return client->client->writeDoubleWord(addr, value);
 }
 
 bool
@@ -77,22 +120,25 @@ MemoryBus::contains(MemAddress addr) const
 /*
  * Private methods
  */
-std::shared_ptr<MemoryInterface>
-MemoryBus::findClient(MemAddress addr) noexcept
+const MemoryBus::Client *
+MemoryBus::findClient(MemAddress addr) const noexcept
 {
   for (auto &client : clients)
-    if (client->contains(addr))
-      return client;
+    if (client.client->contains(addr))
+      return &client;
 
   return nullptr;
 }
 
-std::shared_ptr<MemoryInterface>
+const MemoryBus::Client *
 MemoryBus::getClient(MemAddress addr)
 {
   auto client = findClient(addr);
   if (!client)
     throw IllegalAccess(addr);
 
+  if (client->device)
+    ++nDeviceAccesses;
+
   return client;
 }
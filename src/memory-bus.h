@@ -11,13 +11,33 @@
 #include <memory>
 #include <vector>
 
+class Memory;
+
 class MemoryBus : public MemoryInterface
 {
   public:
     MemoryBus(std::vector<std::shared_ptr<MemoryInterface> > &&clients);
     virtual ~MemoryBus();
 
-    void addClient(std::shared_ptr<MemoryInterface> client);
+    /* Devices are clients with side effects (memory-mapped I/O), as
+     * opposed to plain memories. Accesses to devices are counted.
+     */
+    void addClient(std::shared_ptr<MemoryInterface> client,
+                   bool device = false);
+
+    /* Returns true when a client serves addr. The bus itself claims
+     * the full address space through contains().
+     */
+    bool isMapped(MemAddress addr) const { return findClient(addr) != nullptr; }
+
+    /* The clients that are plain memories, in bus order. 
+		*/
+    std::vector<std::shared_ptr<Memory>> getMemories(void) const;
+
+    const uint64_t *getDeviceAccessCounter(void) const
+    {
+      return &nDeviceAccesses;
+    }
 
     /* MemoryInterface 
 		*/
@@ -34,10 +54,18 @@ class MemoryBus : public MemoryInterface
     virtual bool contains(MemAddress addr) const override;
 
   private:
-    std::vector<std::shared_ptr<MemoryInterface> > clients;
+    struct Client
+    {
+      std::shared_ptr<MemoryInterface> client;
+      bool device;
+    };
+
+    std::vector<Client> clients;
+
+    uint64_t nDeviceAccesses;
 
-    std::shared_ptr<MemoryInterface> findClient(MemAddress addr) noexcept;
-    std::shared_ptr<MemoryInterface> getClient(MemAddress addr);
+    const Client *findClient(MemAddress addr) const noexcept;
+    const Client *getClient(MemAddress addr);
 };
 
 #endif /* __MEMORY_BUS_H__ */
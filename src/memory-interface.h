@@ -38,10 +38,11 @@ class IllegalAccess : public std::exception
 {
   public:
     explicit IllegalAccess(const char *what)
-      : message(what)
+      : message(what), addr(0)
     { }
 
     explicit IllegalAccess(const MemAddress addr)
+      : addr(addr)
     {
       std::stringstream ss;
       ss << "Invalid access at " << std::hex << addr;
@@ -49,6 +50,7 @@ class IllegalAccess : public std::exception
     }
 
     explicit IllegalAccess(const MemAddress addr, const size_t size)
+      : addr(addr)
     {
       std::stringstream ss;
       ss << "Invalid access of size " << size << " at " << std::hex << addr;
@@ -60,8 +62,12 @@ class IllegalAccess : public std::exception
       return message.c_str();
     }
 
+    /* Faulting address, 0 when unknown. */
+    MemAddress getAddress(void) const { return addr; }
+
   private:
     std::string message;
+    MemAddress addr;
 };
 
 #endif /* __MEMORY_INTERFACE_H__ */
@@ -0,0 +1,379 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * memory-trace.cc - Memory access trace and working-set analysis.
+ */
+
+#include "memory-trace.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+static const size_t InitialUseCapacity = 1 << 16;
+static const size_t TopN = 10;
+
+MemoryTrace::MemoryTrace(uint64_t sampleRate, uint64_t window)
+  : sampleRate(sampleRate ? sampleRate : 1), window(window ? window : 1),
+    nBuffered(0), nSkipped(0), nReads(0), nWrites(0),
+    distinct(InitialUseCapacity + 1, 0), now(0), nColdAccesses(0),
+    windowNewPages(0), currentWindow(~(uint64_t)0)
+{
+  distances.fill(0);
+}
+
+static std::string
+formatBytes(uint64_t bytes)
+{
+  static const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+  int unit = 0;
+
+  while (bytes >= 1024 && bytes % 1024 == 0 && unit < 4)
+    {
+      bytes /= 1024;
+      ++unit;
+    }
+
+  return std::to_string(bytes) + " " + units[unit];
+}
+
+static double
+percentage(uint64_t count, uint64_t total)
+{
+  return total ? 100.0 * count / total : 0.0;
+}
+
+void
+MemoryTrace::writeReport(std::ostream &os, const SymbolTable &symbols)
+{
+  analyze();
+  if (!windowPages.empty())
+    closeWindow();
+
+  auto storeFlags(os.flags());
+  auto storeFill(os.fill());
+
+  os << std::dec << std::noshowbase << std::setfill(' ');
+  os << "Memory trace: " << nReads << " loads, " << nWrites
+     << " stores recorded";
+  if (sampleRate > 1)
+    os << " (1 in " << sampleRate << " pages sampled, "
+       << nSkipped << " accesses skipped; counts below are scaled)";
+  os << std::endl
+     << "Footprint: " << pages.size() * sampleRate << " pages ("
+     << formatBytes(pages.size() * sampleRate << PageBits) << ")"
+     << std::endl;
+
+  writeDistances(os);
+  writeWorkingSet(os);
+  writeStrides(os, symbols);
+
+  os.flags(storeFlags);
+  os.fill(storeFill);
+}
+
+
+/*
+ * Private methods
+ */
+void
+MemoryTrace::analyze(void)
+{
+  for (size_t i = 0; i < nBuffered; ++i)
+    {
+      const Entry &entry = buffer[i];
+
+      if (entry.write)
+        ++nWrites;
+      else
+        ++nReads;
+
+      countReuse(entry.addr >> LineBits);
+      countPage(entry.addr >> PageBits, entry.instruction, entry.write);
+      countStride(entry);
+    }
+
+  nBuffered = 0;
+}
+
+void
+MemoryTrace::countReuse(uint64_t line)
+{
+  if (now + 1 >= distinct.size())
+    compactUses();
+
+  auto it = lastUse.find(line);
+
+  if (it == lastUse.end())
+    {
+      ++nColdAccesses;
+      it = lastUse.emplace(line, 0).first;
+    }
+  else
+    {
+      uint64_t distance = countUses(now) - countUses(it->second + 1);
+      distance *= sampleRate;
+
+      int bucket = 0;
+      while (distance >> bucket)
+        ++bucket;
+      ++distances[std::min(bucket, NumDistanceBuckets - 1)];
+
+      markUse(it->second, -1);
+    }
+
+  it->second = now;
+  markUse(now++, 1);
+}
+
+void
+MemoryTrace::countPage(uint64_t page, uint64_t instruction, bool write)
+{
+  if (instruction / window != currentWindow)
+    {
+      if (currentWindow != ~(uint64_t)0)
+        closeWindow();
+      currentWindow = instruction / window;
+    }
+
+  auto it = pages.find(page);
+  if (it == pages.end())
+    {
+      it = pages.emplace(page, PageCounts{ 0, 0 }).first;
+      ++windowNewPages;
+    }
+
+  if (write)
+    ++it->second.writes;
+  else
+    ++it->second.reads;
+
+  windowPages.insert(page);
+}
+
+void
+MemoryTrace::closeWindow(void)
+{
+  windows.push_back(WindowCounts{ currentWindow * window,
+                                  windowPages.size() * sampleRate,
+                                  windowNewPages * sampleRate });
+  windowPages.clear();
+  windowNewPages = 0;
+}
+
+void
+MemoryTrace::countStride(const Entry &entry)
+{
+  auto it = strides.find(entry.pc);
+
+  if (it == strides.end())
+    {
+      strides.emplace(entry.pc, StrideCounts{ entry.addr, 1, 0, entry.size,
+                                              {} });
+      return;
+    }
+
+  StrideCounts &counts = it->second;
+  int64_t stride = entry.addr - counts.lastAddr;
+
+  auto stride_it = counts.strides.find(stride);
+  if (stride_it != counts.strides.end())
+    ++stride_it->second;
+  else if (counts.strides.size() < StrideCounts::MaxStrides)
+    counts.strides.emplace(stride, 1);
+  else
+    ++counts.other;
+
+  counts.lastAddr = entry.addr;
+  ++counts.accesses;
+}
+
+/* Fenwick tree over logical time, index time + 1. 
+*/
+void
+MemoryTrace::markUse(uint64_t time, int delta)
+{
+  for (uint64_t i = time + 1; i < distinct.size(); i += i & -i)
+    distinct[i] += delta;
+}
+
+/* Number of lines whose last use lies before time. 
+*/
+uint64_t
+MemoryTrace::countUses(uint64_t time) const
+{
+  uint64_t count = 0;
+
+  for (uint64_t i = time; i > 0; i -= i & -i)
+    count += distinct[i];
+
+  return count;
+}
+
+/* Logical time runs out: renumber the last uses 0, 1, ... in order,
+ * which keeps all distances intact, and grow the tree when more than
+ * half of it would be in use.
+ */
+void
+MemoryTrace::compactUses(void)
+{
+  std::vector<std::pair<uint64_t, uint64_t>> uses;
+
+  uses.reserve(lastUse.size());
+  for (auto &use : lastUse)
+    uses.emplace_back(use.second, use.first);
+  std::sort(uses.begin(), uses.end());
+
+  size_t capacity = distinct.size() - 1;
+  while (uses.size() * 2 > capacity)
+    capacity *= 2;
+  distinct.assign(capacity + 1, 0);
+
+  for (now = 0; now < uses.size(); ++now)
+    {
+      lastUse[uses[now].second] = now;
+      markUse(now, 1);
+    }
+}
+
+void
+MemoryTrace::writeDistances(std::ostream &os) const
+{
+  uint64_t total = nColdAccesses;
+  for (auto count : distances)
+    total += count;
+
+  os << std::endl
+     << "Reuse distance (distinct " << (1 << LineBits)
+     << "-byte lines between accesses to a line):" << std::endl
+     << "  distance                %  LRU hit rate at size" << std::endl;
+
+  uint64_t cumulative = 0;
+  for (int bucket = 0; bucket < NumDistanceBuckets; ++bucket)
+    {
+      if (distances[bucket] == 0)
+        continue;
+
+      uint64_t low = bucket ? (uint64_t)1 << (bucket - 1) : 0;
+      uint64_t high = bucket ? ((uint64_t)1 << bucket) - 1 : 0;
+
+      std::ostringstream range;
+      range << low;
+      if (high != low)
+        range << "-" << high;
+
+      cumulative += distances[bucket];
+      os << "  " << std::left << std::setw(16) << range.str() << std::right
+         << std::fixed << std::setprecision(2)
+         << std::setw(7) << percentage(distances[bucket], total) << "%  "
+         << std::setw(7) << percentage(cumulative, total) << "%  "
+         << formatBytes((high + 1) << LineBits) << std::endl;
+    }
+
+  os << "  " << std::left << std::setw(16) << "cold" << std::right
+     << std::setw(7) << percentage(nColdAccesses, total) << "%" << std::endl;
+}
+
+void
+MemoryTrace::writeWorkingSet(std::ostream &os) const
+{
+  os << std::endl << "Working set per " << window << " instructions:"
+     << std::endl;
+
+  if (windows.empty())
+    return;
+
+  uint64_t minPages = ~(uint64_t)0, maxPages = 0, sumPages = 0;
+  for (auto &w : windows)
+    {
+      minPages = std::min(minPages, w.pages);
+      maxPages = std::max(maxPages, w.pages);
+      sumPages += w.pages;
+    }
+
+  os << "  pages: min " << minPages << ", average "
+     << std::setprecision(1) << std::fixed
+     << (double)sumPages / windows.size() << ", max " << maxPages
+     << " in " << windows.size() << " windows with accesses" << std::endl
+     << "  first instruction     pages  new pages" << std::endl;
+
+  for (auto &w : windows)
+    os << "  " << std::setw(17) << w.start << "  " << std::setw(8) << w.pages
+       << "  " << std::setw(9) << w.newPages << std::endl;
+
+  std::vector<std::pair<uint64_t, PageCounts>> top(pages.begin(),
+                                                   pages.end());
+  std::sort(top.begin(), top.end(),
+            [](const std::pair<uint64_t, PageCounts> &a,
+               const std::pair<uint64_t, PageCounts> &b)
+            {
+              uint64_t countA = a.second.reads + a.second.writes;
+              uint64_t countB = b.second.reads + b.second.writes;
+              return countA > countB || (countA == countB && a.first < b.first);
+            });
+  if (top.size() > TopN)
+    top.resize(TopN);
+
+  os << std::endl << "Top pages:" << std::endl
+     << "  page                       loads      stores" << std::endl;
+  for (auto &page : top)
+    os << "  0x" << std::hex << std::setw(16) << std::setfill('0')
+       << (page.first << PageBits) << std::setfill(' ') << std::dec
+       << "  " << std::setw(10) << page.second.reads
+       << "  " << std::setw(10) << page.second.writes << std::endl;
+}
+
+void
+MemoryTrace::writeStrides(std::ostream &os, const SymbolTable &symbols) const
+{
+  std::vector<std::pair<MemAddress, const StrideCounts *>> top;
+  for (auto &entry : strides)
+    top.emplace_back(entry.first, &entry.second);
+
+  std::sort(top.begin(), top.end(),
+            [](const std::pair<MemAddress, const StrideCounts *> &a,
+               const std::pair<MemAddress, const StrideCounts *> &b)
+            {
+              return a.second->accesses > b.second->accesses ||
+                  (a.second->accesses == b.second->accesses &&
+                   a.first < b.first);
+            });
+  if (top.size() > TopN)
+    top.resize(TopN);
+
+  os << std::endl << "Stride patterns of the top instructions:" << std::endl
+     << "    accesses  stride      share  pattern      location" << std::endl;
+
+  for (auto &entry : top)
+    {
+      const StrideCounts &counts = *entry.second;
+      int64_t stride = 0;
+      uint64_t strideCount = 0;
+
+      for (auto &s : counts.strides)
+        if (s.second > strideCount)
+          {
+            stride = s.first;
+            strideCount = s.second;
+          }
+
+      /* The first access of an instruction has no stride. */
+      double share = percentage(strideCount, counts.accesses - 1);
+      const char *pattern = "irregular";
+      if (counts.accesses < 2)
+        pattern = "single";
+      else if (share >= 90.0)
+        pattern = stride == 0 ? "constant" :
+                  (stride == counts.size || stride == -(int64_t)counts.size) ?
+                  "sequential" : "strided";
+
+      os << "  " << std::setw(10) << counts.accesses
+         << "  " << std::left << std::setw(8) << stride << std::right
+         << "  " << std::setw(6) << std::setprecision(1) << std::fixed
+         << share << "%  " << std::left << std::setw(11) << pattern
+         << std::right << "  " << symbols.format(entry.first) << std::endl;
+    }
+
+  if (sampleRate > 1)
+    os << "  (strides across pages that are not sampled appear larger)"
+       << std::endl;
+}
@@ -0,0 +1,152 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * memory-trace.h - Memory access trace and working-set analysis.
+ */
+
+#ifndef __MEMORY_TRACE_H__
+#define __MEMORY_TRACE_H__
+
+#include "arch.h"
+#include "alu.h"
+#include "symbol-table.h"
+
+#include <array>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/* Records the data accesses of load and store instructions into a
+ * buffer, which is analyzed in batches when it fills up:
+ *
+ *  - reuse distance: the number of distinct cache lines accessed
+ *    between two accesses to the same line, which gives the hit rate
+ *    of a fully associative LRU cache of any size;
+ *  - working set: the pages touched in each window of instructions;
+ *  - strides: the address difference between consecutive accesses
+ *    of each load or store instruction.
+ *
+ * To bound the overhead, only accesses to a pseudo-random 1 in
+ * sampleRate pages are recorded. Reuse distances and page counts are
+ * scaled back up by the sample rate, which is exact in expectation.
+ */
+class MemoryTrace
+{
+  public:
+    MemoryTrace(uint64_t sampleRate, uint64_t window);
+
+    void record(MemAddress pc, const MemoryAccess &access,
+                uint64_t instructions)
+    {
+      if (sampleRate > 1 && !isSampled(access.vaddr >> PageBits))
+        {
+          ++nSkipped;
+          return;
+        }
+
+      buffer[nBuffered++] = Entry{ pc, access.vaddr, instructions,
+                                   access.size, access.write };
+      if (nBuffered == BufferSize)
+        analyze();
+    }
+
+    /* Analyze the remaining accesses and write the report. 
+		*/
+    void writeReport(std::ostream &os, const SymbolTable &symbols);
+
+  private:
+    static const unsigned int PageBits = 12;
+    static const unsigned int LineBits = 6;
+    static const size_t BufferSize = 4096;
+    static const int NumDistanceBuckets = 48;
+
+    struct Entry
+    {
+      MemAddress pc;
+      MemAddress addr;
+      uint64_t instruction;
+      uint8_t size;
+      bool write;
+    };
+
+    struct PageCounts
+    {
+      uint64_t reads;
+      uint64_t writes;
+    };
+
+    struct WindowCounts
+    {
+      uint64_t start;
+      uint64_t pages;
+      uint64_t newPages;
+    };
+
+    /* Consecutive accesses of a single instruction. Only the first
+     * MaxStrides distinct strides are counted individually.
+     */
+    struct StrideCounts
+    {
+      static const size_t MaxStrides = 8;
+
+      MemAddress lastAddr;
+      uint64_t accesses;
+      uint64_t other;
+      uint8_t size;
+      std::map<int64_t, uint64_t> strides;
+    };
+
+    const uint64_t sampleRate;
+    const uint64_t window;
+
+    std::array<Entry, BufferSize> buffer;
+    size_t nBuffered;
+
+    uint64_t nSkipped;
+    uint64_t nReads;
+    uint64_t nWrites;
+
+    /* Reuse distance: lastUse maps a line to the logical time of its
+     * last access. distinct holds a Fenwick tree over logical time with
+     * a 1 at the last access of each line, so that the number of
+     * distinct lines since time t is a prefix sum.
+     */
+    std::unordered_map<uint64_t, uint64_t> lastUse;
+    std::vector<uint32_t> distinct;
+    uint64_t now;
+
+    std::array<uint64_t, NumDistanceBuckets> distances;
+    uint64_t nColdAccesses;
+
+    /* Working set 
+		*/
+    std::unordered_map<uint64_t, PageCounts> pages;
+    std::unordered_set<uint64_t> windowPages;
+    uint64_t windowNewPages;
+    uint64_t currentWindow;
+    std::vector<WindowCounts> windows;
+
+    std::unordered_map<MemAddress, StrideCounts> strides;
+
+    bool isSampled(uint64_t page) const
+    {
+      return ((page * 0x9e3779b97f4a7c15ULL) >> 40) % sampleRate == 0;
+    }
+
+    void analyze(void);
+    void countReuse(uint64_t line);
+    void countPage(uint64_t page, uint64_t instruction, bool write);
+    void countStride(const Entry &entry);
+    void closeWindow(void);
+
+    void markUse(uint64_t time, int delta);
+    uint64_t countUses(uint64_t time) const;
+    void compactUses(void);
+
+    void writeDistances(std::ostream &os) const;
+    void writeWorkingSet(std::ostream &os) const;
+    void writeStrides(std::ostream &os, const SymbolTable &symbols) const;
+};
+
+#endif /* __MEMORY_TRACE_H__ */
@@ -4,22 +4,231 @@
  */
 
 #include "memory.h"
+#include "checkpoint.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 
 #include <iostream>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
 
 Memory::Memory(const std::string &name,
                uint8_t * const data,
                const MemAddress base,
                const size_t size)
-  : name(name), mayWrite(false), base(base), size(size), data(data)
+  : name(name), mayWrite(false), base(base), size(size), data(data),
+    mapStart(nullptr), mapLength(0),
+    dirty((size + CheckpointPageSize - 1) / CheckpointPageSize, 1)
 {
 }
 
 Memory::~Memory()
 {
-  free(data);
+  if (mapStart)
+    munmap(mapStart, mapLength);
+  else
+    free(data);
+}
+
+std::shared_ptr<Memory>
+Memory::createAnonymous(const std::string &name,
+                        const MemAddress base,
+                        const size_t size)
+{
+  void *data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Failed to allocate memory for " + name + ".");
+
+  std::shared_ptr<Memory> memory(new Memory(name, (uint8_t *)data,
+                                            base, size));
+  memory->mapStart = (uint8_t *)data;
+  memory->mapLength = size;
+  memory->setMayWrite(true);
+
+  return memory;
+}
+
+std::shared_ptr<Memory>
+Memory::createFromFile(const std::string &name,
+                       const MemAddress base,
+                       const size_t size,
+                       int fd, off_t offset,
+                       size_t fileSize)
+{
+  const size_t pageSize = sysconf(_SC_PAGESIZE);
+  const size_t skew = offset % pageSize;
+  const off_t fileStart = offset - skew;
+  const size_t length = (skew + size + pageSize - 1) / pageSize * pageSize;
+
+  if (fileSize > size)
+    throw std::runtime_error("Invalid file size for " + name + ".");
+
+  void *start = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (start == MAP_FAILED)
+    throw std::runtime_error("Failed to allocate memory for " + name + ".");
+
+  std::shared_ptr<Memory> memory(new Memory(name, (uint8_t *)start + skew,
+                                            base, size));
+  memory->mapStart = (uint8_t *)start;
+  memory->mapLength = length;
+
+  /* Only pages that hold file contents up to their end can map the
+   * file, the file data following a partial last page must read as
+   * zeroes. That page is copied.
+   */
+  size_t mappedLength = (skew + fileSize) / pageSize * pageSize;
+
+  if (mappedLength > 0 &&
+      mmap(start, mappedLength, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_FIXED, fd, fileStart) == MAP_FAILED)
+    throw std::runtime_error("Failed to map " + name + ".");
+
+  /* The bytes before offset in the first page are not part of it */
+  size_t tailStart = std::max(mappedLength, skew);
+  size_t tail = skew + fileSize - tailStart;
+
+  if (tail > 0 &&
+      pread(fd, (uint8_t *)start + tailStart, tail,
+            fileStart + tailStart) != (ssize_t)tail)
+    throw std::runtime_error("Failed to read " + name + ".");
+
+  return memory;
+}
+
+void
+Memory::load(MemAddress addr, const void *src, size_t len)
+{
+  if (addr < base || len > size || addr - base > size - len)
+    throw std::runtime_error("Image does not fit in " + name + ".");
+
+  memcpy(data + (addr - base), src, len);
+
+  if (len > 0)
+    std::fill(dirty.begin() + (addr - base) / CheckpointPageSize,
+              dirty.begin() + (addr - base + len - 1) / CheckpointPageSize + 1,
+              1);
+}
+
+static bool
+isZeroPage(const uint8_t *page, size_t len)
+{
+  /* Pages are 8-byte aligned, except possibly in memories allocated
+   * on store, which are smaller than a page.
+   */
+  if (len % sizeof(uint64_t) == 0 && (uintptr_t)page % sizeof(uint64_t) == 0)
+    {
+      const uint64_t *words = (const uint64_t *)page;
+      for (size_t i = 0; i < len / sizeof(uint64_t); ++i)
+        if (words[i] != 0)
+          return false;
+      return true;
+    }
+
+  for (size_t i = 0; i < len; ++i)
+    if (page[i] != 0)
+      return false;
+  return true;
+}
+
+void
+Memory::saveState(CheckpointWriter &writer, bool incremental) const
+{
+  std::vector<uint64_t> pages;
+
+  /* A dirty page that is all zeroes now must still be saved in an
+   * incremental checkpoint, it overwrites the page of the previous one.
+   */
+  for (size_t offset = 0; offset < size; offset += CheckpointPageSize)
+    {
+      size_t page = offset / CheckpointPageSize;
+
+      if (incremental ? dirty[page] :
+          !isZeroPage(data + offset,
+                      std::min<size_t>(CheckpointPageSize, size - offset)))
+        pages.push_back(page);
+    }
+
+  writer.put<uint64_t>(pages.size());
+  writer.write(pages.data(), pages.size() * sizeof(uint64_t));
+  writer.alignToPage();
+
+  /* Only the last page can be partial, the padding completes it */
+  for (uint64_t page : pages)
+    {
+      size_t offset = page * CheckpointPageSize;
+      writer.write(data + offset,
+                   std::min<size_t>(CheckpointPageSize, size - offset));
+    }
+  writer.alignToPage();
+}
+
+void
+Memory::restoreState(CheckpointReader &reader, bool incremental)
+{
+  size_t nPages = (size + CheckpointPageSize - 1) / CheckpointPageSize;
+  uint64_t count = reader.get<uint64_t>();
+  if (count > nPages)
+    throw std::runtime_error("Checkpoint does not match " + name + ".");
+
+  std::vector<uint64_t> pages(count);
+  reader.read(pages.data(), count * sizeof(uint64_t));
+  reader.alignToPage();
+
+  for (size_t i = 0; i < count; ++i)
+    if (pages[i] >= nPages || (i > 0 && pages[i] <= pages[i - 1]))
+      throw std::runtime_error("Checkpoint does not match " + name + ".");
+
+  if (canRemapPages())
+    {
+      /* Start from fresh zero pages, then map each run of consecutive
+       * saved pages with a single call. An incremental checkpoint
+       * applies its pages on top of the previous one.
+       */
+      if (!incremental &&
+          mmap(data, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+               -1, 0) == MAP_FAILED)
+        throw std::runtime_error("Failed to reset memory for " + name + ".");
+
+      for (size_t i = 0; i < count; )
+        {
+          size_t run = 1;
+          while (i + run < count && pages[i + run] == pages[i] + run)
+            ++run;
+
+          reader.mapData(data + pages[i] * CheckpointPageSize,
+                         run * CheckpointPageSize);
+          i += run;
+        }
+    }
+  else
+    {
+      if (!incremental)
+        memset(data, 0, size);
+
+      for (uint64_t page : pages)
+        {
+          size_t offset = page * CheckpointPageSize;
+          const uint8_t *contents = reader.getData(CheckpointPageSize);
+
+          memcpy(data + offset, contents,
+                 std::min<size_t>(CheckpointPageSize, size - offset));
+        }
+    }
+
+  clearDirty();
+}
+
+void
+Memory::clearDirty(void)
+{
+  std::fill(dirty.begin(), dirty.end(), 0);
 }
 
 void
@@ -78,6 +287,9 @@ Memory::writeData(MemAddress addr, T value)
 
   MemAddress effectiveAddr = addr - base;
   *(T *)(data + effectiveAddr) = value;
+  /* Unaligned stores may cross into the next page */
+  dirty[effectiveAddr / CheckpointPageSize] = 1;
+  dirty[(effectiveAddr + sizeof(T) - 1) / CheckpointPageSize] = 1;
 }
 
 void
@@ -114,6 +326,15 @@ Memory::contains(MemAddress addr) const
 /*
  * Private methods
  */
+/* Checkpoint pages can replace the host pages of the memory only when
+ * they line up.
+ */
+bool
+Memory::canRemapPages(void) const
+{
+  return mapStart && (uintptr_t)data % CheckpointPageSize == 0;
+}
+
 bool
 Memory::canAccess(MemAddress addr, size_t size, bool write) const
 {
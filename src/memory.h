@@ -10,6 +10,12 @@
 
 #include <memory>
 #include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+class CheckpointWriter;
+class CheckpointReader;
 
 class Memory : public MemoryInterface
 {
@@ -22,8 +28,50 @@ class Memory : public MemoryInterface
            const size_t size);
     virtual ~Memory();
 
+    /* Create a writable memory backed by an anonymous host mapping.
+     * Host pages are only allocated when first touched, so large
+     * guest RAM sizes are cheap.
+     */
+    static std::shared_ptr<Memory> createAnonymous(const std::string &name,
+                                                   const MemAddress base,
+                                                   const size_t size);
+
+    /* Create a memory whose first fileSize bytes map the file fd from
+     * offset copy-on-write, the remainder reads as zeroes. Like an
+     * anonymous memory, pages are only read or allocated when first
+     * touched.
+     */
+    static std::shared_ptr<Memory> createFromFile(const std::string &name,
+                                                  const MemAddress base,
+                                                  const size_t size,
+                                                  int fd, off_t offset,
+                                                  size_t fileSize);
+
     void setMayWrite(bool setting);
 
+    /* Copy a block into memory regardless of write permission, used
+     * to place images in memory before execution starts.
+     */
+    void load(MemAddress addr, const void *src, size_t len);
+
+    const std::string &getName(void) const { return name; }
+    MemAddress getBase(void) const { return base; }
+    size_t getSize(void) const { return size; }
+    bool getMayWrite(void) const { return mayWrite; }
+
+    /* Save the pages that are not all zeroes and restore them, or for
+     * an incremental checkpoint, the pages written since the previous
+     * one. Memory backed by a page-aligned host mapping maps the pages
+     * from the checkpoint copy-on-write instead of copying them. A
+     * restore marks all pages clean.
+     */
+    void saveState(CheckpointWriter &writer, bool incremental) const;
+    void restoreState(CheckpointReader &reader, bool incremental);
+
+    /* Every page starts out dirty, stores mark the page they write to. 
+		*/
+    void clearDirty(void);
+
     /* MemoryInterface 
 		*/
     virtual uint8_t readByte(MemAddress addr) override;
@@ -55,9 +103,22 @@ class Memory : public MemoryInterface
      */
     uint8_t * const data;
 
+    /* The host mapping that holds data, if any. data starts at an
+     * offset into it when it maps a file offset that is not page
+     * aligned.
+     */
+    uint8_t *mapStart;
+    size_t mapLength;
+
+    /* One byte per CheckpointPageSize page, so the store path only
+     * needs a shift and a byte store.
+     */
+    std::vector<uint8_t> dirty;
+
     /* Private helper methods 
 		*/
     bool canAccess(MemAddress addr, size_t size, bool write) const;
+    bool canRemapPages(void) const;
 
     template <typename T>
     T readData(MemAddress addr);
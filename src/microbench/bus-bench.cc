@@ -0,0 +1,75 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * bus-bench.cc - Microbenchmark of memory bus dispatch.
+ */
+
+#include "microbench.h"
+
+#include "../memory-bus.h"
+#include "../memory.h"
+
+#include <cstdlib>
+#include <string>
+
+static const size_t ClientSize = 4096;
+
+/* A bus with nClients memories of ClientSize bytes, one after the
+ * other starting at 0x10000, like the sections of a loaded ELF file.
+ */
+static MemoryBus
+createBus(int nClients)
+{
+  MemoryBus bus({});
+
+  for (int i = 0; i < nClients; ++i)
+    {
+      uint8_t *data = (uint8_t *)calloc(1, ClientSize);
+      auto memory = std::make_shared<Memory>("data", data,
+                                             0x10000 + i * ClientSize,
+                                             ClientSize);
+      memory->setMayWrite(true);
+      bus.addClient(memory);
+    }
+
+  return bus;
+}
+
+static void
+benchmarkBus(int nClients, int client)
+{
+  MemoryBus bus = createBus(nClients);
+  MemAddress base = 0x10000 + client * ClientSize;
+  std::string name = std::to_string(nClients) + " clients, " +
+                     (client == 0 ? "first" : "last") + " client";
+
+  runMicrobenchmark(("readDoubleWord " + name).c_str(), 512,
+    [&](uint64_t iterations)
+    {
+      for (uint64_t i = 0; i < iterations; ++i)
+        for (MemAddress offset = 0; offset < ClientSize; offset += 8)
+          doNotOptimize(bus.readDoubleWord(base + offset));
+    });
+
+  runMicrobenchmark(("writeDoubleWord " + name).c_str(), 512,
+    [&](uint64_t iterations)
+    {
+      for (uint64_t i = 0; i < iterations; ++i)
+        for (MemAddress offset = 0; offset < ClientSize; offset += 8)
+          bus.writeDoubleWord(base + offset, offset);
+    });
+}
+
+int
+main(void)
+{
+  /* The simple platform has a memory per loaded section plus a few
+   * devices, the virt platform RAM and six devices.
+   */
+  for (int nClients : { 2, 8, 16 })
+    {
+      benchmarkBus(nClients, 0);
+      benchmarkBus(nClients, nClients - 1);
+    }
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * decoder-bench.cc - Microbenchmark of the instruction decoder.
+ */
+
+#include "microbench.h"
+
+#include "../inst-decoder.h"
+#include "../elf-file.h"
+
+#include <vector>
+
+/* Instruction words of the -O0 code generated for sumdemo.c and
+ * roman.c, plus the start-up code of minicrt-riscv.s.
+ */
+static const uint32_t corpus[] =
+{
+  0xfd010113, 0x02813423, 0x03010413, 0x00050793, 0xfcb43823, 0xfcf42e23,
+  0xfe042423, 0xfe042623, 0x0300006f, 0xfec42783, 0x00279793, 0xfd043703,
+  0x00f707b3, 0x0007a783, 0xfe842703, 0x00f707bb, 0xfef42423, 0xfec42783,
+  0x0017879b, 0xfef42623, 0xfec42783, 0x00078713, 0xfdc42783, 0x0007071b,
+  0x0007879b, 0xfcf742e3, 0xfe842783, 0x00078513, 0x02813403, 0x03010113,
+  0x00008067, 0xfe010113, 0x00113c23, 0x00813823, 0x02010413, 0x000107b7,
+  0x3a078593, 0x00600513, 0xf85ff0ef, 0x00050793, 0xfef42623, 0xfec42783,
+  0x00078513, 0x040000ef, 0x00000793, 0x00078513, 0x01813083, 0x01013403,
+  0x02010113, 0x00008067, 0xfd010113, 0x02813423, 0x03010413, 0x00050793,
+  0xfcf42e23, 0x20000793, 0xfef43023, 0xfe042623, 0x0640006f, 0x000117b7,
+  0xa2078713, 0xfec42783, 0x00379793, 0x00f707b3, 0x0047c703, 0xfe043783,
+  0x00e78023, 0xfec42783, 0x00379793, 0x00f707b3, 0x0007a783, 0xfdc42703,
+  0x40f707b3, 0xfcf42e23, 0xfdc42783, 0x00078713, 0xfcf750e3, 0xfec42783,
+  0x0017879b, 0xfef42623, 0xfa0798e3, 0xfe043783, 0x00a00713, 0x00e78023,
+  0x02813403, 0x03010113, 0x00008067, 0x000121b7, 0x80018193, 0x00011137,
+  0x40010113, 0xff010113, 0xed5ff0ef, 0x26a02c23, 0x00000013,
+};
+
+static void
+benchmarkDecode(const char *name, const std::vector<uint32_t> &words)
+{
+  InstructionDecoder decoder;
+
+  if (words.empty())
+    return;
+
+  runMicrobenchmark(name, words.size(), [&](uint64_t iterations)
+    {
+      for (uint64_t i = 0; i < iterations; ++i)
+        for (uint32_t word : words)
+          {
+            decoder.decodeInstruction(word);
+            doNotOptimize(decoder.getDecodedInstruction());
+          }
+    });
+}
+
+/* Only the words of the corpus with one of the given opcodes */
+static std::vector<uint32_t>
+select(const std::vector<uint32_t> &words, std::initializer_list<int> opcodes)
+{
+  std::vector<uint32_t> selected;
+
+  for (uint32_t word : words)
+    if (std::find(opcodes.begin(), opcodes.end(), word & 0x7f) != opcodes.end())
+      selected.push_back(word);
+
+  return selected;
+}
+
+int
+main(int argc, char **argv)
+{
+  std::vector<uint32_t> words(std::begin(corpus), std::end(corpus));
+
+  /* Optionally decode the code of a real program instead. */
+  if (argc > 1)
+    {
+      ELFFile program(argv[1]);
+
+      words.clear();
+      for (auto &section : program.getCodeSections())
+        for (uint64_t i = 0; i + 4 <= section.size; i += 4)
+          words.push_back(section.data[i] | (section.data[i + 1] << 8) |
+                          (section.data[i + 2] << 16) |
+                          ((uint32_t)section.data[i + 3] << 24));
+    }
+
+  benchmarkDecode("decode corpus", words);
+  benchmarkDecode("decode R-type", select(words, { 0x33, 0x3b }));
+  benchmarkDecode("decode I-type", select(words, { 0x13, 0x1b, 0x03, 0x67 }));
+  benchmarkDecode("decode S-type", select(words, { 0x23 }));
+  benchmarkDecode("decode SB-type", select(words, { 0x63 }));
+  benchmarkDecode("decode U-type", select(words, { 0x37 }));
+  benchmarkDecode("decode UJ-type", select(words, { 0x6f }));
+
+  return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * memory-bench.cc - Microbenchmark of memory reads and writes.
+ */
+
+#include "microbench.h"
+
+#include "../memory.h"
+
+#include <cstdlib>
+
+static const MemAddress Base = 0x10000;
+static const size_t Size = 64 * 1024;
+
+template <typename Access>
+static void
+benchmarkAccess(const char *name, size_t stride, Access access)
+{
+  runMicrobenchmark(name, Size / stride, [&](uint64_t iterations)
+    {
+      for (uint64_t i = 0; i < iterations; ++i)
+        for (MemAddress addr = Base; addr < Base + Size; addr += stride)
+          access(addr);
+    });
+}
+
+int
+main(void)
+{
+  Memory memory("data", (uint8_t *)calloc(1, Size), Base, Size);
+  memory.setMayWrite(true);
+
+  benchmarkAccess("readByte", 1, [&](MemAddress addr)
+    { doNotOptimize(memory.readByte(addr)); });
+  benchmarkAccess("readHalfWord", 2, [&](MemAddress addr)
+    { doNotOptimize(memory.readHalfWord(addr)); });
+  benchmarkAccess("readWord", 4, [&](MemAddress addr)
+    { doNotOptimize(memory.readWord(addr)); });
+  benchmarkAccess("readDoubleWord", 8, [&](MemAddress addr)
+    { doNotOptimize(memory.readDoubleWord(addr)); });
+
+  benchmarkAccess("writeByte", 1, [&](MemAddress addr)
+    { memory.writeByte(addr, addr); });
+  benchmarkAccess("writeHalfWord", 2, [&](MemAddress addr)
+    { memory.writeHalfWord(addr, addr); });
+  benchmarkAccess("writeWord", 4, [&](MemAddress addr)
+    { memory.writeWord(addr, addr); });
+  benchmarkAccess("writeDoubleWord", 8, [&](MemAddress addr)
+    { memory.writeDoubleWord(addr, addr); });
+
+  return 0;
+}
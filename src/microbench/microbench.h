@@ -0,0 +1,64 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * microbench.h - Timing loop shared by the microbenchmarks.
+ */
+
+#ifndef __MICROBENCH_H__
+#define __MICROBENCH_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+/* Keeps the compiler from optimizing away a computed value. */
+template <typename T>
+static inline void
+doNotOptimize(const T &value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/* Calls body(iterations) with a growing number of iterations until a
+ * batch takes at least MinBatchTime, then reports the best ns per
+ * operation of Repetitions batches. body performs opsPerIteration
+ * operations per iteration.
+ */
+template <typename Body>
+static void
+runMicrobenchmark(const char *name, uint64_t opsPerIteration, Body body)
+{
+  using Clock = std::chrono::steady_clock;
+  const std::chrono::duration<double> MinBatchTime(0.1);
+  const int Repetitions = 5;
+
+  uint64_t iterations = 1;
+  while (true)
+    {
+      auto start = Clock::now();
+      body(iterations);
+      if (Clock::now() - start >= MinBatchTime)
+        break;
+      iterations *= 2;
+    }
+
+  double best = 0.0;
+  for (int i = 0; i < Repetitions; ++i)
+    {
+      auto start = Clock::now();
+      body(iterations);
+      double ns = std::chrono::duration<double, std::nano>(
+          Clock::now() - start).count() / (iterations * opsPerIteration);
+
+      best = i == 0 ? ns : std::min(best, ns);
+    }
+
+  auto storeFlags(std::cout.flags());
+  std::cout << std::left << std::setw(44) << name << std::right
+            << std::fixed << std::setprecision(2) << std::setw(10) << best
+            << " ns/op" << std::endl;
+  std::cout.flags(storeFlags);
+}
+
+#endif /* __MICROBENCH_H__ */
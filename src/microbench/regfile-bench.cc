@@ -0,0 +1,44 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * regfile-bench.cc - Microbenchmark of the register file.
+ */
+
+#include "microbench.h"
+
+#include "../reg-file.h"
+
+int
+main(void)
+{
+  RegisterFile regfile;
+
+  /* All registers including x0, which takes a separate path */
+  runMicrobenchmark("readRegister", NumRegs, [&](uint64_t iterations)
+    {
+      for (uint64_t i = 0; i < iterations; ++i)
+        for (RegNumber reg = 0; reg < NumRegs; ++reg)
+          doNotOptimize(regfile.readRegister(reg));
+    });
+
+  runMicrobenchmark("writeRegister", NumRegs, [&](uint64_t iterations)
+    {
+      for (uint64_t i = 0; i < iterations; ++i)
+        for (RegNumber reg = 0; reg < NumRegs; ++reg)
+          regfile.writeRegister(reg, i);
+      doNotOptimize(regfile);
+    });
+
+  /* The pattern of an R-type instruction: two reads and a write */
+  runMicrobenchmark("read rs1, rs2, write rd", 1, [&](uint64_t iterations)
+    {
+      for (uint64_t i = 0; i < iterations; ++i)
+        {
+          RegNumber rd = i % NumRegs;
+          regfile.writeRegister(rd, regfile.readRegister((i + 1) % NumRegs) +
+                                    regfile.readRegister((i + 2) % NumRegs));
+        }
+      doNotOptimize(regfile);
+    });
+
+  return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * mmu.cc - Sv39 memory management unit with host-side TLBs.
+ */
+
+#include "mmu.h"
+#include "trap.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+/* Page table entry fields. 
+*/
+static const uint8_t PTE_V = 1 << 0;
+static const uint8_t PTE_R = 1 << 1;
+static const uint8_t PTE_W = 1 << 2;
+static const uint8_t PTE_X = 1 << 3;
+static const uint8_t PTE_U = 1 << 4;
+static const uint8_t PTE_G = 1 << 5;
+static const uint8_t PTE_A = 1 << 6;
+static const uint8_t PTE_D = 1 << 7;
+
+static const unsigned int PTEPPNShift = 10;
+static const RegValue PTEPPNMask = ((RegValue)1 << 44) - 1;
+
+static const int Sv39Levels = 3;
+static const unsigned int Sv39VPNBits = 9;
+static const int PTESize = 8;
+
+MMU::MMU(MemoryBus &bus, const CSRFile &csrs)
+  : bus(bus), csrs(csrs), nWalks(0), nFlushes(0)
+{
+  itlb.hits = itlb.misses = 0;
+  dtlb.hits = dtlb.misses = 0;
+  flush(0, true, 0, true);
+  nFlushes = 0;
+}
+
+void
+MMU::flush(MemAddress vaddr, bool allAddresses,
+           uint16_t asid, bool allASIDs)
+{
+  uint64_t vpn = vaddr >> PageShift;
+
+  ++nFlushes;
+
+  /* Superpages are cached per 4 KiB page, so flushing a single
+   * address cannot be done by index only. Flushes are rare enough to
+   * simply scan both TLBs.
+   */
+  for (TLB *tlb : { &itlb, &dtlb })
+    for (auto &entry : tlb->entries)
+      {
+        if (!allAddresses && entry.vpn != vpn)
+          continue;
+        if (!allASIDs && ((entry.flags & PTE_G) || entry.asid != asid))
+          continue;
+
+        entry.valid = false;
+      }
+}
+
+void
+MMU::dumpStatistics(void) const
+{
+  uint64_t lookups = itlb.hits + itlb.misses + dtlb.hits + dtlb.misses;
+  if (lookups == 0)
+    return;
+
+  auto storeFlags(std::cerr.flags());
+
+  std::cerr << std::fixed << std::setprecision(2)
+            << "ITLB: " << itlb.hits << " hits, " << itlb.misses
+            << " misses (" << (100.0 * itlb.hits /
+                               std::max<uint64_t>(1, itlb.hits + itlb.misses))
+            << "% hit rate)" << std::endl
+            << "DTLB: " << dtlb.hits << " hits, " << dtlb.misses
+            << " misses (" << (100.0 * dtlb.hits /
+                               std::max<uint64_t>(1, dtlb.hits + dtlb.misses))
+            << "% hit rate)" << std::endl
+            << nWalks << " page table walks, "
+            << nFlushes << " TLB flushes." << std::endl;
+
+  std::cerr.flags(storeFlags);
+}
+
+
+/*
+ * Private methods
+ */
+
+/* Loads and stores from M-mode use the privilege in mstatus.MPP when
+ * mstatus.MPRV is set.
+ */
+Privilege
+MMU::getEffectivePrivilege(AccessType type) const
+{
+  Privilege privilege = csrs.getPrivilege();
+
+  if (type != AccessType::Fetch && privilege == Privilege::Machine &&
+      (csrs.getStatus() & MSTATUS_MPRV))
+    privilege = static_cast<Privilege>((csrs.getStatus() & MSTATUS_MPP)
+                                       >> MSTATUS_MPP_SHIFT);
+
+  return privilege;
+}
+
+MemAddress
+MMU::translateSv39(MemAddress vaddr, AccessType type)
+{
+  /* Bits 63:39 must all equal bit 38. */
+  int64_t svaddr = (int64_t)vaddr;
+  if ((svaddr << 25) >> 25 != svaddr)
+    pageFault(vaddr, type);
+
+  TLB &tlb = type == AccessType::Fetch ? itlb : dtlb;
+  uint64_t vpn = vaddr >> PageShift;
+  uint16_t asid = (csrs.getSatp() >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+  TLBEntry &entry = tlb.entries[vpn & (TLBSize - 1)];
+
+  /* A store to a page that is not yet dirty goes through the walker,
+   * so that the dirty bit gets set.
+   */
+  if (entry.valid && entry.vpn == vpn &&
+      ((entry.flags & PTE_G) || entry.asid == asid) &&
+      (type != AccessType::Store || (entry.flags & PTE_D)))
+    ++tlb.hits;
+  else
+    {
+      ++tlb.misses;
+      entry = walk(vaddr, type);
+    }
+
+  if (!checkPermissions(entry.flags, type))
+    pageFault(vaddr, type);
+
+  return (entry.ppn << PageShift) | (vaddr & ((1 << PageShift) - 1));
+}
+
+bool
+MMU::checkPermissions(uint8_t flags, AccessType type) const
+{
+  Privilege privilege = getEffectivePrivilege(type);
+  RegValue status = csrs.getStatus();
+
+  /* U-mode may only access user pages. S-mode may never execute from
+   * user pages and only access their data when SUM is set.
+   */
+  if (privilege == Privilege::User && !(flags & PTE_U))
+    return false;
+  if (privilege == Privilege::Supervisor && (flags & PTE_U) &&
+      (type == AccessType::Fetch || !(status & MSTATUS_SUM)))
+    return false;
+
+  switch (type)
+    {
+      case AccessType::Fetch:
+        return flags & PTE_X;
+      case AccessType::Load:
+        return (flags & PTE_R) || ((status & MSTATUS_MXR) && (flags & PTE_X));
+      case AccessType::Store:
+        return flags & PTE_W;
+    }
+
+  return false;
+}
+
+/* Walk the Sv39 page table, returning a TLB entry for the 4 KiB page
+ * containing vaddr.
+ */
+MMU::TLBEntry
+MMU::walk(MemAddress vaddr, AccessType type)
+{
+  RegValue satp = csrs.getSatp();
+  MemAddress table = (satp & SATP_PPN_MASK) << PageShift;
+  MemAddress pteAddr = 0;
+  RegValue pte = 0;
+  int level;
+
+  ++nWalks;
+
+  for (level = Sv39Levels - 1; level >= 0; --level)
+    {
+      uint64_t index = (vaddr >> (PageShift + level * Sv39VPNBits)) &
+          ((1 << Sv39VPNBits) - 1);
+
+      pteAddr = table + index * PTESize;
+      try
+        {
+          pte = bus.readDoubleWord(pteAddr);
+        }
+      catch (IllegalAccess &e)
+        {
+          accessFault(vaddr, type);
+        }
+
+      if (!(pte & PTE_V) || (!(pte & PTE_R) && (pte & PTE_W)))
+        pageFault(vaddr, type);
+
+      /* Leaf entry */
+      if (pte & (PTE_R | PTE_X))
+        break;
+
+      table = ((pte >> PTEPPNShift) & PTEPPNMask) << PageShift;
+    }
+
+  if (level < 0)
+    pageFault(vaddr, type);
+
+  RegValue ppn = (pte >> PTEPPNShift) & PTEPPNMask;
+
+  /* Superpages must be aligned. */
+  RegValue superMask = ((RegValue)1 << (level * Sv39VPNBits)) - 1;
+  if (ppn & superMask)
+    pageFault(vaddr, type);
+
+  if (!checkPermissions(pte & 0xff, type))
+    pageFault(vaddr, type);
+
+  /* Update the accessed and dirty bits. */
+  RegValue updated = pte | PTE_A;
+  if (type == AccessType::Store)
+    updated |= PTE_D;
+  if (updated != pte)
+    {
+      try
+        {
+          bus.writeDoubleWord(pteAddr, updated);
+        }
+      catch (IllegalAccess &e)
+        {
+          accessFault(vaddr, type);
+        }
+    }
+
+  TLBEntry entry;
+  entry.vpn = vaddr >> PageShift;
+  entry.ppn = ppn | (entry.vpn & superMask);
+  entry.asid = (satp >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+  entry.flags = updated & 0xff;
+  entry.valid = true;
+
+  return entry;
+}
+
+void
+MMU::pageFault(MemAddress vaddr, AccessType type) const
+{
+  switch (type)
+    {
+      case AccessType::Fetch:
+        throw GuestException(ExceptionCause::InstructionPageFault, vaddr,
+                             "Instruction page fault");
+      case AccessType::Load:
+        throw GuestException(ExceptionCause::LoadPageFault, vaddr,
+                             "Load page fault");
+      case AccessType::Store:
+        throw GuestException(ExceptionCause::StorePageFault, vaddr,
+                             "Store page fault");
+    }
+}
+
+void
+MMU::accessFault(MemAddress vaddr, AccessType type) const
+{
+  switch (type)
+    {
+      case AccessType::Fetch:
+        throw GuestException(ExceptionCause::InstructionAccessFault, vaddr,
+                             "Instruction access fault");
+      case AccessType::Load:
+        throw GuestException(ExceptionCause::LoadAccessFault, vaddr,
+                             "Load access fault");
+      case AccessType::Store:
+        throw GuestException(ExceptionCause::StoreAccessFault, vaddr,
+                             "Store access fault");
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * mmu.h - Sv39 memory management unit with host-side TLBs.
+ */
+
+#ifndef __MMU_H__
+#define __MMU_H__
+
+#include "arch.h"
+#include "csr-file.h"
+#include "memory-bus.h"
+
+#include <array>
+
+enum class AccessType
+{
+  Fetch,
+  Load,
+  Store
+};
+
+struct MMUStatistics
+{
+  uint64_t itlbHits;
+  uint64_t itlbMisses;
+  uint64_t dtlbHits;
+  uint64_t dtlbMisses;
+  uint64_t walks;
+  uint64_t flushes;
+};
+
+/* The MMU translates virtual addresses to physical addresses on the
+ * memory bus. Translations are cached in separate instruction and data
+ * TLBs, which are direct-mapped and tagged with the ASID so that
+ * switching address spaces does not require a flush. Superpages are
+ * cached per 4 KiB page.
+ *
+ * Page table entries are read through the memory bus; the accessed and
+ * dirty bits are updated by the walker.
+ */
+class MMU
+{
+  public:
+    MMU(MemoryBus &bus, const CSRFile &csrs);
+
+    /* Returns the physical address or throws a GuestException for a
+     * page fault or access fault.
+     */
+    MemAddress translate(MemAddress vaddr, AccessType type)
+    {
+      if (!isTranslated(type))
+        return vaddr;
+      return translateSv39(vaddr, type);
+    }
+
+    /* sfence.vma: flush entries for the given address and/or ASID,
+     * or everything.
+     */
+    void flush(MemAddress vaddr, bool allAddresses,
+               uint16_t asid, bool allASIDs);
+
+    void dumpStatistics(void) const;
+    MMUStatistics getStatistics(void) const
+    {
+      return MMUStatistics{ itlb.hits, itlb.misses, dtlb.hits, dtlb.misses,
+                            nWalks, nFlushes };
+    }
+
+  private:
+    static const int TLBSize = 256;
+    static const unsigned int PageShift = 12;
+
+    struct TLBEntry
+    {
+      uint64_t vpn;
+      uint64_t ppn;
+      uint16_t asid;
+      /* PTE flag bits, kept so permissions can be checked on a hit */
+      uint8_t flags;
+      bool valid;
+    };
+
+    struct TLB
+    {
+      std::array<TLBEntry, TLBSize> entries;
+
+      uint64_t hits;
+      uint64_t misses;
+    };
+
+    MemoryBus &bus;
+    const CSRFile &csrs;
+
+    TLB itlb;
+    TLB dtlb;
+
+    uint64_t nWalks;
+    uint64_t nFlushes;
+
+    /* Private helper methods 
+		*/
+    bool isTranslated(AccessType type) const
+    {
+      if ((csrs.getSatp() >> SATP_MODE_SHIFT) != SATP_MODE_SV39)
+        return false;
+      return getEffectivePrivilege(type) != Privilege::Machine;
+    }
+
+    Privilege getEffectivePrivilege(AccessType type) const;
+    MemAddress translateSv39(MemAddress vaddr, AccessType type);
+    bool checkPermissions(uint8_t flags, AccessType type) const;
+    TLBEntry walk(MemAddress vaddr, AccessType type);
+    void pageFault(MemAddress vaddr, AccessType type) const;
+    void accessFault(MemAddress vaddr, AccessType type) const;
+};
+
+#endif /* __MMU_H__ */
@@ -0,0 +1,171 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * platform.cc - Platform selection and the "virt" platform layout.
+ */
+
+#include "platform.h"
+#include "fdt.h"
+#include "clint.h"
+#include "plic.h"
+#include "uart.h"
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+/* Phandles referenced within the device tree */
+static const uint32_t CPUIntcPhandle = 1;
+static const uint32_t PLICPhandle = 2;
+static const uint32_t SysControlPhandle = 3;
+
+/* Size of the system controller register window */
+static const MemAddress SysControlSize = 0x38;
+
+/* Offset of the HALT register, writing 0 powers off with exit code 0 */
+static const uint32_t SysControlHalt = 0x08;
+
+static std::string
+nodeName(const std::string &name, MemAddress addr)
+{
+  std::stringstream ss;
+  ss << name << "@" << std::hex << addr;
+  return ss.str();
+}
+
+/* Cells for a reg property with #address-cells = #size-cells = 2. */
+static std::vector<uint32_t>
+regCells(MemAddress addr, uint64_t size)
+{
+  return { (uint32_t)(addr >> 32), (uint32_t)addr,
+           (uint32_t)(size >> 32), (uint32_t)size };
+}
+
+std::vector<uint8_t>
+createVirtDeviceTree(const PlatformConfig &config,
+                     MemAddress sysControlBase,
+                     MemAddress initrdStart,
+                     MemAddress initrdEnd)
+{
+  FDTBuilder fdt;
+  std::string uartPath = "/soc/" + nodeName("serial", UART::DefaultBase);
+
+  fdt.beginNode("");
+  fdt.propertyU32("#address-cells", 2);
+  fdt.propertyU32("#size-cells", 2);
+  fdt.property("compatible", "riscv-virtio");
+  fdt.property("model", "rv64-emu,virt");
+
+  fdt.beginNode("chosen");
+  fdt.property("stdout-path", uartPath);
+  if (!config.bootargs.empty())
+    fdt.property("bootargs", config.bootargs);
+  if (initrdEnd > initrdStart)
+    {
+      fdt.propertyU64("linux,initrd-start", initrdStart);
+      fdt.propertyU64("linux,initrd-end", initrdEnd);
+    }
+  fdt.endNode();
+
+  fdt.beginNode("cpus");
+  fdt.propertyU32("#address-cells", 1);
+  fdt.propertyU32("#size-cells", 0);
+  fdt.propertyU32("timebase-frequency", VirtTimebaseFrequency);
+
+  fdt.beginNode("cpu@0");
+  fdt.property("device_type", "cpu");
+  fdt.propertyU32("reg", 0);
+  fdt.property("status", "okay");
+  fdt.property("compatible", "riscv");
+  fdt.property("riscv,isa", "rv64i_zicsr_zicntr");
+  fdt.property("mmu-type", "riscv,sv39");
+
+  fdt.beginNode("interrupt-controller");
+  fdt.propertyU32("#interrupt-cells", 1);
+  fdt.property("interrupt-controller");
+  fdt.property("compatible", "riscv,cpu-intc");
+  fdt.propertyU32("phandle", CPUIntcPhandle);
+  fdt.endNode();
+
+  fdt.endNode();        /* cpu@0 */
+  fdt.endNode();        /* cpus */
+
+  fdt.beginNode(nodeName("memory", VirtRAMBase));
+  fdt.property("device_type", "memory");
+  fdt.propertyCells("reg", regCells(VirtRAMBase, config.ramSize));
+  fdt.endNode();
+
+  fdt.beginNode("soc");
+  fdt.propertyU32("#address-cells", 2);
+  fdt.propertyU32("#size-cells", 2);
+  fdt.property("compatible", "simple-bus");
+  fdt.property("ranges");
+
+  fdt.beginNode(nodeName("clint", CLINT::DefaultBase));
+  fdt.property("compatible",
+               std::vector<std::string>{ "sifive,clint0", "riscv,clint0" });
+  fdt.propertyCells("reg", regCells(CLINT::DefaultBase, 0x10000));
+  fdt.propertyCells("interrupts-extended",
+                    { CPUIntcPhandle,
+                      static_cast<uint32_t>(Interrupt::MachineSoftware),
+                      CPUIntcPhandle,
+                      static_cast<uint32_t>(Interrupt::MachineTimer) });
+  fdt.endNode();
+
+  fdt.beginNode(nodeName("plic", PLIC::DefaultBase));
+  fdt.property("compatible",
+               std::vector<std::string>{ "sifive,plic-1.0.0", "riscv,plic0" });
+  fdt.propertyCells("reg", regCells(PLIC::DefaultBase, PLIC::Size));
+  fdt.propertyU32("#address-cells", 0);
+  fdt.propertyU32("#interrupt-cells", 1);
+  fdt.property("interrupt-controller");
+  fdt.propertyU32("riscv,ndev", PLIC::NumSources - 1);
+  fdt.propertyCells("interrupts-extended",
+                    { CPUIntcPhandle,
+                      static_cast<uint32_t>(Interrupt::MachineExternal),
+                      CPUIntcPhandle,
+                      static_cast<uint32_t>(Interrupt::SupervisorExternal) });
+  fdt.propertyU32("phandle", PLICPhandle);
+  fdt.endNode();
+
+  fdt.beginNode(nodeName("serial", UART::DefaultBase));
+  fdt.property("compatible", "ns16550a");
+  fdt.propertyCells("reg", regCells(UART::DefaultBase, UART::Size));
+  fdt.propertyU32("clock-frequency", 3686400);
+  fdt.propertyU32("interrupts", VirtUARTInterrupt);
+  fdt.propertyU32("interrupt-parent", PLICPhandle);
+  fdt.endNode();
+
+  /* The system controller doubles as power-off device, understood by
+   * both OpenSBI and Linux.
+   */
+  fdt.beginNode(nodeName("syscon", sysControlBase));
+  fdt.property("compatible", "syscon");
+  fdt.propertyCells("reg", regCells(sysControlBase, SysControlSize));
+  fdt.propertyU32("phandle", SysControlPhandle);
+  fdt.endNode();
+
+  fdt.beginNode("poweroff");
+  fdt.property("compatible", "syscon-poweroff");
+  fdt.propertyU32("regmap", SysControlPhandle);
+  fdt.propertyU32("offset", SysControlHalt);
+  fdt.propertyU32("value", 0);
+  fdt.endNode();
+
+  fdt.endNode();        /* soc */
+  fdt.endNode();        /* root */
+
+  return fdt.finish();
+}
+
+std::vector<uint8_t>
+readImage(const std::string &filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+
+  if (!file)
+    throw std::runtime_error("Could not open image " + filename + ".");
+
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                              std::istreambuf_iterator<char>());
+}
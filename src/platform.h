@@ -0,0 +1,83 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * platform.h - Platform selection and the "virt" platform layout.
+ */
+
+/* Two platforms are available. The "simple" platform creates a memory
+ * for every section of the program and has the write-only serial
+ * interface at 0x200. The "virt" platform follows the QEMU machine of
+ * the same name, so that unmodified firmware and kernels can run:
+ *
+ *   0x00000270  system controller
+ *   0x02000000  CLINT
+ *   0x0c000000  PLIC
+ *   0x10000000  UART 16550, interrupt 10
+ *   0x80000000  RAM, the program is loaded here (e.g. OpenSBI)
+ *   0x80200000  kernel image (optional)
+ *
+ * A device tree describing the platform is placed in the last 64 KiB
+ * of RAM, an initial ramdisk is placed right below it. At entry a0
+ * holds the hart id (0) and a1 the address of the device tree.
+ */
+
+#ifndef __PLATFORM_H__
+#define __PLATFORM_H__
+
+#include "arch.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class PlatformType
+{
+  Simple,
+  Virt
+};
+
+static const MemAddress VirtRAMBase = 0x80000000;
+static const size_t VirtDefaultRAMSize = 128 * 1024 * 1024;
+static const size_t VirtMinimumRAMSize = 4 * 1024 * 1024;
+static const MemAddress VirtKernelOffset = 0x200000;
+static const size_t VirtDeviceTreeSize = 64 * 1024;
+static const int VirtUARTInterrupt = 10;
+
+/* Timebase of the CLINT as advertised to the guest, mtime advances
+ * one tick per instruction.
+ */
+static const uint32_t VirtTimebaseFrequency = 10000000;
+
+struct PlatformConfig
+{
+  PlatformConfig()
+    : type(PlatformType::Simple), ramSize(VirtDefaultRAMSize)
+  { }
+
+  PlatformType type;
+  size_t ramSize;
+
+  /* Optional raw images and kernel command line for "virt" */
+  std::string kernel;
+  std::string initrd;
+  std::string bootargs;
+
+  /* Where the console output of the program goes instead of standard
+   * error (Serial, system controller and termination messages) and
+   * standard output (UART).
+   */
+  std::ostream *console = nullptr;
+};
+
+/* Returns the device tree blob describing the "virt" platform.
+ * Pass zero for both initrd addresses when there is no ramdisk.
+ */
+std::vector<uint8_t> createVirtDeviceTree(const PlatformConfig &config,
+                                          MemAddress sysControlBase,
+                                          MemAddress initrdStart,
+                                          MemAddress initrdEnd);
+
+/* Read a raw image from the host file system. 
+*/
+std::vector<uint8_t> readImage(const std::string &filename);
+
+#endif /* __PLATFORM_H__ */
@@ -0,0 +1,249 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * plic.cc - Platform-level interrupt controller.
+ */
+
+#include "plic.h"
+#include "checkpoint.h"
+#include "trap.h"
+
+PLIC::PLIC(const MemAddress base, CSRFile &csrs)
+  : base(base), csrs(csrs), levels(0), pending(0), inService(0)
+{
+  priority.fill(0);
+  enable.fill(0);
+  threshold.fill(0);
+}
+
+PLIC::~PLIC()
+{
+}
+
+void
+PLIC::setLevel(int source, bool level)
+{
+  uint32_t bit = (uint32_t)1 << source;
+
+  if (source <= 0 || source >= NumSources)
+    return;
+
+  if (level)
+    {
+      levels |= bit;
+      if ((inService & bit) == 0)
+        pending |= bit;
+    }
+  else
+    {
+      levels &= ~bit;
+      pending &= ~bit;
+    }
+
+  update();
+}
+
+void
+PLIC::saveState(CheckpointWriter &writer) const
+{
+  writer.put(priority);
+  writer.put(levels);
+  writer.put(pending);
+  writer.put(inService);
+  writer.put(enable);
+  writer.put(threshold);
+}
+
+void
+PLIC::restoreState(CheckpointReader &reader)
+{
+  priority = reader.get<decltype(priority)>();
+  levels = reader.get<uint32_t>();
+  pending = reader.get<uint32_t>();
+  inService = reader.get<uint32_t>();
+  enable = reader.get<decltype(enable)>();
+  threshold = reader.get<decltype(threshold)>();
+}
+
+/*
+ * MemoryInterface
+ */
+
+uint8_t
+PLIC::readByte(MemAddress addr)
+{
+  throw IllegalAccess(addr, sizeof(uint8_t));
+}
+
+uint16_t
+PLIC::readHalfWord(MemAddress addr)
+{
+  throw IllegalAccess(addr, sizeof(uint16_t));
+}
+
+uint32_t
+PLIC::readWord(MemAddress addr)
+{
+  MemAddress offset = addr - base;
+
+  if ((addr & 0x3) != 0)
+    throw IllegalAccess(addr, sizeof(uint32_t));
+
+  if (offset < Register::Priority + NumSources * 4)
+    return priority[offset / 4];
+
+  if (offset == Register::Pending)
+    return pending;
+
+  if (offset >= Register::Enable &&
+      offset < Register::Enable + NumContexts * Register::EnableStride)
+    {
+      MemAddress context = (offset - Register::Enable) / Register::EnableStride;
+      return (offset & (Register::EnableStride - 1)) == 0 ? enable[context] : 0;
+    }
+
+  if (offset >= Register::Threshold &&
+      offset < Register::Threshold + NumContexts * Register::ContextStride)
+    {
+      int context = (offset - Register::Threshold) / Register::ContextStride;
+      MemAddress reg = offset - context * Register::ContextStride;
+
+      if (reg == Register::Threshold)
+        return threshold[context];
+      else if (reg == Register::Claim)
+        return claim(context);
+    }
+
+  /* Other registers within the range read as zero. */
+  return 0;
+}
+
+uint64_t
+PLIC::readDoubleWord(MemAddress addr)
+{
+  throw IllegalAccess(addr, sizeof(uint64_t));
+}
+
+
+void
+PLIC::writeByte(MemAddress addr, uint8_t value)
+{
+  throw IllegalAccess(addr, sizeof(value));
+}
+
+void
+PLIC::writeHalfWord(MemAddress addr, uint16_t value)
+{
+  throw IllegalAccess(addr, sizeof(value));
+}
+
+void
+PLIC::writeWord(MemAddress addr, uint32_t value)
+{
+  MemAddress offset = addr - base;
+
+  if ((addr & 0x3) != 0)
+    throw IllegalAccess(addr, sizeof(value));
+
+  if (offset < Register::Priority + NumSources * 4)
+    {
+      if (offset != 0)
+        priority[offset / 4] = value & 0x7;
+    }
+  else if (offset >= Register::Enable &&
+           offset < Register::Enable + NumContexts * Register::EnableStride)
+    {
+      MemAddress context = (offset - Register::Enable) / Register::EnableStride;
+      if ((offset & (Register::EnableStride - 1)) == 0)
+        enable[context] = value & ~(uint32_t)1;
+    }
+  else if (offset >= Register::Threshold &&
+           offset < Register::Threshold + NumContexts * Register::ContextStride)
+    {
+      int context = (offset - Register::Threshold) / Register::ContextStride;
+      MemAddress reg = offset - context * Register::ContextStride;
+
+      if (reg == Register::Threshold)
+        threshold[context] = value & 0x7;
+      else if (reg == Register::Claim)
+        complete(context, value);
+    }
+
+  /* Writes to other registers are ignored. */
+  update();
+}
+
+void
+PLIC::writeDoubleWord(MemAddress addr, uint64_t value)
+{
+  throw IllegalAccess(addr, sizeof(value));
+}
+
+bool
+PLIC::contains(MemAddress addr) const
+{
+  return base <= addr && addr < base + Size;
+}
+
+
+/*
+ * Private methods
+ */
+
+/* Returns the pending, enabled source with the highest priority that
+ * exceeds the threshold of the context, or 0 when there is none. Ties
+ * go to the lowest source number.
+ */
+int
+PLIC::getBestSource(int context) const
+{
+  uint32_t candidates = pending & enable[context];
+  int best = 0;
+  uint32_t bestPriority = threshold[context];
+
+  for (int source = 1; source < NumSources; ++source)
+    if ((candidates & ((uint32_t)1 << source)) &&
+        priority[source] > bestPriority)
+      {
+        best = source;
+        bestPriority = priority[source];
+      }
+
+  return best;
+}
+
+uint32_t
+PLIC::claim(int context)
+{
+  int source = getBestSource(context);
+
+  if (source != 0)
+    {
+      pending &= ~((uint32_t)1 << source);
+      inService |= (uint32_t)1 << source;
+      update();
+    }
+
+  return source;
+}
+
+void
+PLIC::complete(int context, uint32_t source)
+{
+  if (source == 0 || source >= NumSources)
+    return;
+
+  uint32_t bit = (uint32_t)1 << source;
+
+  inService &= ~bit;
+  if (levels & bit)
+    pending |= bit;
+}
+
+void
+PLIC::update(void)
+{
+  csrs.setInterruptPending(Interrupt::MachineExternal,
+                           getBestSource(0) != 0);
+  csrs.setInterruptPending(Interrupt::SupervisorExternal,
+                           getBestSource(1) != 0);
+}
@@ -0,0 +1,97 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * plic.h - Platform-level interrupt controller.
+ */
+
+/* Register layout is compatible with the SiFive PLIC as found on the
+ * QEMU "virt" platform, with two contexts: context 0 is the M-mode
+ * and context 1 the S-mode external interrupt of hart 0.
+ *
+ *   0x000000 + 4 * source   priority   (rw)
+ *   0x001000                pending    (r)  one bit per source
+ *   0x002000 + 0x80 * ctx   enable     (rw) one bit per source
+ *   0x200000 + 0x1000 * ctx threshold  (rw)
+ *   0x200004 + 0x1000 * ctx claim      (r)  / complete (w)
+ *
+ * Sources are level triggered. A source that has been claimed does
+ * not become pending again until its completion has been signalled.
+ * Only 32-bit accesses are supported.
+ */
+
+#ifndef __PLIC_H__
+#define __PLIC_H__
+
+#include "memory-interface.h"
+#include "csr-file.h"
+
+#include <array>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+class PLIC : public MemoryInterface
+{
+  public:
+    static const MemAddress DefaultBase = 0xc000000;
+    static const MemAddress Size = 0x600000;
+
+    /* Source 0 is reserved, so sources 1 to NumSources - 1 exist. */
+    static const int NumSources = 32;
+
+    PLIC(const MemAddress base, CSRFile &csrs);
+    virtual ~PLIC();
+
+    void saveState(CheckpointWriter &writer) const;
+    void restoreState(CheckpointReader &reader);
+
+    /* Set the level of an interrupt line, called by devices. 
+		*/
+    void setLevel(int source, bool level);
+
+    /* MemoryInterface 
+		*/
+    virtual uint8_t readByte(MemAddress addr) override;
+    virtual uint16_t readHalfWord(MemAddress addr) override;
+    virtual uint32_t readWord(MemAddress addr) override;
+    virtual uint64_t readDoubleWord(MemAddress addr) override;
+
+    virtual void writeByte(MemAddress addr, uint8_t value) override;
+    virtual void writeHalfWord(MemAddress addr, uint16_t value) override;
+    virtual void writeWord(MemAddress addr, uint32_t value) override;
+    virtual void writeDoubleWord(MemAddress addr, uint64_t value) override;
+
+    virtual bool contains(MemAddress addr) const override;
+
+  private:
+    enum Register : MemAddress
+    {
+      Priority = 0x000000,
+      Pending = 0x001000,
+      Enable = 0x002000,
+      EnableStride = 0x80,
+      Threshold = 0x200000,
+      Claim = 0x200004,
+      ContextStride = 0x1000
+    };
+
+    static const int NumContexts = 2;
+
+    const MemAddress base;
+    CSRFile &csrs;
+
+    std::array<uint32_t, NumSources> priority;
+    uint32_t levels;
+    uint32_t pending;
+    uint32_t inService;
+    std::array<uint32_t, NumContexts> enable;
+    std::array<uint32_t, NumContexts> threshold;
+
+    /* Private helper methods 
+		*/
+    int getBestSource(int context) const;
+    uint32_t claim(int context);
+    void complete(int context, uint32_t source);
+    void update(void);
+};
+
+#endif /* __PLIC_H__ */
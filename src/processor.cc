@@ -8,9 +8,14 @@
 #include "serial.h"
 
 #include "memory.h"
+#include "trace-codec.h"
+#include "checkpoint.h"
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <limits>
+#include <set>
 
 #include <bitset>
 #include <stdint.h>
@@ -47,13 +52,117 @@ class InstructionFetchFailure : public std::exception
 };
 
 
+/* Interval, in instructions, at which host input is polled. */
+static const uint64_t UARTPollInterval = 100000;
+
+static const MemAddress SysControlBase = 0x270;
+
+
 Processor::Processor(ELFFile &program, bool debugMode)
-  : debugMode(debugMode), nCycles(0), nInstructions(0),
-    PC(program.getEntrypoint()), bus(program.createMemories()),
-  control(new SysControl(0x270))
+  : Processor(program, PlatformConfig(), debugMode)
+{
+}
+
+Processor::Processor(ELFFile &program, const PlatformConfig &platform,
+                     bool debugMode)
+  : debugMode(debugMode),
+    console(platform.console ? *platform.console : std::cerr),
+    nCycles(0), nInstructions(0),
+    blockStart(program.getEntrypoint()), blockStartInstructions(0),
+    profileTopN(0), sampleWeight(SampleWeight::Instructions),
+    checkpointAt(std::numeric_limits<uint64_t>::max()),
+    checkpointInterval(0), nCheckpoints(0),
+    stopAt(std::numeric_limits<uint64_t>::max()), stopped(false),
+    stopRequested(false), nRecentBlocks(0),
+    program(program), PC(program.getEntrypoint()), fetchPC(PC),
+    fetchAddress(0), decodeCache(program.getCodeSections()),
+    bus(platform.type == PlatformType::Simple ?
+        program.createMemories() :
+        std::vector<std::shared_ptr<MemoryInterface>>()),
+  mmu(bus, csrs), control(new SysControl(SysControlBase, console)),
+  clint(new CLINT(CLINT::DefaultBase, csrs, &nInstructions))
+{
+  if (platform.type == PlatformType::Virt)
+    setupVirtPlatform(program, platform);
+  else
+    setupSimplePlatform();
+
+  bus.addClient(control, true);
+  bus.addClient(clint, true);
+
+  control->attachCounters(&nInstructions, &nCycles);
+  csrs.attachCounters(&nInstructions, &nCycles);
+  csrs.attachEvent(HPMEvent::DeviceAccess, bus.getDeviceAccessCounter());
+  csrs.attachEvent(HPMEvent::DecodeCacheMiss, decodeCache.getMissCounter());
+}
+
+void
+Processor::setupSimplePlatform(void)
+{
+  bus.addClient(std::shared_ptr<MemoryInterface>(new Serial(0x200, console)), true);
+}
+
+/* Load the program, kernel, initial ramdisk and device tree into RAM
+ * and add the "virt" devices. See platform.h for the layout.
+ */
+void
+Processor::setupVirtPlatform(ELFFile &program, const PlatformConfig &platform)
 {
-  bus.addClient(std::shared_ptr<MemoryInterface>(new Serial(0x200)));
-  bus.addClient(control);
+  if (platform.ramSize < VirtMinimumRAMSize)
+    throw std::runtime_error("RAM size too small for virt platform.");
+
+  std::shared_ptr<Memory> ram =
+      Memory::createAnonymous("RAM", VirtRAMBase, platform.ramSize);
+  program.loadInto(*ram);
+
+  MemAddress kernelEnd = VirtRAMBase + VirtKernelOffset;
+  if (!platform.kernel.empty())
+    {
+      std::vector<uint8_t> image = readImage(platform.kernel);
+      ram->load(kernelEnd, image.data(), image.size());
+      kernelEnd += image.size();
+    }
+
+  MemAddress deviceTree = VirtRAMBase + platform.ramSize - VirtDeviceTreeSize;
+  MemAddress initrdStart = 0, initrdEnd = 0;
+  if (!platform.initrd.empty())
+    {
+      std::vector<uint8_t> image = readImage(platform.initrd);
+
+      if (image.size() > deviceTree - kernelEnd)
+        throw std::runtime_error("RAM size too small for initial ramdisk.");
+
+      initrdStart = (deviceTree - image.size()) & ~(MemAddress)0xfff;
+      initrdEnd = initrdStart + image.size();
+      if (initrdStart < kernelEnd)
+        throw std::runtime_error("RAM size too small for initial ramdisk.");
+
+      ram->load(initrdStart, image.data(), image.size());
+    }
+
+  std::vector<uint8_t> dtb =
+      createVirtDeviceTree(platform, SysControlBase, initrdStart, initrdEnd);
+  if (dtb.size() > VirtDeviceTreeSize)
+    throw std::runtime_error("Device tree too large.");
+  ram->load(deviceTree, dtb.data(), dtb.size());
+
+  plic.reset(new PLIC(PLIC::DefaultBase, csrs));
+  uart.reset(new UART(UART::DefaultBase, plic.get(), VirtUARTInterrupt,
+                      platform.console ? *platform.console : std::cout));
+
+  bus.addClient(ram);
+  bus.addClient(uart, true);
+  bus.addClient(plic, true);
+
+  /* Stores outside of the memory map fault on this platform */
+  alu.setAllocateOnStore(false);
+
+  /* Boot protocol: a0 = hart id, a1 = device tree */
+  regfile.writeRegister(10, 0);
+  regfile.writeRegister(11, deviceTree);
+
+  /* Start polling for console input */
+  csrs.requestInterruptCheck(0);
 }
 
 /* This method is used to initialize registers using values
@@ -71,13 +180,349 @@ Processor::getRegister(RegNumber regnum) const
   return regfile.readRegister(regnum);
 }
 
+void
+Processor::enableProfiling(size_t topN)
+{
+  profiler.reset(new Profiler());
+  profileTopN = topN;
+}
+
+void
+Processor::enableFlameGraph(uint64_t interval, SampleWeight weight)
+{
+  flameGraph.reset(new FlameGraph(PC, interval));
+  sampleWeight = weight;
+}
+
+void
+Processor::writeFlameGraph(std::ostream &os) const
+{
+  if (flameGraph)
+    flameGraph->write(os, program.getSymbolTable());
+}
+
+void
+Processor::enableInstructionMix(void)
+{
+  mix.reset(new InstructionMix());
+}
+
+void
+Processor::writeInstructionMix(std::ostream &os) const
+{
+  if (mix)
+    mix->writeJSON(os, getExecutionEvents());
+}
+
+void
+Processor::enableTrace(const std::string &filename)
+{
+  trace.reset(new TraceWriter(filename, getDefaultTraceCodec()));
+}
+
+void
+Processor::finishTrace(void)
+{
+  if (trace)
+    trace->finish();
+}
+
+void
+Processor::enableMemoryTrace(uint64_t sampleRate, uint64_t window)
+{
+  memoryTrace.reset(new MemoryTrace(sampleRate, window));
+}
+
+void
+Processor::writeMemoryTrace(std::ostream &os)
+{
+  if (memoryTrace)
+    memoryTrace->writeReport(os, program.getSymbolTable());
+}
+
+void
+Processor::enableCoverage(const ELFFile &program)
+{
+  coverage.reset(new Coverage(program));
+}
+
+void
+Processor::writeCoverage(std::ostream &os) const
+{
+  if (coverage)
+    coverage->writeLcov(os);
+}
+
+void
+Processor::enableStatsServer(const std::string &path)
+{
+  statsServer.reset(new StatsServer(path));
+}
+
+void
+Processor::enableBBVProfile(uint64_t interval)
+{
+  bbvProfile.reset(new BBVProfile(interval, getIntervalCounters()));
+}
+
+IntervalCounters
+Processor::getIntervalCounters(void) const
+{
+  MMUStatistics mmuStats = mmu.getStatistics();
+
+  return IntervalCounters{ nInstructions, nCycles,
+                           mmuStats.itlbMisses + mmuStats.dtlbMisses };
+}
+
+void
+Processor::flushTLB(void)
+{
+  mmu.flush(0, true, 0, true);
+}
+
+void
+Processor::enableDecodeCache(const std::string &directory)
+{
+  decodeCache.load(directory);
+  decodeCacheDirectory = directory;
+}
+
+void
+Processor::saveDecodeCache(void)
+{
+  if (!decodeCacheDirectory.empty())
+    decodeCache.save(decodeCacheDirectory);
+}
+
+void
+Processor::enableReplayLog(const std::string &filename, ReplayLog::Mode mode)
+{
+  replayLog.reset(new ReplayLog(filename, mode, &nInstructions));
+
+  control->attachReplayLog(replayLog.get());
+  if (uart)
+    uart->attachReplayLog(replayLog.get());
+}
+
+void
+Processor::finishReplayLog(void)
+{
+  if (replayLog)
+    replayLog->finish();
+}
+
+/* The checkpoint layout follows the order of the calls below, the
+ * memories come last as they make up nearly all of the file. The
+ * serial port has no state.
+ */
+void
+Processor::saveCheckpoint(const std::string &filename, bool incremental)
+{
+  incremental = incremental && !lastCheckpoint.empty();
+  CheckpointWriter writer(filename,
+                          incremental ? lastCheckpoint : std::string());
+
+  writer.put<uint8_t>(plic ? 1 : 0);
+  writer.put(PC);
+  writer.put(nInstructions);
+  writer.put(nCycles);
+  for (RegNumber i = 1; i < NumRegs; ++i)
+    writer.put(regfile.readRegister(i));
+
+  csrs.saveState(writer);
+  control->saveState(writer);
+  clint->saveState(writer);
+  if (plic)
+    {
+      plic->saveState(writer);
+      uart->saveState(writer);
+    }
+
+  auto memories = bus.getMemories();
+  writer.put<uint32_t>(memories.size());
+  for (auto &memory : memories)
+    {
+      writer.putString(memory->getName());
+      writer.put<uint64_t>(memory->getBase());
+      writer.put<uint64_t>(memory->getSize());
+      writer.put(memory->getMayWrite());
+      memory->saveState(writer, incremental);
+    }
+
+  writer.finish();
+
+  for (auto &memory : memories)
+    memory->clearDirty();
+  lastCheckpoint = filename;
+}
+
+/* The resolved path of filename. For a file that does not exist yet,
+ * only its directory is resolved.
+ */
+static std::string
+getCanonicalPath(const std::string &filename)
+{
+  char *path = realpath(filename.c_str(), nullptr);
+  if (path)
+    {
+      std::string result(path);
+      free(path);
+      return result;
+    }
+
+  size_t slash = filename.find_last_of('/');
+  std::string directory = slash == std::string::npos ? "." :
+      slash == 0 ? "/" : filename.substr(0, slash);
+  path = realpath(directory.c_str(), nullptr);
+  if (!path)
+    return filename;
+
+  std::string result(path);
+  free(path);
+  return result + "/" + filename.substr(slash + 1);
+}
+
+void
+Processor::restoreCheckpoint(const std::string &filename)
+{
+  CheckpointReader reader(filename);
+  restoredCheckpoints.insert(getCanonicalPath(filename));
+
+  if (reader.isIncremental())
+    restoreCheckpoint(reader.getParent());
+
+  if (reader.get<uint8_t>() != (plic ? 1 : 0))
+    throw std::runtime_error("Checkpoint was taken on another platform.");
+
+  PC = fetchPC = reader.get<MemAddress>();
+  nInstructions = reader.get<uint64_t>();
+  nCycles = reader.get<uint64_t>();
+  for (RegNumber i = 1; i < NumRegs; ++i)
+    regfile.writeRegister(i, reader.get<RegValue>());
+
+  csrs.restoreState(reader);
+  control->restoreState(reader);
+  clint->restoreState(reader);
+  if (plic)
+    {
+      plic->restoreState(reader);
+      uart->restoreState(reader);
+    }
+
+  /* Memories allocated on store during the run do not exist yet, all
+   * others must be in the checkpoint.
+   */
+  auto memories = bus.getMemories();
+  uint32_t count = reader.get<uint32_t>();
+  size_t matched = 0;
+  for (uint32_t i = 0; i < count; ++i)
+    {
+      std::string name = reader.getString();
+      MemAddress base = reader.get<uint64_t>();
+      size_t size = reader.get<uint64_t>();
+      bool mayWrite = reader.get<bool>();
+
+      std::shared_ptr<Memory> memory;
+      for (auto &candidate : memories)
+        if (candidate->getBase() == base && candidate->getSize() == size)
+          memory = candidate;
+
+      if (memory)
+        ++matched;
+      else
+        {
+          memory = Memory::createAnonymous(name, base, size);
+          bus.addClient(memory);
+        }
+
+      memory->setMayWrite(mayWrite);
+      memory->restoreState(reader, reader.isIncremental());
+    }
+
+  if (matched != memories.size())
+    throw std::runtime_error("Checkpoint was taken of another program.");
+
+  mmu.flush(0, true, 0, true);
+
+  blockStart = PC;
+  blockStartInstructions = nInstructions;
+  lastCheckpoint = filename;
+}
+
+void
+Processor::scheduleCheckpoint(const std::string &filename,
+                              uint64_t instructions, uint64_t interval)
+{
+  /* The restored checkpoint and its parents make up the chain that
+   * the next incremental checkpoint builds on, and guest memory may be
+   * mapped from them. With an interval, filename.1, filename.2 and so
+   * on are written.
+   */
+  std::string path = getCanonicalPath(filename);
+  for (const std::string &restored : restoredCheckpoints)
+    {
+      bool overwrites = restored == path;
+
+      if (interval && restored.compare(0, path.size() + 1, path + ".") == 0)
+        {
+          std::string suffix = restored.substr(path.size() + 1);
+          overwrites = !suffix.empty() &&
+              suffix.find_first_not_of("0123456789") == std::string::npos;
+        }
+
+      if (overwrites)
+        throw std::invalid_argument("Cannot save checkpoint " + filename +
+                                    " over " + restored + ", which the run "
+                                    "was restored from.");
+    }
+
+  checkpointFilename = filename;
+  checkpointAt = instructions;
+  checkpointInterval = interval;
+}
+
+void
+Processor::saveScheduledCheckpoint(void)
+{
+  ++nCheckpoints;
+
+  if (checkpointInterval == 0)
+    {
+      saveCheckpoint(checkpointFilename);
+      checkpointAt = std::numeric_limits<uint64_t>::max();
+      return;
+    }
+
+  saveCheckpoint(checkpointFilename + "." + std::to_string(nCheckpoints),
+                 true);
+
+  /* A long block may have passed several check points */
+  while (checkpointAt <= nInstructions)
+    checkpointAt += checkpointInterval;
+}
+
+ExecutionEvents
+Processor::getExecutionEvents(void) const
+{
+  return ExecutionEvents{ csrs.getEventCount(HPMEvent::BranchTaken),
+                          csrs.getEventCount(HPMEvent::BranchNotTaken),
+                          csrs.getEventCount(HPMEvent::DeviceAccess) };
+}
+
+RegValue
+Processor::getExitCode(void) const
+{
+  return control->getExitCode();
+}
+
 
 /* Processor main loop. Each iteration should execute an instruction.
  * One step in executing and instruction takes exactly 1 clock cycle.
  *
  * The return value indicates whether an exception occurred during
  * execution [false] or whether the whole program was completed 
- * succesfully [true].
+ * succesfully [true]. Exceptions only end execution when the program
+ * did not install a trap handler (mtvec is zero).
  *
  * In "testMode" instruction fetch failures are not fatal. This is because
  * a clean shutdown of the program requires the store instruction to be
@@ -88,7 +533,10 @@ Processor::getRegister(RegNumber regnum) const
 bool
 Processor::run(bool testMode)
 {
-  while (! control->shouldHalt())
+  HOST_PROFILE_SCOPE(HostPhase::Other);
+
+  stopped = false;
+  while (! control->shouldHalt() && ! stopped)
     {
       try
         {
@@ -110,38 +558,337 @@ Processor::run(bool testMode)
           writeBack();
 
           ++nInstructions;
+
+          if (mix)
+            mix->count(instruction);
+
+          if (trace)
+            traceInstruction();
+
+          if (isBlockEnd(decoded.opcode))
+            endOfBlock();
         }
       catch (InstructionFetchFailure &e)
         {
           if (testMode)
             return true;
           /* else */
-          std::cerr << "ABNORMAL PROGRAM TERMINATION; PC = "
-                    << std::hex << PC << std::dec << std::endl;
-          std::cerr << "Reason: " << e.what() << std::endl;
-          return false;
+          if (!raiseException(ExceptionCause::InstructionAccessFault,
+                              fetchPC, e))
+            return false;
+        }
+      catch (GuestException &e)
+        {
+          if (!raiseException(e.getCause(), e.getTval(), e))
+            return false;
+        }
+      catch (IllegalInstruction &e)
+        {
+          if (!raiseException(ExceptionCause::IllegalInstruction,
+                              instruction, e))
+            return false;
         }
       catch (std::exception &e)
         {
-          /* Catch exceptions such as IllegalInstruction and InvalidAccess */
-          std::cerr << "ABNORMAL PROGRAM TERMINATION; PC = "
-                    << std::hex << PC << std::dec << std::endl;
-          std::cerr << "Reason: " << e.what() << std::endl;
+          /* Catch other exceptions, such as register numbers out of range */
+          reportAbnormalTermination(PC, e);
           return false;
         }
     }
 
+  /* Stopped at a block boundary, nothing to account for */
+  if (stopped)
+    return true;
+
+  countBlock(false);
+  if (bbvProfile)
+    bbvProfile->endInterval(getIntervalCounters());
+  if (statsServer)
+    {
+      publishStats();
+      statsServer->getSnapshot().running.store(false,
+                                               std::memory_order_relaxed);
+    }
+  if (flameGraph)
+    flameGraph->sample(nInstructions, sampleWeight == SampleWeight::Cycles ?
+                                      nCycles : nInstructions);
   return true;
 }
 
+/* Work that does not need to be done for every instruction is batched
+ * at the end of a basic block.
+ */
+void
+Processor::endOfBlock(void)
+{
+  countBlock(true);
+
+  if (flameGraph)
+    trackCalls();
+
+  if (statsServer)
+    publishStats();
+
+  if (nInstructions >= checkpointAt)
+    saveScheduledCheckpoint();
+
+  if (nInstructions >= csrs.getInterruptCheckPoint())
+    checkInterrupts();
+
+  checkStopPoint();
+
+  startBlock();
+}
+
+/* A block is complete when it ended with a control transfer or system
+ * instruction, rather than being cut short by a trap or a halt.
+ */
+void
+Processor::countBlock(bool complete)
+{
+  recentBlocks[nRecentBlocks++ % NumRecentBlocks] =
+      std::make_pair(blockStart, fetchPC);
+
+  if (profiler)
+    profiler->countBlock(blockStart, nInstructions - blockStartInstructions);
+
+  if (bbvProfile)
+    {
+      bbvProfile->countBlock(blockStart,
+                             nInstructions - blockStartInstructions);
+      if (bbvProfile->isIntervalDone(nInstructions))
+        bbvProfile->endInterval(getIntervalCounters());
+    }
+
+  if (coverage)
+    {
+      if (!complete)
+        coverage->countPartialBlock(blockStart,
+                                    nInstructions - blockStartInstructions);
+      else
+        {
+          coverage->countBlock(blockStart);
+          if (decoded.opcode == 0x63)
+            coverage->countBranch(fetchPC, PC != fetchPC + 4);
+        }
+    }
+}
+
+void
+Processor::startBlock(void)
+{
+  blockStart = PC;
+  blockStartInstructions = nInstructions;
+}
+
+/* Follows the calling convention: jal and jalr linking through ra or
+ * t0 are calls, jalr through ra or t0 without link is a return. Traps
+ * are entered by raiseException and checkInterrupts, mret and sret
+ * return from them. The stack is sampled before the instruction that
+ * ended the block changes it.
+ */
+void
+Processor::trackCalls(void)
+{
+  if (nInstructions >= flameGraph->getNextSample())
+    flameGraph->sample(nInstructions, sampleWeight == SampleWeight::Cycles ?
+                                      nCycles : nInstructions);
+
+  int rd = decoded.reg[0];
+  int rs1 = decoded.reg[1];
+
+  if (decoded.opcode == 0x6f || decoded.opcode == 0x67)
+    {
+      if (rd == 1 || rd == 5)
+        flameGraph->call(PC, fetchPC + 4);
+      else if (decoded.opcode == 0x67 && (rs1 == 1 || rs1 == 5))
+        flameGraph->ret(PC);
+    }
+  else if (decoded.opcode == 0x73 && decoded.funct3 == 0 &&
+           (decoded.immediate == 0x302 || decoded.immediate == 0x102))
+    flameGraph->ret(PC);
+}
+
+void
+Processor::traceInstruction(void)
+{
+  HOST_PROFILE_SCOPE(HostPhase::Trace);
+
+  const MemoryAccess &access = alu.getMemoryAccess();
+  TraceRecord record;
+
+  record.pc = fetchPC;
+  record.instruction = instruction;
+  record.rd = decoded.reg[0];
+  record.value = alu.getResult();
+  record.memSize = access.valid ? access.size : 0;
+  record.memWrite = access.write;
+  record.memAddr = access.vaddr;
+  record.memValue = access.value;
+
+  trace->record(record);
+}
+
+/* Called at the end of every block, the server thread reads these
+ * whenever it is queried.
+ */
+void
+Processor::publishStats(void)
+{
+  const auto relaxed = std::memory_order_relaxed;
+  StatsSnapshot &snapshot = statsServer->getSnapshot();
+  MMUStatistics mmuStats = mmu.getStatistics();
+
+  snapshot.instructions.store(nInstructions, relaxed);
+  snapshot.cycles.store(nCycles, relaxed);
+  snapshot.pc.store(PC, relaxed);
+  snapshot.itlbHits.store(mmuStats.itlbHits, relaxed);
+  snapshot.itlbMisses.store(mmuStats.itlbMisses, relaxed);
+  snapshot.dtlbHits.store(mmuStats.dtlbHits, relaxed);
+  snapshot.dtlbMisses.store(mmuStats.dtlbMisses, relaxed);
+  snapshot.pageWalks.store(mmuStats.walks, relaxed);
+  snapshot.decodeCacheSize.store(decodeCache.getSize(), relaxed);
+}
+
+void
+Processor::checkInterrupts(void)
+{
+  RegValue cause;
+
+  csrs.clearInterruptCheck();
+  clint->update();
+
+  if (uart)
+    {
+      uart->poll();
+      csrs.requestInterruptCheck(nInstructions + UARTPollInterval);
+    }
+
+  if (csrs.getPendingInterrupt(cause))
+    {
+      MemAddress epc = PC;
+
+      if (replayLog)
+        replayLog->interrupt(cause);
+
+      PC = csrs.enterTrap(epc, cause, 0);
+      if (flameGraph)
+        flameGraph->trap(PC, epc);
+    }
+}
+
+/* Enter the trap handler for a synchronous exception. Without trap
+ * handler, the program is terminated.
+ */
+bool
+Processor::raiseException(ExceptionCause cause, RegValue tval,
+                          const std::exception &e)
+{
+  if (!csrs.hasTrapHandler())
+    {
+      reportAbnormalTermination(fetchPC, e);
+      return false;
+    }
+
+  countBlock(false);
+  PC = csrs.enterTrap(fetchPC, static_cast<RegValue>(cause), tval);
+  if (flameGraph)
+    flameGraph->trap(PC, fetchPC);
+
+  /* A program stuck taking the same trap never ends a block */
+  checkStopPoint();
+
+  startBlock();
+  return true;
+}
+
+/* The faulting address is followed by the function and source line
+ * containing it, when the program has symbols and line information.
+ */
+void
+Processor::reportAbnormalTermination(MemAddress addr, const std::exception &e)
+{
+  console << "ABNORMAL PROGRAM TERMINATION; PC = "
+          << std::hex << addr << std::dec << describeAddress(addr) << std::endl;
+  console << "Reason: " << e.what() << std::endl;
+}
+
+/* Returns " (function+offset, file:line)" for addr, leaving out what is
+ * not known, or an empty string.
+ */
+std::string
+Processor::describeAddress(MemAddress addr) const
+{
+  const SymbolTable &symbols = program.getSymbolTable();
+  const LineRow *row = nullptr;
+  std::string location;
+
+  if (symbols.lookup(addr))
+    location = symbols.format(addr);
+
+  try
+    {
+      const LineTable &lines = program.getLineTable();
+
+      row = lines.lookup(addr);
+      if (row)
+        location += (location.empty() ? "" : ", ") +
+            lines.getFileName(row->file) + ":" + std::to_string(row->line);
+    }
+  catch (std::runtime_error &)
+    {
+      /* Malformed line information, describe the symbol only */
+    }
+
+  return location.empty() ? location : " (" + location + ")";
+}
+
+void
+Processor::dumpHotLoop(std::ostream &os) const
+{
+  size_t count = nRecentBlocks < NumRecentBlocks ?
+      nRecentBlocks : NumRecentBlocks;
+  if (count == 0)
+    return;
+
+  MemAddress first = recentBlocks[0].first, last = recentBlocks[0].second;
+  std::set<MemAddress> starts;
+
+  for (size_t i = 0; i < count; ++i)
+    {
+      first = std::min(first, recentBlocks[i].first);
+      last = std::max(last, recentBlocks[i].second);
+      starts.insert(recentBlocks[i].first);
+    }
+
+  auto storeFlags(os.flags());
+
+  os << "Hot loop: " << starts.size() << " distinct basic blocks in the "
+     << "last " << count << ", PC " << std::hex << first << "-" << last
+     << std::endl
+     << "  from " << first << describeAddress(first) << std::endl
+     << "  to   " << last << describeAddress(last) << std::endl;
+
+  os.flags(storeFlags);
+}
+
 void
 Processor::instructionFetch(void)
 {
+  HOST_PROFILE_SCOPE(HostPhase::Fetch);
+
   try
   {
-    instruction = bus.readWord(PC);
+    fetchPC = PC;
+    fetchAddress = mmu.translate(PC, AccessType::Fetch);
+    instruction = bus.readWord(fetchAddress);
     PC += 0x04;
   }
+  catch (GuestException &e)
+  {
+    /* Page faults are passed on as is */
+    throw;
+  }
   catch (std::exception &e)
   {
     throw InstructionFetchFailure(PC);
@@ -154,9 +901,18 @@ Processor::instructionFetch(void)
 bool
 Processor::instructionDecode(void)
 {
+  HOST_PROFILE_SCOPE(HostPhase::Decode);
 
-  decoder.decodeInstruction(instruction);
-  decoded = decoder.getDecodedInstruction();
+  const DecodedInstruction *cached = decodeCache.lookup(fetchAddress,
+                                                       instruction);
+  if (cached)
+    decoded = *cached;
+  else
+    {
+      decoder.decodeInstruction(instruction);
+      decoded = decoder.getDecodedInstruction();
+      decodeCache.insert(fetchAddress, instruction, decoded);
+    }
 
   if (debugMode)
   {
@@ -183,8 +939,18 @@ Processor::instructionDecode(void)
 void
 Processor::execute(void)
 {
+  HOST_PROFILE_SCOPE(HostPhase::Execute);
+
+  MemAddress nextPC = PC;
+
   alu.clear();
-  alu.execute(decoded,regfile,PC);
+  alu.execute(decoded,regfile,PC,csrs,mmu);
+
+  if(decoded.opcode == 0x63)
+    csrs.countEvent(PC != nextPC ? HPMEvent::BranchTaken
+                                 : HPMEvent::BranchNotTaken);
+  else if(decoded.opcode == 0x6f || decoded.opcode == 0x67)
+    csrs.countEvent(HPMEvent::Jump);
 }
 
 /* Send memory instruction to the memory controller 
@@ -192,7 +958,20 @@ Processor::execute(void)
 void
 Processor::memory(void)
 {
-   alu.memorycontroller(decoded,regfile,bus);
+   HOST_PROFILE_SCOPE(HostPhase::Memory);
+
+   alu.memorycontroller(decoded,regfile,bus,mmu);
+
+   if(memoryTrace && alu.getMemoryAccess().valid)
+     {
+       HOST_PROFILE_SCOPE(HostPhase::Trace);
+       memoryTrace->record(fetchPC, alu.getMemoryAccess(), nInstructions);
+     }
+
+   if(decoded.opcode == 0x03)
+     csrs.countEvent(HPMEvent::Load);
+   else if(decoded.opcode == 0x23)
+     csrs.countEvent(HPMEvent::Store);
 
    if(debugMode)
    {
@@ -241,4 +1020,25 @@ Processor::dumpStatistics(void) const
   std::cerr << nCycles << " clock cycles, "
             << nInstructions << " instructions executed." << std::endl
             << "CPI: " << ((float)nCycles / nInstructions) << std::endl;
+
+  mmu.dumpStatistics();
+
+  if (!decodeCacheDirectory.empty())
+    decodeCache.dumpStatistics();
+
+  if (mix)
+    mix->dumpTable(std::cerr, getExecutionEvents());
+
+  if (trace)
+    trace->dumpStatistics();
+
+  if (coverage)
+    coverage->dumpSummary(std::cerr);
+
+  if (profiler)
+    profiler->dumpReport(std::cerr, program.getSymbolTable(), profileTopN);
+
+#ifdef ENABLE_HOST_PROFILE
+  HostProfile::dumpReport(std::cerr);
+#endif
 }
@@ -12,15 +12,41 @@
 
 #include "elf-file.h"
 #include "inst-decoder.h"
+#include "decode-cache.h"
 #include "alu.h"
 #include "memory-bus.h"
 #include "memory.h"
 #include "sys-control.h"
+#include "csr-file.h"
+#include "clint.h"
+#include "mmu.h"
+#include "plic.h"
+#include "uart.h"
+#include "platform.h"
+#include "profiler.h"
+#include "flame-graph.h"
+#include "inst-mix.h"
+#include "trace-writer.h"
+#include "memory-trace.h"
+#include "coverage.h"
+#include "stats-server.h"
+#include "host-profile.h"
+#include "simpoint.h"
+#include "replay-log.h"
+#include "symbol-table.h"
+#include "trap.h"
+
+#include <array>
+#include <atomic>
+#include <limits>
+#include <set>
 
 class Processor
 {
   public:
     Processor(ELFFile &program, bool debugMode=false);
+    Processor(ELFFile &program, const PlatformConfig &platform,
+              bool debugMode=false);
 
     /* Command-line register initialization 
 		*/
@@ -41,28 +67,241 @@ class Processor
 		*/
     void dumpRegisters(void) const;
     void dumpStatistics(void) const;
+    uint64_t getInstructionCount(void) const { return nInstructions; }
+    uint64_t getCycleCount(void) const { return nCycles; }
+
+    /* Count executions per basic block and print a report of the
+     * topN functions and instructions with the statistics.
+     */
+    void enableProfiling(size_t topN);
+
+    /* Track calls in a shadow call stack and sample it every interval
+     * instructions. The samples are written as folded stacks.
+     */
+    void enableFlameGraph(uint64_t interval, SampleWeight weight);
+    void writeFlameGraph(std::ostream &os) const;
+
+    /* Count the retired instructions by mnemonic, format and class. 
+		*/
+    void enableInstructionMix(void);
+    void writeInstructionMix(std::ostream &os) const;
+
+    /* Write every retired instruction to a compressed binary trace,
+     * see trace-format.h. finishTrace() flushes the trace.
+     */
+    void enableTrace(const std::string &filename);
+    void finishTrace(void);
+
+    /* Record data accesses of 1 in sampleRate pages and report reuse
+     * distances, the working set per window instructions and strides.
+     */
+    void enableMemoryTrace(uint64_t sampleRate, uint64_t window);
+    void writeMemoryTrace(std::ostream &os);
+
+    /* Record which basic blocks and branch edges of the program are
+     * executed, and write them per source line in lcov format.
+     */
+    void enableCoverage(const ELFFile &program);
+    void writeCoverage(std::ostream &os) const;
+
+    /* Serve the instruction count, PC, MIPS and TLB statistics as JSON
+     * on a UNIX-domain socket while running.
+     */
+    void enableStatsServer(const std::string &path);
+
+    /* Save the complete machine state to a checkpoint file, or restore
+     * it from a checkpoint of the same program and platform. An
+     * incremental checkpoint only holds the memory pages written since
+     * the last checkpoint saved or restored, and restoring it restores
+     * that one first.
+     */
+    void saveCheckpoint(const std::string &filename, bool incremental=false);
+    void restoreCheckpoint(const std::string &filename);
+
+    /* A scheduled checkpoint is saved at the end of the basic block
+     * during which the instruction count reaches instructions. With an
+     * interval, a checkpoint is saved every interval instructions from
+     * there on, to filename.1, filename.2 and so on, each incremental
+     * on top of the previous one. The first is a full checkpoint unless
+     * a checkpoint was restored. Throws std::invalid_argument when a
+     * checkpoint would replace one in the chain the run was restored
+     * from.
+     */
+    void scheduleCheckpoint(const std::string &filename,
+                            uint64_t instructions, uint64_t interval=0);
+    bool isCheckpointPending(void) const
+    {
+      return !checkpointFilename.empty() && nCheckpoints == 0;
+    }
+
+    /* Make run() return at the end of the basic block during which the
+     * instruction count reaches instructions. Calling run() again
+     * continues from there.
+     */
+    void setStopPoint(uint64_t instructions) { stopAt = instructions; }
+    bool isStopped(void) const { return stopped; }
+
+    /* Make run() return at the end of the current basic block, as if a
+     * stop point was reached. Safe to call from another thread, such as
+     * a Watchdog; the flag is only polled at block boundaries.
+     */
+    void requestStop(void)
+    {
+      stopRequested.store(true, std::memory_order_relaxed);
+    }
+
+    /* Report the address range of the last basic blocks executed, for
+     * a run that was stopped because it did not finish in time.
+     */
+    void dumpHotLoop(std::ostream &os) const;
+
+    /* Collect a basic block vector every interval instructions, for
+     * sampled simulation. See simpoint.h.
+     */
+    void enableBBVProfile(uint64_t interval);
+    const BBVProfile *getBBVProfile(void) const { return bbvProfile.get(); }
+
+    IntervalCounters getIntervalCounters(void) const;
+    void flushTLB(void);
+
+    /* Keep the decode cache in directory across runs: load the cache
+     * saved there for this program, if any, and saveDecodeCache() it
+     * there after the run. See decode-cache.h.
+     */
+    void enableDecodeCache(const std::string &directory);
+    void saveDecodeCache(void);
+    DecodeCache &getDecodeCache(void) { return decodeCache; }
+
+    /* Record the timer reads, UART input and interrupts of the run to
+     * a log, or replay them from a log recorded with the same program
+     * and options. See replay-log.h.
+     */
+    void enableReplayLog(const std::string &filename, ReplayLog::Mode mode);
+    const ReplayLog *getReplayLog(void) const { return replayLog.get(); }
+    void finishReplayLog(void);
+
+    /* Exit code as set by the guest through the system controller 
+		*/
+    RegValue getExitCode(void) const;
 
   private:
     bool debugMode;
 
+    /* Output of the Serial device, the system controller and abnormal
+     * termination messages.
+     */
+    std::ostream &console;
+
+    /* Platform setup 
+		*/
+    void setupSimplePlatform(void);
+    void setupVirtPlatform(ELFFile &program, const PlatformConfig &platform);
+
+    /* Traps and interrupts 
+		*/
+    void endOfBlock(void);
+    void countBlock(bool complete);
+    void startBlock(void);
+    void trackCalls(void);
+    void traceInstruction(void);
+    void publishStats(void);
+    void saveScheduledCheckpoint(void);
+    ExecutionEvents getExecutionEvents(void) const;
+    void checkInterrupts(void);
+    bool raiseException(ExceptionCause cause, RegValue tval,
+                        const std::exception &e);
+    void reportAbnormalTermination(MemAddress addr, const std::exception &e);
+    std::string describeAddress(MemAddress addr) const;
+
+    void checkStopPoint(void)
+    {
+      if (nInstructions >= stopAt ||
+          stopRequested.load(std::memory_order_relaxed))
+        {
+          stopped = true;
+          stopAt = std::numeric_limits<uint64_t>::max();
+          stopRequested.store(false, std::memory_order_relaxed);
+        }
+    }
+
     /* Statistics 
 		*/
-    int nCycles;
-    int nInstructions;
+    uint64_t nCycles;
+    uint64_t nInstructions;
+
+    /* Start of the basic block being executed, for profiling 
+		*/
+    MemAddress blockStart;
+    uint64_t blockStartInstructions;
+
+    std::unique_ptr<Profiler> profiler;
+    size_t profileTopN;
+
+    std::unique_ptr<FlameGraph> flameGraph;
+    SampleWeight sampleWeight;
+
+    std::unique_ptr<InstructionMix> mix;
+    std::unique_ptr<TraceWriter> trace;
+    std::unique_ptr<MemoryTrace> memoryTrace;
+    std::unique_ptr<Coverage> coverage;
+    std::unique_ptr<StatsServer> statsServer;
+    std::unique_ptr<BBVProfile> bbvProfile;
+    std::unique_ptr<ReplayLog> replayLog;
+    std::string decodeCacheDirectory;
+
+    std::string checkpointFilename;
+    uint64_t checkpointAt;
+    uint64_t checkpointInterval;
+    uint64_t nCheckpoints;
+
+    /* The checkpoint the next incremental checkpoint builds on */
+    std::string lastCheckpoint;
+
+    /* Resolved paths of the checkpoints restored, the last one and its
+     * parents. Guest memory may still be mapped from them.
+     */
+    std::set<std::string> restoredCheckpoints;
+
+    uint64_t stopAt;
+    bool stopped;
+    std::atomic<bool> stopRequested;
+
+    /* First and last instruction of the most recent basic blocks,
+     * including those cut short by a trap, for dumpHotLoop().
+     */
+    static const size_t NumRecentBlocks = 16;
+    std::array<std::pair<MemAddress, MemAddress>, NumRecentBlocks> recentBlocks;
+    uint64_t nRecentBlocks;
+
+    /* Symbols and source lines are looked up in the program, which
+     * only parses them once a report or fault message needs them.
+     */
+    const ELFFile &program;
 
     /* Components making up the system 
 		*/
     MemAddress PC;
+    MemAddress fetchPC;
+    MemAddress fetchAddress;
     uint32_t instruction;
     DecodedInstruction decoded;
     RegValue result;
 
     InstructionDecoder decoder;
+    DecodeCache decodeCache;
     RegisterFile regfile;
+    CSRFile csrs;
     ALU alu;
 
     MemoryBus bus;
+    MMU mmu;
     std::shared_ptr<SysControl> control;
+    std::shared_ptr<CLINT> clint;
+
+    /* Only present on the "virt" platform 
+		*/
+    std::shared_ptr<PLIC> plic;
+    std::shared_ptr<UART> uart;
 };
 
 #endif /* __PROCESSOR_H__ */
@@ -0,0 +1,92 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * profiler.cc - Guest execution profiler.
+ */
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <vector>
+
+Profiler::Profiler()
+{
+}
+
+template <typename Key>
+static std::vector<std::pair<Key, uint64_t>>
+topEntries(const std::map<Key, uint64_t> &counts, size_t topN)
+{
+  std::vector<std::pair<Key, uint64_t>> entries(counts.begin(), counts.end());
+
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const std::pair<Key, uint64_t> &a,
+                      const std::pair<Key, uint64_t> &b)
+                   { return a.second > b.second; });
+  if (entries.size() > topN)
+    entries.resize(topN);
+
+  return entries;
+}
+
+static void
+printShare(std::ostream &os, uint64_t count, uint64_t total)
+{
+  os << "  " << std::setw(6) << std::fixed << std::setprecision(2)
+     << (total ? 100.0 * count / total : 0.0) << "%  "
+     << std::setw(14) << count << "  ";
+}
+
+void
+Profiler::dumpReport(std::ostream &os, const SymbolTable &symbols,
+                     size_t topN) const
+{
+  std::map<MemAddress, uint64_t> perPC;
+  uint64_t total = 0;
+
+  for (auto &block : blocks)
+    for (uint64_t i = 0; i < block.first.instructions; ++i)
+      {
+        perPC[block.first.start + 4 * i] += block.second;
+        total += block.second;
+      }
+
+  std::map<std::string, uint64_t> perFunction;
+  for (auto &pc : perPC)
+    {
+      const Symbol *symbol = symbols.lookup(pc.first);
+      perFunction[symbol ? symbol->name : "[unknown]"] += pc.second;
+    }
+
+  auto storeFlags(os.flags());
+  auto storeFill(os.fill());
+
+  os << std::dec << std::noshowbase << std::setfill(' ');
+  os << std::endl << "Profile: " << total << " instructions in "
+     << blocks.size() << " distinct blocks";
+  if (symbols.empty())
+    os << " (no symbols)";
+  os << std::endl;
+
+  os << std::endl << "Top functions:" << std::endl
+     << "        %    instructions  function" << std::endl;
+  for (auto &entry : topEntries(perFunction, topN))
+    {
+      printShare(os, entry.second, total);
+      os << entry.first << std::endl;
+    }
+
+  os << std::endl << "Top instructions:" << std::endl
+     << "        %    instructions  address             location" << std::endl;
+  for (auto &entry : topEntries(perPC, topN))
+    {
+      printShare(os, entry.second, total);
+      os << "0x" << std::hex << std::setw(16) << std::setfill('0')
+         << entry.first << std::setfill(' ') << std::dec << "  "
+         << symbols.format(entry.first) << std::endl;
+    }
+
+  os.flags(storeFlags);
+  os.fill(storeFill);
+}
@@ -0,0 +1,63 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * profiler.h - Guest execution profiler.
+ */
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "arch.h"
+#include "symbol-table.h"
+
+#include <iostream>
+#include <unordered_map>
+
+/* Counts executions per basic block. The processor reports each block
+ * when it ends, so the cost is one hash table update per block rather
+ * than per instruction. Per-PC counts are derived from the blocks when
+ * the report is generated: a block of n instructions starting at PC
+ * covers PC, PC + 4, ..., PC + 4 * (n - 1).
+ */
+class Profiler
+{
+  public:
+    Profiler();
+
+    void countBlock(MemAddress start, uint64_t instructions)
+    {
+      if (instructions != 0)
+        ++blocks[BlockKey{ start, instructions }];
+    }
+
+    /* Print the topN functions and instruction addresses. 
+		*/
+    void dumpReport(std::ostream &os, const SymbolTable &symbols,
+                    size_t topN) const;
+
+  private:
+    /* A block is identified by its start and length, since a trap can
+     * cut a block short.
+     */
+    struct BlockKey
+    {
+      MemAddress start;
+      uint64_t instructions;
+
+      bool operator==(const BlockKey &other) const
+      {
+        return start == other.start && instructions == other.instructions;
+      }
+    };
+
+    struct BlockKeyHash
+    {
+      size_t operator()(const BlockKey &key) const
+      {
+        return std::hash<MemAddress>()(key.start ^ (key.instructions << 48));
+      }
+    };
+
+    std::unordered_map<BlockKey, uint64_t, BlockKeyHash> blocks;
+};
+
+#endif /* __PROFILER_H__ */
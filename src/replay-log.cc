@@ -0,0 +1,266 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * replay-log.cc - Record and replay of nondeterministic inputs.
+ */
+
+#include "replay-log.h"
+#include "trace-format.h"
+
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+static const char ReplayLogMagic[8] = { 'R', 'V', '6', '4',
+                                        'R', 'P', 'L', 'Y' };
+static const size_t HeaderSize = sizeof(ReplayLogMagic) + 4;
+
+/* Recorded events are written out in chunks of about this size */
+static const size_t FlushSize = 64 * 1024;
+
+static const char *
+eventName(ReplayEvent event)
+{
+  switch (event)
+    {
+      case ReplayEvent::Time:
+        return "timer read";
+      case ReplayEvent::Input:
+        return "input";
+      case ReplayEvent::InputClosed:
+        return "end of input";
+      case ReplayEvent::Interrupt:
+        return "interrupt";
+    }
+
+  return "unknown event";
+}
+
+ReplayLog::ReplayLog(const std::string &filename, Mode mode,
+                     const uint64_t *instructions)
+  : filename(filename), mode(mode), instructions(instructions),
+    position(0), lastInstructions(0), lastTime(0)
+{
+  if (mode == Mode::Record)
+    {
+      output.open(filename, std::ios::binary);
+      if (!output)
+        throw std::runtime_error("Could not create replay log " + filename);
+
+      buffer.insert(buffer.end(), ReplayLogMagic,
+                    ReplayLogMagic + sizeof(ReplayLogMagic));
+      for (int i = 0; i < 4; ++i)
+        buffer.push_back((uint8_t)(ReplayLogVersion >> (8 * i)));
+      return;
+    }
+
+  std::ifstream input(filename, std::ios::binary);
+  if (!input)
+    throw std::runtime_error("Could not open replay log " + filename);
+
+  buffer.assign(std::istreambuf_iterator<char>(input),
+                std::istreambuf_iterator<char>());
+
+  uint32_t version = 0;
+  if (buffer.size() >= HeaderSize)
+    for (int i = 0; i < 4; ++i)
+      version |= (uint32_t)buffer[sizeof(ReplayLogMagic) + i] << (8 * i);
+
+  if (buffer.size() < HeaderSize ||
+      memcmp(buffer.data(), ReplayLogMagic, sizeof(ReplayLogMagic)) != 0)
+    throw std::runtime_error("Not a replay log: " + filename);
+  if (version != ReplayLogVersion)
+    throw std::runtime_error("Unsupported replay log version in " + filename);
+
+  position = HeaderSize;
+}
+
+ReplayLog::~ReplayLog()
+{
+  if (mode == Mode::Record)
+    flush();
+}
+
+uint64_t
+ReplayLog::time(uint64_t hostTime)
+{
+  if (mode == Mode::Replay)
+    {
+      getEvent(ReplayEvent::Time);
+      lastTime += zigzagDecode(getNumber());
+      return lastTime;
+    }
+
+  putEvent(ReplayEvent::Time);
+  putNumber(zigzagEncode(hostTime - lastTime));
+  lastTime = hostTime;
+
+  return hostTime;
+}
+
+void
+ReplayLog::recordInput(const uint8_t *data, ssize_t count)
+{
+  if (count == 0)
+    return;
+
+  if (count < 0)
+    {
+      putEvent(ReplayEvent::InputClosed);
+      return;
+    }
+
+  putEvent(ReplayEvent::Input);
+  putNumber(count);
+  buffer.insert(buffer.end(), data, data + count);
+}
+
+ssize_t
+ReplayLog::replayInput(uint8_t *data, size_t size)
+{
+  ReplayEvent event;
+  uint64_t at;
+
+  if (!peekEvent(event, at) ||
+      (event != ReplayEvent::Input && event != ReplayEvent::InputClosed))
+    return 0;
+  if (at > *instructions)
+    return 0;
+
+  getEvent(event);
+  if (event == ReplayEvent::InputClosed)
+    return -1;
+
+  uint64_t count = getNumber();
+  if (count > size || count > buffer.size() - position)
+    diverged("input does not fit");
+
+  memcpy(data, buffer.data() + position, count);
+  position += count;
+
+  return count;
+}
+
+void
+ReplayLog::interrupt(uint64_t cause)
+{
+  if (mode == Mode::Record)
+    {
+      putEvent(ReplayEvent::Interrupt);
+      putNumber(cause);
+      return;
+    }
+
+  getEvent(ReplayEvent::Interrupt);
+  if (getNumber() != cause)
+    diverged("a different interrupt was taken");
+}
+
+void
+ReplayLog::finish(void)
+{
+  if (mode == Mode::Replay)
+    return;
+
+  flush();
+  output.flush();
+  if (!output)
+    throw std::runtime_error("Could not write replay log " + filename);
+}
+
+/*
+ * Private methods
+ */
+
+void
+ReplayLog::putEvent(ReplayEvent event)
+{
+  if (buffer.size() >= FlushSize)
+    flush();
+
+  buffer.push_back(static_cast<uint8_t>(event));
+  putNumber(*instructions - lastInstructions);
+  lastInstructions = *instructions;
+}
+
+void
+ReplayLog::putNumber(uint64_t value)
+{
+  uint8_t bytes[10];
+
+  buffer.insert(buffer.end(), bytes, ::putVarint(bytes, value));
+}
+
+void
+ReplayLog::flush(void)
+{
+  output.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+  buffer.clear();
+}
+
+/* Decode the type and instruction count of the next event without
+ * consuming it. Returns false at the end of the log.
+ */
+bool
+ReplayLog::peekEvent(ReplayEvent &event, uint64_t &at) const
+{
+  if (position == buffer.size())
+    return false;
+
+  uint64_t delta;
+  if (!::getVarint(buffer.data() + position + 1,
+                   buffer.data() + buffer.size(), delta))
+    diverged("the log is truncated");
+
+  event = static_cast<ReplayEvent>(buffer[position]);
+  at = lastInstructions + delta;
+  return true;
+}
+
+/* Consume the next event, which must be of type expected and happen at
+ * the current instruction count.
+ */
+void
+ReplayLog::getEvent(ReplayEvent expected)
+{
+  ReplayEvent event;
+  uint64_t at;
+
+  if (!peekEvent(event, at))
+    diverged(std::string("unexpected ") + eventName(expected) +
+             " after the end of the log");
+
+  if (event != expected || at != *instructions)
+    {
+      std::ostringstream reason;
+      reason << "unexpected " << eventName(expected) << ", the log has "
+             << eventName(event) << " at instruction " << at;
+      diverged(reason.str());
+    }
+
+  ++position;
+  lastInstructions = at;
+  getNumber();
+}
+
+uint64_t
+ReplayLog::getNumber(void)
+{
+  uint64_t value;
+  const uint8_t *next = ::getVarint(buffer.data() + position,
+                                    buffer.data() + buffer.size(), value);
+  if (!next)
+    diverged("the log is truncated");
+
+  position = next - buffer.data();
+  return value;
+}
+
+void
+ReplayLog::diverged(const std::string &reason) const
+{
+  std::ostringstream message;
+  message << "Replay of " << filename << " diverged at instruction "
+          << *instructions << ": " << reason;
+  throw std::runtime_error(message.str());
+}
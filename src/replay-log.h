@@ -0,0 +1,114 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * replay-log.h - Record and replay of nondeterministic inputs.
+ */
+
+/* Apart from its inputs, a run is fully determined by the program and
+ * the command line. A replay log records the inputs in the order they
+ * are consumed, each tagged with the instruction count at which that
+ * happens, so a later run of the same program with the same options
+ * can consume the same inputs at the same points.
+ *
+ * The log starts with the magic "RV64RPLY" and a uint32 version in
+ * little-endian order, followed by events:
+ *
+ *   type               1 byte, ReplayEvent
+ *   instruction delta  varint, since the previous event
+ *   payload            depends on the type:
+ *     Time             zigzag varint, delta from the previous time
+ *     Input            varint length, the bytes
+ *     InputClosed      none
+ *     Interrupt        varint, the cause
+ *
+ * Interrupts follow from the other inputs, so they are only recorded
+ * to detect a diverging replay early.
+ */
+
+#ifndef __REPLAY_LOG_H__
+#define __REPLAY_LOG_H__
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+static const uint32_t ReplayLogVersion = 1;
+
+enum class ReplayEvent : uint8_t
+{
+  Time = 1,
+  Input = 2,
+  InputClosed = 3,
+  Interrupt = 4
+};
+
+class ReplayLog
+{
+  public:
+    enum class Mode { Record, Replay };
+
+    /* Throws std::runtime_error when the log cannot be created or is
+     * not a valid replay log.
+     */
+    ReplayLog(const std::string &filename, Mode mode,
+              const uint64_t *instructions);
+    ~ReplayLog();
+
+    bool isReplaying(void) const { return mode == Mode::Replay; }
+
+    /* A timer read. Returns hostTime when recording, the recorded
+     * value when replaying.
+     */
+    uint64_t time(uint64_t hostTime);
+
+    /* Input received by a device. count is the number of bytes in
+     * buffer, 0 when nothing was received and -1 when the input was
+     * closed.
+     */
+    void recordInput(const uint8_t *buffer, ssize_t count);
+
+    /* Returns the input recorded at the current instruction count in
+     * the same form, reading at most size bytes into buffer.
+     */
+    ssize_t replayInput(uint8_t *buffer, size_t size);
+
+    /* An interrupt is taken. When replaying, throws when it was not
+     * taken at this point in the recorded run.
+     */
+    void interrupt(uint64_t cause);
+
+    /* True when every recorded event was replayed.
+		*/
+    bool atEnd(void) const { return position == buffer.size(); }
+
+    /* Flush the log, throws when any write failed.
+		*/
+    void finish(void);
+
+  private:
+    std::string filename;
+    Mode mode;
+    const uint64_t *instructions;
+
+    std::ofstream output;
+    std::vector<uint8_t> buffer;
+    size_t position;
+
+    uint64_t lastInstructions;
+    uint64_t lastTime;
+
+    /* Private helper methods
+		*/
+    void putEvent(ReplayEvent event);
+    void putNumber(uint64_t value);
+    void flush(void);
+
+    bool peekEvent(ReplayEvent &event, uint64_t &at) const;
+    void getEvent(ReplayEvent expected);
+    uint64_t getNumber(void);
+    [[noreturn]] void diverged(const std::string &reason) const;
+};
+
+#endif /* __REPLAY_LOG_H__ */
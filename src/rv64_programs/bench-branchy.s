@@ -0,0 +1,80 @@
+# bench-branchy.s - Benchmark: data-dependent branches that are hard to
+# predict.
+#
+# The values come from a full-period linear congruential generator
+# modulo 1024 (x = 5x + 7), computed without multiplication. Every value
+# is classified by a tree of branches that increments one of eight
+# counters. Returns counts[1] - counts[2] + counts[6] modulo 128.
+
+        # gp is not set up, prevent relaxing %hi/%lo pairs to gp.
+        .option norelax
+        # Compressed instructions are not implemented.
+        .option norvc
+
+        .equ    SYSCTL_HALT, 0x278
+        .equ    ITERATIONS, 32768
+
+        .bss
+        .align  3
+counts:
+        .skip   8 * 8
+
+        .text
+        .align  2
+        .globl  _start
+        .type   _start, @function
+_start:
+        lui     s0,%hi(counts)
+        addi    s0,s0,%lo(counts)
+        li      t0,1
+        lui     s1,%hi(ITERATIONS)
+        li      s2,256
+        li      s3,512
+        li      s4,768
+1:
+        # x = (x + (x << 2) + 7) & 0x3ff
+        slli    t1,t0,2
+        add     t0,t0,t1
+        addi    t0,t0,7
+        andi    t0,t0,0x3ff
+
+        # t2 = &counts[k]
+        mv      t2,s0
+        blt     t0,s2,9f
+        bge     t0,s3,3f
+        andi    t1,t0,1
+        addi    t2,s0,16
+        beqz    t1,9f
+        addi    t2,s0,8
+        j       9f
+3:
+        bge     t0,s4,5f
+        andi    t1,t0,2
+        addi    t2,s0,24
+        bnez    t1,9f
+        andi    t1,t0,4
+        addi    t2,s0,32
+        bnez    t1,9f
+        addi    t2,s0,40
+        j       9f
+5:
+        andi    t1,t0,8
+        addi    t2,s0,48
+        bnez    t1,9f
+        addi    t2,s0,56
+9:
+        ld      t1,0(t2)
+        addi    t1,t1,1
+        sd      t1,0(t2)
+
+        addi    s1,s1,-1
+        bnez    s1,1b
+
+        ld      a0,8(s0)
+        ld      t1,16(s0)
+        sub     a0,a0,t1
+        ld      t1,48(s0)
+        add     a0,a0,t1
+        andi    a0,a0,0x7f
+        sw      a0,SYSCTL_HALT(zero)
+        .size   _start, .-_start
@@ -0,0 +1,37 @@
+# bench-intloop.s - Benchmark: integer arithmetic in tight nested loops.
+#
+# Sums (i << 2) - j over i < OUTER and j < INNER and returns the sum
+# modulo 128.
+
+        # gp is not set up, prevent relaxing %hi/%lo pairs to gp.
+        .option norelax
+        # Compressed instructions are not implemented.
+        .option norvc
+
+        .equ    SYSCTL_HALT, 0x278
+        .equ    OUTER, 1024
+        .equ    INNER, 64
+
+        .text
+        .align  2
+        .globl  _start
+        .type   _start, @function
+_start:
+        li      a0,0
+        li      t0,0
+        li      t2,OUTER
+        li      t5,INNER
+1:
+        li      t1,0
+        slli    t3,t0,2
+2:
+        sub     t4,t3,t1
+        add     a0,a0,t4
+        addi    t1,t1,1
+        blt     t1,t5,2b
+        addi    t0,t0,1
+        blt     t0,t2,1b
+
+        andi    a0,a0,0x7f
+        sw      a0,SYSCTL_HALT(zero)
+        .size   _start, .-_start
@@ -0,0 +1,71 @@
+# bench-matvec.s - Benchmark: the matvec kernel, column-wise traversal
+# of a larger matrix, repeated. Compare with matvec.c and matvecu.c.
+#
+# B[i] = i + 1, then REPEAT times A[i][j] += B[i] for every column j
+# and row i of the N x N word matrix A. Returns A[N - 1][N - 1] modulo
+# 128.
+
+        # gp is not set up, prevent relaxing %hi/%lo pairs to gp.
+        .option norelax
+        # Compressed instructions are not implemented.
+        .option norvc
+
+        .equ    SYSCTL_HALT, 0x278
+        .equ    N, 32
+        .equ    REPEAT, 32
+
+        .bss
+        .align  3
+A:
+        .skip   N * N * 4
+B:
+        .skip   N * 4
+
+        .text
+        .align  2
+        .globl  _start
+        .type   _start, @function
+_start:
+        # B[i] = i + 1
+        lui     s1,%hi(B)
+        addi    s1,s1,%lo(B)
+        mv      t0,s1
+        li      t1,1
+        li      t2,N
+1:
+        sw      t1,0(t0)
+        addi    t0,t0,4
+        addi    t1,t1,1
+        bge     t2,t1,1b
+
+        lui     s0,%hi(A)
+        addi    s0,s0,%lo(A)
+        li      s2,REPEAT
+2:
+        # t0 = &A[0][j], for j < N
+        mv      t0,s0
+        addi    t5,s0,N * 4
+3:
+        # t1 = &A[i][j], t2 = &B[i], for i < N
+        mv      t1,t0
+        mv      t2,s1
+        addi    t6,s1,N * 4
+4:
+        lw      t3,0(t1)
+        lw      t4,0(t2)
+        add     t3,t3,t4
+        sw      t3,0(t1)
+        addi    t1,t1,N * 4
+        addi    t2,t2,4
+        bne     t2,t6,4b
+
+        addi    t0,t0,4
+        bne     t0,t5,3b
+
+        addi    s2,s2,-1
+        bnez    s2,2b
+
+        lw      a0,-4(s1)
+        andi    a0,a0,0x7f
+        sw      a0,SYSCTL_HALT(zero)
+        .size   _start, .-_start
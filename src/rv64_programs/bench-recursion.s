@@ -0,0 +1,56 @@
+# bench-recursion.s - Benchmark: call-heavy recursion, a naive
+# Fibonacci.
+#
+# Returns fib(DEPTH) modulo 128.
+
+        # gp is not set up, prevent relaxing %hi/%lo pairs to gp.
+        .option norelax
+        # Compressed instructions are not implemented.
+        .option norvc
+
+        .equ    SYSCTL_HALT, 0x278
+        .equ    DEPTH, 20
+        .equ    STACK_SIZE, 4096
+
+        .bss
+        .align  4
+stack:
+        .skip   STACK_SIZE
+
+        .text
+        .align  2
+        .globl  _start
+        .type   _start, @function
+_start:
+        lui     sp,%hi(stack + STACK_SIZE)
+        addi    sp,sp,%lo(stack + STACK_SIZE)
+
+        li      a0,DEPTH
+        jal     ra,fib
+        andi    a0,a0,0x7f
+        sw      a0,SYSCTL_HALT(zero)
+        .size   _start, .-_start
+
+# Returns fib(a0).
+        .type   fib, @function
+fib:
+        li      t0,2
+        blt     a0,t0,1f
+        addi    sp,sp,-32
+        sd      ra,24(sp)
+        sd      s0,16(sp)
+        sd      s1,8(sp)
+        mv      s0,a0
+        addi    a0,s0,-1
+        jal     ra,fib
+        mv      s1,a0
+        addi    a0,s0,-2
+        jal     ra,fib
+        add     a0,s1,a0
+        ld      s1,8(sp)
+        ld      s0,16(sp)
+        ld      ra,24(sp)
+        addi    sp,sp,32
+1:
+        ret
+        .size   fib, .-fib
@@ -0,0 +1,128 @@
+# bench-roman.s - Benchmark: formatting numbers as roman numerals into
+# a string, as roman.c does, but into a buffer instead of the serial
+# port.
+#
+# Formats every number from 1 to COUNT and returns the sum of all
+# characters modulo 128.
+
+        # gp is not set up, prevent relaxing %hi/%lo pairs to gp.
+        .option norelax
+        # Compressed instructions are not implemented.
+        .option norvc
+
+        .equ    SYSCTL_HALT, 0x278
+        .equ    COUNT, 2000
+
+        # Entries of a doubleword base and a string of up to 7
+        # characters, terminated by a zero base.
+        .data
+        .align  3
+roman_table:
+        .dword  1000
+        .asciz  "M"
+        .balign 8
+        .dword  900
+        .asciz  "CM"
+        .balign 8
+        .dword  500
+        .asciz  "D"
+        .balign 8
+        .dword  400
+        .asciz  "CD"
+        .balign 8
+        .dword  100
+        .asciz  "C"
+        .balign 8
+        .dword  90
+        .asciz  "XC"
+        .balign 8
+        .dword  50
+        .asciz  "L"
+        .balign 8
+        .dword  40
+        .asciz  "XL"
+        .balign 8
+        .dword  10
+        .asciz  "X"
+        .balign 8
+        .dword  9
+        .asciz  "IX"
+        .balign 8
+        .dword  5
+        .asciz  "V"
+        .balign 8
+        .dword  4
+        .asciz  "IV"
+        .balign 8
+        .dword  1
+        .asciz  "I"
+        .balign 8
+        .dword  0
+
+        .bss
+buffer:
+        .skip   32
+
+        .text
+        .align  2
+        .globl  _start
+        .type   _start, @function
+_start:
+        li      s0,1
+        li      s1,COUNT
+        li      s2,0
+        lui     s3,%hi(buffer)
+        addi    s3,s3,%lo(buffer)
+1:
+        mv      a0,s0
+        mv      a1,s3
+        jal     ra,format_roman
+
+        # Sum the characters
+        mv      t0,s3
+2:
+        lbu     t1,0(t0)
+        beqz    t1,3f
+        add     s2,s2,t1
+        addi    t0,t0,1
+        j       2b
+3:
+        addi    s0,s0,1
+        bge     s1,s0,1b
+
+        andi    a0,s2,0x7f
+        sw      a0,SYSCTL_HALT(zero)
+        .size   _start, .-_start
+
+# Writes a0 as a zero-terminated roman numeral to the buffer at a1.
+# Returns the length.
+        .type   format_roman, @function
+format_roman:
+        mv      t0,a1
+        lui     t1,%hi(roman_table)
+        addi    t1,t1,%lo(roman_table)
+1:
+        ld      t2,0(t1)
+        beqz    t2,6f
+2:
+        blt     a0,t2,5f
+        # Append the representation and subtract the base
+        addi    t3,t1,8
+3:
+        lbu     t4,0(t3)
+        beqz    t4,4f
+        sb      t4,0(t0)
+        addi    t0,t0,1
+        addi    t3,t3,1
+        j       3b
+4:
+        sub     a0,a0,t2
+        j       2b
+5:
+        addi    t1,t1,16
+        j       1b
+6:
+        sb      zero,0(t0)
+        sub     a0,t0,a1
+        ret
+        .size   format_roman, .-format_roman
@@ -0,0 +1,84 @@
+# bench-stream.s - Benchmark: streaming through arrays larger than a
+# typical L1 cache, in the style of the STREAM copy and add kernels.
+#
+# b[i] = i, then PASSES times c[i] = b[i] and a[i] = b[i] + c[i] over
+# arrays of N doublewords. Returns a[N - 1] modulo 128, which is 126.
+
+        # gp is not set up, prevent relaxing %hi/%lo pairs to gp.
+        .option norelax
+        # Compressed instructions are not implemented.
+        .option norvc
+
+        .equ    SYSCTL_HALT, 0x278
+        .equ    N, 8192
+        .equ    PASSES, 4
+
+        .bss
+        .align  3
+a:
+        .skip   N * 8
+b:
+        .skip   N * 8
+c:
+        .skip   N * 8
+
+        .text
+        .align  2
+        .globl  _start
+        .type   _start, @function
+_start:
+        # b[i] = i
+        lui     t0,%hi(b)
+        addi    t0,t0,%lo(b)
+        li      t1,0
+        lui     t2,%hi(N)
+1:
+        sd      t1,0(t0)
+        addi    t0,t0,8
+        addi    t1,t1,1
+        blt     t1,t2,1b
+
+        li      s0,PASSES
+2:
+        # c[i] = b[i]
+        lui     t0,%hi(b)
+        addi    t0,t0,%lo(b)
+        lui     t1,%hi(c)
+        addi    t1,t1,%lo(c)
+        lui     t2,%hi(c)
+        addi    t2,t2,%lo(c)
+3:
+        ld      t3,0(t0)
+        sd      t3,0(t1)
+        addi    t0,t0,8
+        addi    t1,t1,8
+        bne     t0,t2,3b
+
+        # a[i] = b[i] + c[i]
+        lui     t0,%hi(a)
+        addi    t0,t0,%lo(a)
+        lui     t1,%hi(b)
+        addi    t1,t1,%lo(b)
+        lui     t2,%hi(c)
+        addi    t2,t2,%lo(c)
+        lui     t4,%hi(b)
+        addi    t4,t4,%lo(b)
+4:
+        ld      t3,0(t1)
+        ld      t5,0(t2)
+        add     t3,t3,t5
+        sd      t3,0(t0)
+        addi    t0,t0,8
+        addi    t1,t1,8
+        addi    t2,t2,8
+        bne     t0,t4,4b
+
+        addi    s0,s0,-1
+        bnez    s0,2b
+
+        lui     t0,%hi(b)
+        addi    t0,t0,%lo(b)
+        ld      a0,-8(t0)
+        andi    a0,a0,0x7f
+        sw      a0,SYSCTL_HALT(zero)
+        .size   _start, .-_start
@@ -0,0 +1,421 @@
+# boot-kernel.s - Small kernel booting the virt platform to a shell
+# prompt, the default image of make boot-bench.
+#
+# It goes through the steps of a firmware and Linux boot on a small
+# scale. The M-mode part, like OpenSBI, delegates traps to S-mode,
+# provides the legacy SBI set_timer and console_putchar calls and enters
+# the kernel in S-mode with a0 = hart id and a1 = device tree. The
+# kernel checks the device tree header, enables Sv39 with gigapage
+# identity mappings and takes TIMER_TICKS timer interrupts through SBI.
+# Console output is serialized by a lr/sc spinlock and the ticks are
+# counted with amoadd, numbers are printed with divu and remu. After
+# the prompt the kernel powers off through the system controller.
+#
+# Build with -Wl,-Ttext=0x80000000 and run with --platform=virt.
+
+        # gp is not set up, prevent relaxing to gp.
+        .option norelax
+        # Compressed instructions are not implemented.
+        .option norvc
+
+        .equ    SYSCTL_HALT, 0x278
+        .equ    UART_BASE, 0x10000000
+        .equ    UART_LSR, 5
+        .equ    LSR_THRE, 0x20
+        .equ    CLINT_MTIMECMP, 0x2004000
+        .equ    FDT_MAGIC, 0xedfe0dd0      # 0xd00dfeed, big-endian
+        .equ    TIMER_TICKS, 100
+        .equ    TIMER_INTERVAL, 10000      # mtime counts instructions
+        .equ    STACK_SIZE, 4096
+
+        .equ    SBI_SET_TIMER, 0
+        .equ    SBI_CONSOLE_PUTCHAR, 1
+
+        .bss
+        .align  12
+page_table:
+        .skip   4096
+m_stack:
+        .skip   STACK_SIZE
+s_stack:
+        .skip   STACK_SIZE
+        .align  3
+ticks:
+        .skip   8
+console_lock:
+        .skip   8
+
+        .section .rodata
+firmware_msg:
+        .string "boot-kernel firmware: entering S-mode\n"
+kernel_msg:
+        .string "Linux-like boot-kernel for rv64-emu, hart "
+fdt_msg:
+        .string "Device tree: "
+bytes_msg:
+        .string " bytes\n"
+paging_msg:
+        .string "Sv39 paging enabled\n"
+timer_msg:
+        .string "Timer: "
+ticks_msg:
+        .string " interrupts\n"
+init_msg:
+        .string "Run /init as init process\n"
+prompt_msg:
+        .string "\n/ # "
+fdt_error_msg:
+        .string "Kernel panic: no device tree\n"
+trap_error_msg:
+        .string "Kernel panic: unexpected trap, scause "
+newline_msg:
+        .string "\n"
+
+        .text
+        .align  2
+        .globl  _start
+        .type   _start, @function
+
+#######################################################################
+# Firmware, runs in M-mode
+#######################################################################
+_start:
+        la      sp,m_stack + STACK_SIZE
+        csrw    mscratch,sp
+        la      t0,m_trap
+        csrw    mtvec,t0
+
+        # Delegate the misaligned fetch, breakpoint, ecall from U-mode
+        # and page fault exceptions and the supervisor interrupts.
+        li      t0,0xb109
+        csrw    medeleg,t0
+        li      t0,0x222
+        csrw    mideleg,t0
+
+        # Let S-mode read cycle, time and instret
+        li      t0,7
+        csrw    mcounteren,t0
+
+        # Firmware banner
+        la      t2,firmware_msg
+1:
+        lbu     t3,0(t2)
+        beqz    t3,2f
+        li      t0,UART_BASE
+3:
+        lbu     t1,UART_LSR(t0)
+        andi    t1,t1,LSR_THRE
+        beqz    t1,3b
+        sb      t3,0(t0)
+        addi    t2,t2,1
+        j       1b
+2:
+        # mret to the kernel in S-mode, a0 and a1 are passed on
+        li      t0,0x1800
+        csrc    mstatus,t0
+        li      t0,0x800
+        csrs    mstatus,t0
+        la      t0,kernel_entry
+        csrw    mepc,t0
+        mret
+
+        # SBI calls (ecall from S-mode) and the machine timer interrupt,
+        # which is passed on to S-mode as STIP.
+        .align  2
+m_trap:
+        csrrw   sp,mscratch,sp
+        addi    sp,sp,-16
+        sd      t0,0(sp)
+        sd      t1,8(sp)
+
+        csrr    t0,mcause
+        bltz    t0,m_interrupt
+        li      t1,9
+        bne     t0,t1,m_fatal
+
+        csrr    t0,mepc
+        addi    t0,t0,4
+        csrw    mepc,t0
+
+        li      t1,SBI_SET_TIMER
+        beq     a7,t1,sbi_set_timer
+        li      t1,SBI_CONSOLE_PUTCHAR
+        beq     a7,t1,sbi_console_putchar
+        li      a0,-2
+        j       m_return
+
+sbi_set_timer:
+        li      t0,CLINT_MTIMECMP
+        sd      a0,0(t0)
+        li      t0,0x20
+        csrc    mip,t0
+        li      t0,0x80
+        csrs    mie,t0
+        li      a0,0
+        j       m_return
+
+sbi_console_putchar:
+        li      t0,UART_BASE
+1:
+        lbu     t1,UART_LSR(t0)
+        andi    t1,t1,LSR_THRE
+        beqz    t1,1b
+        sb      a0,0(t0)
+        li      a0,0
+        j       m_return
+
+m_interrupt:
+        slli    t0,t0,1
+        srli    t0,t0,1
+        li      t1,7
+        bne     t0,t1,m_fatal
+        li      t0,0x80
+        csrc    mie,t0
+        li      t0,0x20
+        csrs    mip,t0
+
+m_return:
+        ld      t0,0(sp)
+        ld      t1,8(sp)
+        addi    sp,sp,16
+        csrrw   sp,mscratch,sp
+        mret
+
+m_fatal:
+        li      t0,1
+        sd      t0,SYSCTL_HALT(zero)
+1:
+        j       1b
+
+#######################################################################
+# Kernel, runs in S-mode
+#######################################################################
+kernel_entry:
+        la      sp,s_stack + STACK_SIZE
+        mv      s0,a0
+        mv      s1,a1
+        la      t0,s_trap
+        csrw    stvec,t0
+
+        # Early console through SBI
+        la      a0,kernel_msg
+        call    sbi_puts
+        mv      a0,s0
+        call    putdec
+        la      a0,newline_msg
+        call    sbi_puts
+
+        # The device tree header holds the magic and the total size,
+        # both big-endian.
+        lwu     t0,0(s1)
+        li      t1,FDT_MAGIC
+        bne     t0,t1,no_device_tree
+        lwu     a0,4(s1)
+        call    bswap32
+        mv      s2,a0
+        la      a0,fdt_msg
+        call    puts
+        mv      a0,s2
+        call    putdec
+        la      a0,bytes_msg
+        call    puts
+
+        # Identity map the first 4 GiB through gigapages: the devices
+        # in the first, RAM in the third. V, R, W, X, A and D are set.
+        la      t0,page_table
+        li      t1,0xcf
+        li      t2,1
+        slli    t2,t2,28
+        li      t3,4
+1:
+        sd      t1,0(t0)
+        add     t1,t1,t2
+        addi    t0,t0,8
+        addi    t3,t3,-1
+        bnez    t3,1b
+
+        # satp = Sv39 | ppn(page_table)
+        la      t0,page_table
+        srli    t0,t0,12
+        li      t1,8
+        slli    t1,t1,60
+        or      t0,t0,t1
+        csrw    satp,t0
+        sfence.vma
+        la      a0,paging_msg
+        call    puts
+
+        # Take TIMER_TICKS timer interrupts, each arming the next
+        li      t0,0x20
+        csrs    sie,t0
+        call    set_next_timer
+        csrsi   sstatus,2
+1:
+        wfi
+        la      t0,ticks
+        ld      t1,0(t0)
+        li      t2,TIMER_TICKS
+        bltu    t1,t2,1b
+        csrci   sstatus,2
+
+        la      a0,timer_msg
+        call    puts
+        la      t0,ticks
+        ld      a0,0(t0)
+        call    putdec
+        la      a0,ticks_msg
+        call    puts
+
+        la      a0,init_msg
+        call    puts
+        la      a0,prompt_msg
+        call    puts
+
+        # Power off
+        sd      zero,SYSCTL_HALT(zero)
+1:
+        j       1b
+
+no_device_tree:
+        la      a0,fdt_error_msg
+        call    sbi_puts
+        j       panic
+
+        # Only the supervisor timer interrupt is expected
+        .align  2
+s_trap:
+        addi    sp,sp,-64
+        sd      ra,0(sp)
+        sd      t0,8(sp)
+        sd      t1,16(sp)
+        sd      t2,24(sp)
+        sd      a0,32(sp)
+        sd      a7,40(sp)
+
+        csrr    t0,scause
+        li      t1,1
+        slli    t1,t1,63
+        addi    t1,t1,5
+        bne     t0,t1,unexpected_trap
+
+        li      t1,1
+        la      t0,ticks
+        amoadd.d t1,t1,(t0)
+        addi    t1,t1,1
+        li      t2,TIMER_TICKS
+        bgeu    t1,t2,1f
+        call    set_next_timer
+        j       2f
+1:
+        # Clear the pending interrupt without arming the timer
+        li      a0,-1
+        li      a7,SBI_SET_TIMER
+        ecall
+2:
+        ld      ra,0(sp)
+        ld      t0,8(sp)
+        ld      t1,16(sp)
+        ld      t2,24(sp)
+        ld      a0,32(sp)
+        ld      a7,40(sp)
+        addi    sp,sp,64
+        sret
+
+unexpected_trap:
+        la      a0,trap_error_msg
+        call    puts
+        csrr    a0,scause
+        call    putdec
+        la      a0,newline_msg
+        call    puts
+panic:
+        li      t0,1
+        sd      t0,SYSCTL_HALT(zero)
+1:
+        j       1b
+
+# Arm the timer TIMER_INTERVAL ticks from now
+set_next_timer:
+        rdtime  a0
+        li      t0,TIMER_INTERVAL
+        add     a0,a0,t0
+        li      a7,SBI_SET_TIMER
+        ecall
+        ret
+
+# Print the string at a0 through SBI
+sbi_puts:
+        mv      t2,a0
+1:
+        lbu     a0,0(t2)
+        beqz    a0,2f
+        li      a7,SBI_CONSOLE_PUTCHAR
+        ecall
+        addi    t2,t2,1
+        j       1b
+2:
+        ret
+
+# Print the string at a0 to the UART, holding the console lock
+puts:
+        la      t0,console_lock
+        li      t1,1
+1:
+        lr.w.aq t2,(t0)
+        bnez    t2,1b
+        sc.w    t2,t1,(t0)
+        bnez    t2,1b
+
+        li      t1,UART_BASE
+2:
+        lbu     t2,0(a0)
+        beqz    t2,4f
+3:
+        lbu     a7,UART_LSR(t1)
+        andi    a7,a7,LSR_THRE
+        beqz    a7,3b
+        sb      t2,0(t1)
+        addi    a0,a0,1
+        j       2b
+4:
+        amoswap.w.rl zero,zero,(t0)
+        ret
+
+# Print a0 in decimal
+putdec:
+        addi    sp,sp,-48
+        sd      ra,40(sp)
+        addi    t0,sp,32
+        sb      zero,0(t0)
+        li      t1,10
+1:
+        remu    t2,a0,t1
+        divu    a0,a0,t1
+        addi    t2,t2,'0'
+        addi    t0,t0,-1
+        sb      t2,0(t0)
+        bnez    a0,1b
+        mv      a0,t0
+        call    puts
+        ld      ra,40(sp)
+        addi    sp,sp,48
+        ret
+
+# Swap the bytes of the word in a0
+bswap32:
+        srliw   t0,a0,24
+        srliw   t1,a0,8
+        li      t2,0xff00
+        and     t1,t1,t2
+        or      t0,t0,t1
+        slliw   t1,a0,8
+        li      t2,0xff0000
+        and     t1,t1,t2
+        or      t0,t0,t1
+        slliw   t1,a0,24
+        or      a0,t0,t1
+        slli    a0,a0,32
+        srli    a0,a0,32
+        ret
+
+        .size   _start, .-_start
@@ -5,14 +5,20 @@
 	.globl _start
         .type _start, @function
 _start:
-        # Initialize gp
-        la      gp,_gp
+        # Initialize gp. Not with la, which expands to auipc (not
+        # implemented), and not relaxed into a gp-relative addi.
+        .option push
+        .option norelax
+        lui     gp,%hi(_gp)
+        addi    gp,gp,%lo(_gp)
+        .option pop
         # create a pseudo-stack.
         lui     sp,%hi(_stack+4096)
         add     sp,sp,%lo(_stack+4096)
         add     sp,sp,-16
 
-        call main
+        # jal, since call also expands to auipc
+        jal     ra,main
 
         # end simulation with exit code
         sw      a0,632(zero)
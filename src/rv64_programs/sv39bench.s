@@ -0,0 +1,116 @@
+# sv39bench.s - Measure the cost of Sv39 address translation.
+#
+# Runs the same load kernel twice: first in M-mode without translation,
+# then in S-mode with the first 2 MiB identity mapped through 4 KiB
+# pages. The kernel strides over 64 pages so that every load touches a
+# different page. Host time (from the system controller) spent in each
+# run is returned in a0 (untranslated) and a1 (translated); the TLB
+# statistics are printed by the emulator on exit.
+
+        # gp is not set up, prevent relaxing %hi/%lo pairs to gp.
+        .option norelax
+
+        .equ    SYSCTL_TIME, 0x290
+        .equ    SYSCTL_HALT, 0x278
+        .equ    PASSES, 1024
+        .equ    PAGES, 64
+
+        .bss
+        .align  12
+pt_root:
+        .skip   4096
+pt_l1:
+        .skip   4096
+pt_l0:
+        .skip   4096
+array:
+        .skip   PAGES * 4096
+
+        .text
+        .align  2
+        .globl  _start
+        .type   _start, @function
+_start:
+        jal     ra,measure
+        mv      s1,a0
+
+        # root[0] -> pt_l1
+        lui     t0,%hi(pt_root)
+        addi    t0,t0,%lo(pt_root)
+        lui     t1,%hi(pt_l1)
+        addi    t1,t1,%lo(pt_l1)
+        srli    t2,t1,12
+        slli    t2,t2,10
+        addi    t2,t2,1
+        sd      t2,0(t0)
+
+        # pt_l1[0] -> pt_l0
+        lui     t1,%hi(pt_l0)
+        addi    t1,t1,%lo(pt_l0)
+        srli    t2,t1,12
+        slli    t2,t2,10
+        addi    t2,t2,1
+        lui     t3,%hi(pt_l1)
+        addi    t3,t3,%lo(pt_l1)
+        sd      t2,0(t3)
+
+        # pt_l0[i] -> page i, with V, R, W, X, A and D set
+        li      t2,0xcf
+        li      t4,512
+        li      t5,1024
+1:
+        sd      t2,0(t1)
+        add     t2,t2,t5
+        addi    t1,t1,8
+        addi    t4,t4,-1
+        bnez    t4,1b
+
+        # satp = Sv39 | ppn(pt_root)
+        li      t2,8
+        slli    t2,t2,60
+        srli    t3,t0,12
+        add     t2,t2,t3
+        csrw    satp,t2
+        sfence.vma
+
+        # Continue in S-mode
+        li      t0,0x1800
+        csrc    mstatus,t0
+        li      t0,1
+        slli    t0,t0,11
+        csrs    mstatus,t0
+        lui     t0,%hi(supervisor)
+        addi    t0,t0,%lo(supervisor)
+        csrw    mepc,t0
+        mret
+
+supervisor:
+        jal     ra,measure
+        mv      a1,a0
+        mv      a0,s1
+        sw      zero,SYSCTL_HALT(zero)
+        nop
+        nop
+        .size   _start, .-_start
+
+# Returns the host time in nanoseconds spent running the kernel.
+        .type   measure, @function
+measure:
+        ld      t0,SYSCTL_TIME(zero)
+        li      t2,PASSES
+1:
+        lui     t3,%hi(array)
+        addi    t3,t3,%lo(array)
+        li      t4,PAGES
+        lui     t6,1
+2:
+        ld      t5,0(t3)
+        add     t3,t3,t6
+        addi    t4,t4,-1
+        bnez    t4,2b
+        addi    t2,t2,-1
+        bnez    t2,1b
+        ld      t1,SYSCTL_TIME(zero)
+        sub     a0,t1,t0
+        ret
+        .size   measure, .-measure
@@ -7,8 +7,8 @@
 
 #include <iostream>
 
-Serial::Serial(const MemAddress base)
-  : base(base)
+Serial::Serial(const MemAddress base, std::ostream &output)
+  : base(base), output(output)
 {
 }
 
@@ -51,7 +51,7 @@ Serial::writeByte(MemAddress addr, uint8_t value)
   if (addr != base)
     throw IllegalAccess("Invalid address");
 
-  std::cerr << (char)value;
+  output << (char)value;
 }
 
 void
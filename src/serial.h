@@ -8,10 +8,12 @@
 
 #include "memory-interface.h"
 
+#include <iostream>
+
 class Serial : public MemoryInterface
 {
   public:
-    Serial(const MemAddress base);
+    Serial(const MemAddress base, std::ostream &output = std::cerr);
     virtual ~Serial();
 
     /* MemoryInterface 
@@ -30,6 +32,7 @@ class Serial : public MemoryInterface
 
   private:
     const MemAddress base;
+    std::ostream &output;
 };
 
 #endif /* __SERIAL_H__ */
@@ -0,0 +1,439 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * simpoint.cc - SimPoint-style sampled simulation.
+ */
+
+#include "simpoint.h"
+#include "processor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <random>
+
+/* Number of k-means runs with different initial centroids per k */
+static const int KMeansRuns = 5;
+static const int KMeansIterations = 100;
+
+/* A random value in [-1, 1] per block and dimension, derived from the
+ * block address so it does not need to be stored.
+ */
+static double
+projection(MemAddress block, int dimension)
+{
+  uint64_t x = block * 0x9e3779b97f4a7c15ULL + dimension;
+
+  /* splitmix64 finalizer */
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+
+  return (double)(x >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+BBVProfile::BBVProfile(uint64_t intervalLength,
+                       const IntervalCounters &start)
+  : intervalLength(intervalLength),
+    intervalEnd(start.instructions + intervalLength), start(start)
+{
+}
+
+void
+BBVProfile::endInterval(const IntervalCounters &counters)
+{
+  if (current.empty())
+    return;
+
+  Interval interval;
+  uint64_t total = 0;
+
+  for (auto &block : current)
+    total += block.second;
+
+  interval.projected.fill(0.0);
+  for (auto &block : current)
+    {
+      uint32_t id = blockIds.emplace(block.first, blockIds.size() + 1)
+          .first->second;
+      interval.blocks.emplace_back(id, block.second);
+
+      double share = (double)block.second / total;
+      for (int d = 0; d < Dimensions; ++d)
+        interval.projected[d] += share * projection(block.first, d);
+    }
+
+  std::sort(interval.blocks.begin(), interval.blocks.end());
+  interval.end = counters;
+
+  intervals.push_back(std::move(interval));
+  current.clear();
+  intervalEnd = counters.instructions + intervalLength;
+}
+
+IntervalCounters
+BBVProfile::getStart(size_t interval) const
+{
+  return interval == 0 ? start : intervals[interval - 1].end;
+}
+
+IntervalCounters
+BBVProfile::getEnd(size_t interval) const
+{
+  return intervals[interval].end;
+}
+
+/*
+ * Clustering
+ */
+namespace {
+
+using Vector = std::array<double, BBVProfile::Dimensions>;
+
+double
+distance2(const Vector &a, const Vector &b)
+{
+  double sum = 0.0;
+  for (size_t d = 0; d < a.size(); ++d)
+    sum += (a[d] - b[d]) * (a[d] - b[d]);
+  return sum;
+}
+
+struct Clustering
+{
+  std::vector<Vector> centroids;
+  std::vector<size_t> assignment;
+  double sse;
+};
+
+/* Lloyd's algorithm from k-means++ initial centroids. 
+*/
+Clustering
+kmeans(const std::vector<Vector> &points, size_t k, std::mt19937_64 &rng)
+{
+  Clustering result;
+  std::vector<double> nearest(points.size(),
+                              std::numeric_limits<double>::max());
+
+  result.centroids.push_back(points[rng() % points.size()]);
+  while (result.centroids.size() < k)
+    {
+      double total = 0.0;
+      for (size_t i = 0; i < points.size(); ++i)
+        {
+          nearest[i] = std::min(nearest[i],
+                                distance2(points[i], result.centroids.back()));
+          total += nearest[i];
+        }
+
+      /* All points coincide with a centroid */
+      if (total == 0.0)
+        break;
+
+      double pick = std::uniform_real_distribution<double>(0.0, total)(rng);
+      size_t i = 0;
+      for ( ; i + 1 < points.size() && pick >= nearest[i]; ++i)
+        pick -= nearest[i];
+      result.centroids.push_back(points[i]);
+    }
+
+  result.assignment.assign(points.size(), 0);
+  for (int iteration = 0; iteration < KMeansIterations; ++iteration)
+    {
+      bool changed = iteration == 0;
+
+      for (size_t i = 0; i < points.size(); ++i)
+        {
+          size_t best = 0;
+          for (size_t c = 1; c < result.centroids.size(); ++c)
+            if (distance2(points[i], result.centroids[c]) <
+                distance2(points[i], result.centroids[best]))
+              best = c;
+
+          if (best != result.assignment[i])
+            {
+              result.assignment[i] = best;
+              changed = true;
+            }
+        }
+
+      if (!changed)
+        break;
+
+      std::vector<Vector> sums(result.centroids.size(), Vector());
+      std::vector<size_t> counts(result.centroids.size(), 0);
+      for (size_t i = 0; i < points.size(); ++i)
+        {
+          for (size_t d = 0; d < Vector().size(); ++d)
+            sums[result.assignment[i]][d] += points[i][d];
+          ++counts[result.assignment[i]];
+        }
+
+      for (size_t c = 0; c < result.centroids.size(); ++c)
+        if (counts[c] > 0)
+          for (size_t d = 0; d < Vector().size(); ++d)
+            result.centroids[c][d] = sums[c][d] / counts[c];
+    }
+
+  result.sse = 0.0;
+  for (size_t i = 0; i < points.size(); ++i)
+    result.sse += distance2(points[i], result.centroids[result.assignment[i]]);
+
+  return result;
+}
+
+/* Bayesian information criterion of a clustering under a spherical
+ * Gaussian model, as used by X-means and SimPoint.
+ */
+double
+bicScore(const Clustering &clustering, size_t nPoints)
+{
+  const double R = nPoints;
+  const double M = BBVProfile::Dimensions;
+  const double K = clustering.centroids.size();
+
+  double variance = R > K ? clustering.sse / (M * (R - K)) : 0.0;
+  variance = std::max(variance, 1e-12);
+
+  std::vector<size_t> sizes(clustering.centroids.size(), 0);
+  for (size_t c : clustering.assignment)
+    ++sizes[c];
+
+  double likelihood = -R * M / 2.0 * std::log(2.0 * M_PI * variance)
+      - clustering.sse / (2.0 * variance);
+  for (size_t size : sizes)
+    if (size > 0)
+      likelihood += size * std::log(size / R);
+
+  double parameters = K * (M + 1.0);
+  return likelihood - parameters / 2.0 * std::log(R);
+}
+
+} /* namespace */
+
+std::vector<SimPoint>
+BBVProfile::selectSimPoints(int maxK) const
+{
+  std::vector<Vector> points;
+  for (auto &interval : intervals)
+    points.push_back(interval.projected);
+
+  if (points.empty())
+    return std::vector<SimPoint>();
+
+  /* Fixed seed, so the same profile always gives the same points */
+  std::mt19937_64 rng(1);
+  std::vector<Clustering> best;
+  std::vector<double> scores;
+
+  size_t limit = std::min<size_t>(std::max(maxK, 1), points.size());
+  for (size_t k = 1; k <= limit; ++k)
+    {
+      Clustering bestRun;
+      bestRun.sse = std::numeric_limits<double>::max();
+      for (int run = 0; run < KMeansRuns; ++run)
+        {
+          Clustering clustering = kmeans(points, k, rng);
+          if (clustering.sse < bestRun.sse)
+            bestRun = std::move(clustering);
+        }
+
+      scores.push_back(bicScore(bestRun, points.size()));
+      best.push_back(std::move(bestRun));
+    }
+
+  double low = *std::min_element(scores.begin(), scores.end());
+  double high = *std::max_element(scores.begin(), scores.end());
+  size_t chosen = 0;
+  while (scores[chosen] < low + 0.9 * (high - low))
+    ++chosen;
+
+  const Clustering &clustering = best[chosen];
+  uint64_t totalInstructions = intervals.back().end.instructions -
+      start.instructions;
+
+  std::vector<SimPoint> simPoints;
+  for (size_t c = 0; c < clustering.centroids.size(); ++c)
+    {
+      std::vector<size_t> members;
+      for (size_t i = 0; i < points.size(); ++i)
+        if (clustering.assignment[i] == c)
+          members.push_back(i);
+
+      if (members.empty())
+        continue;
+
+      SimPoint point;
+      point.interval = members[0];
+      point.clusterSize = members.size();
+
+      uint64_t instructions = 0;
+      for (size_t i : members)
+        {
+          if (distance2(points[i], clustering.centroids[c]) <
+              distance2(points[point.interval], clustering.centroids[c]))
+            point.interval = i;
+
+          instructions += getEnd(i).instructions - getStart(i).instructions;
+        }
+
+      point.weight = (double)instructions / totalInstructions;
+      point.cpiVariance = metricVariance(members, false);
+      point.mpkiVariance = metricVariance(members, true);
+      simPoints.push_back(point);
+    }
+
+  return simPoints;
+}
+
+void
+BBVProfile::writeBBV(std::ostream &os) const
+{
+  for (auto &interval : intervals)
+    {
+      os << "T";
+      for (auto &block : interval.blocks)
+        os << ":" << block.first << ":" << block.second << " ";
+      os << std::endl;
+    }
+}
+
+/*
+ * Private methods
+ */
+static double
+getCPI(const IntervalCounters &start, const IntervalCounters &end)
+{
+  return (double)(end.cycles - start.cycles) /
+      (end.instructions - start.instructions);
+}
+
+static double
+getMPKI(const IntervalCounters &start, const IntervalCounters &end)
+{
+  return 1000.0 * (end.tlbMisses - start.tlbMisses) /
+      (end.instructions - start.instructions);
+}
+
+double
+BBVProfile::metricVariance(const std::vector<size_t> &members,
+                           bool mpki) const
+{
+  if (members.size() < 2)
+    return 0.0;
+
+  std::vector<double> values;
+  for (size_t i : members)
+    values.push_back(mpki ? getMPKI(getStart(i), getEnd(i)) :
+                            getCPI(getStart(i), getEnd(i)));
+
+  double mean = 0.0;
+  for (double value : values)
+    mean += value;
+  mean /= values.size();
+
+  double sum = 0.0;
+  for (double value : values)
+    sum += (value - mean) * (value - mean);
+  return sum / (values.size() - 1);
+}
+
+/*
+ * Detailed simulation of the chosen intervals
+ */
+static bool
+runUntil(Processor &p, uint64_t instructions)
+{
+  if (p.getInstructionCount() >= instructions)
+    return true;
+
+  p.setStopPoint(instructions);
+  return p.run() && p.isStopped();
+}
+
+void
+runSimPoints(Processor &p, const BBVProfile &profile,
+             const std::vector<SimPoint> &points, uint64_t warmup,
+             std::ostream &os)
+{
+  std::vector<SimPoint> ordered(points);
+  std::sort(ordered.begin(), ordered.end(),
+            [](const SimPoint &a, const SimPoint &b)
+            { return a.interval < b.interval; });
+
+  auto storeFlags(os.flags());
+  auto storeFill(os.fill(' '));
+
+  os << std::endl << "SimPoint: " << profile.getIntervalCount()
+     << " intervals of " << profile.getIntervalLength()
+     << " instructions, " << ordered.size() << " clusters." << std::endl;
+  os << std::right << std::setw(10) << "interval" << std::setw(10) << "size"
+     << std::setw(10) << "weight" << std::setw(14) << "instructions"
+     << std::setw(10) << "CPI" << std::setw(10) << "TLB MPKI" << std::endl;
+
+  double cpi = 0.0, cpiError = 0.0, mpki = 0.0, mpkiError = 0.0;
+  uint64_t detailed = 0;
+
+  for (auto &point : ordered)
+    {
+      IntervalCounters start = profile.getStart(point.interval);
+      IntervalCounters end = profile.getEnd(point.interval);
+
+      /* Consecutive intervals are already warm */
+      uint64_t warmStart = start.instructions > warmup ?
+          start.instructions - warmup : 0;
+      if (p.getInstructionCount() < warmStart)
+        {
+          if (!runUntil(p, warmStart))
+            break;
+          p.flushTLB();
+        }
+
+      if (!runUntil(p, start.instructions))
+        break;
+
+      IntervalCounters before = p.getIntervalCounters();
+      p.setStopPoint(end.instructions);
+      if (!p.run())
+        break;
+      IntervalCounters after = p.getIntervalCounters();
+
+      if (after.instructions == before.instructions)
+        continue;
+
+      double intervalCPI = getCPI(before, after);
+      double intervalMPKI = getMPKI(before, after);
+
+      cpi += point.weight * intervalCPI;
+      mpki += point.weight * intervalMPKI;
+      cpiError += point.weight * point.weight * point.cpiVariance;
+      mpkiError += point.weight * point.weight * point.mpkiVariance;
+      detailed += after.instructions - before.instructions;
+
+      os << std::setw(10) << point.interval << std::setw(10)
+         << point.clusterSize << std::fixed << std::setprecision(4)
+         << std::setw(10) << point.weight << std::setw(14)
+         << after.instructions - before.instructions
+         << std::setprecision(3) << std::setw(10) << intervalCPI
+         << std::setw(10) << intervalMPKI << std::endl;
+    }
+
+  IntervalCounters first = profile.getStart(0);
+  IntervalCounters last = profile.getEnd(profile.getIntervalCount() - 1);
+
+  /* One interval per cluster, so the variance of the estimate is the
+   * sum of the weighted variances within the clusters.
+   */
+  os << std::fixed << std::setprecision(4)
+     << "Extrapolated CPI: " << cpi << " +/- " << 1.96 * std::sqrt(cpiError)
+     << " (full run " << getCPI(first, last) << ")" << std::endl
+     << "Extrapolated TLB MPKI: " << mpki << " +/- "
+     << 1.96 * std::sqrt(mpkiError)
+     << " (full run " << getMPKI(first, last) << ")" << std::endl
+     << "Detailed simulation of " << detailed << " of "
+     << last.instructions - first.instructions << " instructions."
+     << std::endl;
+
+  os.flags(storeFlags);
+  os.fill(storeFill);
+}
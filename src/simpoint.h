@@ -0,0 +1,121 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * simpoint.h - SimPoint-style sampled simulation.
+ */
+
+#ifndef __SIMPOINT_H__
+#define __SIMPOINT_H__
+
+#include "arch.h"
+
+#include <array>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+class Processor;
+
+/* Counter values at an interval boundary, the metrics of an interval
+ * are the differences between its boundaries.
+ */
+struct IntervalCounters
+{
+  uint64_t instructions;
+  uint64_t cycles;
+  uint64_t tlbMisses;
+};
+
+/* A representative interval and the share of all instructions executed
+ * in the intervals of its cluster. The variances of the metrics within
+ * the cluster, measured while profiling, give the error bounds.
+ */
+struct SimPoint
+{
+  size_t interval;
+  size_t clusterSize;
+  double weight;
+  double cpiVariance;
+  double mpkiVariance;
+};
+
+/* Collects a basic block vector per interval of a fixed number of
+ * instructions: the instructions executed per basic block. Like
+ * SimPoint, the vectors are normalized and reduced to Dimensions
+ * through a random projection before clustering with k-means.
+ */
+class BBVProfile
+{
+  public:
+    static const int Dimensions = 15;
+
+    BBVProfile(uint64_t intervalLength, const IntervalCounters &start);
+
+    /* Blocks are counted in the interval during which they end. 
+		*/
+    void countBlock(MemAddress start, uint64_t instructions)
+    {
+      if (instructions != 0)
+        current[start] += instructions;
+    }
+
+    bool isIntervalDone(uint64_t instructions) const
+    {
+      return instructions >= intervalEnd;
+    }
+
+    void endInterval(const IntervalCounters &counters);
+
+    uint64_t getIntervalLength(void) const { return intervalLength; }
+    size_t getIntervalCount(void) const { return intervals.size(); }
+
+    /* Returns the boundaries of interval, as actually executed. 
+		*/
+    IntervalCounters getStart(size_t interval) const;
+    IntervalCounters getEnd(size_t interval) const;
+
+    /* Clusters the intervals with k-means for k up to maxK and keeps
+     * the smallest k whose BIC score is within 90% of the best, as
+     * SimPoint does. Returns one SimPoint per cluster.
+     */
+    std::vector<SimPoint> selectSimPoints(int maxK) const;
+
+    /* Write the vectors in the SimPoint .bb format. 
+		*/
+    void writeBBV(std::ostream &os) const;
+
+  private:
+    using Vector = std::array<double, Dimensions>;
+
+    struct Interval
+    {
+      std::vector<std::pair<uint32_t, uint64_t>> blocks;
+      Vector projected;
+      IntervalCounters end;
+    };
+
+    uint64_t intervalLength;
+    uint64_t intervalEnd;
+    IntervalCounters start;
+
+    std::unordered_map<MemAddress, uint64_t> current;
+    std::unordered_map<MemAddress, uint32_t> blockIds;
+    std::vector<Interval> intervals;
+
+    /* Private helper methods 
+		*/
+    double metricVariance(const std::vector<size_t> &members,
+                          bool mpki) const;
+};
+
+/* Runs the intervals chosen by selectSimPoints on a processor that
+ * starts from the same state as the profiled run: it fast-forwards to
+ * each interval, flushes the TLBs and warms them up for warmup
+ * instructions, then measures the interval. Reports the measured and
+ * extrapolated CPI and TLB misses per 1000 instructions, with 95%
+ * error bounds, next to the values of the full profiled run.
+ */
+void runSimPoints(Processor &p, const BBVProfile &profile,
+                  const std::vector<SimPoint> &points, uint64_t warmup,
+                  std::ostream &os);
+
+#endif /* __SIMPOINT_H__ */
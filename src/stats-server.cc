@@ -0,0 +1,157 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * stats-server.cc - Live statistics over a UNIX-domain socket.
+ */
+
+#include "stats-server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+StatsServer::StatsServer(const std::string &path)
+  : path(path), listenFd(-1), start(std::chrono::steady_clock::now()),
+    lastQuery(start), lastInstructions(0)
+{
+  struct sockaddr_un addr;
+
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path " + path + " is too long.");
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd < 0)
+    throw std::runtime_error("Could not create statistics socket.");
+
+  /* A socket left behind by an earlier run would make bind fail */
+  unlink(path.c_str());
+
+  if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listenFd, 4) < 0)
+    {
+      std::string error(strerror(errno));
+
+      close(listenFd);
+      throw std::runtime_error("Could not listen on " + path + ": " + error);
+    }
+
+  if (pipe(wakeupFds) < 0)
+    {
+      close(listenFd);
+      unlink(path.c_str());
+      throw std::runtime_error("Could not create statistics socket.");
+    }
+
+  server = std::thread(&StatsServer::serverThread, this);
+}
+
+StatsServer::~StatsServer()
+{
+  /* Wake up the server thread, which then exits */
+  if (write(wakeupFds[1], "", 1) < 0)
+    { }
+  server.join();
+
+  close(wakeupFds[0]);
+  close(wakeupFds[1]);
+  close(listenFd);
+  unlink(path.c_str());
+}
+
+
+/*
+ * Private methods
+ */
+void
+StatsServer::serverThread(void)
+{
+  struct pollfd fds[2] =
+  {
+    { listenFd, POLLIN, 0 },
+    { wakeupFds[0], POLLIN, 0 }
+  };
+
+  while (true)
+    {
+      if (poll(fds, 2, -1) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return;
+        }
+
+      if (fds[1].revents)
+        return;
+
+      if (!(fds[0].revents & POLLIN))
+        continue;
+
+      int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0)
+        continue;
+
+      std::string json = formatSnapshot();
+      send(fd, json.data(), json.size(), MSG_NOSIGNAL);
+      close(fd);
+    }
+}
+
+static double
+hitRate(uint64_t hits, uint64_t misses)
+{
+  return hits + misses ? (double)hits / (hits + misses) : 0.0;
+}
+
+std::string
+StatsServer::formatSnapshot(void)
+{
+  const auto relaxed = std::memory_order_relaxed;
+  auto now = std::chrono::steady_clock::now();
+
+  uint64_t instructions = snapshot.instructions.load(relaxed);
+  uint64_t itlbHits = snapshot.itlbHits.load(relaxed);
+  uint64_t itlbMisses = snapshot.itlbMisses.load(relaxed);
+  uint64_t dtlbHits = snapshot.dtlbHits.load(relaxed);
+  uint64_t dtlbMisses = snapshot.dtlbMisses.load(relaxed);
+
+  double elapsed = std::chrono::duration<double>(now - start).count();
+  double interval = std::chrono::duration<double>(now - lastQuery).count();
+  double mips = elapsed > 0 ? instructions / elapsed / 1e6 : 0.0;
+  double recentMips = interval > 0 ?
+      (instructions - lastInstructions) / interval / 1e6 : 0.0;
+
+  lastQuery = now;
+  lastInstructions = instructions;
+
+  std::ostringstream json;
+  json << "{\"running\": "
+       << (snapshot.running.load(relaxed) ? "true" : "false")
+       << ", \"instructions\": " << instructions
+       << ", \"cycles\": " << snapshot.cycles.load(relaxed)
+       << ", \"pc\": \"0x" << std::hex << snapshot.pc.load(relaxed)
+       << std::dec << "\""
+       << ", \"elapsed_seconds\": " << elapsed
+       << ", \"mips\": " << mips
+       << ", \"recent_mips\": " << recentMips
+       << ", \"itlb\": {\"hits\": " << itlbHits
+       << ", \"misses\": " << itlbMisses
+       << ", \"hit_rate\": " << hitRate(itlbHits, itlbMisses) << "}"
+       << ", \"dtlb\": {\"hits\": " << dtlbHits
+       << ", \"misses\": " << dtlbMisses
+       << ", \"hit_rate\": " << hitRate(dtlbHits, dtlbMisses) << "}"
+       << ", \"page_walks\": " << snapshot.pageWalks.load(relaxed)
+       << ", \"decode_cache_size\": "
+       << snapshot.decodeCacheSize.load(relaxed)
+       << "}" << std::endl;
+
+  return json.str();
+}
@@ -0,0 +1,68 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * stats-server.h - Live statistics over a UNIX-domain socket.
+ */
+
+#ifndef __STATS_SERVER_H__
+#define __STATS_SERVER_H__
+
+#include "arch.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+/* Counters published by the execution thread. Every counter is a
+ * separate relaxed atomic: a reader may see values from slightly
+ * different moments, but the execution thread never waits.
+ */
+struct StatsSnapshot
+{
+  std::atomic<uint64_t> instructions{ 0 };
+  std::atomic<uint64_t> cycles{ 0 };
+  std::atomic<uint64_t> pc{ 0 };
+  std::atomic<uint64_t> itlbHits{ 0 };
+  std::atomic<uint64_t> itlbMisses{ 0 };
+  std::atomic<uint64_t> dtlbHits{ 0 };
+  std::atomic<uint64_t> dtlbMisses{ 0 };
+  std::atomic<uint64_t> pageWalks{ 0 };
+  std::atomic<uint64_t> decodeCacheSize{ 0 };
+  std::atomic<bool> running{ true };
+};
+
+/* Listens on a UNIX-domain stream socket in a separate thread. Every
+ * connection is answered with the current snapshot as a JSON object,
+ * after which the connection is closed, e.g.:
+ *
+ *   socat - UNIX-CONNECT:/tmp/rv64.sock
+ */
+class StatsServer
+{
+  public:
+    StatsServer(const std::string &path);
+    ~StatsServer();
+
+    StatsSnapshot &getSnapshot(void) { return snapshot; }
+
+  private:
+    const std::string path;
+    int listenFd;
+    int wakeupFds[2];
+
+    StatsSnapshot snapshot;
+    std::thread server;
+
+    const std::chrono::steady_clock::time_point start;
+
+    /* The rate since the previous query is computed from these, only
+     * used by the server thread.
+     */
+    std::chrono::steady_clock::time_point lastQuery;
+    uint64_t lastInstructions;
+
+    void serverThread(void);
+    std::string formatSnapshot(void);
+};
+
+#endif /* __STATS_SERVER_H__ */
@@ -0,0 +1,57 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * symbol-table.cc - Address to symbol lookup.
+ */
+
+#include "symbol-table.h"
+
+#include <algorithm>
+#include <sstream>
+
+SymbolTable::SymbolTable()
+{
+}
+
+SymbolTable::SymbolTable(std::vector<Symbol> &&symbols)
+  : symbols(std::move(symbols))
+{
+  std::stable_sort(this->symbols.begin(), this->symbols.end(),
+                   [](const Symbol &a, const Symbol &b)
+                   { return a.addr < b.addr; });
+
+  addrs.reserve(this->symbols.size());
+  for (const Symbol &symbol : this->symbols)
+    addrs.push_back(symbol.addr);
+}
+
+const Symbol *
+SymbolTable::lookup(MemAddress addr) const
+{
+  auto it = std::upper_bound(addrs.begin(), addrs.end(), addr);
+  if (it == addrs.begin())
+    return nullptr;
+
+  const Symbol &symbol = symbols[it - addrs.begin() - 1];
+  if (symbol.size != 0 && addr - symbol.addr >= symbol.size)
+    return nullptr;
+
+  return &symbol;
+}
+
+std::string
+SymbolTable::format(MemAddress addr) const
+{
+  std::stringstream ss;
+  const Symbol *symbol = lookup(addr);
+
+  if (symbol)
+    {
+      ss << symbol->name;
+      if (addr != symbol->addr)
+        ss << "+0x" << std::hex << addr - symbol->addr;
+    }
+  else
+    ss << "0x" << std::hex << addr;
+
+  return ss.str();
+}
@@ -0,0 +1,57 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * symbol-table.h - Address to symbol lookup.
+ */
+
+#ifndef __SYMBOL_TABLE_H__
+#define __SYMBOL_TABLE_H__
+
+#include "arch.h"
+
+#include <string>
+#include <vector>
+
+struct Symbol
+{
+  std::string name;
+  MemAddress addr;
+  uint64_t size;
+};
+
+/* Symbols are kept sorted by address. A symbol without size (such
+ * as a label in assembly code) extends up to the next symbol. The
+ * addresses are also kept in an array of their own, so that a lookup
+ * only touches a few cache lines of addresses and a single symbol.
+ */
+class SymbolTable
+{
+  public:
+    SymbolTable();
+    SymbolTable(std::vector<Symbol> &&symbols);
+
+    bool empty(void) const { return symbols.empty(); }
+
+    std::vector<Symbol>::const_iterator begin(void) const
+    {
+      return symbols.begin();
+    }
+    std::vector<Symbol>::const_iterator end(void) const
+    {
+      return symbols.end();
+    }
+
+    /* Returns the symbol containing addr, or nullptr. 
+		*/
+    const Symbol *lookup(MemAddress addr) const;
+
+    /* Format addr as symbol+offset, or as hexadecimal address when
+     * no symbol contains it.
+     */
+    std::string format(MemAddress addr) const;
+
+  private:
+    std::vector<MemAddress> addrs;
+    std::vector<Symbol> symbols;
+};
+
+#endif /* __SYMBOL_TABLE_H__ */
@@ -4,11 +4,17 @@
  */
 
 #include "sys-control.h"
+#include "checkpoint.h"
+#include "replay-log.h"
 
 #include <iostream>
+#include <limits>
 
-SysControl::SysControl(const MemAddress base)
-  : base(base), shouldHaltFlag(false)
+SysControl::SysControl(const MemAddress base, std::ostream &output)
+  : base(base), output(output), shouldHaltFlag(false), exitCode(0),
+    timerCmp(std::numeric_limits<uint64_t>::max()),
+    instructions(nullptr), cycles(nullptr),
+    startTime(std::chrono::steady_clock::now()), replayLog(nullptr)
 {
 }
 
@@ -16,6 +22,30 @@ SysControl::~SysControl()
 {
 }
 
+void
+SysControl::attachCounters(const uint64_t *instructions,
+                           const uint64_t *cycles)
+{
+  this->instructions = instructions;
+  this->cycles = cycles;
+}
+
+void
+SysControl::saveState(CheckpointWriter &writer) const
+{
+  writer.put(shouldHaltFlag);
+  writer.put(exitCode);
+  writer.put(timerCmp);
+}
+
+void
+SysControl::restoreState(CheckpointReader &reader)
+{
+  shouldHaltFlag = reader.get<bool>();
+  exitCode = reader.get<uint64_t>();
+  timerCmp = reader.get<uint64_t>();
+}
+
 /*
  * MemoryInterface
  */
@@ -23,62 +53,142 @@ SysControl::~SysControl()
 uint8_t
 SysControl::readByte(MemAddress addr)
 {
-  throw IllegalAccess("Not supported on syscontrol interface");
+  return readRegister(addr, sizeof(uint8_t));
 }
 
 uint16_t
 SysControl::readHalfWord(MemAddress addr)
 {
-  throw IllegalAccess("Not supported on syscontrol interface");
+  return readRegister(addr, sizeof(uint16_t));
 }
 
 uint32_t
 SysControl::readWord(MemAddress addr)
 {
-  throw IllegalAccess("Not supported on syscontrol interface");
+  return readRegister(addr, sizeof(uint32_t));
 }
 
 uint64_t
 SysControl::readDoubleWord(MemAddress addr)
 {
-  throw IllegalAccess("Not supported on syscontrol interface");
+  return readRegister(addr, sizeof(uint64_t));
 }
 
 
 void
 SysControl::writeByte(MemAddress addr, uint8_t value)
 {
-  if (addr != base + 0x8)
-    throw IllegalAccess("Invalid system controller address");
-
-  std::cerr << "System halt requested." << std::endl;
-  shouldHaltFlag = true;
+  writeRegister(addr, sizeof(value), value);
 }
 
 void
 SysControl::writeHalfWord(MemAddress addr, uint16_t value)
 {
-  throw IllegalAccess("Not supported on syscontrol interface");
+  writeRegister(addr, sizeof(value), value);
 }
 
 void
 SysControl::writeWord(MemAddress addr, uint32_t value)
 {
-  if (addr != base + 0x8)
-    throw IllegalAccess("Invalid system controller address");
-
-  std::cerr << "System halt requested." << std::endl;
-  shouldHaltFlag = true;
+  writeRegister(addr, sizeof(value), value);
 }
 
 void
 SysControl::writeDoubleWord(MemAddress addr, uint64_t value)
 {
-  throw IllegalAccess("Not supported on syscontrol interface");
+  writeRegister(addr, sizeof(value), value);
 }
 
 bool
 SysControl::contains(MemAddress addr) const
 {
-  return base <= addr && addr < base + 0x10;
+  return base <= addr && addr < base + Register::End;
+}
+
+
+/*
+ * Private methods
+ */
+uint64_t
+SysControl::getTime(void) const
+{
+  auto elapsed = std::chrono::steady_clock::now() - startTime;
+  uint64_t time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+  return replayLog ? replayLog->time(time) : time;
+}
+
+/* Read (part of) a register. Sub-word reads return the bytes at the
+ * given offset within the register, as if reading from little-endian
+ * memory.
+ */
+uint64_t
+SysControl::readRegister(MemAddress addr, size_t size)
+{
+  MemAddress offset = (addr - base) & ~(MemAddress)0x7;
+  unsigned int shift = ((addr - base) & 0x7) * 8;
+
+  if ((addr & (size - 1)) != 0)
+    throw IllegalAccess(addr, size);
+
+  uint64_t value;
+  switch (offset)
+    {
+      case Register::ExitCode:
+        value = exitCode;
+        break;
+
+      case Register::InstRet:
+        value = instructions ? *instructions : 0;
+        break;
+
+      case Register::Cycle:
+        value = cycles ? *cycles : 0;
+        break;
+
+      case Register::Time:
+        value = getTime();
+        break;
+
+      case Register::TimerCmp:
+        value = timerCmp;
+        break;
+
+      case Register::TimerStatus:
+        value = getTime() >= timerCmp ? 1 : 0;
+        break;
+
+      default:
+        throw IllegalAccess("Invalid system controller address");
+    }
+
+  return value >> shift;
+}
+
+void
+SysControl::writeRegister(MemAddress addr, size_t size, uint64_t value)
+{
+  if (((addr - base) & 0x7) != 0)
+    throw IllegalAccess(addr, size);
+
+  switch (addr - base)
+    {
+      case Register::ExitCode:
+        exitCode = value;
+        break;
+
+      case Register::Halt:
+        output << "System halt requested." << std::endl;
+        exitCode = value;
+        shouldHaltFlag = true;
+        break;
+
+      case Register::TimerCmp:
+        timerCmp = value;
+        break;
+
+      default:
+        throw IllegalAccess("Invalid system controller address");
+    }
 }
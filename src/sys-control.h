@@ -3,9 +3,21 @@
  * sys-control.h - System control module.
  */
 
-/* The system control module currently only supported halting the
- * system. Other functionalities could be implemented here at different
- * memory addresses. (For instance, reading the instruction counter).
+/* The system control module exposes a small bank of 64-bit registers
+ * to the guest. Offsets are relative to the base address:
+ *
+ *   0x00  EXIT_CODE     (rw) exit code of the program
+ *   0x08  HALT          (w)  halt the system, the value written is
+ *                            stored as exit code
+ *   0x10  INSTRET       (r)  number of instructions executed
+ *   0x18  CYCLE         (r)  number of clock cycles
+ *   0x20  TIME          (r)  monotonic host time in nanoseconds since
+ *                            the system controller was created
+ *   0x28  TIMER_CMP     (rw) timer compare value, in TIME units
+ *   0x30  TIMER_STATUS  (r)  1 when TIME >= TIMER_CMP, 0 otherwise
+ *
+ * Registers may be accessed with any naturally aligned access that
+ * fits within the register. Writes always replace the full register.
  */
 
 #ifndef __SYS_CONTROL_H__
@@ -13,13 +25,34 @@
 
 #include "memory-interface.h"
 
+#include <chrono>
+#include <iostream>
+
+class CheckpointWriter;
+class CheckpointReader;
+class ReplayLog;
+
 class SysControl : public MemoryInterface
 {
   public:
-    SysControl(const MemAddress base);
+    SysControl(const MemAddress base, std::ostream &output = std::cerr);
     virtual ~SysControl();
 
+    void saveState(CheckpointWriter &writer) const;
+    void restoreState(CheckpointReader &reader);
+
+    /* Counters are owned by the processor, the system controller
+     * only reads them.
+     */
+    void attachCounters(const uint64_t *instructions,
+                        const uint64_t *cycles);
+
+    /* Timer reads are recorded to or replayed from log. 
+		*/
+    void attachReplayLog(ReplayLog *log) { replayLog = log; }
+
     bool shouldHalt(void) const { return shouldHaltFlag; }
+    uint64_t getExitCode(void) const { return exitCode; }
 
     /* MemoryInterface 
 		*/
@@ -36,9 +69,36 @@ class SysControl : public MemoryInterface
     virtual bool contains(MemAddress addr) const override;
 
   private:
+    enum Register : MemAddress
+    {
+      ExitCode = 0x00,
+      Halt = 0x08,
+      InstRet = 0x10,
+      Cycle = 0x18,
+      Time = 0x20,
+      TimerCmp = 0x28,
+      TimerStatus = 0x30,
+      End = 0x38
+    };
+
     const MemAddress base;
+    std::ostream &output;
 
     bool shouldHaltFlag;
+    uint64_t exitCode;
+    uint64_t timerCmp;
+
+    const uint64_t *instructions;
+    const uint64_t *cycles;
+
+    const std::chrono::steady_clock::time_point startTime;
+    ReplayLog *replayLog;
+
+    /* Private helper methods 
+		*/
+    uint64_t getTime(void) const;
+    uint64_t readRegister(MemAddress addr, size_t size);
+    void writeRegister(MemAddress addr, size_t size, uint64_t value);
 };
 
 #endif /* __SYS_CONTROL_H__ */
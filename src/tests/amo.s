@@ -0,0 +1,19 @@
+	.text
+        .align 4
+	.globl	_start
+	.type	_start, @function
+_start:
+  sd x18,1024(x0)
+  li x5,1024
+  amoadd.d x20,x19,(x5)
+  amoswap.d x21,x18,(x5)
+  amomax.d x22,x19,(x5)
+  amominu.d x23,x18,(x5)
+  lr.d x24,(x5)
+  sc.d x25,x18,(x5)
+  sc.d x26,x19,(x5)
+  ld x27,1024(x0)
+  sw x18,1032(x0)
+  li x6,1032
+  amoadd.w x28,x19,(x6)
+  lw x29,1032(x0)
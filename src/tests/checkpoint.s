@@ -0,0 +1,28 @@
+	# gp is not set up, prevent relaxing %hi/%lo pairs to gp.
+	.option norelax
+
+	.text
+        .align 4
+	.globl	_start
+	.type	_start, @function
+_start:
+	li	x5,0
+	li	x6,1
+	li	x7,20
+	lui	x8,%hi(values)
+	addi	x8,x8,%lo(values)
+.L1:
+	add	x5,x5,x6
+	sd	x5,0(x8)
+	addi	x8,x8,8
+	addi	x6,x6,1
+	bge	x7,x6,.L1
+	ld	x9,-8(x8)
+	ld	x10,-144(x8)
+_end:
+	.size	_start, .-_start
+
+	.bss
+	.align	3
+values:
+	.skip	20 * 8
@@ -0,0 +1,18 @@
+	.text
+        .align 4
+	.globl	_start
+	.type	_start, @function
+_start:
+	li	x5,1
+	csrw	mhpmevent3,x5
+	csrw	mhpmcounter3,x0
+	sd	x0,1024(x0)
+	ld	x6,1024(x0)
+	ld	x6,1024(x0)
+	csrr	x7,mhpmcounter3
+	csrw	minstret,x0
+	nop
+	nop
+	csrr	x8,minstret
+	csrrs	x9,mhpmevent3,x0
+	.size	_start, .-_start
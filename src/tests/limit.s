@@ -0,0 +1,12 @@
+	.text
+        .align 4
+	.globl	_start
+	.type	_start, @function
+_start:
+	li	x5,0
+	li	x6,1000
+.L1:
+	addi	x5,x5,1
+	blt	x5,x6,.L1
+_end:
+	.size	_start, .-_start
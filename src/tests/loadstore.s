@@ -5,4 +5,5 @@
 _start:
   sd x18,1024(ra)
   lw x19,1024(ra)
-  lb x20,1024(ra)
+  lbu x20,1024(ra)
+  lb x21,1024(ra)
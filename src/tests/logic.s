@@ -0,0 +1,16 @@
+	.text
+        .align 4
+	.globl	_start
+	.type	_start, @function
+_start:
+  or x20,x18,x19
+  xor x21,x18,x19
+  and x22,x18,x19
+  slt x23,x18,x19
+  sltu x24,x18,x19
+  sra x25,x18,x19
+  srai x26,x18,2
+  ori x27,x19,-16
+  xori x28,x19,-1
+  addiw x29,x18,0
+  addw x30,x19,x19
@@ -0,0 +1,16 @@
+	.text
+        .align 4
+	.globl	_start
+	.type	_start, @function
+_start:
+  mul x20,x18,x19
+  mulh x21,x18,x19
+  mulhu x22,x18,x19
+  div x23,x18,x19
+  divu x24,x19,x18
+  rem x25,x18,x19
+  remu x26,x19,x18
+  div x27,x18,x0
+  rem x28,x18,x0
+  mulw x29,x18,x19
+  divw x30,x18,x19
@@ -0,0 +1,20 @@
+	.text
+        .align 4
+	.globl	_start
+	.type	_start, @function
+_start:
+	lui	x1,%hi(handler)
+	addi	x1,x1,%lo(handler)
+	csrw	mtvec,x1
+	ecall
+	ecall
+	csrr	x6,mcause
+	j	_end
+handler:
+	addi	x5,x5,1
+	csrr	x7,mepc
+	addi	x7,x7,4
+	csrw	mepc,x7
+	mret
+_end:
+	.size	_start, .-_start
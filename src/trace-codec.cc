@@ -0,0 +1,241 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * trace-codec.cc - Compression of trace chunks.
+ */
+
+#include "trace-codec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* The built-in codec is a byte-oriented LZ77 variant in the style of
+ * the LZ4 block format. A chunk is a series of sequences:
+ *
+ *   token        high nibble literal length, low nibble match length - 4,
+ *                a nibble of 15 is followed by 255-terminated extra bytes
+ *   literals
+ *   offset       u16 LE, distance back to the match
+ *
+ * The last sequence consists of literals only. It is fast rather than
+ * strong, which suits the highly repetitive record stream.
+ */
+
+static const size_t MinMatch = 4;
+static const size_t MaxOffset = 65535;
+static const unsigned int HashBits = 16;
+
+static void
+putLength(std::vector<uint8_t> &output, size_t length)
+{
+  while (length >= 255)
+    {
+      output.push_back(255);
+      length -= 255;
+    }
+  output.push_back(length);
+}
+
+static void
+putSequence(std::vector<uint8_t> &output, const uint8_t *literals,
+            size_t nLiterals, size_t offset, size_t matchLength)
+{
+  size_t matchCode = matchLength ? matchLength - MinMatch : 0;
+
+  output.push_back((std::min<size_t>(nLiterals, 15) << 4) |
+                   std::min<size_t>(matchCode, 15));
+  if (nLiterals >= 15)
+    putLength(output, nLiterals - 15);
+
+  output.insert(output.end(), literals, literals + nLiterals);
+
+  if (matchLength)
+    {
+      output.push_back(offset & 0xff);
+      output.push_back(offset >> 8);
+      if (matchCode >= 15)
+        putLength(output, matchCode - 15);
+    }
+}
+
+static void
+compressLZ(const uint8_t *input, size_t size, std::vector<uint8_t> &output)
+{
+  std::vector<uint32_t> table(1 << HashBits, 0);
+  size_t anchor = 0, pos = 0;
+
+  while (pos + MinMatch <= size)
+    {
+      uint32_t sequence;
+      memcpy(&sequence, input + pos, sizeof(sequence));
+
+      size_t hash = (sequence * 2654435761u) >> (32 - HashBits);
+      size_t candidate = table[hash];
+      table[hash] = pos + 1;
+
+      /* Table entries hold position + 1, so that 0 means empty */
+      if (candidate != 0 && pos - (candidate - 1) <= MaxOffset &&
+          !memcmp(input + candidate - 1, input + pos, MinMatch))
+        {
+          size_t match = candidate - 1;
+          size_t length = MinMatch;
+
+          while (pos + length < size && input[match + length] == input[pos + length])
+            ++length;
+
+          putSequence(output, input + anchor, pos - anchor, pos - match, length);
+          pos += length;
+          anchor = pos;
+        }
+      else
+        ++pos;
+    }
+
+  putSequence(output, input + anchor, size - anchor, 0, 0);
+}
+
+static bool
+getLength(const uint8_t *&in, const uint8_t *end, size_t &length)
+{
+  uint8_t byte;
+
+  do
+    {
+      if (in >= end)
+        return false;
+      byte = *in++;
+      length += byte;
+    }
+  while (byte == 255);
+
+  return true;
+}
+
+static void
+decompressLZ(const uint8_t *in, size_t size, size_t rawSize,
+             std::vector<uint8_t> &output)
+{
+  const uint8_t *end = in + size;
+  const std::runtime_error corrupt("Corrupt trace chunk.");
+
+  output.reserve(rawSize);
+
+  while (in < end)
+    {
+      uint8_t token = *in++;
+      size_t nLiterals = token >> 4;
+
+      if (nLiterals == 15 && !getLength(in, end, nLiterals))
+        throw corrupt;
+      if (nLiterals > (size_t)(end - in) || output.size() + nLiterals > rawSize)
+        throw corrupt;
+
+      output.insert(output.end(), in, in + nLiterals);
+      in += nLiterals;
+
+      if (in == end)
+        break;
+
+      if (end - in < 2)
+        throw corrupt;
+      size_t offset = in[0] | (in[1] << 8);
+      in += 2;
+
+      size_t length = token & 0xf;
+      if (length == 15 && !getLength(in, end, length))
+        throw corrupt;
+      length += MinMatch;
+
+      if (offset == 0 || offset > output.size() ||
+          output.size() + length > rawSize)
+        throw corrupt;
+
+      /* Matches may overlap the bytes they produce */
+      size_t from = output.size() - offset;
+      for (size_t i = 0; i < length; ++i)
+        output.push_back(output[from + i]);
+    }
+
+  if (output.size() != rawSize)
+    throw corrupt;
+}
+
+TraceCodec
+getDefaultTraceCodec(void)
+{
+#ifdef HAVE_ZSTD
+  return TraceCodec::Zstd;
+#else
+  return TraceCodec::LZ;
+#endif
+}
+
+void
+compressChunk(TraceCodec codec, const uint8_t *input, size_t size,
+              std::vector<uint8_t> &output)
+{
+  output.clear();
+
+  switch (codec)
+    {
+      case TraceCodec::None:
+        output.assign(input, input + size);
+        break;
+
+      case TraceCodec::LZ:
+        compressLZ(input, size, output);
+        break;
+
+      case TraceCodec::Zstd:
+#ifdef HAVE_ZSTD
+        {
+          output.resize(ZSTD_compressBound(size));
+          size_t result = ZSTD_compress(output.data(), output.size(),
+                                        input, size, 3);
+          if (ZSTD_isError(result))
+            throw std::runtime_error(ZSTD_getErrorName(result));
+          output.resize(result);
+        }
+        break;
+#endif
+      default:
+        throw std::runtime_error("Trace codec not supported by this build.");
+    }
+}
+
+void
+decompressChunk(TraceCodec codec, const uint8_t *input, size_t size,
+                size_t rawSize, std::vector<uint8_t> &output)
+{
+  output.clear();
+
+  switch (codec)
+    {
+      case TraceCodec::None:
+        if (size != rawSize)
+          throw std::runtime_error("Corrupt trace chunk.");
+        output.assign(input, input + size);
+        break;
+
+      case TraceCodec::LZ:
+        decompressLZ(input, size, rawSize, output);
+        break;
+
+      case TraceCodec::Zstd:
+#ifdef HAVE_ZSTD
+        {
+          output.resize(rawSize);
+          size_t result = ZSTD_decompress(output.data(), rawSize, input, size);
+          if (ZSTD_isError(result) || result != rawSize)
+            throw std::runtime_error("Corrupt trace chunk.");
+        }
+        break;
+#endif
+      default:
+        throw std::runtime_error("Trace codec not supported by this build.");
+    }
+}
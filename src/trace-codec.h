@@ -0,0 +1,31 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * trace-codec.h - Compression of trace chunks.
+ */
+
+#ifndef __TRACE_CODEC_H__
+#define __TRACE_CODEC_H__
+
+#include "trace-format.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* The best codec this build supports: zstd when built with HAVE_ZSTD,
+ * the built-in LZ codec otherwise.
+ */
+TraceCodec getDefaultTraceCodec(void);
+
+/* Compress input into output (replacing its contents). 
+*/
+void compressChunk(TraceCodec codec, const uint8_t *input, size_t size,
+                   std::vector<uint8_t> &output);
+
+/* Decompress a chunk of known raw size, throws std::runtime_error on
+ * corrupt input or an unsupported codec.
+ */
+void decompressChunk(TraceCodec codec, const uint8_t *input, size_t size,
+                     size_t rawSize, std::vector<uint8_t> &output);
+
+#endif /* __TRACE_CODEC_H__ */
@@ -0,0 +1,240 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * trace-dump.cc - Decoder for binary execution traces.
+ */
+
+#include "trace-format.h"
+#include "trace-codec.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <getopt.h>
+#include <inttypes.h>
+
+/* Mirrors the encoder state of TraceWriter. 
+*/
+class TraceDecoder
+{
+  public:
+    TraceDecoder()
+      : lastPC(0), lastMemAddr(0)
+    {
+      lastValues.fill(0);
+    }
+
+    /* Decode one record, returns the position after it. 
+		*/
+    const uint8_t *decode(const uint8_t *in, const uint8_t *end,
+                          TraceRecord &record)
+    {
+      const std::runtime_error corrupt("Corrupt trace record.");
+      uint64_t value;
+
+      uint8_t flags = *in++;
+
+      record.pc = lastPC + 4;
+      if (flags & TraceFlags::PCJump)
+        {
+          if (!(in = getVarint(in, end, value)))
+            throw corrupt;
+          record.pc += zigzagDecode(value);
+        }
+      lastPC = record.pc;
+
+      if (flags & TraceFlags::Instruction)
+        {
+          if (end - in < 4)
+            throw corrupt;
+          record.instruction = in[0] | (in[1] << 8) | (in[2] << 16) |
+                               ((uint32_t)in[3] << 24);
+          in += 4;
+          cache.set(record.pc, record.instruction);
+        }
+      else
+        record.instruction = cache.get(record.pc);
+
+      record.rd = 0;
+      if (flags & TraceFlags::RegWrite)
+        {
+          if (in >= end)
+            throw corrupt;
+          record.rd = *in++ % NumRegs;
+          if (!(in = getVarint(in, end, value)))
+            throw corrupt;
+          record.value = lastValues[record.rd] + zigzagDecode(value);
+          lastValues[record.rd] = record.value;
+        }
+
+      record.memSize = 0;
+      if (flags & TraceFlags::MemAccess)
+        {
+          if (in >= end)
+            throw corrupt;
+          record.memSize = 1 << (*in++ & 0x3);
+          record.memWrite = flags & TraceFlags::MemWrite;
+          if (!(in = getVarint(in, end, value)))
+            throw corrupt;
+          record.memAddr = lastMemAddr + zigzagDecode(value);
+          lastMemAddr = record.memAddr;
+
+          if (record.memWrite && !(in = getVarint(in, end, record.memValue)))
+            throw corrupt;
+        }
+
+      return in;
+    }
+
+  private:
+    MemAddress lastPC;
+    MemAddress lastMemAddr;
+    std::array<RegValue, NumRegs> lastValues;
+    TraceInstructionCache cache;
+};
+
+static bool
+readU32(FILE *file, uint32_t &value)
+{
+  uint8_t bytes[4];
+
+  if (fread(bytes, 1, 4, file) != 4)
+    return false;
+
+  value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+          ((uint32_t)bytes[3] << 24);
+  return true;
+}
+
+static void
+printRecord(const TraceRecord &record)
+{
+  printf("%016" PRIx64 "  %08" PRIx32, record.pc, record.instruction);
+
+  if (record.rd != 0)
+    printf("  x%-2d = 0x%016" PRIx64, record.rd, record.value);
+
+  if (record.memSize != 0)
+    {
+      if (record.memWrite)
+        printf("  store %d @ 0x%" PRIx64 " = 0x%" PRIx64,
+               record.memSize, record.memAddr, record.memValue);
+      else
+        printf("  load %d @ 0x%" PRIx64, record.memSize, record.memAddr);
+    }
+
+  putchar('\n');
+}
+
+static void
+showHelp(const char *progName)
+{
+  std::cerr << progName << " [-s] <traceFilename>" << std::endl;
+  std::cerr <<
+R"HERE(
+    Decodes a trace written by rv64-emu --trace and prints one line per
+    instruction: PC, instruction word, register write and memory access.
+
+    -s only prints a summary of the trace.
+)HERE";
+}
+
+int
+main(int argc, char **argv)
+{
+  int c;
+  bool summaryOnly = false;
+  const char *progName = argv[0];
+
+  while ((c = getopt(argc, argv, "sh")) != -1)
+    {
+      switch (c)
+        {
+          case 's':
+            summaryOnly = true;
+            break;
+
+          case 'h':
+          default:
+            showHelp(progName);
+            return 2;
+        }
+    }
+
+  if (optind >= argc)
+    {
+      showHelp(progName);
+      return 2;
+    }
+
+  FILE *file = fopen(argv[optind], "rb");
+  if (!file)
+    {
+      std::cerr << "Error: Could not open " << argv[optind] << std::endl;
+      return 1;
+    }
+
+  char magic[sizeof(TraceMagic)];
+  int codec;
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, TraceMagic, sizeof(magic)) != 0 ||
+      (codec = fgetc(file)) == EOF)
+    {
+      std::cerr << "Error: Not a trace file." << std::endl;
+      fclose(file);
+      return 1;
+    }
+
+  TraceDecoder decoder;
+  TraceRecord record;
+  std::vector<uint8_t> compressed, chunk;
+  uint64_t nRecords = 0, nLoads = 0, nStores = 0, nChunks = 0;
+  uint32_t rawSize, size;
+
+  try
+    {
+      while (readU32(file, rawSize) && readU32(file, size))
+        {
+          if (rawSize > TraceChunkSize)
+            throw std::runtime_error("Corrupt trace chunk.");
+
+          compressed.resize(size);
+          if (fread(compressed.data(), 1, size, file) != size)
+            throw std::runtime_error("Truncated trace chunk.");
+
+          decompressChunk(static_cast<TraceCodec>(codec),
+                          compressed.data(), size, rawSize, chunk);
+          ++nChunks;
+
+          const uint8_t *in = chunk.data(), *end = in + chunk.size();
+          while (in < end)
+            {
+              in = decoder.decode(in, end, record);
+              ++nRecords;
+
+              if (record.memSize != 0)
+                ++(record.memWrite ? nStores : nLoads);
+
+              if (!summaryOnly)
+                printRecord(record);
+            }
+        }
+    }
+  catch (std::exception &e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+      fclose(file);
+      return 1;
+    }
+
+  fclose(file);
+
+  if (summaryOnly)
+    std::cout << nRecords << " instructions, " << nLoads << " loads, "
+              << nStores << " stores in " << nChunks << " chunks"
+              << std::endl;
+
+  return 0;
+}
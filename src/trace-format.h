@@ -0,0 +1,165 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * trace-format.h - Binary execution trace format.
+ */
+
+/* A trace file starts with a header, followed by chunks:
+ *
+ *   header:  "RV64TRC1" (8 bytes), codec (1 byte)
+ *   chunk:   raw size (u32 LE), compressed size (u32 LE), data
+ *
+ * Chunks are compressed independently with the codec named in the
+ * header. The decompressed chunks form one stream of records, one per
+ * retired instruction:
+ *
+ *   flags            1 byte, see TraceFlags
+ *   PC delta         zigzag varint, if PCJump: PC - (previous PC + 4)
+ *   instruction      u32 LE, if Instruction
+ *   rd, value delta  1 byte, zigzag varint, if RegWrite: the value
+ *                    relative to the previous value of rd
+ *   size, addr delta 1 byte, zigzag varint, if MemAccess: log2 of the
+ *                    access size and the virtual address relative to
+ *                    the previous access
+ *   store value      varint, if MemAccess and MemWrite
+ *
+ * Instruction words are only stored when they are not in a small
+ * direct-mapped cache indexed by PC, which the reader maintains in
+ * the same way. Records of straight-line code in loops therefore
+ * take one to three bytes before compression.
+ */
+
+#ifndef __TRACE_FORMAT_H__
+#define __TRACE_FORMAT_H__
+
+#include "arch.h"
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+static const char TraceMagic[8] = { 'R', 'V', '6', '4', 'T', 'R', 'C', '1' };
+
+enum class TraceCodec : uint8_t
+{
+  None = 0,
+  LZ = 1,               /* built-in LZ77 codec, see trace-codec.cc */
+  Zstd = 2
+};
+
+enum TraceFlags : uint8_t
+{
+  PCJump = 0x01,
+  Instruction = 0x02,
+  RegWrite = 0x04,
+  MemAccess = 0x08,
+  MemWrite = 0x10
+};
+
+/* Raw size of a chunk, records never straddle chunks. */
+static const size_t TraceChunkSize = 1 << 20;
+
+/* Upper bound on the encoded size of a single record */
+static const size_t TraceMaxRecordSize = 1 + 10 + 4 + 1 + 10 + 1 + 10 + 10;
+
+/* A single retired instruction. rd is 0 when no register was written,
+ * memSize is 0 when there was no memory access.
+ */
+struct TraceRecord
+{
+  MemAddress pc;
+  uint32_t instruction;
+  uint8_t rd;
+  RegValue value;
+  uint8_t memSize;
+  bool memWrite;
+  MemAddress memAddr;
+  RegValue memValue;
+};
+
+/* Instruction words seen recently, shared by writer and reader.
+ */
+class TraceInstructionCache
+{
+  public:
+    TraceInstructionCache()
+    {
+      pcs.fill(~(MemAddress)0);
+      words.fill(0);
+    }
+
+    /* Returns true when the word at pc was cached, updates the cache
+     * otherwise.
+     */
+    bool lookup(MemAddress pc, uint32_t word)
+    {
+      size_t index = (pc >> 2) % Size;
+
+      if (pcs[index] == pc && words[index] == word)
+        return true;
+
+      pcs[index] = pc;
+      words[index] = word;
+      return false;
+    }
+
+    uint32_t get(MemAddress pc) const { return words[(pc >> 2) % Size]; }
+
+    void set(MemAddress pc, uint32_t word)
+    {
+      size_t index = (pc >> 2) % Size;
+
+      pcs[index] = pc;
+      words[index] = word;
+    }
+
+  private:
+    static const size_t Size = 4096;
+
+    std::array<MemAddress, Size> pcs;
+    std::array<uint32_t, Size> words;
+};
+
+static inline uint64_t
+zigzagEncode(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t
+zigzagDecode(uint64_t value)
+{
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* Appends value as LEB128 varint, returns the new end of buffer. */
+static inline uint8_t *
+putVarint(uint8_t *out, uint64_t value)
+{
+  while (value >= 0x80)
+    {
+      *out++ = (uint8_t)value | 0x80;
+      value >>= 7;
+    }
+  *out++ = (uint8_t)value;
+
+  return out;
+}
+
+/* Reads a varint, returns nullptr when the input is truncated. */
+static inline const uint8_t *
+getVarint(const uint8_t *in, const uint8_t *end, uint64_t &value)
+{
+  value = 0;
+  for (unsigned int shift = 0; in < end && shift < 64; shift += 7)
+    {
+      uint8_t byte = *in++;
+
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        return in;
+    }
+
+  return nullptr;
+}
+
+#endif /* __TRACE_FORMAT_H__ */
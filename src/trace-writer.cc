@@ -0,0 +1,227 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * trace-writer.cc - Streaming writer of binary execution traces.
+ */
+
+#include "trace-writer.h"
+#include "trace-codec.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+static void
+putU32(std::vector<uint8_t> &buffer, uint32_t value)
+{
+  for (int i = 0; i < 4; ++i)
+    buffer.push_back(value >> (8 * i));
+}
+
+TraceWriter::TraceWriter(const std::string &filename, TraceCodec codec)
+  : filename(filename), codec(codec), lastPC(0), lastMemAddr(0),
+    finished(false), nRecords(0), nRawBytes(0), nWrittenBytes(0)
+{
+  file = fopen(filename.c_str(), "wb");
+  if (!file)
+    throw std::runtime_error("Could not open trace file " + filename + ".");
+
+  if (fwrite(TraceMagic, sizeof(TraceMagic), 1, file) != 1 ||
+      fputc(static_cast<uint8_t>(codec), file) == EOF)
+    {
+      std::string reason(strerror(errno));
+
+      fclose(file);
+      throw std::runtime_error("Could not write trace file " + filename +
+                               ": " + reason);
+    }
+  nWrittenBytes = sizeof(TraceMagic) + 1;
+
+  lastValues.fill(0);
+
+  for (size_t i = 0; i < MaxQueuedChunks; ++i)
+    freeChunks.emplace_back(new Chunk{
+        std::unique_ptr<uint8_t[]>(new uint8_t[TraceChunkSize]), 0 });
+
+  current = std::move(freeChunks.front());
+  freeChunks.pop_front();
+
+  writer = std::thread(&TraceWriter::writerThread, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+  try
+    {
+      finish();
+    }
+  catch (std::runtime_error &e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+    }
+}
+
+void
+TraceWriter::finish(void)
+{
+  if (!file)
+    return;
+
+  if (current->used > 0)
+    submit();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+  }
+  queueReady.notify_one();
+  writer.join();
+
+  if (fclose(file) != 0 && error.empty())
+    error = strerror(errno);
+  file = nullptr;
+
+  if (!error.empty())
+    throw std::runtime_error("Could not write trace file " + filename +
+                             ": " + error);
+}
+
+void
+TraceWriter::dumpStatistics(void) const
+{
+  std::cerr << "Trace: " << nRecords << " records, "
+            << nRawBytes << " bytes encoded, "
+            << nWrittenBytes << " bytes written";
+  if (nRecords)
+    std::cerr << " (" << (double)nWrittenBytes / nRecords
+              << " bytes/instruction)";
+  std::cerr << std::endl;
+}
+
+
+/*
+ * Private methods
+ */
+uint8_t *
+TraceWriter::encode(const TraceRecord &record, uint8_t *out)
+{
+  uint8_t *flags = out++;
+  *flags = 0;
+
+  if (record.pc != lastPC + 4)
+    {
+      *flags |= TraceFlags::PCJump;
+      out = putVarint(out, zigzagEncode(record.pc - (lastPC + 4)));
+    }
+  lastPC = record.pc;
+
+  if (!cache.lookup(record.pc, record.instruction))
+    {
+      *flags |= TraceFlags::Instruction;
+      for (int i = 0; i < 4; ++i)
+        *out++ = record.instruction >> (8 * i);
+    }
+
+  if (record.rd != 0)
+    {
+      *flags |= TraceFlags::RegWrite;
+      *out++ = record.rd;
+      out = putVarint(out, zigzagEncode(record.value - lastValues[record.rd]));
+      lastValues[record.rd] = record.value;
+    }
+
+  if (record.memSize != 0)
+    {
+      *flags |= TraceFlags::MemAccess;
+      if (record.memWrite)
+        *flags |= TraceFlags::MemWrite;
+
+      *out++ = record.memSize == 1 ? 0 : record.memSize == 2 ? 1 :
+               record.memSize == 4 ? 2 : 3;
+      out = putVarint(out, zigzagEncode(record.memAddr - lastMemAddr));
+      lastMemAddr = record.memAddr;
+
+      if (record.memWrite)
+        out = putVarint(out, record.memValue);
+    }
+
+  return out;
+}
+
+void
+TraceWriter::submit(void)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  nRawBytes += current->used;
+  queue.push_back(std::move(current));
+  queueReady.notify_one();
+
+  chunkFree.wait(lock, [this] { return !freeChunks.empty(); });
+  current = std::move(freeChunks.front());
+  freeChunks.pop_front();
+  current->used = 0;
+}
+
+void
+TraceWriter::writerThread(void)
+{
+  std::vector<uint8_t> compressed;
+  std::vector<uint8_t> header;
+
+  while (true)
+    {
+      std::unique_ptr<Chunk> chunk;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        queueReady.wait(lock, [this] { return finished || !queue.empty(); });
+
+        if (queue.empty())
+          return;
+
+        chunk = std::move(queue.front());
+        queue.pop_front();
+      }
+
+      /* After an error the chunks are only recycled, so that record()
+       * does not block.
+       */
+      std::string chunkError;
+      size_t written = 0;
+
+      if (error.empty())
+        {
+          try
+            {
+              compressChunk(codec, chunk->data.get(), chunk->used, compressed);
+
+              header.clear();
+              putU32(header, chunk->used);
+              putU32(header, compressed.size());
+
+              if (fwrite(header.data(), 1, header.size(), file) !=
+                      header.size() ||
+                  fwrite(compressed.data(), 1, compressed.size(), file) !=
+                      compressed.size())
+                chunkError = strerror(errno);
+              else
+                written = header.size() + compressed.size();
+            }
+          catch (std::exception &e)
+            {
+              chunkError = e.what();
+            }
+        }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        nWrittenBytes += written;
+        if (error.empty())
+          error = chunkError;
+        freeChunks.push_back(std::move(chunk));
+      }
+      chunkFree.notify_one();
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * trace-writer.h - Streaming writer of binary execution traces.
+ */
+
+#ifndef __TRACE_WRITER_H__
+#define __TRACE_WRITER_H__
+
+#include "trace-format.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/* Records are encoded into chunks on the calling thread. Full chunks
+ * are compressed and written by a background thread. At most a few
+ * chunks are queued; when the writer falls behind, record() blocks
+ * until a chunk becomes available again, which bounds memory use.
+ * When compressing or writing fails, the background thread discards
+ * the remaining chunks and finish() reports the error.
+ */
+class TraceWriter
+{
+  public:
+    TraceWriter(const std::string &filename, TraceCodec codec);
+    ~TraceWriter();
+
+    void record(const TraceRecord &record)
+    {
+      if (current->used + TraceMaxRecordSize > TraceChunkSize)
+        submit();
+
+      current->used = encode(record, current->data.get() + current->used) -
+                      current->data.get();
+      ++nRecords;
+    }
+
+    /* Write the remaining records and wait for the writer thread.
+     * Throws std::runtime_error when the trace could not be written
+     * completely.
+     */
+    void finish(void);
+
+    void dumpStatistics(void) const;
+
+  private:
+    static const size_t MaxQueuedChunks = 4;
+
+    struct Chunk
+    {
+      std::unique_ptr<uint8_t[]> data;
+      size_t used;
+    };
+
+    const std::string filename;
+    FILE *file;
+    const TraceCodec codec;
+
+    /* Encoder state 
+		*/
+    MemAddress lastPC;
+    MemAddress lastMemAddr;
+    std::array<RegValue, NumRegs> lastValues;
+    TraceInstructionCache cache;
+
+    std::unique_ptr<Chunk> current;
+    std::deque<std::unique_ptr<Chunk>> queue;
+    std::deque<std::unique_ptr<Chunk>> freeChunks;
+
+    std::mutex mutex;
+    std::condition_variable queueReady;
+    std::condition_variable chunkFree;
+    bool finished;
+    std::thread writer;
+
+    /* First error of the writer thread, empty when there was none */
+    std::string error;
+
+    /* Statistics 
+		*/
+    uint64_t nRecords;
+    uint64_t nRawBytes;
+    uint64_t nWrittenBytes;
+
+    uint8_t *encode(const TraceRecord &record, uint8_t *out);
+    void submit(void);
+    void writerThread(void);
+};
+
+#endif /* __TRACE_WRITER_H__ */
@@ -0,0 +1,80 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * trap.h - Exception and interrupt causes.
+ */
+
+#ifndef __TRAP_H__
+#define __TRAP_H__
+
+#include "arch.h"
+
+#include <stdexcept>
+#include <string>
+
+/* Exception codes as reported in mcause. 
+*/
+enum class ExceptionCause : RegValue
+{
+  InstructionAccessFault = 1,
+  IllegalInstruction = 2,
+  Breakpoint = 3,
+  LoadAccessFault = 5,
+  StoreAccessFault = 7,
+  UserEnvironmentCall = 8,
+  SupervisorEnvironmentCall = 9,
+  MachineEnvironmentCall = 11,
+  InstructionPageFault = 12,
+  LoadPageFault = 13,
+  StorePageFault = 15,
+};
+
+/* Interrupt codes as reported in mcause, these double as bit
+ * positions in mip and mie.
+ */
+enum class Interrupt : RegValue
+{
+  SupervisorSoftware = 1,
+  MachineSoftware = 3,
+  SupervisorTimer = 5,
+  MachineTimer = 7,
+  SupervisorExternal = 9,
+  MachineExternal = 11,
+};
+
+/* Privilege levels, encoded as in mstatus.MPP. 
+*/
+enum class Privilege : RegValue
+{
+  User = 0,
+  Supervisor = 1,
+  Machine = 3,
+};
+
+static const RegValue InterruptCauseFlag = (RegValue)1 << 63;
+
+static inline RegValue
+interruptMask(Interrupt interrupt)
+{
+  return (RegValue)1 << static_cast<RegValue>(interrupt);
+}
+
+/* Exception that is thrown by instructions which raise a synchronous
+ * exception by design, such as ecall and ebreak.
+ */
+class GuestException : public std::runtime_error
+{
+  public:
+    GuestException(ExceptionCause cause, RegValue tval,
+                   const std::string &what)
+      : std::runtime_error(what), cause(cause), tval(tval)
+    { }
+
+    ExceptionCause getCause(void) const { return cause; }
+    RegValue getTval(void) const { return tval; }
+
+  private:
+    ExceptionCause cause;
+    RegValue tval;
+};
+
+#endif /* __TRAP_H__ */
@@ -0,0 +1,303 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * uart.cc - NS16550A compatible UART.
+ */
+
+#include "uart.h"
+#include "checkpoint.h"
+#include "plic.h"
+#include "replay-log.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+static const uint8_t IER_RDA = 0x01;
+static const uint8_t IER_THRE = 0x02;
+
+static const uint8_t IIR_NONE = 0x01;
+static const uint8_t IIR_THRE = 0x02;
+static const uint8_t IIR_RDA = 0x04;
+static const uint8_t IIR_FIFO = 0xc0;
+
+static const uint8_t FCR_ENABLE = 0x01;
+static const uint8_t FCR_CLEAR_RX = 0x02;
+
+static const uint8_t LCR_DLAB = 0x80;
+
+static const uint8_t LSR_DR = 0x01;
+static const uint8_t LSR_THRE = 0x20;
+static const uint8_t LSR_TEMT = 0x40;
+
+/* DCD, DSR and CTS asserted */
+static const uint8_t MSR_DEFAULT = 0xb0;
+
+static const size_t RxFifoSize = 16;
+
+UART::UART(const MemAddress base, PLIC *plic, int irq,
+           std::ostream &output)
+  : base(base), plic(plic), irq(irq), output(output), inputClosed(false),
+    ier(0), fcr(0), lcr(0), mcr(0), scr(0), divisor(0),
+    thrEmptyPending(false), replayLog(nullptr)
+{
+}
+
+UART::~UART()
+{
+  output.flush();
+}
+
+void
+UART::saveState(CheckpointWriter &writer) const
+{
+  writer.put<uint64_t>(rxFifo.size());
+  for (uint8_t c : rxFifo)
+    writer.put(c);
+
+  for (uint8_t reg : { ier, fcr, lcr, mcr, scr })
+    writer.put(reg);
+  writer.put(divisor);
+  writer.put(thrEmptyPending);
+}
+
+void
+UART::restoreState(CheckpointReader &reader)
+{
+  rxFifo.clear();
+  uint64_t count = reader.get<uint64_t>();
+  for (uint64_t i = 0; i < count; ++i)
+    rxFifo.push_back(reader.get<uint8_t>());
+
+  for (uint8_t *reg : { &ier, &fcr, &lcr, &mcr, &scr })
+    *reg = reader.get<uint8_t>();
+  divisor = reader.get<uint16_t>();
+  thrEmptyPending = reader.get<bool>();
+}
+
+void
+UART::poll(void)
+{
+  if (inputClosed || rxFifo.size() >= RxFifoSize)
+    return;
+
+  uint8_t buffer[RxFifoSize];
+  size_t size = RxFifoSize - rxFifo.size();
+  ssize_t count;
+
+  if (replayLog && replayLog->isReplaying())
+    count = replayLog->replayInput(buffer, size);
+  else
+    {
+      count = readHostInput(buffer, size);
+      if (replayLog)
+        replayLog->recordInput(buffer, count);
+    }
+
+  if (count == 0)
+    return;
+
+  if (count < 0)
+    inputClosed = true;
+  else
+    rxFifo.insert(rxFifo.end(), buffer, buffer + count);
+
+  updateInterrupt();
+}
+
+/*
+ * MemoryInterface
+ */
+
+uint8_t
+UART::readByte(MemAddress addr)
+{
+  uint8_t value = 0;
+
+  switch (addr - base)
+    {
+      case Register::RBR:
+        if (lcr & LCR_DLAB)
+          value = divisor & 0xff;
+        else if (!rxFifo.empty())
+          {
+            value = rxFifo.front();
+            rxFifo.pop_front();
+          }
+        break;
+
+      case Register::IER:
+        value = (lcr & LCR_DLAB) ? divisor >> 8 : ier;
+        break;
+
+      case Register::IIR:
+        value = getInterruptId();
+        if (value == IIR_THRE)
+          thrEmptyPending = false;
+        if (fcr & FCR_ENABLE)
+          value |= IIR_FIFO;
+        break;
+
+      case Register::LCR:
+        value = lcr;
+        break;
+
+      case Register::MCR:
+        value = mcr;
+        break;
+
+      case Register::LSR:
+        value = LSR_THRE | LSR_TEMT | (rxFifo.empty() ? 0 : LSR_DR);
+        break;
+
+      case Register::MSR:
+        value = MSR_DEFAULT;
+        break;
+
+      case Register::SCR:
+        value = scr;
+        break;
+
+      default:
+        /* Remainder of the register window reads as zero */
+        break;
+    }
+
+  updateInterrupt();
+  return value;
+}
+
+uint16_t
+UART::readHalfWord(MemAddress addr)
+{
+  throw IllegalAccess(addr, sizeof(uint16_t));
+}
+
+uint32_t
+UART::readWord(MemAddress addr)
+{
+  throw IllegalAccess(addr, sizeof(uint32_t));
+}
+
+uint64_t
+UART::readDoubleWord(MemAddress addr)
+{
+  throw IllegalAccess(addr, sizeof(uint64_t));
+}
+
+
+void
+UART::writeByte(MemAddress addr, uint8_t value)
+{
+  switch (addr - base)
+    {
+      case Register::THR:
+        if (lcr & LCR_DLAB)
+          divisor = (divisor & 0xff00) | value;
+        else
+          {
+            output.put((char)value);
+            output.flush();
+            thrEmptyPending = true;
+          }
+        break;
+
+      case Register::IER:
+        if (lcr & LCR_DLAB)
+          divisor = (divisor & 0x00ff) | (value << 8);
+        else
+          {
+            /* Enabling the THRE interrupt raises it right away, since
+             * the holding register is always empty.
+             */
+            if ((value & IER_THRE) && !(ier & IER_THRE))
+              thrEmptyPending = true;
+            ier = value & 0x0f;
+          }
+        break;
+
+      case Register::FCR:
+        fcr = value;
+        if (value & FCR_CLEAR_RX)
+          rxFifo.clear();
+        break;
+
+      case Register::LCR:
+        lcr = value;
+        break;
+
+      case Register::MCR:
+        mcr = value;
+        break;
+
+      case Register::SCR:
+        scr = value;
+        break;
+
+      default:
+        /* Writes to LSR, MSR and the remainder of the window are ignored */
+        break;
+    }
+
+  updateInterrupt();
+}
+
+void
+UART::writeHalfWord(MemAddress addr, uint16_t value)
+{
+  throw IllegalAccess(addr, sizeof(value));
+}
+
+void
+UART::writeWord(MemAddress addr, uint32_t value)
+{
+  throw IllegalAccess(addr, sizeof(value));
+}
+
+void
+UART::writeDoubleWord(MemAddress addr, uint64_t value)
+{
+  throw IllegalAccess(addr, sizeof(value));
+}
+
+bool
+UART::contains(MemAddress addr) const
+{
+  return base <= addr && addr < base + Size;
+}
+
+
+/*
+ * Private methods
+ */
+/* Returns the number of bytes read, 0 when no input is pending and -1
+ * when the input was closed.
+ */
+ssize_t
+UART::readHostInput(uint8_t *buffer, size_t size)
+{
+  struct pollfd fds = { STDIN_FILENO, POLLIN, 0 };
+
+  if (::poll(&fds, 1, 0) <= 0 || (fds.revents & (POLLIN | POLLHUP)) == 0)
+    return 0;
+
+  ssize_t count = read(STDIN_FILENO, buffer, size);
+
+  return count <= 0 ? -1 : count;
+}
+
+uint8_t
+UART::getInterruptId(void) const
+{
+  if ((ier & IER_RDA) && !rxFifo.empty())
+    return IIR_RDA;
+  if ((ier & IER_THRE) && thrEmptyPending)
+    return IIR_THRE;
+
+  return IIR_NONE;
+}
+
+void
+UART::updateInterrupt(void)
+{
+  if (plic)
+    plic->setLevel(irq, getInterruptId() != IIR_NONE);
+}
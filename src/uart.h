@@ -0,0 +1,114 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * uart.h - NS16550A compatible UART.
+ */
+
+/* A minimal 16550A with byte-wide registers (reg-shift 0). Transmitted
+ * characters are written to the console immediately, so the transmit
+ * holding register is always empty. Received characters are read from
+ * the host's standard input when the processor polls the UART.
+ *
+ *   0x0  RBR (r) / THR (w) / DLL (DLAB)
+ *   0x1  IER (rw)          / DLM (DLAB)
+ *   0x2  IIR (r) / FCR (w)
+ *   0x3  LCR (rw)
+ *   0x4  MCR (rw)
+ *   0x5  LSR (r)
+ *   0x6  MSR (r)
+ *   0x7  SCR (rw)
+ */
+
+#ifndef __UART_H__
+#define __UART_H__
+
+#include "memory-interface.h"
+
+#include <deque>
+#include <iostream>
+
+class PLIC;
+
+class CheckpointWriter;
+class CheckpointReader;
+class ReplayLog;
+
+class UART : public MemoryInterface
+{
+  public:
+    static const MemAddress DefaultBase = 0x10000000;
+    static const MemAddress Size = 0x100;
+
+    UART(const MemAddress base, PLIC *plic, int irq,
+         std::ostream &output = std::cout);
+    virtual ~UART();
+
+    void saveState(CheckpointWriter &writer) const;
+    void restoreState(CheckpointReader &reader);
+
+    /* Read pending input from the host without blocking. Called by
+     * the processor at regular intervals.
+     */
+    void poll(void);
+
+    /* Input is recorded to log, or replayed from it instead of being
+     * read from the host.
+     */
+    void attachReplayLog(ReplayLog *log) { replayLog = log; }
+
+    /* MemoryInterface 
+		*/
+    virtual uint8_t readByte(MemAddress addr) override;
+    virtual uint16_t readHalfWord(MemAddress addr) override;
+    virtual uint32_t readWord(MemAddress addr) override;
+    virtual uint64_t readDoubleWord(MemAddress addr) override;
+
+    virtual void writeByte(MemAddress addr, uint8_t value) override;
+    virtual void writeHalfWord(MemAddress addr, uint16_t value) override;
+    virtual void writeWord(MemAddress addr, uint32_t value) override;
+    virtual void writeDoubleWord(MemAddress addr, uint64_t value) override;
+
+    virtual bool contains(MemAddress addr) const override;
+
+  private:
+    enum Register : MemAddress
+    {
+      RBR = 0, THR = 0, DLL = 0,
+      IER = 1, DLM = 1,
+      IIR = 2, FCR = 2,
+      LCR = 3,
+      MCR = 4,
+      LSR = 5,
+      MSR = 6,
+      SCR = 7
+    };
+
+    const MemAddress base;
+    PLIC *plic;
+    const int irq;
+    std::ostream &output;
+
+    std::deque<uint8_t> rxFifo;
+    bool inputClosed;
+
+    uint8_t ier;
+    uint8_t fcr;
+    uint8_t lcr;
+    uint8_t mcr;
+    uint8_t scr;
+    uint16_t divisor;
+
+    /* Set when the THR became empty and the interrupt for it has
+     * not yet been acknowledged by reading IIR.
+     */
+    bool thrEmptyPending;
+
+    ReplayLog *replayLog;
+
+    /* Private helper methods 
+		*/
+    ssize_t readHostInput(uint8_t *buffer, size_t size);
+    uint8_t getInterruptId(void) const;
+    void updateInterrupt(void);
+};
+
+#endif /* __UART_H__ */
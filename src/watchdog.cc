@@ -0,0 +1,38 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * watchdog.cc - Wall-clock limit on a run.
+ */
+
+#include "watchdog.h"
+
+#include <chrono>
+
+Watchdog::Watchdog(double seconds, std::function<void(void)> expire)
+  : cancelled(false), expired(false)
+{
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(seconds));
+
+  thread = std::thread([this, deadline, expire]
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      if (wakeup.wait_until(guard, deadline, [this] { return cancelled; }))
+        return;
+
+      expired.store(true, std::memory_order_release);
+      expire();
+    });
+}
+
+Watchdog::~Watchdog()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    cancelled = true;
+  }
+  wakeup.notify_one();
+
+  thread.join();
+}
@@ -0,0 +1,42 @@
+/*
+ * rv64-emu -- Simple 64-bit RISC-V simulator
+ * watchdog.h - Wall-clock limit on a run.
+ */
+
+#ifndef __WATCHDOG_H__
+#define __WATCHDOG_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/* Calls expire from a thread of its own once the given number of
+ * seconds has passed, unless the Watchdog is destroyed first. The
+ * emulator itself never waits for the watchdog: expire is expected to
+ * only set a flag that the run loop polls at block boundaries.
+ */
+class Watchdog
+{
+  public:
+    Watchdog(double seconds, std::function<void(void)> expire);
+    ~Watchdog();
+
+    Watchdog(const Watchdog &) = delete;
+    Watchdog &operator=(const Watchdog &) = delete;
+
+    bool hasExpired(void) const
+    {
+      return expired.load(std::memory_order_acquire);
+    }
+
+  private:
+    std::mutex lock;
+    std::condition_variable wakeup;
+    bool cancelled;
+    std::atomic<bool> expired;
+    std::thread thread;
+};
+
+#endif /* __WATCHDOG_H__ */